@@ -0,0 +1,368 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "AlignerPool.h"
+
+#include "plugin/FeatureExtractionPluginFactory.h"
+#include "data/model/DenseTimeValueModel.h"
+#include "data/model/SparseOneDimensionalModel.h"
+
+#include "base/Debug.h"
+
+#include <QMutexLocker>
+#include <QDateTime>
+
+#include <cmath>
+
+using namespace std;
+using namespace sv;
+
+//#define DEBUG_ALIGNER_POOL 1
+
+AlignerPool::AlignerPool()
+{
+}
+
+AlignerPool::~AlignerPool()
+{
+}
+
+QString
+AlignerPool::makeKey(const Transform &transform, sv_samplerate_t sampleRate)
+{
+    // Parameters are not part of the key, as pooled instances are
+    // not yet initialised and they are set for each run; the program
+    // is, as it names the score
+
+    return QString("%1|%2|%3|%4|%5|%6")
+        .arg(transform.getPluginIdentifier())
+        .arg(transform.getOutput())
+        .arg(transform.getProgram())
+        .arg(sampleRate)
+        .arg(transform.getStepSize())
+        .arg(transform.getBlockSize());
+}
+
+shared_ptr<AlignerPool::Instance>
+AlignerPool::create(const Transform &transform, sv_samplerate_t sampleRate)
+{
+    QString pluginId = transform.getPluginIdentifier();
+
+    auto factory = FeatureExtractionPluginFactory::instance();
+    if (!factory) {
+        return {};
+    }
+
+    auto plugin = factory->instantiatePlugin(pluginId, sampleRate);
+    if (!plugin) {
+        SVDEBUG << "AlignerPool::create: Failed to instantiate plugin \""
+                << pluginId << "\"" << endl;
+        return {};
+    }
+
+    if (plugin->getInputDomain() != Vamp::Plugin::TimeDomain ||
+        plugin->getMinChannelCount() > 1) {
+        SVDEBUG << "AlignerPool::create: Plugin \"" << pluginId
+                << "\" does not take mono time-domain input, not pooling it"
+                << endl;
+        return {};
+    }
+
+    auto outputs = plugin->getOutputDescriptors();
+    int outputIndex = -1;
+    for (int i = 0; i < int(outputs.size()); ++i) {
+        if (transform.getOutput() == "" ||
+            outputs[i].identifier == transform.getOutput().toStdString()) {
+            outputIndex = i;
+            break;
+        }
+    }
+    if (outputIndex < 0 ||
+        !outputs[outputIndex].hasFixedBinCount ||
+        outputs[outputIndex].binCount != 0) {
+        SVDEBUG << "AlignerPool::create: Plugin \"" << pluginId
+                << "\" has no time-instant output \"" << transform.getOutput()
+                << "\", not pooling it" << endl;
+        return {};
+    }
+
+    // This is the slow part for an aligner, which loads the score
+    // files for the named program
+
+    if (transform.getProgram() != "") {
+        plugin->selectProgram(transform.getProgram().toStdString());
+    }
+
+    int blockSize = transform.getBlockSize();
+    if (blockSize <= 0) {
+        blockSize = int(plugin->getPreferredBlockSize());
+        if (blockSize <= 0) blockSize = 1024;
+    }
+    int stepSize = transform.getStepSize();
+    if (stepSize <= 0) {
+        stepSize = int(plugin->getPreferredStepSize());
+        if (stepSize <= 0) stepSize = blockSize;
+    }
+
+    auto instance = make_shared<Instance>();
+    instance->plugin = plugin;
+    instance->outputIndex = outputIndex;
+    instance->stepSize = stepSize;
+    instance->blockSize = blockSize;
+    instance->key = makeKey(transform, sampleRate);
+    return instance;
+}
+
+shared_ptr<AlignerPool::Instance>
+AlignerPool::tryAcquire(const Transform &transform, sv_samplerate_t sampleRate)
+{
+    QString key = makeKey(transform, sampleRate);
+    shared_ptr<Instance> instance;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        for (auto i = m_idle.begin(); i != m_idle.end(); ++i) {
+            if (i->instance->key == key) {
+                instance = i->instance;
+                m_idle.erase(i);
+                ++m_inUse[key];
+                break;
+            }
+        }
+    }
+
+    if (!instance) {
+#ifdef DEBUG_ALIGNER_POOL
+        SVDEBUG << "AlignerPool::tryAcquire: No idle instance for " << key
+                << endl;
+#endif
+        return {};
+    }
+
+#ifdef DEBUG_ALIGNER_POOL
+    SVDEBUG << "AlignerPool::tryAcquire: Using instance for " << key << endl;
+#endif
+
+    return instance;
+}
+
+bool
+AlignerPool::initialise(shared_ptr<Instance> instance,
+                        const Transform &transform)
+{
+    // Parameters must be set before initialise(), which an aligner
+    // may use to take the score and audio range of the run
+
+    for (const auto &p : transform.getParameters()) {
+        instance->plugin->setParameter(p.first.toStdString(), p.second);
+    }
+
+    if (!instance->plugin->initialise(1, instance->stepSize,
+                                      instance->blockSize)) {
+        SVDEBUG << "AlignerPool::initialise: Plugin \""
+                << transform.getPluginIdentifier()
+                << "\" failed to initialise with step size "
+                << instance->stepSize << " and block size "
+                << instance->blockSize << endl;
+        return false;
+    }
+
+    return true;
+}
+
+void
+AlignerPool::discard(shared_ptr<Instance> instance)
+{
+    if (!instance) return;
+
+    QMutexLocker locker(&m_mutex);
+
+    if (--m_inUse[instance->key] <= 0) {
+        m_inUse.erase(instance->key);
+    }
+}
+
+void
+AlignerPool::add(shared_ptr<Instance> instance)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_idle.push_back({ instance, QDateTime::currentMSecsSinceEpoch() });
+
+    // Evict the longest idle instances beyond the limit; they are
+    // at the front
+
+    while (int(m_idle.size()) > maxIdleInstances) {
+        m_idle.erase(m_idle.begin());
+    }
+}
+
+bool
+AlignerPool::warm(const Transform &transform, sv_samplerate_t sampleRate)
+{
+    QString key = makeKey(transform, sampleRate);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        for (const auto &i : m_idle) {
+            if (i.instance->key == key) {
+                return true;
+            }
+        }
+        if (m_warming.find(key) != m_warming.end()) {
+            return true;
+        }
+        m_warming.insert(key);
+    }
+
+    SVDEBUG << "AlignerPool::warm: Making instance for " << key << endl;
+
+    auto instance = create(transform, sampleRate);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_warming.erase(key);
+        if (!instance) {
+            return false;
+        }
+    }
+
+    add(instance);
+    return true;
+}
+
+int
+AlignerPool::evictIdle()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    QMutexLocker locker(&m_mutex);
+
+    for (auto i = m_idle.begin(); i != m_idle.end(); ) {
+        if (now - i->since > maxIdleMs) {
+#ifdef DEBUG_ALIGNER_POOL
+            SVDEBUG << "AlignerPool::evictIdle: Evicting instance for "
+                    << i->instance->key << endl;
+#endif
+            i = m_idle.erase(i);
+        } else {
+            ++i;
+        }
+    }
+
+    int remaining = int(m_idle.size() + m_warming.size());
+    for (const auto &u : m_inUse) {
+        remaining += u.second;
+    }
+    return remaining;
+}
+
+void
+AlignerPool::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_idle.clear();
+}
+
+bool
+AlignerPool::run(shared_ptr<Instance> instance,
+                 ModelId audioModelId,
+                 ModelId onsetsModelId,
+                 const atomic<bool> &abandoned)
+{
+    sv_frame_t startFrame = 0, endFrame = 0;
+    sv_samplerate_t sampleRate = 0;
+    int channels = 1;
+
+    {
+        auto audioModel = ModelById::getAs<DenseTimeValueModel>(audioModelId);
+        if (!audioModel) return false;
+        startFrame = audioModel->getStartFrame();
+        endFrame = audioModel->getEndFrame();
+        sampleRate = audioModel->getSampleRate();
+        channels = audioModel->getChannelCount();
+        if (channels < 1) channels = 1;
+    }
+
+    auto plugin = instance->plugin;
+    int output = instance->outputIndex;
+    int stepSize = instance->stepSize;
+    int blockSize = instance->blockSize;
+    unsigned int intRate = (unsigned int)lrint(sampleRate);
+
+    auto addFeatures = [&](const Vamp::Plugin::FeatureSet &features,
+                           sv_frame_t frame) {
+        auto onsetsModel =
+            ModelById::getAs<SparseOneDimensionalModel>(onsetsModelId);
+        if (!onsetsModel) return false;
+        auto itr = features.find(output);
+        if (itr == features.end()) return true;
+        for (const auto &f : itr->second) {
+            sv_frame_t featureFrame = frame;
+            if (f.hasTimestamp) {
+                featureFrame = Vamp::RealTime::realTime2Frame
+                    (f.timestamp, intRate);
+            }
+            onsetsModel->add(Event(featureFrame,
+                                   QString::fromStdString(f.label)));
+        }
+        return true;
+    };
+
+    int completion = 0;
+
+    for (sv_frame_t frame = startFrame; frame < endFrame; frame += stepSize) {
+
+        if (abandoned) return false;
+        
+        floatvec_t data;
+        {
+            auto audioModel =
+                ModelById::getAs<DenseTimeValueModel>(audioModelId);
+            if (!audioModel) return false;
+            data = audioModel->getData(-1, frame, blockSize);
+        }
+        data.resize(blockSize, 0.f);
+
+        // getData returns the sum of the channels for a mixdown;
+        // average it, as FeatureExtractionModelTransformer does, so
+        // that the plugin sees the same input either way
+        
+        if (channels > 1) {
+            for (auto &f : data) {
+                f /= float(channels);
+            }
+        }
+
+        const float *buffers[1] = { data.data() };
+        auto features = plugin->process
+            (buffers, Vamp::RealTime::frame2RealTime(frame, intRate));
+        if (!addFeatures(features, frame)) return false;
+
+        int c = int((100 * (frame - startFrame)) / (endFrame - startFrame));
+        if (c > completion && c < 100) {
+            completion = c;
+            auto onsetsModel =
+                ModelById::getAs<SparseOneDimensionalModel>(onsetsModelId);
+            if (!onsetsModel) return false;
+            onsetsModel->setCompletion(completion);
+        }
+    }
+
+    if (!addFeatures(plugin->getRemainingFeatures(), endFrame)) return false;
+
+    auto onsetsModel =
+        ModelById::getAs<SparseOneDimensionalModel>(onsetsModelId);
+    if (!onsetsModel) return false;
+    onsetsModel->setCompletion(100);
+    return true;
+}
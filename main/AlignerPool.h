@@ -0,0 +1,151 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_ALIGNER_POOL_H
+#define SV_ALIGNER_POOL_H
+
+#include "transform/Transform.h"
+#include "data/model/Model.h"
+#include "base/BaseTypes.h"
+
+#include <vamp-hostsdk/Plugin.h>
+
+#include <QMutex>
+#include <QString>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+/**
+ * A pool of score aligner plugin instances that have already been
+ * loaded and had their score selected (which is when an aligner
+ * reads its score files). An alignment with the same transform,
+ * sample rate and score can then start immediately, instead of going
+ * through plugin loading and score reading again as a derived layer
+ * would.
+ *
+ * Pooled instances are not initialised, because a Vamp plugin takes
+ * its parameters before initialise() and can only be initialised
+ * once. An instance is taken with tryAcquire(), set up for the run
+ * with initialise(), used for a single run, and then given up with
+ * discard(). Both initialise() and run() may be slow and should be
+ * called on a background thread. Instances are made in advance
+ * with warm(), which is slow and intended to be called on a
+ * background thread. Instances that have been idle for longer than
+ * maxIdleMs are discarded by evictIdle(), which the owner should
+ * call periodically.
+ *
+ * Only plugins that take time-domain input on a single channel and
+ * whose output is a series of time instants can be pooled; for
+ * anything else warm() does nothing and tryAcquire() always fails.
+ *
+ * All methods are thread-safe.
+ */
+class AlignerPool
+{
+public:
+    AlignerPool();
+    ~AlignerPool();
+
+    struct Instance {
+        std::shared_ptr<Vamp::Plugin> plugin;
+        int outputIndex;
+        int stepSize;
+        int blockSize;
+        QString key;
+    };
+
+    /**
+     * Take an idle instance for the given transform and sample rate
+     * from the pool. Return null if there is no idle instance. This
+     * is quick; the instance must then be initialised with
+     * initialise() before use.
+     */
+    std::shared_ptr<Instance> tryAcquire(const sv::Transform &transform,
+                                         sv::sv_samplerate_t sampleRate);
+
+    /**
+     * Apply the given transform's parameters to an instance obtained
+     * from tryAcquire() and initialise it. This is when an aligner
+     * takes the score and audio range of the run, so it may take
+     * some time. Return false if the plugin fails to initialise, in
+     * which case the instance should be discarded.
+     */
+    static bool initialise(std::shared_ptr<Instance> instance,
+                           const sv::Transform &transform);
+
+    /**
+     * Give up an instance obtained from tryAcquire(), once it has
+     * been used or has failed to initialise. It is not returned to the pool, as it cannot be
+     * initialised again; call warm() to replace it.
+     */
+    void discard(std::shared_ptr<Instance> instance);
+
+    /**
+     * Make an instance for the given transform and sample rate and
+     * add it to the pool, unless there is already one idle or being
+     * made. This loads the plugin and may take some time. Return true
+     * if an instance for the transform is now available.
+     */
+    bool warm(const sv::Transform &transform,
+              sv::sv_samplerate_t sampleRate);
+
+    /**
+     * Discard instances that have been idle for longer than
+     * maxIdleMs. Return the number of instances remaining, including
+     * those in use or being made.
+     */
+    int evictIdle();
+
+    /**
+     * Discard all idle instances.
+     */
+    void clear();
+
+    /**
+     * Run the given initialised instance over the whole of the
+     * given audio model, mixed down to mono, adding its output
+     * features as events to the given sparse one-dimensional model
+     * and updating that model's completion as it goes. Return false
+     * if either model disappeared, or abandoned was set, before the
+     * run was complete. The instance should be discarded afterwards.
+     */
+    static bool run(std::shared_ptr<Instance> instance,
+                    sv::ModelId audioModel,
+                    sv::ModelId onsetsModel,
+                    const std::atomic<bool> &abandoned);
+
+    static const int maxIdleMs = 120000;
+    static const int maxIdleInstances = 4;
+
+private:
+    struct Idle {
+        std::shared_ptr<Instance> instance;
+        qint64 since;
+    };
+
+    QMutex m_mutex;
+    std::vector<Idle> m_idle;
+    std::map<QString, int> m_inUse;
+    std::set<QString> m_warming;
+
+    static QString makeKey(const sv::Transform &transform,
+                           sv::sv_samplerate_t sampleRate);
+    static std::shared_ptr<Instance> create(const sv::Transform &transform,
+                                            sv::sv_samplerate_t sampleRate);
+    void add(std::shared_ptr<Instance> instance);
+};
+
+#endif
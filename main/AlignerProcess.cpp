@@ -0,0 +1,310 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "AlignerProcess.h"
+#include "AlignerSharedAudio.h"
+
+#include "data/model/DenseTimeValueModel.h"
+#include "data/model/SparseOneDimensionalModel.h"
+#include "base/HelperExecPath.h"
+#include "base/Debug.h"
+
+#include <QThread>
+#include <QUuid>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+using namespace sv;
+
+//#define DEBUG_ALIGNER_PROCESS 1
+
+static const QString helperName = "performance-precision-aligner";
+
+AlignerProcess::AlignerProcess(QObject *parent) :
+    QObject(parent),
+    m_startFrame(0),
+    m_copyThread(nullptr),
+    m_cancelled(false),
+    m_process(nullptr),
+    m_done(false),
+    m_reported(false)
+{
+}
+
+AlignerProcess::~AlignerProcess()
+{
+    m_cancelled = true;
+    if (m_copyThread) {
+        m_copyThread->wait();
+        delete m_copyThread;
+    }
+    if (m_process) {
+        m_process->disconnect(this);
+        if (m_process->state() != QProcess::NotRunning) {
+            m_process->kill();
+            m_process->waitForFinished(1000);
+        }
+        delete m_process;
+    }
+    m_sharedAudio.detach();
+}
+
+QString
+AlignerProcess::findHelper()
+{
+    auto helpers = HelperExecPath(HelperExecPath::NativeArchitectureOnly)
+        .getHelperExecutables(helperName);
+    if (helpers.empty()) {
+        return {};
+    }
+    return helpers[0].executable;
+}
+
+bool
+AlignerProcess::isAvailable()
+{
+    return findHelper() != "";
+}
+
+bool
+AlignerProcess::start(const Transform &transform,
+                      ModelId audioModelId,
+                      ModelId onsetsModelId)
+{
+    if (!isAvailable()) {
+        SVDEBUG << "AlignerProcess::start: Helper \"" << helperName
+                << "\" not found" << endl;
+        return false;
+    }
+
+    auto audioModel = ModelById::getAs<DenseTimeValueModel>(audioModelId);
+    if (!audioModel) {
+        return false;
+    }
+
+    m_transform = transform;
+    m_audioModel = audioModelId;
+    m_onsetsModel = onsetsModelId;
+
+    sv_frame_t startFrame = audioModel->getStartFrame();
+    m_startFrame = startFrame;
+    sv_frame_t frameCount = audioModel->getEndFrame() - startFrame;
+    if (frameCount <= 0) {
+        return false;
+    }
+
+    // Each alignment has a segment of its own, so that several can
+    // run at once
+
+    m_sharedAudio.setKey(QString("%1-%2").arg(helperName)
+                         .arg(QUuid::createUuid().toString(QUuid::WithoutBraces)));
+
+    qsizetype bytes = qsizetype(sizeof(AlignerSharedAudioHeader) +
+                                size_t(frameCount) * sizeof(float));
+    if (!m_sharedAudio.create(bytes)) {
+        SVDEBUG << "AlignerProcess::start: Failed to create shared memory of "
+                << bytes << " bytes: " << m_sharedAudio.errorString() << endl;
+        return false;
+    }
+
+    auto *header = static_cast<AlignerSharedAudioHeader *>(m_sharedAudio.data());
+    header->magic = AlignerSharedAudioHeader::expectedMagic;
+    header->version = AlignerSharedAudioHeader::expectedVersion;
+    header->sampleRate = audioModel->getSampleRate();
+    header->frameCount = frameCount;
+    float *audio = reinterpret_cast<float *>(header + 1);
+
+    // Mixing down and copying a long recording takes a moment, so
+    // do it in the background. Nothing else writes to the segment,
+    // and the helper is not started until the copy is complete
+
+    // getData returns the sum of the channels for a mixdown; we
+    // average it, as FeatureExtractionModelTransformer does, so
+    // that the helper sees the same input as an in-process aligner
+    
+    int channels = std::max(1, audioModel->getChannelCount());
+
+    m_copyThread = QThread::create([=]() {
+        const sv_frame_t blockSize = 65536;
+        for (sv_frame_t f = 0; f < frameCount; f += blockSize) {
+            if (m_cancelled) {
+                return;
+            }
+            auto model = ModelById::getAs<DenseTimeValueModel>(audioModelId);
+            if (!model) {
+                QMetaObject::invokeMethod(this, "audioCopied",
+                                          Qt::QueuedConnection,
+                                          Q_ARG(bool, false));
+                return;
+            }
+            sv_frame_t n = std::min(blockSize, frameCount - f);
+            auto data = model->getData(-1, startFrame + f, n);
+            sv_frame_t got = std::min(n, sv_frame_t(data.size()));
+            if (channels > 1) {
+                for (sv_frame_t i = 0; i < got; ++i) {
+                    audio[f + i] = data[i] / float(channels);
+                }
+            } else {
+                memcpy(audio + f, data.data(), size_t(got) * sizeof(float));
+            }
+            if (got < n) {
+                memset(audio + f + got, 0, size_t(n - got) * sizeof(float));
+            }
+        }
+        QMetaObject::invokeMethod(this, "audioCopied",
+                                  Qt::QueuedConnection,
+                                  Q_ARG(bool, true));
+    });
+    m_copyThread->setObjectName("AlignerProcess audio copy");
+    m_copyThread->start();
+
+    return true;
+}
+
+void
+AlignerProcess::audioCopied(bool success)
+{
+    if (!success) {
+        fail(tr("Audio was no longer available for alignment"));
+        return;
+    }
+
+    QString pluginId = m_transform.getPluginIdentifier();
+    QString pluginKey = pluginId;
+    if (pluginKey.startsWith("vamp:")) {
+        pluginKey = pluginKey.mid(5);
+    }
+
+    QStringList args;
+    args << m_sharedAudio.key()
+         << pluginKey
+         << m_transform.getOutput()
+         << m_transform.getProgram()
+         << QString::number(m_transform.getStepSize())
+         << QString::number(m_transform.getBlockSize());
+    for (const auto &p : m_transform.getParameters()) {
+        // Enough digits for audio-start and audio-end to keep their
+        // precision in long recordings
+        args << QString("%1=%2").arg(p.first)
+            .arg(QString::number(p.second, 'g', 9));
+    }
+
+#ifdef DEBUG_ALIGNER_PROCESS
+    SVDEBUG << "AlignerProcess::audioCopied: Starting helper with args "
+            << args.join(" ") << endl;
+#endif
+
+    m_process = new QProcess;
+    m_process->setProcessChannelMode(QProcess::SeparateChannels);
+
+    connect(m_process, &QProcess::readyReadStandardOutput,
+            this, &AlignerProcess::readyReadStandardOutput);
+    connect(m_process, &QProcess::finished,
+            this, &AlignerProcess::processFinished);
+    connect(m_process, &QProcess::errorOccurred,
+            this, &AlignerProcess::processErrorOccurred);
+
+    m_process->start(findHelper(), args);
+}
+
+void
+AlignerProcess::readyReadStandardOutput()
+{
+    m_pending += m_process->readAllStandardOutput();
+
+    int nl;
+    while ((nl = m_pending.indexOf('\n')) >= 0) {
+        QByteArray line = m_pending.left(nl);
+        m_pending.remove(0, nl + 1);
+        handleLine(line);
+    }
+}
+
+void
+AlignerProcess::handleLine(QByteArray line)
+{
+    auto onsetsModel =
+        ModelById::getAs<SparseOneDimensionalModel>(m_onsetsModel);
+    if (!onsetsModel) {
+        // The alignment was abandoned
+        m_process->kill();
+        return;
+    }
+
+    if (line.startsWith("feature ")) {
+        int space = line.indexOf(' ', 8);
+        QByteArray frame = (space < 0 ? line.mid(8) : line.mid(8, space - 8));
+        QString label = (space < 0 ? QString() :
+                         QString::fromUtf8(line.mid(space + 1)));
+        // The helper counts frames from the start of the shared
+        // audio, which begins at the model's start frame
+        onsetsModel->add(Event(m_startFrame + frame.toLongLong(), label));
+    } else if (line.startsWith("progress ")) {
+        onsetsModel->setCompletion(line.mid(9).toInt());
+    } else if (line == "done") {
+        m_done = true;
+    }
+}
+
+void
+AlignerProcess::processFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    readyReadStandardOutput();
+    m_sharedAudio.detach();
+
+    if (exitStatus != QProcess::NormalExit || exitCode != 0 || !m_done) {
+        QString error = QString::fromUtf8(m_process->readAllStandardError())
+            .trimmed();
+        if (exitStatus != QProcess::NormalExit) {
+            fail(tr("Score alignment helper crashed"));
+        } else if (error != "") {
+            fail(tr("Score alignment helper failed: %1").arg(error));
+        } else {
+            fail(tr("Score alignment helper exited with code %1")
+                 .arg(exitCode));
+        }
+        return;
+    }
+
+    auto onsetsModel =
+        ModelById::getAs<SparseOneDimensionalModel>(m_onsetsModel);
+    if (onsetsModel) {
+        onsetsModel->setCompletion(100);
+    }
+
+    if (!m_reported) {
+        m_reported = true;
+        emit finished(m_onsetsModel);
+    }
+}
+
+void
+AlignerProcess::processErrorOccurred(QProcess::ProcessError error)
+{
+    // Crashes are reported through processFinished
+    if (error == QProcess::FailedToStart) {
+        m_sharedAudio.detach();
+        fail(tr("Failed to start score alignment helper"));
+    }
+}
+
+void
+AlignerProcess::fail(QString message)
+{
+    SVDEBUG << "AlignerProcess: " << message << endl;
+    if (!m_reported) {
+        m_reported = true;
+        emit failed(m_onsetsModel, message);
+    }
+}
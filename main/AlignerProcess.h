@@ -0,0 +1,95 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_ALIGNER_PROCESS_H
+#define SV_ALIGNER_PROCESS_H
+
+#include "transform/Transform.h"
+#include "data/model/Model.h"
+
+#include <QObject>
+#include <QProcess>
+#include <QSharedMemory>
+
+#include <atomic>
+
+class QThread;
+
+/**
+ * Runs a score aligner plugin in a separate helper process
+ * (performance-precision-aligner), so that a crashing or
+ * misbehaving aligner cannot take the application down with it, and
+ * several alignments can run in parallel without contending with
+ * the GUI for memory or CPU.
+ *
+ * The audio is mixed down to mono and copied once into a
+ * shared-memory segment, on a background thread, from which the
+ * helper reads it in place. Features reported by the helper are
+ * added as events to the given sparse one-dimensional model as they
+ * arrive.
+ *
+ * An AlignerProcess runs a single alignment and then emits either
+ * finished() or failed(). It may be deleted at any time, which kills
+ * the helper if it is still running.
+ */
+class AlignerProcess : public QObject
+{
+    Q_OBJECT
+
+public:
+    AlignerProcess(QObject *parent = nullptr);
+    virtual ~AlignerProcess();
+
+    /**
+     * Return true if the helper executable can be found.
+     */
+    static bool isAvailable();
+
+    /**
+     * Start running the given aligner transform over the given
+     * audio model, writing its features to the given onsets model.
+     * Return false if the alignment could not be started at all, in
+     * which case neither finished() nor failed() will be emitted.
+     */
+    bool start(const sv::Transform &transform,
+               sv::ModelId audioModel,
+               sv::ModelId onsetsModel);
+
+signals:
+    void finished(sv::ModelId onsetsModel);
+    void failed(sv::ModelId onsetsModel, QString message);
+
+private slots:
+    void audioCopied(bool success);
+    void readyReadStandardOutput();
+    void processFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void processErrorOccurred(QProcess::ProcessError error);
+
+private:
+    sv::Transform m_transform;
+    sv::ModelId m_audioModel;
+    sv::ModelId m_onsetsModel;
+    sv::sv_frame_t m_startFrame;
+    QSharedMemory m_sharedAudio;
+    QThread *m_copyThread;
+    std::atomic<bool> m_cancelled;
+    QProcess *m_process;
+    QByteArray m_pending;
+    bool m_done;
+    bool m_reported;
+
+    static QString findHelper();
+    void handleLine(QByteArray line);
+    void fail(QString message);
+};
+
+#endif
@@ -0,0 +1,44 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_ALIGNER_SHARED_AUDIO_H
+#define SV_ALIGNER_SHARED_AUDIO_H
+
+#include <cstdint>
+
+/**
+ * Layout of the shared-memory segment through which AlignerProcess
+ * hands audio to the aligner helper process. The header is followed
+ * directly by frameCount mono float samples.
+ *
+ * The helper reports back on its standard output, one line per
+ * message:
+ *
+ *   progress <percent>
+ *   feature <frame> <label>
+ *   done
+ *
+ * and writes any error to its standard error before exiting with a
+ * non-zero code.
+ */
+struct AlignerSharedAudioHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    double sampleRate;
+    int64_t frameCount;
+
+    static const uint32_t expectedMagic = 0x50504141; // "PPAA"
+    static const uint32_t expectedVersion = 1;
+};
+
+#endif
@@ -0,0 +1,267 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "LatencyMonitor.h"
+#include "Tracing.h"
+
+#include "base/Debug.h"
+
+#include <QPainter>
+#include <QFontMetrics>
+
+#include <algorithm>
+#include <map>
+
+using namespace std;
+using namespace sv;
+
+namespace {
+
+// Percentiles are taken over this many of the most recent samples
+// of each metric, so that they follow changes in behaviour
+const int window = 2048;
+
+// Interval at which a report is written to the log while enabled
+const int64_t logIntervalUs = 10 * 1000 * 1000;
+
+const vector<double> bins { 4.0, 8.0, 16.0, 33.0, 50.0, 100.0, 250.0 };
+
+struct Samples
+{
+    vector<double> recent; // ms, ring of up to window samples
+    int next = 0;
+    int count = 0;
+    int countAtLastLog = 0;
+};
+
+map<LatencyMonitor::Metric, Samples> samples;
+int64_t lastLog = 0;
+
+const vector<LatencyMonitor::Metric> allMetrics {
+    LatencyMonitor::Metric::ScoreHover,
+    LatencyMonitor::Metric::TempoCurveHover,
+    LatencyMonitor::Metric::AlignmentEditToTempo
+};
+
+double
+percentile(const vector<double> &sorted, double p)
+{
+    if (sorted.empty()) return 0.0;
+    int i = int(p * double(sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, int(sorted.size()) - 1)];
+}
+
+}
+
+bool LatencyMonitor::m_enabled = false;
+
+void
+LatencyMonitor::Probe::painted()
+{
+    if (m_pending < 0) {
+        return;
+    }
+    if (isEnabled()) {
+        record(m_metric, m_pending, now());
+    }
+    m_pending = -1;
+}
+
+void
+LatencyMonitor::setEnabled(bool enabled)
+{
+    if (m_enabled == enabled) {
+        return;
+    }
+    m_enabled = enabled;
+    if (enabled) {
+        lastLog = now();
+    } else {
+        SVDEBUG << "LatencyMonitor: Final report:\n" << getReport() << endl;
+    }
+}
+
+void
+LatencyMonitor::reset()
+{
+    samples.clear();
+}
+
+int64_t
+LatencyMonitor::now()
+{
+    return Tracing::now();
+}
+
+LatencyMonitor::Probe &
+LatencyMonitor::getProbe(Metric metric)
+{
+    static map<Metric, Probe> probes;
+    auto itr = probes.find(metric);
+    if (itr == probes.end()) {
+        itr = probes.insert({ metric, Probe(metric) }).first;
+    }
+    return itr->second;
+}
+
+QString
+LatencyMonitor::getMetricName(Metric metric)
+{
+    switch (metric) {
+    case Metric::ScoreHover: return "Score hover";
+    case Metric::TempoCurveHover: return "Tempo curve hover";
+    case Metric::AlignmentEditToTempo: return "Onset edit to tempo curve";
+    }
+    return {};
+}
+
+void
+LatencyMonitor::record(Metric metric, int64_t start, int64_t end)
+{
+    if (Tracing::isEnabled()) {
+        const char *name = "";
+        switch (metric) {
+        case Metric::ScoreHover: name = "Latency: score hover"; break;
+        case Metric::TempoCurveHover: name = "Latency: tempo curve hover"; break;
+        case Metric::AlignmentEditToTempo: name = "Latency: onset edit to tempo curve"; break;
+        }
+        Tracing::complete(name, "latency", start, end - start);
+    }
+
+    double ms = double(end - start) / 1000.0;
+
+    Samples &s = samples[metric];
+    if (int(s.recent.size()) < window) {
+        s.recent.push_back(ms);
+    } else {
+        s.recent[s.next] = ms;
+    }
+    s.next = (s.next + 1) % window;
+    ++s.count;
+
+    if (end - lastLog > logIntervalUs) {
+        lastLog = end;
+        bool anyNew = false;
+        for (auto &m : samples) {
+            if (m.second.count > m.second.countAtLastLog) {
+                anyNew = true;
+            }
+            m.second.countAtLastLog = m.second.count;
+        }
+        if (anyNew) {
+            SVDEBUG << "LatencyMonitor:\n" << getReport() << endl;
+        }
+    }
+}
+
+vector<double>
+LatencyMonitor::getHistogramBins()
+{
+    return bins;
+}
+
+LatencyMonitor::Summary
+LatencyMonitor::getSummary(Metric metric)
+{
+    Summary summary;
+    summary.histogram = vector<int>(bins.size() + 1, 0);
+
+    auto itr = samples.find(metric);
+    if (itr == samples.end() || itr->second.recent.empty()) {
+        return summary;
+    }
+
+    vector<double> sorted = itr->second.recent;
+    sort(sorted.begin(), sorted.end());
+
+    summary.count = itr->second.count;
+    summary.p50 = percentile(sorted, 0.50);
+    summary.p95 = percentile(sorted, 0.95);
+    summary.p99 = percentile(sorted, 0.99);
+    summary.max = sorted.back();
+
+    for (double ms : sorted) {
+        auto b = lower_bound(bins.begin(), bins.end(), ms);
+        ++summary.histogram[b - bins.begin()];
+    }
+
+    return summary;
+}
+
+QString
+LatencyMonitor::getReport()
+{
+    QStringList lines;
+    for (auto metric : allMetrics) {
+        auto s = getSummary(metric);
+        if (s.count == 0) {
+            continue;
+        }
+        QStringList histogram;
+        for (int i = 0; i < int(s.histogram.size()); ++i) {
+            if (i < int(bins.size())) {
+                histogram << QString("<=%1:%2").arg(bins[i]).arg(s.histogram[i]);
+            } else {
+                histogram << QString(">%1:%2").arg(bins.back()).arg(s.histogram[i]);
+            }
+        }
+        lines << QString("%1: n=%2 p50=%3ms p95=%4ms p99=%5ms max=%6ms [%7]")
+            .arg(getMetricName(metric)).arg(s.count)
+            .arg(s.p50, 0, 'f', 1).arg(s.p95, 0, 'f', 1)
+            .arg(s.p99, 0, 'f', 1).arg(s.max, 0, 'f', 1)
+            .arg(histogram.join(" "));
+    }
+    if (lines.empty()) {
+        return "No input latencies recorded";
+    }
+    return lines.join("\n");
+}
+
+void
+LatencyMonitor::paintOverlay(QPainter &paint, QRect rect,
+                             vector<Metric> metrics)
+{
+    QStringList lines;
+    for (auto metric : metrics) {
+        auto s = getSummary(metric);
+        lines << QString("%1: p50 %2 / p95 %3 / p99 %4 ms (%5)")
+            .arg(getMetricName(metric))
+            .arg(s.p50, 0, 'f', 1).arg(s.p95, 0, 'f', 1)
+            .arg(s.p99, 0, 'f', 1).arg(s.count);
+    }
+
+    paint.save();
+    paint.resetTransform();
+
+    QFontMetrics fm = paint.fontMetrics();
+    int margin = 4;
+    int w = 0;
+    for (auto l : lines) {
+        w = std::max(w, fm.horizontalAdvance(l));
+    }
+    int h = fm.height() * int(lines.size());
+    QRect box(rect.right() - w - margin * 3, rect.top() + margin,
+              w + margin * 2, h + margin * 2);
+
+    paint.setPen(Qt::NoPen);
+    paint.setBrush(QColor(0, 0, 0, 160));
+    paint.drawRect(box);
+
+    paint.setPen(Qt::white);
+    for (int i = 0; i < int(lines.size()); ++i) {
+        paint.drawText(box.left() + margin,
+                       box.top() + margin + fm.ascent() + i * fm.height(),
+                       lines[i]);
+    }
+
+    paint.restore();
+}
@@ -0,0 +1,120 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_LATENCY_MONITOR_H
+#define SV_LATENCY_MONITOR_H
+
+#include <QString>
+#include <QRect>
+
+#include <cstdint>
+#include <vector>
+
+class QPainter;
+
+/**
+ * Opt-in measurement of the latency from user input to the repaint
+ * that shows its result, for the score and tempo-curve widgets.
+ *
+ * Each metric has a probe. A widget tells the probe when an input
+ * event arrives (inputReceived), when that event has asked for a
+ * repaint (repaintRequested), and when it has finished painting
+ * (painted). The latency recorded is from the earliest input whose
+ * repaint is still outstanding to the end of the next paint, so
+ * several inputs coalesced into one repaint count once, at their
+ * worst.
+ *
+ * While enabled, results are summarised as percentiles and a
+ * histogram, shown in an overlay drawn by the widgets, written to
+ * the log every few seconds, and recorded as trace events if
+ * Tracing is also on. When disabled, each probe call costs a single
+ * test.
+ *
+ * For use from the GUI thread only.
+ */
+class LatencyMonitor
+{
+public:
+    enum class Metric {
+        ScoreHover,             // ScoreWidget mouse move to repaint
+        TempoCurveHover,        // TempoCurveWidget mouse move to repaint
+        AlignmentEditToTempo,   // Onset edit, via Session::modelChanged,
+                                // to TempoCurveWidget repaint
+    };
+
+    class Probe
+    {
+    public:
+        Probe(Metric metric) : m_metric(metric) { }
+
+        void inputReceived() {
+            m_candidate = (isEnabled() ? now() : -1);
+        }
+        void repaintRequested() {
+            if (m_pending < 0) m_pending = m_candidate;
+        }
+        void painted();
+
+    private:
+        Metric m_metric;
+        int64_t m_candidate = -1;
+        int64_t m_pending = -1;
+    };
+
+    static bool isEnabled() { return m_enabled; }
+    static void setEnabled(bool enabled);
+
+    /**
+     * Discard all recorded latencies.
+     */
+    static void reset();
+
+    static Probe &getProbe(Metric metric);
+
+    static QString getMetricName(Metric metric);
+
+    struct Summary {
+        int count = 0;          // in total since reset
+        double p50 = 0.0;       // percentiles and maximum in ms, over
+        double p95 = 0.0;       // the most recent samples only
+        double p99 = 0.0;
+        double max = 0.0;
+        std::vector<int> histogram; // counts per getHistogramBins() bin
+    };
+
+    static Summary getSummary(Metric metric);
+
+    /**
+     * Return the upper bounds, in ms, of all but the last of the
+     * histogram bins. The last bin counts everything above.
+     */
+    static std::vector<double> getHistogramBins();
+
+    /**
+     * Return a plain-text report of all metrics, one line each.
+     */
+    static QString getReport();
+
+    /**
+     * Paint a summary of the given metrics in the top-right corner
+     * of the given rect.
+     */
+    static void paintOverlay(QPainter &paint, QRect rect,
+                             std::vector<Metric> metrics);
+
+private:
+    static bool m_enabled;
+    static int64_t now();
+    static void record(Metric metric, int64_t start, int64_t end);
+};
+
+#endif
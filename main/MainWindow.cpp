@@ -22,6 +22,10 @@
 #include "ScoreParser.h"
 #include "ScoreAlignmentTransform.h"
 #include "Session.h"
+#include "ScoreBasedFrameAligner.h"
+#include "Tracing.h"
+#include "LatencyMonitor.h"
+#include "MemoryReport.h"
 #include "piano-aligner/Score.h"
 #include "align/Align.h"
 
@@ -134,6 +138,7 @@
 #include <QDialogButtonBox>
 #include <QFileSystemWatcher>
 #include <QTextEdit>
+#include <QFontDatabase>
 #include <QWidgetAction>
 #include <QGroupBox>
 #include <QButtonGroup>
@@ -141,6 +146,7 @@
 #include <QFileDialog>
 #include <QDockWidget>
 #include <QSplitter>
+#include <QThread>
 
 #include <iostream>
 #include <cstdio>
@@ -153,180 +159,6 @@ using std::string;
 
 using namespace sv;
 
-class MainWindow::ScoreBasedFrameAligner : public View::PlaybackFrameAligner {
-public:
-    ScoreBasedFrameAligner(Session *session) : m_session(session) { }
-
-    sv_frame_t map(const View *forView, sv_frame_t frame) const override
-    {
-        auto sourcePane = m_session->getPaneContainingOnsetsLayer();
-        if (forView == sourcePane) {
-            return frame;
-        }
-
-        Pane *targetPane =
-            const_cast<Pane *>(dynamic_cast<const Pane *>(forView));
-        auto targetLayer = m_session->getOnsetsLayerFromPane(targetPane);
-        if (!targetLayer) {
-            return frame;
-        }
-
-        QString label;
-        double proportion;
-
-        mapToScoreLabelAndProportion(m_session->getOnsetsLayer(),
-                                     frame, label, proportion);
-
-        mapFromScoreLabelAndProportion(targetLayer,
-                                       label, proportion, frame);
-        
-        return frame;
-    }
-
-    QString mapToScoreLabel(sv_frame_t frame) const
-    {
-        TimeInstantLayer *layer = m_session->getOnsetsLayer();
-        if (!layer) {
-            return {};
-        }
-        
-        QString label;
-        double proportion;
-        mapToScoreLabelAndProportion(layer, frame, label, proportion);
-        return label;
-    }
-
-    void mapToScoreLabelAndProportion(Layer *layer,
-                                      sv_frame_t frame,
-                                      QString &label,
-                                      double &proportion) const
-    {
-        //!!! Much too slow - rework with search & cacheing
-
-        label = "";
-        proportion = 0.0;
-        if (!layer) {
-            return;
-        }
-        
-        ModelId targetId = layer->getModel();
-        auto targetModel = ModelById::getAs<SparseOneDimensionalModel>(targetId);
-        auto events = targetModel->getAllEvents();
-        if (events.empty()) {
-            return;
-        }
-        
-        label = events[0].getLabel();
-        bool found = false;
-        int eventCount = targetModel->getEventCount();
-        for (int i = 1; i < eventCount; ++i) {
-            sv_frame_t eventFrame = events[i].getFrame();
-            if (frame < eventFrame) {
-                label = events[i-1].getLabel();
-                sv_frame_t priorEventFrame = events[i-1].getFrame();
-                if (priorEventFrame < eventFrame) {
-                    proportion = double(frame - priorEventFrame) /
-                        double(eventFrame - priorEventFrame);
-                }
-                found = true;
-                break;
-            } else if (frame == eventFrame) {
-                label = events[i].getLabel();
-                found = true;
-                break;
-            }
-        }
-        if (!found && eventCount > 0) {
-            label = events[eventCount-1].getLabel();
-        }
-    }
-
-    void mapFromScoreLabelAndProportion(Layer *layer,
-                                        QString label,
-                                        double proportion,
-                                        sv_frame_t &frame) const
-    {
-        //!!! miserably slow (I assume! - measure it - but at any rate
-        //!!! this is doing the same query as in
-        //!!! mapToScoreLabelAndProportion all over again)
-
-        if (!layer) {
-            return; // leave frame unchanged
-        }
-        
-        frame = 0;
-        
-        ModelId targetId = layer->getModel();
-        mapFromScoreLabelAndProportion(targetId, label, proportion, frame);
-    }
-
-    void mapFromScoreLabelAndProportion(ModelId targetModelId,
-                                        QString label,
-                                        double proportion,
-                                        sv_frame_t &frame) const
-    {
-        frame = 0;
-        auto targetModel = ModelById::getAs<SparseOneDimensionalModel>(targetModelId);
-        if (!targetModel) {
-            SVDEBUG << "ERROR: mapFromScoreLabelAndProportion: model is not a SparseOneDimensionalModel" << endl;
-            return;
-        }
-        auto events = targetModel->getAllEvents();
-        int eventCount = targetModel->getEventCount();
-        bool found = false;
-        for (int i = 0; i < eventCount; ++i) {
-            if (label == events[i].getLabel()) {
-                found = true;
-                sv_frame_t eventFrame = events[i].getFrame();
-                if (proportion == 0.0 || i + 1 == eventCount) {
-                    frame = eventFrame;
-                    break;
-                } else {
-                    frame = sv_frame_t
-                        (round(eventFrame + proportion *
-                               (events[i+1].getFrame() - eventFrame)));
-                    break;
-                }
-            }
-        }
-        if (!found) {
-            for (int i = 0; i < eventCount; ++i) {
-                frame = events[i].getFrame();
-                if (labelLessThan(label, events[i].getLabel())) {
-                    if (i > 0) {
-                        frame = events[i-1].getFrame();
-                    }
-                    return;
-                }
-            }
-        }
-    }
-    
-private:
-    Session *m_session;
-
-    static bool labelLessThan(QString first, QString second) {
-        if (first == second) {
-            return false;
-        }
-        static QRegularExpression punct("[^0-9]");
-        QStringList firstBits = first.split(punct, Qt::SkipEmptyParts);
-        QStringList secondBits = second.split(punct, Qt::SkipEmptyParts);
-        if (firstBits.size() < 2 || secondBits.size() < 2) {
-            return false;
-        }
-        int i0 = firstBits[0].toInt(), i1 = secondBits[0].toInt();
-        if (i0 > i1) {
-            return false;
-        } else if (i0 == i1) {
-            if (firstBits[1].toInt() >= secondBits[1].toInt()) {
-                return false;
-            }
-        }
-        return true;
-    }
-};
-
 MainWindow::MainWindow(AudioMode audioMode, MIDIMode midiMode, bool withOSCSupport) :
     MainWindowBase(audioMode, midiMode, int(PaneStack::Option::Default)),
     m_overview(nullptr),
@@ -357,6 +189,9 @@ MainWindow::MainWindow(AudioMode audioMode, MIDIMode midiMode, bool withOSCSuppo
     m_playSelectionAction(nullptr),
     m_playLoopAction(nullptr),
     m_chooseSmartCopyAction(nullptr),
+    m_recordTraceAction(nullptr),
+    m_showLatencyAction(nullptr),
+    m_scoreAlignerMenuPopulated(false),
     m_soloModified(false),
     m_prevSolo(false),
     m_playControlsSpacer(nullptr),
@@ -1007,6 +842,12 @@ MainWindow::setupFileMenu()
     toolbar->addAction(action);
     menu->addAction(action);
 
+    action = new QAction(tr("Export Tempo Statistics..."), this);
+    action->setStatusTip(tr("Export tempo and inter-onset interval statistics for the current alignment to a CSV file"));
+    connect(action, SIGNAL(triggered()), this, SLOT(exportTempoStatistics()));
+    connect(this, SIGNAL(canSaveScoreAlignmentAs(bool)), action, SLOT(setEnabled(bool)));
+    menu->addAction(action);
+
     menu->addSeparator();
 
     action = new QAction(tr("Import Annotation &Layer..."), this);
@@ -1052,6 +893,12 @@ MainWindow::setupFileMenu()
     connect(this, SIGNAL(canExportImage(bool)), action, SLOT(setEnabled(bool)));
     menu->addAction(action);
 
+    action = new QAction(tr("Export Score Page as SVG File..."), this);
+    action->setStatusTip(tr("Export the currently displayed page of the score to a scalable SVG image file"));
+    connect(action, SIGNAL(triggered()), this, SLOT(exportScorePageSVG()));
+    connect(this, SIGNAL(canExportScorePage(bool)), action, SLOT(setEnabled(bool)));
+    menu->addAction(action);
+
     menu->addSeparator();
 
     action = new QAction(tr("Browse Recorded and Converted Audio"), this);
@@ -1508,6 +1355,36 @@ MainWindow::setupViewMenu()
     m_keyReference->registerShortcut(action);
     menu->addAction(action);
 
+    menu->addSeparator();
+
+    QActionGroup *scoreViewGroup = new QActionGroup(this);
+
+    ScoreWidget::ViewMode scoreViewMode = m_scoreWidget->getViewMode();
+    
+    action = new QAction(tr("Show Score &Page by Page"), this);
+    action->setStatusTip(tr("Show the score one page at a time"));
+    connect(action, SIGNAL(triggered()), this, SLOT(showScorePaged()));
+    action->setCheckable(true);
+    action->setChecked(scoreViewMode == ScoreWidget::ViewMode::Paged);
+    scoreViewGroup->addAction(action);
+    menu->addAction(action);
+    
+    action = new QAction(tr("Scroll Score &Vertically"), this);
+    action->setStatusTip(tr("Show the score as a continuous column of systems"));
+    connect(action, SIGNAL(triggered()), this, SLOT(showScoreScrollingVertically()));
+    action->setCheckable(true);
+    action->setChecked(scoreViewMode == ScoreWidget::ViewMode::ScrollVertical);
+    scoreViewGroup->addAction(action);
+    menu->addAction(action);
+    
+    action = new QAction(tr("Scroll Score &Horizontally"), this);
+    action->setStatusTip(tr("Show the score as a continuous row of systems"));
+    connect(action, SIGNAL(triggered()), this, SLOT(showScoreScrollingHorizontally()));
+    action->setCheckable(true);
+    action->setChecked(scoreViewMode == ScoreWidget::ViewMode::ScrollHorizontal);
+    scoreViewGroup->addAction(action);
+    menu->addAction(action);
+
     menu->addSeparator();
         
     action = new QAction(tr("Show &Zoom Wheels"), this);
@@ -2131,13 +2008,32 @@ MainWindow::prepareTransformsMenu()
     
     QTimer::singleShot(150, TransformFactory::getInstance(),
                        SLOT(startPopulatingInstalledTransforms()));
+
+    // The aligner menu does not have to wait for the full plugin
+    // scan if the alignment transforms are cached from a previous
+    // run with the same plugins
+    
+    QThread *warming = ScoreAlignmentTransform::createWarmingThread();
+    connect(warming, &QThread::finished,
+            this, &MainWindow::scoreAlignmentTransformsFound);
+    warming->start(QThread::LowPriority);
+}
+
+void
+MainWindow::scoreAlignmentTransformsFound()
+{
+    if (!m_scoreAlignerMenuPopulated) {
+        populateScoreAlignerChoiceMenu();
+    }
 }
 
 void
 MainWindow::installedTransformsPopulated()
 {
     populateTransformsMenu();
-    populateScoreAlignerChoiceMenu();
+    if (!m_scoreAlignerMenuPopulated) {
+        populateScoreAlignerChoiceMenu();
+    }
 
     if (m_shouldStartOSCQueue) {
         SVDEBUG << "MainWindow: Creating OSC queue with network port"
@@ -2470,7 +2366,41 @@ MainWindow::setupHelpMenu()
     action->setStatusTip(tr("List the changes in this release (and every previous release) of %1").arg(name)); 
     connect(action, SIGNAL(triggered()), this, SLOT(whatsNew()));
     menu->addAction(action);
-*/    
+*/
+    QMenu *diagnosticsMenu = menu->addMenu(tr("&Diagnostics"));
+
+    m_recordTraceAction = new QAction(tr("&Record Performance Trace"), this);
+    m_recordTraceAction->setStatusTip(tr("Record timings of score, alignment and tempo activity for later analysis"));
+    m_recordTraceAction->setCheckable(true);
+    m_recordTraceAction->setChecked(Tracing::isEnabled());
+    connect(m_recordTraceAction, SIGNAL(toggled(bool)),
+            this, SLOT(setTracingEnabled(bool)));
+    diagnosticsMenu->addAction(m_recordTraceAction);
+
+    action = new QAction(tr("&Save Performance Trace..."), this);
+    action->setStatusTip(tr("Save the recorded performance trace in Chrome trace format, for viewing in Perfetto"));
+    connect(action, SIGNAL(triggered()), this, SLOT(saveTrace()));
+    diagnosticsMenu->addAction(action);
+
+    diagnosticsMenu->addSeparator();
+
+    m_showLatencyAction = new QAction(tr("Show Input &Latency"), this);
+    m_showLatencyAction->setStatusTip(tr("Measure the time from mouse input to repaint in the score and tempo curve, and show percentiles over them"));
+    m_showLatencyAction->setCheckable(true);
+    m_showLatencyAction->setChecked(LatencyMonitor::isEnabled());
+    connect(m_showLatencyAction, SIGNAL(toggled(bool)),
+            this, SLOT(setLatencyMonitorEnabled(bool)));
+    diagnosticsMenu->addAction(m_showLatencyAction);
+
+    diagnosticsMenu->addSeparator();
+
+    action = new QAction(tr("Show &Memory Report..."), this);
+    action->setStatusTip(tr("Show an estimate of the memory used by the score, alignment and tempo data"));
+    connect(action, SIGNAL(triggered()), this, SLOT(showMemoryReport()));
+    diagnosticsMenu->addAction(action);
+
+    menu->addSeparator();
+    
     action = new QAction(tr("&About %1").arg(name), this); 
     action->setStatusTip(tr("Show information about %1").arg(name)); 
     connect(action, SIGNAL(triggered()), this, SLOT(about()));
@@ -2684,7 +2614,6 @@ MainWindow::openScoreFile(QString scoreName, QString scoreFile)
     settings.endGroup();
 
     newSession();
-    m_score = Score();
 
     // Creating score structure
     string sname = scoreName.toStdString();
@@ -2709,15 +2638,19 @@ MainWindow::openScoreFile(QString scoreName, QString scoreFile)
     
     string soloPath = ScoreFinder::getScoreFile(sname, "solo");
     string meterPath = ScoreFinder::getScoreFile(sname, "meter");
-    if (!m_score.initialize(soloPath)) {
+
+    // The score is only needed to read the musical events, which are
+    // then shared by the session and the score and tempo widgets
+    Score score;
+    if (!score.initialize(soloPath)) {
         SVCERR << "MainWindow::chooseScore: Failed to load score data from solo file path \"" << soloPath << "\"" << endl;
         return;
     }
-    if (!m_score.readMeter(meterPath)) {
+    if (!score.readMeter(meterPath)) {
         SVCERR << "MainWindow::chooseScore: Failed to load meter data from meter file path \"" << meterPath << "\"" << endl;
         return;
     }
-    auto musicalEvents = m_score.getMusicalEvents();
+    auto musicalEvents = makeSharedMusicalEvents(score.getMusicalEvents());
     m_session.setMusicalEvents(m_scoreId, musicalEvents);
     m_scoreWidget->setMusicalEvents(musicalEvents);
     m_tempoCurveWidget->setMusicalEvents(musicalEvents);
@@ -2785,9 +2718,118 @@ MainWindow::viewManagerPlaybackFrameChanged(sv_frame_t frame)
     }
 }
 
+void
+MainWindow::setTracingEnabled(bool enabled)
+{
+    Tracing::setEnabled(enabled);
+
+    if (m_recordTraceAction && m_recordTraceAction->isChecked() != enabled) {
+        m_recordTraceAction->setChecked(enabled);
+    }
+}
+
+void
+MainWindow::setLatencyMonitorEnabled(bool enabled)
+{
+    LatencyMonitor::setEnabled(enabled);
+
+    if (m_showLatencyAction && m_showLatencyAction->isChecked() != enabled) {
+        m_showLatencyAction->setChecked(enabled);
+    }
+
+    // to show or hide the overlays
+    m_scoreWidget->update();
+    m_tempoCurveWidget->update();
+}
+
+void
+MainWindow::saveTrace()
+{
+    if (Tracing::getEventCount() == 0) {
+        QMessageBox::information(this,
+                                 tr("No performance trace recorded"),
+                                 tr("No performance trace has been recorded. Switch on \"Record Performance Trace\" in the Diagnostics menu, repeat the activity you want to look at, and then save the trace."),
+                                 QMessageBox::Ok);
+        return;
+    }
+    
+    QString path = QFileDialog::getSaveFileName
+        (this, tr("Save Performance Trace"),
+         QDir::home().filePath("performance-precision-trace.json"),
+         tr("Chrome trace files (*.json)"));
+    if (path == "") {
+        // cancelled
+        return;
+    }
+
+    if (!Tracing::writeChromeTrace(path)) {
+        QMessageBox::warning(this,
+                             tr("Failed to save performance trace"),
+                             tr("Failed to save performance trace. See log file for more information."),
+                             QMessageBox::Ok);
+    }
+}
+
+MemoryReport
+MainWindow::makeMemoryReport() const
+{
+    MemoryReport report;
+    m_session.reportMemoryUsage(report);
+    m_scoreWidget->reportMemoryUsage(report);
+    m_tempoCurveWidget->reportMemoryUsage(report);
+    return report;
+}
+
+void
+MainWindow::showMemoryReport()
+{
+    MemoryReport report = makeMemoryReport();
+    QString text = report.toText();
+
+    SVDEBUG << "MainWindow::showMemoryReport:\n" << text << endl;
+    
+    QDialog *d = new QDialog(this);
+    d->setWindowTitle(tr("Memory Report"));
+
+    QGridLayout *layout = new QGridLayout;
+    d->setLayout(layout);
+
+    QTextEdit *textEdit = new QTextEdit;
+    textEdit->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    textEdit->setPlainText(text);
+    textEdit->setReadOnly(true);
+    layout->addWidget(textEdit, 0, 0);
+    
+    QDialogButtonBox *bb = new QDialogButtonBox(QDialogButtonBox::Save |
+                                                QDialogButtonBox::Close);
+    layout->addWidget(bb, 1, 0);
+    connect(bb, SIGNAL(rejected()), d, SLOT(reject()));
+    connect(bb, &QDialogButtonBox::accepted, d, [d, report]() {
+        QString path = QFileDialog::getSaveFileName
+            (d, tr("Save Memory Report"),
+             QDir::home().filePath("performance-precision-memory.txt"),
+             tr("Text files (*.txt)"));
+        if (path != "" && !report.write(path)) {
+            QMessageBox::warning(d,
+                                 tr("Failed to save memory report"),
+                                 tr("Failed to save memory report. See log file for more information."),
+                                 QMessageBox::Ok);
+        }
+    });
+
+    d->setMinimumSize(m_viewManager->scalePixelSize(560),
+                      m_viewManager->scalePixelSize(450));
+    
+    d->exec();
+
+    delete d;
+}
+
 void
 MainWindow::highlightFrameInScore(sv_frame_t frame)
 {
+    TraceScope trace("MainWindow::highlightFrameInScore", "follow");
+    
     QString label = m_scoreBasedFrameAligner->mapToScoreLabel(frame);
     if (label == "") {
         SVDEBUG << "highlightFrameInScore: Unable to map frame "
@@ -3063,6 +3105,8 @@ MainWindow::populateScoreAlignerChoiceMenu()
 {
     delete m_alignerChoice->menu();
     m_alignerChoice->setMenu(nullptr);
+
+    m_scoreAlignerMenuPopulated = true;
     
     auto transforms =
         ScoreAlignmentTransform::getAvailableAlignmentTransforms();
@@ -3798,6 +3842,9 @@ MainWindow::updateMenuStates()
     bool haveScore =
         m_scoreId != "";
 
+    emit canExportScorePage(haveScore && m_scoreWidget &&
+                            m_scoreWidget->getPageCount() > 0);
+
     // NB this does not depend on actually having an alignment - we
     // want to be able to export an empty alignment (with every row
     // showing N/N)
@@ -4356,6 +4403,25 @@ MainWindow::saveScoreAlignmentAs()
     updateMenuStates();
 }
 
+void
+MainWindow::exportTempoStatistics()
+{
+    SVDEBUG << "MainWindow::exportTempoStatistics" << endl;
+
+    QString filename = getSaveFileName(FileFinder::CSVFile);
+    if (filename == "") {
+        // cancelled
+        return;
+    }
+
+    if (!m_session.exportTempoStatisticsTo(filename)) {
+        QMessageBox::warning(this,
+                             tr("Failed to export tempo statistics"),
+                             tr("Failed to export tempo statistics. See log file for more information."),
+                             QMessageBox::Ok);
+    }
+}
+
 void
 MainWindow::propagateAlignmentFromReference()
 {
@@ -4737,6 +4803,42 @@ MainWindow::exportSVG()
     }
 }
 
+void
+MainWindow::exportScorePageSVG()
+{
+    int page = m_scoreWidget->getCurrentPage();
+    if (page < 0) return;
+    
+    QString path = getSaveFileName(FileFinder::SVGFile);
+    if (path == "") return;
+    if (QFileInfo(path).suffix() == "") path += ".svg";
+
+    QString error;
+    if (!m_scoreWidget->exportPageToSvg(page, path, error)) {
+        SVDEBUG << "MainWindow::exportScorePageSVG: " << error << endl;
+        QMessageBox::critical(this, tr("Failed to save SVG file"),
+                              tr("Failed to save SVG file %1").arg(path));
+    }
+}
+
+void
+MainWindow::showScorePaged()
+{
+    m_scoreWidget->setViewMode(ScoreWidget::ViewMode::Paged);
+}
+
+void
+MainWindow::showScoreScrollingVertically()
+{
+    m_scoreWidget->setViewMode(ScoreWidget::ViewMode::ScrollVertical);
+}
+
+void
+MainWindow::showScoreScrollingHorizontally()
+{
+    m_scoreWidget->setViewMode(ScoreWidget::ViewMode::ScrollHorizontal);
+}
+
 void
 MainWindow::browseRecordedAudio()
 {
@@ -38,6 +38,8 @@ class UnitConverter;
 }
 
 class Score;
+class ScoreBasedFrameAligner;
+class MemoryReport;
 
 class MainWindow : public sv::MainWindowBase
 {
@@ -54,6 +56,7 @@ signals:
     void canSaveScoreAlignmentAs(bool);
     void canLoadScoreAlignment(bool);
     void canPropagateAlignment(bool);
+    void canExportScorePage(bool);
 
 public slots:
     void preferenceChanged(sv::PropertyContainer::PropertyName) override;
@@ -78,11 +81,13 @@ protected slots:
     virtual void loadScoreAlignment();
     virtual void saveScoreAlignment();
     virtual void saveScoreAlignmentAs();
+    virtual void exportTempoStatistics();
     virtual void propagateAlignmentFromReference();
     virtual void importLayer();
     virtual void exportLayer();
     virtual void exportImage();
     virtual void exportSVG();
+    virtual void exportScorePageSVG();
     virtual void browseRecordedAudio();
     virtual void saveSession();
     virtual void saveSessionAs();
@@ -100,6 +105,10 @@ protected slots:
     virtual void toolEraseSelected();
     virtual void toolMeasureSelected();
 
+    virtual void showScorePaged();
+    virtual void showScoreScrollingVertically();
+    virtual void showScoreScrollingHorizontally();
+
     void documentModified() override;
     void documentRestored() override;
     virtual void documentReplaced();
@@ -212,6 +221,7 @@ protected slots:
 
     void installedTransformsPopulated();
     void populateTransformsMenu();
+    void scoreAlignmentTransformsFound();
     
     virtual void betaReleaseWarning();
     virtual void pluginPopulationWarning(QString text);
@@ -227,6 +237,10 @@ protected slots:
     virtual void about();
     virtual void whatsNew();
     virtual void keyReference();
+    virtual void setTracingEnabled(bool);
+    virtual void saveTrace();
+    virtual void setLatencyMonitorEnabled(bool);
+    virtual void showMemoryReport();
     void newerVersionAvailable(QString) override;
 
 protected:
@@ -288,6 +302,9 @@ protected:
     QAction                 *m_scrollRightAction;
     QAction                 *m_showPropertyBoxesAction;
     QAction                 *m_chooseSmartCopyAction;
+    QAction                 *m_recordTraceAction;
+    QAction                 *m_showLatencyAction;
+    bool                     m_scoreAlignerMenuPopulated;
 
     bool                     m_soloModified;
     bool                     m_prevSolo;
@@ -315,10 +332,8 @@ protected:
 
     QString                  m_scoreId;
     Session                  m_session;
-    Score                    m_score;
     bool                     m_followScore;
 
-    class ScoreBasedFrameAligner;
     ScoreBasedFrameAligner  *m_scoreBasedFrameAligner;
 
     std::vector<std::string> m_scoreFilesToDelete;
@@ -371,6 +386,8 @@ protected:
     TransformActionReverseMap m_transformActionsReverse;
 
     QString getReleaseText() const;
+
+    MemoryReport makeMemoryReport() const;
     
     void setupMenus() override;
 
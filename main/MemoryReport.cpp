@@ -0,0 +1,166 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "MemoryReport.h"
+
+#include "base/TempWriteFile.h"
+#include "base/Debug.h"
+
+#include <QFile>
+#include <QTextStream>
+
+#include <algorithm>
+
+using namespace std;
+using namespace sv;
+
+void
+MemoryReport::add(QString owner, QString item, size_t count, size_t bytes)
+{
+    m_entries.push_back({ owner, item, count, bytes });
+}
+
+void
+MemoryReport::addShared(QString owner, QString item, const void *shared,
+                        size_t count, size_t bytes)
+{
+    if (m_shared.insert(shared).second) {
+        add(owner, item, count, bytes);
+    } else {
+        add(owner, item + " (shared)", count, 0);
+    }
+}
+
+void
+MemoryReport::warn(QString owner, QString message)
+{
+    m_warnings.push_back(QString("%1: %2").arg(owner).arg(message));
+}
+
+size_t
+MemoryReport::getTotal() const
+{
+    size_t total = 0;
+    for (const auto &e : m_entries) {
+        total += e.bytes;
+    }
+    return total;
+}
+
+size_t
+MemoryReport::getTotalFor(QString owner) const
+{
+    size_t total = 0;
+    for (const auto &e : m_entries) {
+        if (e.owner == owner) {
+            total += e.bytes;
+        }
+    }
+    return total;
+}
+
+QString
+MemoryReport::formatBytes(size_t bytes)
+{
+    if (bytes < 10 * 1024) {
+        return QString("%1 B").arg(bytes);
+    } else if (bytes < 10 * 1024 * 1024) {
+        return QString("%1 KB").arg(double(bytes) / 1024.0, 0, 'f', 1);
+    } else {
+        return QString("%1 MB").arg(double(bytes) / (1024.0 * 1024.0),
+                                    0, 'f', 1);
+    }
+}
+
+QString
+MemoryReport::toText() const
+{
+    QString text;
+    QTextStream out(&text);
+
+    vector<QString> owners;
+    for (const auto &e : m_entries) {
+        if (find(owners.begin(), owners.end(), e.owner) == owners.end()) {
+            owners.push_back(e.owner);
+        }
+    }
+
+    for (const auto &owner : owners) {
+        out << owner << ":\n";
+        for (const auto &e : m_entries) {
+            if (e.owner != owner) continue;
+            out << "  " << e.item.leftJustified(36, ' ')
+                << (e.count > 0 ? QString::number(e.count) : QString())
+                    .rightJustified(9, ' ')
+                << formatBytes(e.bytes).rightJustified(12, ' ') << "\n";
+        }
+        out << "  " << QString("(total)").leftJustified(45, ' ')
+            << formatBytes(getTotalFor(owner)).rightJustified(12, ' ')
+            << "\n\n";
+    }
+
+    out << "Total: " << formatBytes(getTotal()) << "\n";
+
+    if (!m_warnings.empty()) {
+        out << "\nWarnings:\n";
+        for (const auto &w : m_warnings) {
+            out << "  " << w << "\n";
+        }
+    }
+
+    return text;
+}
+
+bool
+MemoryReport::write(QString path) const
+{
+    TempWriteFile temp(path);
+    QFile file(temp.getTemporaryFilename());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        SVCERR << "MemoryReport::write: Failed to open file "
+               << temp.getTemporaryFilename() << " for writing" << endl;
+        return false;
+    }
+
+    QTextStream out(&file);
+    out << toText();
+
+    file.close();
+    temp.moveToTarget();
+
+    SVDEBUG << "MemoryReport::write: Wrote report to " << path << endl;
+    
+    return true;
+}
+
+size_t
+MemoryReport::sizeOf(const Score::MusicalEventList &events)
+{
+    size_t bytes = sizeOfFlat(events);
+    for (const auto &ev : events) {
+        bytes += heapSize(ev.notes);
+        for (const auto &n : ev.notes) {
+            bytes += heapSize(n.noteId);
+        }
+    }
+    return bytes;
+}
+
+size_t
+MemoryReport::sizeOf(const EventVector &events)
+{
+    size_t bytes = sizeOfFlat(events);
+    for (const auto &e : events) {
+        bytes += heapSize(e);
+    }
+    return bytes;
+}
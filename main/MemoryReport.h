@@ -0,0 +1,155 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_MEMORY_REPORT_H
+#define SV_MEMORY_REPORT_H
+
+#include "base/Event.h"
+
+#include "piano-aligner/Score.h"
+
+#include <QString>
+#include <QHash>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * An account of the memory held by the score, alignment and tempo
+ * data structures, gathered on request by ScoreWidget, Session and
+ * TempoCurveWidget through their reportMemoryUsage methods.
+ *
+ * Sizes are estimates. They include the objects themselves and the
+ * heap blocks they own directly, using the container layouts of
+ * libstdc++ and Qt 6 on a 64-bit platform, but not allocator
+ * overhead or rounding. Implicitly shared Qt data is counted once by
+ * every holder, so totals may overstate a little where strings are
+ * shared between structures.
+ *
+ * Anything suspicious found while walking the structures, such as a
+ * tempo model retained for an audio model that no longer exists, is
+ * recorded as a warning.
+ */
+class MemoryReport
+{
+public:
+    struct Entry {
+        QString owner;  // e.g. "ScoreWidget"
+        QString item;   // e.g. "m_idDataMap"
+        size_t count;   // number of elements, or 0 if not applicable
+        size_t bytes;
+    };
+
+    void add(QString owner, QString item, size_t count, size_t bytes);
+
+    /**
+     * Add an item that may be shared between owners, identified by
+     * the given address. Its bytes are counted for the first owner
+     * that reports it only; later owners list it as shared.
+     */
+    void addShared(QString owner, QString item, const void *shared,
+                   size_t count, size_t bytes);
+    void warn(QString owner, QString message);
+
+    const std::vector<Entry> &getEntries() const { return m_entries; }
+    const std::vector<QString> &getWarnings() const { return m_warnings; }
+
+    size_t getTotal() const;
+    size_t getTotalFor(QString owner) const;
+
+    /**
+     * Return the report as a plain-text table, grouped by owner with
+     * a subtotal for each, followed by any warnings.
+     */
+    QString toText() const;
+
+    /**
+     * Write the report, as returned by toText(), to the given
+     * file. Return false if the file could not be written.
+     */
+    bool write(QString path) const;
+
+    static QString formatBytes(size_t bytes);
+
+    // Estimates of the heap memory owned by a single object, not
+    // including the object itself
+
+    static size_t heapSize(const QString &s) {
+        if (s.isNull()) return 0;
+        return qArrayHeaderSize + size_t(s.capacity() + 1) * sizeof(QChar);
+    }
+
+    static size_t heapSize(const std::string &s) {
+        if (s.capacity() <= stringLocalCapacity) return 0;
+        return s.capacity() + 1;
+    }
+
+    static size_t heapSize(const sv::Event &e) {
+        return heapSize(e.getLabel()) + heapSize(e.getURI());
+    }
+
+    template <typename T>
+    static size_t heapSize(const std::vector<T> &v) {
+        return v.capacity() * sizeof(T);
+    }
+
+    // Estimates of the total memory held by a container and its
+    // elements, including the heap memory owned by the elements
+
+    static size_t sizeOf(const Score::MusicalEventList &events);
+    static size_t sizeOf(const sv::EventVector &events);
+
+    template <typename T>
+    static size_t sizeOfFlat(const std::vector<T> &v) {
+        return sizeof(v) + heapSize(v);
+    }
+
+    template <typename T, typename F>
+    static size_t sizeOf(const std::vector<T> &v, F elementHeapSize) {
+        size_t bytes = sizeOfFlat(v);
+        for (const auto &e : v) bytes += elementHeapSize(e);
+        return bytes;
+    }
+
+    template <typename K, typename V, typename F>
+    static size_t sizeOf(const std::map<K, V> &m, F elementHeapSize) {
+        size_t bytes = sizeof(m) +
+            m.size() * (mapNodeOverhead + sizeof(std::pair<const K, V>));
+        for (const auto &e : m) bytes += elementHeapSize(e);
+        return bytes;
+    }
+
+    template <typename K, typename V, typename F>
+    static size_t sizeOf(const QHash<K, V> &h, F elementHeapSize) {
+        // A span of 128 one-byte offsets per 128 buckets, plus the
+        // entry storage within the spans
+        size_t bytes = sizeof(h) +
+            size_t(h.capacity()) * (1 + sizeof(K) + sizeof(V));
+        for (auto i = h.begin(); i != h.end(); ++i) {
+            bytes += elementHeapSize(i.key(), i.value());
+        }
+        return bytes;
+    }
+
+private:
+    static constexpr size_t qArrayHeaderSize = 16;
+    static constexpr size_t stringLocalCapacity = 15;
+    static constexpr size_t mapNodeOverhead = 32; // colour and 3 links
+
+    std::vector<Entry> m_entries;
+    std::vector<QString> m_warnings;
+    std::set<const void *> m_shared;
+};
+
+#endif
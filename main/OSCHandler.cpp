@@ -14,6 +14,9 @@
 */
 
 #include "MainWindow.h"
+#include "Tracing.h"
+#include "LatencyMonitor.h"
+#include "MemoryReport.h"
 #include "data/osc/OSCQueue.h"
 
 #include "layer/WaveformLayer.h"
@@ -842,6 +845,78 @@ MainWindow::handleOSCMessage(const OSCMessage &message)
             }
         }            
 
+    } else if (message.getMethod() == "trace") {
+
+        QString command;
+        if (message.getArgCount() >= 1 &&
+            message.getArg(0).canConvert(QMetaType(QMetaType::QString))) {
+            command = message.getArg(0).toString();
+        }
+
+        if (command == "on" && message.getArgCount() == 1) {
+            setTracingEnabled(true);
+        } else if (command == "off" && message.getArgCount() == 1) {
+            setTracingEnabled(false);
+        } else if (command == "clear" && message.getArgCount() == 1) {
+            Tracing::clear();
+        } else if (command == "save" && message.getArgCount() == 2 &&
+                   message.getArg(1).canConvert(QMetaType(QMetaType::QString))) {
+            QString path = message.getArg(1).toString();
+            if (Tracing::writeChromeTrace(path)) {
+                SVDEBUG << "OSCHandler: Saved trace to \""
+                        << path << "\"" << endl;
+            } else {
+                SVCERR << "OSCHandler: Failed to save trace to \""
+                       << path << "\"" << endl;
+            }
+        } else {
+            SVCERR << "OSCHandler: Usage: /trace <on|off|clear>" << endl;
+            SVCERR << "               or  /trace save <filename>" << endl;
+        }
+
+    } else if (message.getMethod() == "latency") {
+
+        QString command;
+        if (message.getArgCount() == 1 &&
+            message.getArg(0).canConvert(QMetaType(QMetaType::QString))) {
+            command = message.getArg(0).toString();
+        }
+
+        if (command == "on") {
+            setLatencyMonitorEnabled(true);
+        } else if (command == "off") {
+            setLatencyMonitorEnabled(false);
+        } else if (command == "reset") {
+            LatencyMonitor::reset();
+        } else if (command == "report") {
+            SVCERR << "OSCHandler: Input latency:\n"
+                   << LatencyMonitor::getReport() << endl;
+        } else {
+            SVCERR << "OSCHandler: Usage: /latency <on|off|reset|report>"
+                   << endl;
+        }
+
+    } else if (message.getMethod() == "memory") {
+
+        MemoryReport report = makeMemoryReport();
+        
+        if (message.getArgCount() == 0) {
+            SVCERR << "OSCHandler: Memory report:\n"
+                   << report.toText() << endl;
+        } else if (message.getArgCount() == 1 &&
+                   message.getArg(0).canConvert(QMetaType(QMetaType::QString))) {
+            QString path = message.getArg(0).toString();
+            if (report.write(path)) {
+                SVDEBUG << "OSCHandler: Saved memory report to \""
+                        << path << "\"" << endl;
+            } else {
+                SVCERR << "OSCHandler: Failed to save memory report to \""
+                       << path << "\"" << endl;
+            }
+        } else {
+            SVCERR << "OSCHandler: Usage: /memory [<filename>]" << endl;
+        }
+
     } else {
         SVCERR << "WARNING: OSCHandler: Unknown or unsupported "
                   << "method \"" << message.getMethod()
@@ -0,0 +1,124 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_OPEN_HASH_INDEX_H
+#define SV_OPEN_HASH_INDEX_H
+
+#include <functional>
+#include <vector>
+
+/**
+ * A lookup from keys to indices into an array held elsewhere, as an
+ * open-addressing hash table with linear probing in a single flat
+ * array of slots.
+ *
+ * The table does not store the keys themselves, only their hashes
+ * and the indices they map to. The caller provides a function that
+ * returns the key for a given index, which is used to resolve hash
+ * collisions. So an array of interned strings, for example, can be
+ * indexed without a second copy of every string.
+ *
+ * The table is kept at most half full, so probe sequences stay
+ * short.
+ */
+template <typename Key, typename Hash = std::hash<Key>>
+class OpenHashIndex
+{
+public:
+    OpenHashIndex() : m_count(0) { }
+
+    void clear() {
+        m_slots.clear();
+        m_count = 0;
+    }
+
+    /**
+     * Make room for at least n entries without rehashing.
+     */
+    void reserve(int n) {
+        size_t wanted = 16;
+        while (wanted < size_t(n) * 2) wanted *= 2;
+        if (wanted > m_slots.size()) rehash(wanted);
+    }
+
+    int size() const { return m_count; }
+
+    /**
+     * Return the index for the given key, or -1 if it is not
+     * present. keyOf(index) must return the key for an index.
+     */
+    template <typename KeyOf>
+    int find(const Key &key, KeyOf keyOf) const {
+        if (m_slots.empty()) return -1;
+        size_t h = Hash()(key);
+        size_t mask = m_slots.size() - 1;
+        for (size_t i = h & mask; m_slots[i].index >= 0; i = (i + 1) & mask) {
+            if (m_slots[i].hash == h && keyOf(m_slots[i].index) == key) {
+                return m_slots[i].index;
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * Map the given key to the given index, replacing any index it
+     * was already mapped to. keyOf is as for find().
+     */
+    template <typename KeyOf>
+    void insert(const Key &key, int index, KeyOf keyOf) {
+        if (size_t(m_count + 1) * 2 > m_slots.size()) {
+            rehash(m_slots.empty() ? 16 : m_slots.size() * 2);
+        }
+        size_t h = Hash()(key);
+        size_t mask = m_slots.size() - 1;
+        size_t i = h & mask;
+        for (; m_slots[i].index >= 0; i = (i + 1) & mask) {
+            if (m_slots[i].hash == h && keyOf(m_slots[i].index) == key) {
+                m_slots[i].index = index;
+                return;
+            }
+        }
+        m_slots[i] = { h, index };
+        ++m_count;
+    }
+
+    /**
+     * Return the number of bytes used by the slots.
+     */
+    size_t getMemoryUsage() const {
+        return m_slots.capacity() * sizeof(Slot);
+    }
+
+private:
+    struct Slot {
+        size_t hash;
+        int index; // or -1 if the slot is empty
+    };
+
+    std::vector<Slot> m_slots; // size is zero or a power of two
+    int m_count;
+
+    void rehash(size_t size) {
+        std::vector<Slot> old;
+        old.swap(m_slots);
+        m_slots = std::vector<Slot>(size, Slot { 0, -1 });
+        size_t mask = size - 1;
+        for (const auto &s : old) {
+            if (s.index < 0) continue;
+            size_t i = s.hash & mask;
+            while (m_slots[i].index >= 0) i = (i + 1) & mask;
+            m_slots[i] = s;
+        }
+    }
+};
+
+#endif
@@ -98,6 +98,10 @@ PreferencesDialog::PreferencesDialog(QWidget *parent) :
                                          Qt::Checked);
     connect(vampProcessSeparation, SIGNAL(stateChanged(int)),
             this, SLOT(vampProcessSeparationChanged(int)));
+
+    QCheckBox *alignerProcessSeparation = new QCheckBox;
+    connect(alignerProcessSeparation, SIGNAL(stateChanged(int)),
+            this, SLOT(alignerProcessSeparationChanged(int)));
     
     QComboBox *smoothing = new QComboBox;
     
@@ -316,6 +320,11 @@ PreferencesDialog::PreferencesDialog(QWidget *parent) :
     QString permishTag = QString("network-permission-%1").arg(SV_VERSION);
     m_networkPermission = settings.value(permishTag, false).toBool();
 
+    m_runAlignersInHelper =
+        settings.value("run-aligners-in-helper-process", false).toBool();
+    alignerProcessSeparation->setCheckState(m_runAlignersInHelper ?
+                                            Qt::Checked : Qt::Unchecked);
+
     settings.endGroup();
 
     QComboBox *locale = new QComboBox;
@@ -485,6 +494,10 @@ PreferencesDialog::PreferencesDialog(QWidget *parent) :
     subgrid->addWidget(new QLabel(tr("Run Vamp plugins in separate process:")),
                        row, 0);
     subgrid->addWidget(vampProcessSeparation, row++, 1, 1, 1);
+
+    subgrid->addWidget(new QLabel(tr("Run score aligners in separate process:")),
+                       row, 0);
+    subgrid->addWidget(alignerProcessSeparation, row++, 1, 1, 1);
     
     subgrid->setRowStretch(row, 10);
     
@@ -823,6 +836,13 @@ PreferencesDialog::vampProcessSeparationChanged(int state)
     m_changesOnRestart = true;
 }
 
+void
+PreferencesDialog::alignerProcessSeparationChanged(int state)
+{
+    m_runAlignersInHelper = (state == Qt::Checked);
+    m_applyButton->setEnabled(true);
+}
+
 void
 PreferencesDialog::networkPermissionChanged(int state)
 {
@@ -980,6 +1000,7 @@ PreferencesDialog::applyClicked()
     settings.beginGroup("Preferences");
     QString permishTag = QString("network-permission-%1").arg(SV_VERSION);
     settings.setValue(permishTag, m_networkPermission);
+    settings.setValue("run-aligners-in-helper-process", m_runAlignersInHelper);
 
     vector<string> names = breakfastquay::AudioFactory::getImplementationNames();
     string implementationName;
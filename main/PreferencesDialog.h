@@ -74,6 +74,7 @@ protected slots:
     void finerTimeStretchChanged(int state);
     void gaplessModeChanged(int state);
     void vampProcessSeparationChanged(int state);
+    void alignerProcessSeparationChanged(int state);
     void tempDirRootChanged(QString root);
     void backgroundModeChanged(int mode);
     void timeToTextModeChanged(int mode);
@@ -131,6 +132,7 @@ protected:
     bool m_finerTimeStretch;
     bool m_gapless;
     bool m_runPluginsInProcess;
+    bool m_runAlignersInHelper;
     bool m_networkPermission;
     bool m_retina;
     QString m_tempDirRoot;
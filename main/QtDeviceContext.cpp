@@ -0,0 +1,1079 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "QtDeviceContext.h"
+
+#include "verovio/include/vrv/glyph.h"
+#include "verovio/include/vrv/object.h"
+#include "verovio/include/vrv/resources.h"
+
+#include <QFile>
+#include <QXmlStreamReader>
+#include <QFontMetricsF>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include "base/Debug.h"
+
+#include <map>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+//#define DEBUG_QT_DEVICE_CONTEXT 1
+
+using std::string;
+using std::u32string;
+using std::shared_ptr;
+using std::make_shared;
+
+namespace {
+
+// Parse SVG path data into a QPainterPath. Verovio's glyph files
+// use only the basic commands, but we accept all of them; arcs are
+// approximated by a straight line to their end point.
+QPainterPath
+parsePathData(const QString &d)
+{
+    QPainterPath path;
+
+    const QChar *p = d.constData();
+    const QChar *end = p + d.size();
+
+    auto skipSeparators = [&]() {
+        while (p < end && (p->isSpace() || *p == ',')) ++p;
+    };
+
+    auto readNumber = [&](double &value) -> bool {
+        skipSeparators();
+        const QChar *start = p;
+        if (p < end && (*p == '-' || *p == '+')) ++p;
+        bool digits = false;
+        while (p < end && p->isDigit()) { ++p; digits = true; }
+        if (p < end && *p == '.') {
+            ++p;
+            while (p < end && p->isDigit()) { ++p; digits = true; }
+        }
+        if (!digits) {
+            p = start;
+            return false;
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            const QChar *e = p++;
+            if (p < end && (*p == '-' || *p == '+')) ++p;
+            if (p < end && p->isDigit()) {
+                while (p < end && p->isDigit()) ++p;
+            } else {
+                p = e;
+            }
+        }
+        bool ok = false;
+        value = QString(start, int(p - start)).toDouble(&ok);
+        return ok;
+    };
+
+    QPointF current, subpathStart, lastControl;
+    QChar command, previous;
+
+    while (true) {
+        skipSeparators();
+        if (p >= end) break;
+
+        if (p->isLetter()) {
+            command = *p++;
+        } else if (command.isNull()) {
+            break;
+        } else if (command == 'M') {
+            command = 'L';
+        } else if (command == 'm') {
+            command = 'l';
+        }
+
+        bool relative = command.isLower();
+        QPointF base = relative ? current : QPointF();
+        QChar upper = command.toUpper();
+        double v[7];
+
+        auto read = [&](int n) -> bool {
+            for (int i = 0; i < n; ++i) {
+                if (!readNumber(v[i])) return false;
+            }
+            return true;
+        };
+
+        if (upper == 'Z') {
+            path.closeSubpath();
+            current = subpathStart;
+            previous = upper;
+            continue;
+        }
+
+        bool ok = true;
+
+        switch (upper.unicode()) {
+        case 'M':
+            if ((ok = read(2))) {
+                current = base + QPointF(v[0], v[1]);
+                subpathStart = current;
+                path.moveTo(current);
+            }
+            break;
+        case 'L':
+            if ((ok = read(2))) {
+                current = base + QPointF(v[0], v[1]);
+                path.lineTo(current);
+            }
+            break;
+        case 'H':
+            if ((ok = read(1))) {
+                current.setX((relative ? current.x() : 0.0) + v[0]);
+                path.lineTo(current);
+            }
+            break;
+        case 'V':
+            if ((ok = read(1))) {
+                current.setY((relative ? current.y() : 0.0) + v[0]);
+                path.lineTo(current);
+            }
+            break;
+        case 'C':
+            if ((ok = read(6))) {
+                QPointF c1 = base + QPointF(v[0], v[1]);
+                lastControl = base + QPointF(v[2], v[3]);
+                current = base + QPointF(v[4], v[5]);
+                path.cubicTo(c1, lastControl, current);
+            }
+            break;
+        case 'S':
+            if ((ok = read(4))) {
+                QPointF c1 = current;
+                if (previous == 'C' || previous == 'S') {
+                    c1 = current * 2.0 - lastControl;
+                }
+                lastControl = base + QPointF(v[0], v[1]);
+                current = base + QPointF(v[2], v[3]);
+                path.cubicTo(c1, lastControl, current);
+            }
+            break;
+        case 'Q':
+            if ((ok = read(4))) {
+                lastControl = base + QPointF(v[0], v[1]);
+                current = base + QPointF(v[2], v[3]);
+                path.quadTo(lastControl, current);
+            }
+            break;
+        case 'T':
+            if ((ok = read(2))) {
+                if (previous == 'Q' || previous == 'T') {
+                    lastControl = current * 2.0 - lastControl;
+                } else {
+                    lastControl = current;
+                }
+                current = base + QPointF(v[0], v[1]);
+                path.quadTo(lastControl, current);
+            }
+            break;
+        case 'A':
+            if ((ok = read(7))) {
+                current = base + QPointF(v[5], v[6]);
+                path.lineTo(current);
+            }
+            break;
+        default:
+            ok = false;
+            break;
+        }
+
+        if (!ok) break;
+        previous = upper;
+    }
+
+    return path;
+}
+
+// Outlines are cached by glyph file path, normalised to a glyph of
+// size 1.0 with its origin on the baseline and y increasing
+// downwards, as for everything else on the page
+
+QMutex glyphCacheMutex;
+std::map<string, QPainterPath> glyphCache;
+
+QPainterPath
+loadGlyphOutline(const vrv::Glyph *glyph)
+{
+    string filename = glyph->GetPath();
+
+    QMutexLocker locker(&glyphCacheMutex);
+
+    auto itr = glyphCache.find(filename);
+    if (itr != glyphCache.end()) {
+        return itr->second;
+    }
+
+    QPainterPath outline;
+    double unitsPerEm = glyph->GetUnitsPerEm();
+    bool flip = false;
+
+    QFile file(QString::fromStdString(filename));
+    if (!file.open(QIODevice::ReadOnly)) {
+        SVDEBUG << "QtDeviceContext: Failed to open glyph file \""
+                << filename << "\"" << endl;
+    } else {
+        QXmlStreamReader reader(&file);
+        while (!reader.atEnd()) {
+            if (reader.readNext() != QXmlStreamReader::StartElement) {
+                continue;
+            }
+            auto attrs = reader.attributes();
+            if (reader.name() == QString("symbol")) {
+                QStringList vb = attrs.value("viewBox").toString()
+                    .split(' ', Qt::SkipEmptyParts);
+                if (vb.size() == 4 && vb[3].toDouble() > 0.0) {
+                    unitsPerEm = vb[3].toDouble();
+                }
+            } else if (reader.name() == QString("path")) {
+                flip = attrs.value("transform").toString()
+                    .contains("scale(1,-1)");
+                outline = parsePathData(attrs.value("d").toString());
+                break;
+            }
+        }
+    }
+
+    if (unitsPerEm > 0.0) {
+        double s = 1.0 / unitsPerEm;
+        outline = QTransform::fromScale(s, flip ? -s : s).map(outline);
+    }
+
+    glyphCache[filename] = outline;
+    return outline;
+}
+
+}
+
+QtDeviceContext::QtDeviceContext() :
+    m_page(make_shared<ScorePage>()),
+    m_originX(0),
+    m_originY(0),
+    m_textAlignment(vrv::HORIZONTALALIGNMENT_left),
+    m_textRunStart(-1),
+    m_textRunStartX(0.0)
+{
+}
+
+QtDeviceContext::~QtDeviceContext()
+{
+}
+
+shared_ptr<ScorePage>
+QtDeviceContext::takePage()
+{
+    auto page = m_page;
+    m_page = make_shared<ScorePage>();
+    m_elementStack.clear();
+    m_glyphIndex.clear();
+    m_elementStaff.clear();
+    m_staffLines.clear();
+    m_noteElements.clear();
+    m_systemElements.clear();
+    return page;
+}
+
+void
+QtDeviceContext::SetBackground(int, int)
+{
+}
+
+void
+QtDeviceContext::SetBackgroundImage(void *, double)
+{
+}
+
+void
+QtDeviceContext::SetBackgroundMode(int)
+{
+}
+
+void
+QtDeviceContext::SetTextForeground(int)
+{
+}
+
+void
+QtDeviceContext::SetTextBackground(int)
+{
+}
+
+void
+QtDeviceContext::SetLogicalOrigin(int x, int y)
+{
+    m_originX = -x;
+    m_originY = -y;
+}
+
+vrv::Point
+QtDeviceContext::GetLogicalOrigin()
+{
+    return vrv::Point(m_originX, m_originY);
+}
+
+QColor
+QtDeviceContext::colourFor(int colour, double opacity) const
+{
+    QColor c(Qt::black);
+    if (colour != vrv::AxNONE) {
+        c = QColor((colour >> 16) & 255, (colour >> 8) & 255, colour & 255);
+    }
+    if (opacity < 1.0) {
+        c.setAlphaF(std::max(opacity, 0.0));
+    }
+    return c;
+}
+
+int
+QtDeviceContext::currentPen()
+{
+    QPen pen(Qt::black);
+    pen.setCapStyle(Qt::FlatCap);
+    pen.setJoinStyle(Qt::MiterJoin);
+
+    if (!m_penStack.empty()) {
+        const vrv::Pen &vp = m_penStack.top();
+        if (vp.GetWidth() <= 0) {
+            return -1;
+        }
+        pen.setColor(colourFor(vp.GetColour(), 1.0));
+        pen.setWidthF(vp.GetWidth());
+        if (vp.GetDashLength() > 0) {
+            double w = vp.GetWidth();
+            double dash = vp.GetDashLength();
+            double gap = (vp.GetGapLength() > 0 ? vp.GetGapLength() : dash);
+            pen.setDashPattern({ dash / w, gap / w });
+        }
+    }
+
+    auto &pens = m_page->m_pens;
+    for (int i = int(pens.size()) - 1; i >= 0; --i) {
+        if (pens[i] == pen) return i;
+    }
+    pens.push_back(pen);
+    return int(pens.size()) - 1;
+}
+
+int
+QtDeviceContext::currentBrush()
+{
+    QBrush brush(Qt::black);
+
+    if (!m_brushStack.empty()) {
+        const vrv::Brush &vb = m_brushStack.top();
+        brush = QBrush(colourFor(vb.GetColour(), vb.GetOpacity()));
+    }
+
+    auto &brushes = m_page->m_brushes;
+    for (int i = int(brushes.size()) - 1; i >= 0; --i) {
+        if (brushes[i] == brush) return i;
+    }
+    brushes.push_back(brush);
+    return int(brushes.size()) - 1;
+}
+
+int
+QtDeviceContext::penAsBrush()
+{
+    // Some shapes (slurs and ties, for example) are filled using the
+    // pen colour rather than the brush
+    int pen = currentPen();
+    QBrush brush(pen < 0 ? QColor(Qt::black) : m_page->m_pens[pen].color());
+
+    auto &brushes = m_page->m_brushes;
+    for (int i = int(brushes.size()) - 1; i >= 0; --i) {
+        if (brushes[i] == brush) return i;
+    }
+    brushes.push_back(brush);
+    return int(brushes.size()) - 1;
+}
+
+QFont
+QtDeviceContext::currentFont() const
+{
+    QFont font;
+    if (m_fontStack.empty()) {
+        return font;
+    }
+    const vrv::FontInfo *info = m_fontStack.top();
+    font.setFamily(QString::fromStdString(info->GetFaceName()));
+    font.setPixelSize(std::max(1, info->GetPointSize()));
+    font.setItalic(info->GetStyle() == vrv::FONTSTYLE_italic);
+    font.setBold(info->GetWeight() == vrv::FONTWEIGHT_bold);
+    return font;
+}
+
+void
+QtDeviceContext::addItem(const ScorePage::Item &item, const QRectF &bounds)
+{
+    int index = int(m_page->m_items.size());
+    m_page->m_items.push_back(item);
+
+    if (item.element >= 0) {
+        int system = m_page->m_elements[item.element].system;
+        if (system >= 0) {
+            auto &sys = m_page->m_systems[system];
+            if (sys.firstItem < 0) sys.firstItem = index;
+            sys.endItem = index + 1;
+        }
+    }
+
+    // Text is positioned, and so its bounds known, only when the
+    // run it belongs to is finished
+    if (item.type == ScorePage::ItemType::Text ||
+        (item.type == ScorePage::ItemType::Glyph &&
+         m_textRunStart >= 0)) {
+        return;
+    }
+
+    for (int e = item.element; e >= 0; e = m_page->m_elements[e].parent) {
+        auto &eb = m_page->m_elements[e].bounds;
+        eb = eb.united(bounds);
+    }
+}
+
+void
+QtDeviceContext::addPathItem(const QPainterPath &path, bool filled)
+{
+    ScorePage::Item item;
+    item.type = (filled ? ScorePage::ItemType::Path :
+                 ScorePage::ItemType::Polyline);
+    item.element = (m_elementStack.empty() ? -1 : m_elementStack.back());
+    item.pen = currentPen();
+    item.brush = (filled ? currentBrush() : -1);
+    item.index = int(m_page->m_paths.size());
+    m_page->m_paths.push_back(path);
+    addItem(item, path.boundingRect());
+}
+
+void
+QtDeviceContext::addEllipseItem(QRectF rect)
+{
+    ScorePage::Item item;
+    item.type = ScorePage::ItemType::Ellipse;
+    item.element = (m_elementStack.empty() ? -1 : m_elementStack.back());
+    item.pen = currentPen();
+    item.brush = currentBrush();
+    item.index = -1;
+    item.a = rect.topLeft();
+    item.b = QPointF(rect.width(), rect.height());
+    addItem(item, rect);
+}
+
+int
+QtDeviceContext::glyphIndexFor(char32_t code)
+{
+    auto itr = m_glyphIndex.find(code);
+    if (itr != m_glyphIndex.end()) {
+        return itr->second;
+    }
+
+    const vrv::Resources *resources = GetResources();
+    if (!resources) return -1;
+
+    const vrv::Glyph *glyph = resources->GetGlyph(code);
+    if (!glyph) return -1;
+
+    auto &glyphs = m_page->m_glyphs;
+    glyphs.push_back({ code, loadGlyphOutline(glyph) });
+    m_glyphIndex[code] = int(glyphs.size()) - 1;
+    return int(glyphs.size()) - 1;
+}
+
+void
+QtDeviceContext::addGlyphItem(char32_t code, double size)
+{
+    int index = glyphIndexFor(code);
+    if (index < 0) return;
+
+    QRectF bounds = m_page->m_glyphs[index].outline.boundingRect();
+    bounds = QRectF(m_textCursor.x() + bounds.x() * size,
+                    m_textCursor.y() + bounds.y() * size,
+                    bounds.width() * size,
+                    bounds.height() * size);
+
+    QBrush brush(Qt::black);
+    auto &brushes = m_page->m_brushes;
+    int b = -1;
+    for (int i = int(brushes.size()) - 1; i >= 0; --i) {
+        if (brushes[i] == brush) { b = i; break; }
+    }
+    if (b < 0) {
+        brushes.push_back(brush);
+        b = int(brushes.size()) - 1;
+    }
+
+    ScorePage::Item item;
+    item.type = ScorePage::ItemType::Glyph;
+    item.element = (m_elementStack.empty() ? -1 : m_elementStack.back());
+    item.pen = -1;
+    item.brush = b;
+    item.index = index;
+    item.a = m_textCursor;
+    item.b = QPointF(size, 0.0);
+    addItem(item, bounds);
+
+    const vrv::Glyph *glyph = GetResources()->GetGlyph(code);
+    if (glyph->GetHorizAdvX() > 0) {
+        m_textCursor.rx() +=
+            glyph->GetHorizAdvX() * size / glyph->GetUnitsPerEm();
+    } else {
+        vrv::TextExtend extend;
+        GetSmuflTextExtent(u32string(1, code), &extend);
+        m_textCursor.rx() += extend.m_width;
+    }
+}
+
+void
+QtDeviceContext::addTextItem(const QString &text, double angle)
+{
+    if (text.isEmpty()) return;
+
+    QFont font = currentFont();
+
+    QPen pen(Qt::black);
+    auto &pens = m_page->m_pens;
+    int p = -1;
+    for (int i = int(pens.size()) - 1; i >= 0; --i) {
+        if (pens[i] == pen) { p = i; break; }
+    }
+    if (p < 0) {
+        pens.push_back(pen);
+        p = int(pens.size()) - 1;
+    }
+
+    ScorePage::Item item;
+    item.type = ScorePage::ItemType::Text;
+    item.element = (m_elementStack.empty() ? -1 : m_elementStack.back());
+    item.pen = p;
+    item.brush = -1;
+    item.index = int(m_page->m_texts.size());
+    item.a = m_textCursor;
+    m_page->m_texts.push_back({ text, font, angle });
+    addItem(item, {});
+
+    m_textCursor.rx() += QFontMetricsF(font).horizontalAdvance(text);
+}
+
+void
+QtDeviceContext::finishTextRun()
+{
+    if (m_textRunStart < 0) return;
+
+    double width = m_textCursor.x() - m_textRunStartX;
+    double shift = 0.0;
+    if (m_textAlignment == vrv::HORIZONTALALIGNMENT_center) {
+        shift = -width / 2.0;
+    } else if (m_textAlignment == vrv::HORIZONTALALIGNMENT_right) {
+        shift = -width;
+    }
+
+    auto &items = m_page->m_items;
+    for (int i = m_textRunStart; i < int(items.size()); ++i) {
+
+        auto &item = items[i];
+        QRectF bounds;
+
+        if (item.type == ScorePage::ItemType::Text) {
+            item.a.rx() += shift;
+            const auto &text = m_page->m_texts[item.index];
+            bounds = QFontMetricsF(text.font).boundingRect(text.text)
+                .translated(item.a);
+        } else if (item.type == ScorePage::ItemType::Glyph) {
+            item.a.rx() += shift;
+            double size = item.b.x();
+            bounds = m_page->m_glyphs[item.index].outline.boundingRect();
+            bounds = QRectF(item.a.x() + bounds.x() * size,
+                            item.a.y() + bounds.y() * size,
+                            bounds.width() * size,
+                            bounds.height() * size);
+        } else {
+            continue;
+        }
+
+        for (int e = item.element; e >= 0;
+             e = m_page->m_elements[e].parent) {
+            auto &eb = m_page->m_elements[e].bounds;
+            eb = eb.united(bounds);
+        }
+    }
+
+    m_textRunStart = -1;
+}
+
+void
+QtDeviceContext::DrawSimpleBezierPath(vrv::Point bezier[4])
+{
+    QPainterPath path(map(bezier[0].x, bezier[0].y));
+    path.cubicTo(map(bezier[1].x, bezier[1].y),
+                 map(bezier[2].x, bezier[2].y),
+                 map(bezier[3].x, bezier[3].y));
+    addPathItem(path, false);
+}
+
+void
+QtDeviceContext::DrawComplexBezierPath(vrv::Point bezier1[4],
+                                       vrv::Point bezier2[4])
+{
+    QPainterPath path(map(bezier1[0].x, bezier1[0].y));
+    path.cubicTo(map(bezier1[1].x, bezier1[1].y),
+                 map(bezier1[2].x, bezier1[2].y),
+                 map(bezier1[3].x, bezier1[3].y));
+    path.cubicTo(map(bezier2[2].x, bezier2[2].y),
+                 map(bezier2[1].x, bezier2[1].y),
+                 map(bezier2[0].x, bezier2[0].y));
+    path.closeSubpath();
+
+    ScorePage::Item item;
+    item.type = ScorePage::ItemType::Path;
+    item.element = (m_elementStack.empty() ? -1 : m_elementStack.back());
+    item.pen = currentPen();
+    item.brush = penAsBrush();
+    item.index = int(m_page->m_paths.size());
+    m_page->m_paths.push_back(path);
+    addItem(item, path.boundingRect());
+}
+
+void
+QtDeviceContext::DrawCircle(int x, int y, int radius)
+{
+    DrawEllipse(x - radius, y - radius, 2 * radius, 2 * radius);
+}
+
+void
+QtDeviceContext::DrawEllipse(int x, int y, int width, int height)
+{
+    addEllipseItem(QRectF(map(x, y), QSizeF(width, height)).normalized());
+}
+
+void
+QtDeviceContext::DrawEllipticArc(int x, int y, int width, int height,
+                                 double start, double end)
+{
+    QRectF rect = QRectF(map(x, y), QSizeF(width, height)).normalized();
+    QPainterPath path;
+    path.arcMoveTo(rect, start);
+    path.arcTo(rect, start, end - start);
+    addPathItem(path, false);
+}
+
+void
+QtDeviceContext::DrawLine(int x1, int y1, int x2, int y2)
+{
+    ScorePage::Item item;
+    item.type = ScorePage::ItemType::Line;
+    item.element = (m_elementStack.empty() ? -1 : m_elementStack.back());
+    item.pen = currentPen();
+    item.brush = -1;
+    item.index = -1;
+    item.a = map(x1, y1);
+    item.b = map(x2, y2);
+
+    double hw = (item.pen < 0 ? 0.0 : m_page->m_pens[item.pen].widthF() / 2.0);
+    QRectF bounds = QRectF(item.a, item.b).normalized()
+        .adjusted(-hw, -hw, hw, hw);
+    addItem(item, bounds);
+
+    if (item.element >= 0) {
+        findSystemExtent(item.element, item.a, item.b);
+    }
+}
+
+void
+QtDeviceContext::findSystemExtent(int element, QPointF a, QPointF b)
+{
+    // A system's extent is defined using either the vertical line
+    // that joins its staffs, or if there is only one staff, the
+    // locations of the first and fifth staff lines. Whichever we see
+    // first is used
+    
+    int system = m_page->m_elements[element].system;
+    if (system < 0) return;
+
+    auto &sys = m_page->m_systems[system];
+    if (sys.height > 0.0) return;
+
+    if (a.x() == b.x() && a.y() != b.y()) {
+#ifdef DEBUG_QT_DEVICE_CONTEXT
+        SVDEBUG << "QtDeviceContext: Found extent for system with id \""
+                << sys.id << "\": from " << a.y() << " -> " << b.y() << endl;
+#endif
+        sys.y = std::min(a.y(), b.y());
+        sys.height = fabs(b.y() - a.y());
+        return;
+    }
+
+    int staff = m_elementStaff[element];
+    if (staff >= 0 && a.y() == b.y() && a.x() != b.x()) {
+        auto &lines = m_staffLines[staff];
+        lines.push_back(a.y());
+        if (lines.size() == 5) {
+#ifdef DEBUG_QT_DEVICE_CONTEXT
+            SVDEBUG << "QtDeviceContext: Deducing extent from staff lines as "
+                    << lines[0] << " -> " << lines[4] << endl;
+#endif
+            sys.y = std::min(lines[0], lines[4]);
+            sys.height = fabs(lines[4] - lines[0]);
+        }
+    }
+}
+
+void
+QtDeviceContext::DrawPolyline(int n, vrv::Point points[], bool close)
+{
+    if (n < 2) return;
+    QPainterPath path(map(points[0].x, points[0].y));
+    for (int i = 1; i < n; ++i) {
+        path.lineTo(map(points[i].x, points[i].y));
+    }
+    if (close) {
+        path.closeSubpath();
+    }
+    addPathItem(path, false);
+}
+
+void
+QtDeviceContext::DrawPolygon(int n, vrv::Point points[],
+                             int xoffset, int yoffset)
+{
+    if (n < 2) return;
+    QPainterPath path(map(points[0].x + xoffset, points[0].y + yoffset));
+    for (int i = 1; i < n; ++i) {
+        path.lineTo(map(points[i].x + xoffset, points[i].y + yoffset));
+    }
+    path.closeSubpath();
+    addPathItem(path, true);
+}
+
+void
+QtDeviceContext::DrawRectangle(int x, int y, int width, int height)
+{
+    DrawRoundedRectangle(x, y, width, height, 0);
+}
+
+void
+QtDeviceContext::DrawRoundedRectangle(int x, int y, int width, int height,
+                                      int radius)
+{
+    QRectF rect = QRectF(map(x, y), QSizeF(width, height)).normalized();
+
+    if (radius != 0) {
+        QPainterPath path;
+        path.addRoundedRect(rect, radius, radius);
+        addPathItem(path, true);
+        return;
+    }
+
+    ScorePage::Item item;
+    item.type = ScorePage::ItemType::Rect;
+    item.element = (m_elementStack.empty() ? -1 : m_elementStack.back());
+    item.pen = currentPen();
+    item.brush = currentBrush();
+    item.index = -1;
+    item.a = rect.topLeft();
+    item.b = QPointF(rect.width(), rect.height());
+    addItem(item, rect);
+}
+
+void
+QtDeviceContext::DrawRotatedText(const string &text, int x, int y,
+                                 double angle)
+{
+    QPointF cursor = m_textCursor;
+    m_textCursor = map(x, y);
+
+    int prevRunStart = m_textRunStart;
+    m_textRunStart = int(m_page->m_items.size());
+    m_textRunStartX = m_textCursor.x();
+    vrv::data_HORIZONTALALIGNMENT prevAlignment = m_textAlignment;
+    m_textAlignment = vrv::HORIZONTALALIGNMENT_left;
+
+    addTextItem(QString::fromStdString(text), angle);
+    finishTextRun();
+
+    m_textAlignment = prevAlignment;
+    m_textRunStart = prevRunStart;
+    m_textCursor = cursor;
+}
+
+void
+QtDeviceContext::DrawText(const string &text, const u32string &wtext,
+                          int x, int y, int, int)
+{
+    if (x != VRV_UNSET && y != VRV_UNSET) {
+        finishTextRun();
+        m_textCursor = map(x, y);
+        m_textRunStart = int(m_page->m_items.size());
+        m_textRunStartX = m_textCursor.x();
+    }
+
+    if (wtext.empty()) {
+        addTextItem(QString::fromStdString(text), 0.0);
+        return;
+    }
+
+    // Characters from the SMuFL range are drawn as glyphs from the
+    // music font; runs of anything else as ordinary text
+
+    double size = (m_fontStack.empty() ? 0.0 :
+                   m_fontStack.top()->GetPointSize());
+
+    u32string run;
+
+    for (char32_t c : wtext) {
+        if (c >= 0xE000 && c <= 0xF8FF) {
+            if (!run.empty()) {
+                addTextItem(QString::fromUcs4(run.data(), int(run.size())),
+                            0.0);
+                run.clear();
+            }
+            addGlyphItem(c, size);
+        } else {
+            run.push_back(c);
+        }
+    }
+
+    if (!run.empty()) {
+        addTextItem(QString::fromUcs4(run.data(), int(run.size())), 0.0);
+    }
+}
+
+void
+QtDeviceContext::DrawMusicText(const u32string &text, int x, int y, bool)
+{
+    if (m_fontStack.empty()) return;
+
+    double size = m_fontStack.top()->GetPointSize();
+
+    QPointF cursor = m_textCursor;
+    int runStart = m_textRunStart;
+    m_textRunStart = -1;
+    m_textCursor = map(x, y);
+
+    for (char32_t c : text) {
+        addGlyphItem(c, size);
+    }
+
+    m_textCursor = cursor;
+    m_textRunStart = runStart;
+}
+
+void
+QtDeviceContext::DrawSpline(int, vrv::Point [])
+{
+}
+
+void
+QtDeviceContext::DrawGraphicUri(int, int, int, int, const string &)
+{
+}
+
+void
+QtDeviceContext::DrawSvgShape(int, int, int, int, double, pugi::xml_node)
+{
+}
+
+void
+QtDeviceContext::DrawBackgroundImage(int, int)
+{
+}
+
+void
+QtDeviceContext::StartText(int x, int y,
+                           vrv::data_HORIZONTALALIGNMENT alignment)
+{
+    finishTextRun();
+    m_textCursor = map(x, y);
+    m_textAlignment = alignment;
+    m_textRunStart = int(m_page->m_items.size());
+    m_textRunStartX = m_textCursor.x();
+}
+
+void
+QtDeviceContext::MoveTextTo(int x, int y,
+                            vrv::data_HORIZONTALALIGNMENT alignment)
+{
+    finishTextRun();
+    m_textCursor = map(x, y);
+    m_textAlignment = alignment;
+    m_textRunStart = int(m_page->m_items.size());
+    m_textRunStartX = m_textCursor.x();
+}
+
+void
+QtDeviceContext::MoveTextVerticallyTo(int y)
+{
+    finishTextRun();
+    m_textCursor.setY(y + m_originY);
+    m_textRunStart = int(m_page->m_items.size());
+    m_textRunStartX = m_textCursor.x();
+}
+
+void
+QtDeviceContext::EndText()
+{
+    finishTextRun();
+}
+
+void
+QtDeviceContext::startElement(vrv::Object *object,
+                              const string &gClass,
+                              const string &gId)
+{
+    ScorePage::Element element;
+
+    string type = object->GetClassName();
+    if (!type.empty()) {
+        type[0] = char(tolower(type[0]));
+    }
+    element.type = QString::fromStdString(type);
+    element.id = QString::fromStdString(gId);
+    element.parent = (m_elementStack.empty() ? -1 : m_elementStack.back());
+
+#ifdef DEBUG_QT_DEVICE_CONTEXT
+    SVDEBUG << "QtDeviceContext::startElement: type " << element.type
+            << ", class \"" << gClass << "\", id \"" << element.id
+            << "\", parent " << element.parent << endl;
+#else
+    (void)gClass;
+#endif
+
+    int index = int(m_page->m_elements.size());
+    if (!element.id.isEmpty()) {
+        m_page->m_elementIndex[element.id] = index;
+    }
+
+    int parent = element.parent;
+    int system = (parent >= 0 ? m_page->m_elements[parent].system : -1);
+    int staff = (parent >= 0 ? m_elementStaff[parent] : -1);
+    bool isSystem = (element.type == "system");
+    bool isStaff = (element.type == "staff");
+
+    if (staff < 0 && isStaff) {
+        staff = index;
+    }
+    if (system < 0 && (isSystem || isStaff)) {
+        // A staff outside any system stands in for its own system
+        system = int(m_page->m_systems.size());
+        m_page->m_systems.push_back({ element.id, 0.0, 0.0, {}, -1, -1 });
+        m_systemElements.push_back(index);
+    }
+    
+    if (element.type == "note" && !element.id.isEmpty()) {
+        m_page->m_noteIndex[element.id] = int(m_page->m_notes.size());
+        m_page->m_notes.push_back({ element.id, {}, system });
+        m_noteElements.push_back(index);
+    }
+    
+    element.system = system;
+    m_page->m_elements.push_back(element);
+    m_elementStaff.push_back(staff);
+    m_elementStack.push_back(index);
+}
+
+void
+QtDeviceContext::endElement()
+{
+    if (!m_elementStack.empty()) {
+        m_elementStack.pop_back();
+    }
+}
+
+void
+QtDeviceContext::StartGraphic(vrv::Object *object, string gClass,
+                              string gId, vrv::GraphicID, bool)
+{
+    startElement(object, gClass, gId);
+}
+
+void
+QtDeviceContext::EndGraphic(vrv::Object *, vrv::View *)
+{
+    endElement();
+}
+
+void
+QtDeviceContext::ResumeGraphic(vrv::Object *object, string gId)
+{
+    auto itr = m_page->m_elementIndex.find(QString::fromStdString(gId));
+    if (itr == m_page->m_elementIndex.end()) {
+        startElement(object, "", gId);
+    } else {
+        m_elementStack.push_back(*itr);
+    }
+}
+
+void
+QtDeviceContext::EndResumedGraphic(vrv::Object *, vrv::View *)
+{
+    endElement();
+}
+
+void
+QtDeviceContext::StartTextGraphic(vrv::Object *object, string gClass,
+                                  string gId)
+{
+    startElement(object, gClass, gId);
+}
+
+void
+QtDeviceContext::EndTextGraphic(vrv::Object *, vrv::View *)
+{
+    endElement();
+}
+
+void
+QtDeviceContext::RotateGraphic(vrv::Point const &, double)
+{
+    // Rotation is not recorded
+}
+
+void
+QtDeviceContext::StartPage()
+{
+    m_page->m_size = QSizeF(GetWidth() * DEFINITION_FACTOR,
+                            GetHeight() * DEFINITION_FACTOR);
+    m_elementStack.clear();
+    m_textRunStart = -1;
+}
+
+void
+QtDeviceContext::EndPage()
+{
+    finishTextRun();
+    m_elementStack.clear();
+
+    // Only now are the bounds of all notes complete
+    auto &notes = m_page->m_notes;
+    for (int i = 0; i < int(notes.size()); ++i) {
+        notes[i].bounds = m_page->m_elements[m_noteElements[i]].bounds;
+    }
+    auto &systems = m_page->m_systems;
+    for (int i = 0; i < int(systems.size()); ++i) {
+        systems[i].bounds = m_page->m_elements[m_systemElements[i]].bounds;
+    }
+
+#ifdef DEBUG_QT_DEVICE_CONTEXT
+    SVDEBUG << "QtDeviceContext::EndPage: recorded "
+            << m_page->m_items.size() << " items, "
+            << m_page->m_elements.size() << " elements, "
+            << m_page->m_notes.size() << " notes in "
+            << m_page->m_systems.size() << " systems, "
+            << m_page->m_glyphs.size() << " distinct glyphs" << endl;
+#endif
+}
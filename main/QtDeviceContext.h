@@ -0,0 +1,153 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_QT_DEVICE_CONTEXT_H
+#define SV_QT_DEVICE_CONTEXT_H
+
+#include "verovio/include/vrv/devicecontext.h"
+
+#include "ScorePage.h"
+
+#include <memory>
+#include <vector>
+#include <map>
+
+/**
+ * A Verovio DeviceContext that records a page into a ScorePage
+ * display list, for use with vrv::Toolkit::RenderToDeviceContext.
+ * This avoids generating SVG text and parsing it again in order to
+ * show the score.
+ *
+ * SMuFL glyph outlines are loaded from the Verovio resource files
+ * the first time each glyph is used and are shared by all pages.
+ * Graphics that we never expect to see in a score shown in this
+ * application (embedded images and SVG shapes, background images)
+ * are ignored.
+ */
+class QtDeviceContext : public vrv::DeviceContext
+{
+public:
+    QtDeviceContext();
+    virtual ~QtDeviceContext();
+
+    /**
+     * Return the page recorded since the last call, and start a new
+     * one.
+     */
+    std::shared_ptr<ScorePage> takePage();
+
+    void SetBackground(int colour, int style) override;
+    void SetBackgroundImage(void *image, double opacity) override;
+    void SetBackgroundMode(int mode) override;
+    void SetTextForeground(int colour) override;
+    void SetTextBackground(int colour) override;
+    void SetLogicalOrigin(int x, int y) override;
+
+    vrv::Point GetLogicalOrigin() override;
+
+    void DrawSimpleBezierPath(vrv::Point bezier[4]) override;
+    void DrawComplexBezierPath(vrv::Point bezier1[4],
+                               vrv::Point bezier2[4]) override;
+    void DrawCircle(int x, int y, int radius) override;
+    void DrawEllipse(int x, int y, int width, int height) override;
+    void DrawEllipticArc(int x, int y, int width, int height,
+                         double start, double end) override;
+    void DrawLine(int x1, int y1, int x2, int y2) override;
+    void DrawPolyline(int n, vrv::Point points[], bool close = false) override;
+    void DrawPolygon(int n, vrv::Point points[],
+                     int xoffset = 0, int yoffset = 0) override;
+    void DrawRectangle(int x, int y, int width, int height) override;
+    void DrawRotatedText(const std::string &text, int x, int y,
+                         double angle) override;
+    void DrawRoundedRectangle(int x, int y, int width, int height,
+                              int radius) override;
+    void DrawText(const std::string &text,
+                  const std::u32string &wtext = U"",
+                  int x = VRV_UNSET, int y = VRV_UNSET,
+                  int width = VRV_UNSET, int height = VRV_UNSET) override;
+    void DrawMusicText(const std::u32string &text, int x, int y,
+                       bool setSmuflGlyph = false) override;
+    void DrawSpline(int n, vrv::Point points[]) override;
+    void DrawGraphicUri(int x, int y, int width, int height,
+                        const std::string &uri) override;
+    void DrawSvgShape(int x, int y, int width, int height, double scale,
+                      pugi::xml_node svg) override;
+    void DrawBackgroundImage(int x = 0, int y = 0) override;
+
+    void MoveTextTo(int x, int y,
+                    vrv::data_HORIZONTALALIGNMENT alignment) override;
+    void MoveTextVerticallyTo(int y) override;
+    void StartText(int x, int y, vrv::data_HORIZONTALALIGNMENT alignment =
+                   vrv::HORIZONTALALIGNMENT_left) override;
+    void EndText() override;
+
+    void StartGraphic(vrv::Object *object, std::string gClass,
+                      std::string gId, vrv::GraphicID graphicID = vrv::PRIMARY,
+                      bool preprocessDash = false) override;
+    void EndGraphic(vrv::Object *object, vrv::View *view) override;
+    void ResumeGraphic(vrv::Object *object, std::string gId) override;
+    void EndResumedGraphic(vrv::Object *object, vrv::View *view) override;
+    void StartTextGraphic(vrv::Object *object, std::string gClass,
+                          std::string gId) override;
+    void EndTextGraphic(vrv::Object *object, vrv::View *view) override;
+    void RotateGraphic(vrv::Point const &orig, double angle) override;
+
+    void StartPage() override;
+    void EndPage() override;
+
+private:
+    std::shared_ptr<ScorePage> m_page;
+
+    int m_originX;
+    int m_originY;
+
+    std::vector<int> m_elementStack;
+    std::map<char32_t, int> m_glyphIndex; // code -> index in page glyphs
+
+    // Per element: element index of the enclosing staff (or -1). The
+    // enclosing system is recorded in the page's element table
+    std::vector<int> m_elementStaff;
+    std::map<int, std::vector<double>> m_staffLines; // staff -> line ys
+    std::vector<int> m_noteElements; // per page note, its element index
+    std::vector<int> m_systemElements; // per page system, its element index
+
+    // Text runs: a run starts at StartText or MoveTextTo and is
+    // shifted according to its alignment when it ends
+    QPointF m_textCursor;
+    vrv::data_HORIZONTALALIGNMENT m_textAlignment;
+    int m_textRunStart;
+    double m_textRunStartX;
+
+    QPointF map(int x, int y) const {
+        return QPointF(x + m_originX, y + m_originY);
+    }
+
+    int currentPen();
+    int currentBrush();
+    int penAsBrush();
+    QColor colourFor(int colour, double opacity) const;
+    QFont currentFont() const;
+
+    int glyphIndexFor(char32_t code);
+    void addItem(const ScorePage::Item &item, const QRectF &bounds);
+    void findSystemExtent(int element, QPointF a, QPointF b);
+    void addPathItem(const QPainterPath &path, bool filled);
+    void addEllipseItem(QRectF rect);
+    void addTextItem(const QString &text, double angle);
+    void addGlyphItem(char32_t code, double size);
+    void startElement(vrv::Object *object, const std::string &gClass,
+                      const std::string &gId);
+    void endElement();
+    void finishTextRun();
+};
+
+#endif
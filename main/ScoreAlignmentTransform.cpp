@@ -14,7 +14,17 @@
 
 #include "transform/TransformFactory.h"
 
+#include <vamp-hostsdk/PluginHostAdapter.h>
+
 #include <QMutexLocker>
+#include <QSettings>
+#include <QThread>
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QCryptographicHash>
+
+#include <future>
 
 using namespace sv;
 
@@ -41,26 +51,156 @@ ScoreAlignmentTransform::getAvailableAlignmentTransforms()
 
     m_transforms.clear();
 
+    QString fingerprint = getPluginFingerprint();
+    
+    if (readCache(fingerprint, m_transforms)) {
+        SVDEBUG << "ScoreAlignmentTransform: plugin libraries unchanged, "
+                << "using " << m_transforms.size()
+                << " cached alignment transforms" << endl;
+        m_queried = true;
+        return m_transforms;
+    }
+    
     auto allTransforms =
         TransformFactory::getInstance()->getInstalledTransformDescriptions();
 
     for (const auto &desc : allTransforms) {
+
+        // The output is the last element of the transform identifier
+        // (type:library:plugin:output), so there is no need to
+        // construct a Transform to find it
+        
         TransformId identifier = desc.identifier;
-        Transform transform;
-        transform.setIdentifier(identifier);
-        SVDEBUG << "ScoreAlignmentTransform: looking at transform "
-                << identifier << " with output \"" << transform.getOutput()
-                << "\"" << endl;
-        if (transform.getOutput() == ALIGNMENT_OUTPUT_NAME) {
-            SVDEBUG << "ScoreAlignmentTransform: it's a candidate" << endl;
+        if (identifier.section(':', -1) == ALIGNMENT_OUTPUT_NAME) {
+            SVDEBUG << "ScoreAlignmentTransform: transform " << identifier
+                    << " is a candidate" << endl;
             m_transforms.push_back(desc);
         }
     }
 
+    writeCache(fingerprint, m_transforms);
+    
     m_queried = true;
     return m_transforms;
 }
 
+QThread *
+ScoreAlignmentTransform::createWarmingThread()
+{
+    QThread *thread = QThread::create([]() {
+        (void)getAvailableAlignmentTransforms();
+    });
+    thread->setObjectName("ScoreAlignmentTransform");
+    QObject::connect(thread, &QThread::finished,
+                     thread, &QObject::deleteLater);
+    return thread;
+}
+
+QString
+ScoreAlignmentTransform::getPluginFingerprint()
+{
+    // Identify the installed Vamp plugin libraries by path,
+    // modification time and size. The plugin directories are
+    // listed concurrently, as some may be on slow filesystems
+    
+    auto path = Vamp::PluginHostAdapter::getPluginPath();
+
+    std::vector<std::future<QStringList>> futures;
+    for (const auto &dir : path) {
+        QString dirName = QString::fromStdString(dir);
+        futures.push_back(std::async(std::launch::async, [dirName]() {
+            QStringList entries;
+            QDir d(dirName);
+            if (!d.exists()) {
+                return entries;
+            }
+            QFileInfoList files = d.entryInfoList
+                ({ "*.so", "*.dylib", "*.dll" }, QDir::Files, QDir::Name);
+            for (const auto &f : files) {
+                entries << QString("%1|%2|%3")
+                    .arg(f.absoluteFilePath())
+                    .arg(f.lastModified().toMSecsSinceEpoch())
+                    .arg(f.size());
+            }
+            return entries;
+        }));
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    for (int i = 0; i < int(futures.size()); ++i) {
+        hash.addData(QByteArray::fromStdString(path[i]));
+        for (const auto &entry : futures[i].get()) {
+            hash.addData(entry.toUtf8());
+        }
+    }
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+bool
+ScoreAlignmentTransform::readCache(QString fingerprint, TransformList &transforms)
+{
+    QSettings settings;
+    settings.beginGroup("ScoreAlignmentTransformCache");
+
+    if (settings.value("fingerprint").toString() != fingerprint) {
+        settings.endGroup();
+        return false;
+    }
+
+    int n = settings.beginReadArray("transforms");
+    for (int i = 0; i < n; ++i) {
+        settings.setArrayIndex(i);
+        TransformDescription desc;
+        desc.type = TransformDescription::Type
+            (settings.value("type").toInt());
+        desc.category = settings.value("category").toString();
+        desc.identifier = settings.value("identifier").toString();
+        desc.name = settings.value("name").toString();
+        desc.friendlyName = settings.value("friendlyName").toString();
+        desc.description = settings.value("description").toString();
+        desc.longDescription = settings.value("longDescription").toString();
+        desc.maker = settings.value("maker").toString();
+        desc.units = settings.value("units").toString();
+        desc.pluginName = settings.value("pluginName").toString();
+        desc.configurable = settings.value("configurable").toBool();
+        transforms.push_back(desc);
+    }
+    settings.endArray();
+    settings.endGroup();
+
+    // An empty list is not cached as such, in case plugins were
+    // simply failing to load last time
+    return !transforms.empty();
+}
+
+void
+ScoreAlignmentTransform::writeCache(QString fingerprint,
+                                    const TransformList &transforms)
+{
+    QSettings settings;
+    settings.beginGroup("ScoreAlignmentTransformCache");
+    settings.remove("");
+    settings.setValue("fingerprint", fingerprint);
+    settings.beginWriteArray("transforms", int(transforms.size()));
+    for (int i = 0; i < int(transforms.size()); ++i) {
+        const auto &desc = transforms[i];
+        settings.setArrayIndex(i);
+        settings.setValue("type", int(desc.type));
+        settings.setValue("category", desc.category);
+        settings.setValue("identifier", desc.identifier);
+        settings.setValue("name", desc.name);
+        settings.setValue("friendlyName", desc.friendlyName);
+        settings.setValue("description", desc.description);
+        settings.setValue("longDescription", desc.longDescription);
+        settings.setValue("maker", desc.maker);
+        settings.setValue("units", desc.units);
+        settings.setValue("pluginName", desc.pluginName);
+        settings.setValue("configurable", desc.configurable);
+    }
+    settings.endArray();
+    settings.endGroup();
+}
+
 TransformId
 ScoreAlignmentTransform::getDefaultAlignmentTransform()
 {
@@ -17,16 +17,39 @@
 
 #include <QMutex>
 
+class QThread;
+
 class ScoreAlignmentTransform
 {
 public:
+    /**
+     * Return the installed transforms that produce an audio-to-score
+     * alignment. If the plugin libraries are unchanged since the
+     * list was last found, it is read from a cache in the settings
+     * without waiting for the transform factory to scan plugins;
+     * otherwise this blocks until the scan is complete.
+     */
     static sv::TransformList getAvailableAlignmentTransforms();
     static sv::TransformId getDefaultAlignmentTransform();
 
+    /**
+     * Create (but do not start) a thread that will find the
+     * available alignment transforms, so that a later call to
+     * getAvailableAlignmentTransforms returns at once. The caller
+     * should connect to the thread's finished signal if it wants to
+     * know when this is done, then start it. The thread deletes
+     * itself when finished.
+     */
+    static QThread *createWarmingThread();
+
 private:
     static QMutex m_mutex;
     static bool m_queried;
     static sv::TransformList m_transforms;
+
+    static QString getPluginFingerprint();
+    static bool readCache(QString fingerprint, sv::TransformList &);
+    static void writeCache(QString fingerprint, const sv::TransformList &);
 };
 
 #endif
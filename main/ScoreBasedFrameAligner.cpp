@@ -0,0 +1,204 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "ScoreBasedFrameAligner.h"
+#include "Session.h"
+#include "Tracing.h"
+
+#include "view/Pane.h"
+#include "layer/TimeInstantLayer.h"
+#include "data/model/SparseOneDimensionalModel.h"
+#include "base/Debug.h"
+
+#include <QRegularExpression>
+#include <QStringList>
+
+#include <cmath>
+
+using namespace sv;
+
+sv_frame_t
+ScoreBasedFrameAligner::map(const View *forView, sv_frame_t frame) const
+{
+    TraceScope trace("ScoreBasedFrameAligner::map", "follow");
+
+    auto sourcePane = m_session->getPaneContainingOnsetsLayer();
+    if (forView == sourcePane) {
+        return frame;
+    }
+
+    Pane *targetPane =
+        const_cast<Pane *>(dynamic_cast<const Pane *>(forView));
+    auto targetLayer = m_session->getOnsetsLayerFromPane(targetPane);
+    if (!targetLayer) {
+        return frame;
+    }
+
+    QString label;
+    double proportion;
+
+    mapToScoreLabelAndProportion(m_session->getOnsetsLayer(),
+                                 frame, label, proportion);
+
+    mapFromScoreLabelAndProportion(targetLayer,
+                                   label, proportion, frame);
+    
+    return frame;
+}
+
+QString
+ScoreBasedFrameAligner::mapToScoreLabel(sv_frame_t frame) const
+{
+    TraceScope trace("ScoreBasedFrameAligner::mapToScoreLabel", "follow");
+
+    TimeInstantLayer *layer = m_session->getOnsetsLayer();
+    if (!layer) {
+        return {};
+    }
+    
+    QString label;
+    double proportion;
+    mapToScoreLabelAndProportion(layer, frame, label, proportion);
+    return label;
+}
+
+void
+ScoreBasedFrameAligner::mapToScoreLabelAndProportion(Layer *layer,
+                                                     sv_frame_t frame,
+                                                     QString &label,
+                                                     double &proportion) const
+{
+    //!!! Much too slow - rework with search & cacheing
+
+    label = "";
+    proportion = 0.0;
+    if (!layer) {
+        return;
+    }
+    
+    ModelId targetId = layer->getModel();
+    auto targetModel = ModelById::getAs<SparseOneDimensionalModel>(targetId);
+    auto events = targetModel->getAllEvents();
+    if (events.empty()) {
+        return;
+    }
+    
+    label = events[0].getLabel();
+    bool found = false;
+    int eventCount = targetModel->getEventCount();
+    for (int i = 1; i < eventCount; ++i) {
+        sv_frame_t eventFrame = events[i].getFrame();
+        if (frame < eventFrame) {
+            label = events[i-1].getLabel();
+            sv_frame_t priorEventFrame = events[i-1].getFrame();
+            if (priorEventFrame < eventFrame) {
+                proportion = double(frame - priorEventFrame) /
+                    double(eventFrame - priorEventFrame);
+            }
+            found = true;
+            break;
+        } else if (frame == eventFrame) {
+            label = events[i].getLabel();
+            found = true;
+            break;
+        }
+    }
+    if (!found && eventCount > 0) {
+        label = events[eventCount-1].getLabel();
+    }
+}
+
+void
+ScoreBasedFrameAligner::mapFromScoreLabelAndProportion(Layer *layer,
+                                                       QString label,
+                                                       double proportion,
+                                                       sv_frame_t &frame) const
+{
+    //!!! miserably slow (I assume! - measure it - but at any rate
+    //!!! this is doing the same query as in
+    //!!! mapToScoreLabelAndProportion all over again)
+
+    if (!layer) {
+        return; // leave frame unchanged
+    }
+    
+    frame = 0;
+    
+    ModelId targetId = layer->getModel();
+    mapFromScoreLabelAndProportion(targetId, label, proportion, frame);
+}
+
+void
+ScoreBasedFrameAligner::mapFromScoreLabelAndProportion(ModelId targetModelId,
+                                                       QString label,
+                                                       double proportion,
+                                                       sv_frame_t &frame) const
+{
+    frame = 0;
+    auto targetModel = ModelById::getAs<SparseOneDimensionalModel>(targetModelId);
+    if (!targetModel) {
+        SVDEBUG << "ERROR: mapFromScoreLabelAndProportion: model is not a SparseOneDimensionalModel" << endl;
+        return;
+    }
+    auto events = targetModel->getAllEvents();
+    int eventCount = targetModel->getEventCount();
+    bool found = false;
+    for (int i = 0; i < eventCount; ++i) {
+        if (label == events[i].getLabel()) {
+            found = true;
+            sv_frame_t eventFrame = events[i].getFrame();
+            if (proportion == 0.0 || i + 1 == eventCount) {
+                frame = eventFrame;
+                break;
+            } else {
+                frame = sv_frame_t
+                    (round(eventFrame + proportion *
+                           (events[i+1].getFrame() - eventFrame)));
+                break;
+            }
+        }
+    }
+    if (!found) {
+        for (int i = 0; i < eventCount; ++i) {
+            frame = events[i].getFrame();
+            if (labelLessThan(label, events[i].getLabel())) {
+                if (i > 0) {
+                    frame = events[i-1].getFrame();
+                }
+                return;
+            }
+        }
+    }
+}
+
+bool
+ScoreBasedFrameAligner::labelLessThan(QString first, QString second)
+{
+    if (first == second) {
+        return false;
+    }
+    static QRegularExpression punct("[^0-9]");
+    QStringList firstBits = first.split(punct, Qt::SkipEmptyParts);
+    QStringList secondBits = second.split(punct, Qt::SkipEmptyParts);
+    if (firstBits.size() < 2 || secondBits.size() < 2) {
+        return false;
+    }
+    int i0 = firstBits[0].toInt(), i1 = secondBits[0].toInt();
+    if (i0 > i1) {
+        return false;
+    } else if (i0 == i1) {
+        if (firstBits[1].toInt() >= secondBits[1].toInt()) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,65 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_SCORE_BASED_FRAME_ALIGNER_H
+#define SV_SCORE_BASED_FRAME_ALIGNER_H
+
+#include "view/View.h"
+#include "data/model/Model.h"
+
+#include <QString>
+
+class Session;
+
+namespace sv {
+class Layer;
+}
+
+/**
+ * Playback frame aligner that maps between recordings by way of the
+ * score: a frame in the recording whose onsets layer is active is
+ * mapped to a score label and a proportion of the way to the next
+ * onset, and that label and proportion are mapped back to a frame
+ * through the onsets layer of the target view.
+ */
+class ScoreBasedFrameAligner : public sv::View::PlaybackFrameAligner
+{
+public:
+    ScoreBasedFrameAligner(Session *session) : m_session(session) { }
+
+    sv::sv_frame_t map(const sv::View *forView,
+                       sv::sv_frame_t frame) const override;
+
+    QString mapToScoreLabel(sv::sv_frame_t frame) const;
+
+    void mapToScoreLabelAndProportion(sv::Layer *layer,
+                                      sv::sv_frame_t frame,
+                                      QString &label,
+                                      double &proportion) const;
+
+    void mapFromScoreLabelAndProportion(sv::Layer *layer,
+                                        QString label,
+                                        double proportion,
+                                        sv::sv_frame_t &frame) const;
+
+    void mapFromScoreLabelAndProportion(sv::ModelId targetModelId,
+                                        QString label,
+                                        double proportion,
+                                        sv::sv_frame_t &frame) const;
+    
+private:
+    Session *m_session;
+
+    static bool labelLessThan(QString first, QString second);
+};
+
+#endif
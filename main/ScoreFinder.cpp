@@ -14,13 +14,17 @@
 #include "base/Debug.h"
 #include "system/System.h"
 
+#include <chrono>
 #include <filesystem>
 #include <vector>
 #include <set>
 
 #include <QCoreApplication>
+#include <QCryptographicHash>
 #include <QFileInfo>
+#include <QFile>
 #include <QDir>
+#include <QSettings>
 
 using std::string;
 using std::vector;
@@ -102,70 +106,351 @@ ScoreFinder::getBundledScoreDirectory()
     return getBundledDirectory("Scores");
 }
 
-vector<string>
-ScoreFinder::getScoreNames()
+QMutex
+ScoreFinder::m_mutex;
+
+bool
+ScoreFinder::m_indexLoaded = false;
+
+bool
+ScoreFinder::m_indexChanged = false;
+
+ScoreFinder::IndexedRoot
+ScoreFinder::m_roots[2];
+
+static
+int64_t
+getModified(string path)
 {
-    vector<string> scoreDirs
-        { getUserScoreDirectory(), getBundledScoreDirectory() };
-    vector<string> names;
+    // Return the modification time of the given directory, or -1 if
+    // it does not exist. Return 0 if it was modified so recently that
+    // a further change might leave the time unchanged, given the
+    // coarse timestamps of some filesystems: 0 never matches a time
+    // recorded in the index, so the directory will be looked at again
     
-    for (auto scoreDir : scoreDirs) {
-        
-        if (scoreDir == "") continue;
+    std::error_code ec;
+    auto modified = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return -1;
+    }
+    if (std::filesystem::file_time_type::clock::now() - modified <
+        std::chrono::seconds(2)) {
+        return 0;
+    }
+    return int64_t(modified.time_since_epoch().count());
+}
+
+void
+ScoreFinder::refreshRoot(int i)
+{
+    IndexedRoot &root = m_roots[i];
+    
+    string path = (i == 0 ?
+                   getUserScoreDirectory() :
+                   getBundledScoreDirectory());
+
+    if (path != root.path) {
+        root = IndexedRoot();
+        root.path = path;
+        m_indexChanged = true;
+    }
 
-        for (const auto& entry : std::filesystem::directory_iterator(scoreDir)) {
+    if (path == "") {
+        return;
+    }
 
-            string name = entry.path().filename().string();
-            if (name.size() == 0 || name[0] == '.') continue;
+    int64_t modified = getModified(path);
+    if (modified > 0 && modified == root.modified) {
+        return;
+    }
 
-            std::filesystem::path dir(entry.path());
-            if (std::filesystem::exists(dir) &&
-                std::filesystem::is_directory(dir)) {
-                names.push_back(name);
-            }
+    std::unordered_map<string, IndexedScore> scores;
+    bool changed = (modified != root.modified);
+    
+    for (const auto& entry : std::filesystem::directory_iterator(path)) {
+
+        string name = entry.path().filename().string();
+        if (name.size() == 0 || name[0] == '.') continue;
+
+        std::error_code ec;
+        if (!entry.is_directory(ec)) continue;
+
+        auto itr = root.scores.find(name);
+        if (itr != root.scores.end()) {
+            scores[name] = std::move(itr->second);
+        } else {
+            IndexedScore score;
+            score.info.name = name;
+            score.info.directory = entry.path().string();
+            score.info.bundled = (i == 1);
+            scores[name] = score;
+            changed = true;
         }
+    }
 
-        SVDEBUG << "ScoreFinder::getScoreNames: Found \"" << names.size()
-                << "\" potential scores in " << scoreDir << endl;
+    if (scores.size() != root.scores.size()) {
+        changed = true;
     }
+    
+    root.scores.swap(scores);
+    root.modified = modified;
 
-    return names;
+    if (changed) {
+        m_indexChanged = true;
+    }
+    
+    SVDEBUG << "ScoreFinder::refreshRoot: Found " << root.scores.size()
+            << " potential scores in " << path << endl;
 }
 
-string
-ScoreFinder::getScoreFile(string scoreName, string extension)
+bool
+ScoreFinder::refreshScore(IndexedScore &score)
 {
-    vector<string> scoreDirs
-        { getUserScoreDirectory(), getBundledScoreDirectory() };
-    vector<string> names;
+    int64_t modified = getModified(score.info.directory);
+    if (modified < 0) {
+        return false;
+    }
+    if (modified > 0 && modified == score.modified) {
+        return true;
+    }
+
+    std::set<string> extensions;
+    string prefix = score.info.name + ".";
     
-    for (auto scoreDir : scoreDirs) {
-        
-        if (scoreDir == "") continue;
+    for (const auto& entry :
+             std::filesystem::directory_iterator(score.info.directory)) {
+        string filename = entry.path().filename().string();
+        if (filename.size() > prefix.size() &&
+            filename.compare(0, prefix.size(), prefix) == 0) {
+            extensions.insert(filename.substr(prefix.size()));
+        }
+    }
 
-        // Inefficient
-        
-        for (const auto& entry : std::filesystem::directory_iterator(scoreDir)) {
+    if (modified != score.modified || extensions != score.info.extensions) {
+        score.info.extensions = extensions;
+        score.modified = modified;
+        m_indexChanged = true;
+    }
+    
+    return true;
+}
 
-            string name = entry.path().filename().string();
-            if (name != scoreName) continue;
+void
+ScoreFinder::refreshMeiHash(ScoreInfo &info)
+{
+    if (info.extensions.find("mei") == info.extensions.end()) {
+        if (info.meiHash != "") {
+            info.meiHash = "";
+            info.meiSize = 0;
+            info.meiModified = 0;
+            m_indexChanged = true;
+        }
+        return;
+    }
 
-            std::filesystem::path filePath =
-                entry.path().string() + "/" + scoreName + "." + extension;
+    // An MEI file may be rewritten in place without changing the
+    // directory's modification time, so check the file itself
+    
+    QFileInfo fileInfo(QString::fromStdString
+                       (info.directory + "/" + info.name + ".mei"));
+    int64_t size = fileInfo.size();
+    int64_t modified = fileInfo.lastModified().toMSecsSinceEpoch();
+    if (info.meiHash != "" &&
+        size == info.meiSize && modified == info.meiModified) {
+        return;
+    }
 
-            if (!std::filesystem::exists(filePath)) {
-                SVDEBUG << "ScoreFinder::getScoreFile: Score file \""
-                        << filePath << "\" does not exist" << endl;
-                return {};
-            } else {
-                return filePath.string();
+    QFile file(fileInfo.filePath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        SVDEBUG << "ScoreFinder::refreshMeiHash: Failed to open MEI file "
+                << fileInfo.filePath() << endl;
+        return;
+    }
+    
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(&file);
+    info.meiHash = hash.result().toHex().toStdString();
+    info.meiSize = size;
+    info.meiModified = modified;
+    m_indexChanged = true;
+}
+
+ScoreFinder::IndexedScore *
+ScoreFinder::findScore(string scoreName)
+{
+    if (!m_indexLoaded) {
+        readIndex();
+    }
+    
+    for (int i = 0; i < 2; ++i) {
+        refreshRoot(i);
+        auto itr = m_roots[i].scores.find(scoreName);
+        if (itr == m_roots[i].scores.end()) {
+            continue;
+        }
+        if (refreshScore(itr->second)) {
+            return &itr->second;
+        }
+        // The score directory has gone since the root was scanned
+        m_roots[i].scores.erase(itr);
+        m_roots[i].modified = 0;
+        m_indexChanged = true;
+    }
+    
+    return nullptr;
+}
+
+void
+ScoreFinder::readIndex()
+{
+    m_indexLoaded = true;
+    
+    QSettings settings;
+    settings.beginGroup("ScoreFinderIndex");
+
+    int n = settings.beginReadArray("roots");
+    for (int i = 0; i < n && i < 2; ++i) {
+        settings.setArrayIndex(i);
+        m_roots[i].path = settings.value("path").toString().toStdString();
+        m_roots[i].modified = settings.value("modified").toLongLong();
+    }
+    settings.endArray();
+
+    n = settings.beginReadArray("scores");
+    for (int i = 0; i < n; ++i) {
+        settings.setArrayIndex(i);
+        int r = settings.value("root").toInt();
+        if (r < 0 || r > 1 || m_roots[r].path == "") continue;
+        IndexedScore score;
+        score.info.name = settings.value("name").toString().toStdString();
+        score.info.directory = m_roots[r].path + "/" + score.info.name;
+        score.info.bundled = (r == 1);
+        for (auto ext : settings.value("extensions").toStringList()) {
+            score.info.extensions.insert(ext.toStdString());
+        }
+        score.info.meiHash = settings.value("meiHash").toString().toStdString();
+        score.info.meiSize = settings.value("meiSize").toLongLong();
+        score.info.meiModified = settings.value("meiModified").toLongLong();
+        score.modified = settings.value("modified").toLongLong();
+        m_roots[r].scores[score.info.name] = score;
+    }
+    settings.endArray();
+    settings.endGroup();
+
+    SVDEBUG << "ScoreFinder::readIndex: Read " << m_roots[0].scores.size()
+            << " user and " << m_roots[1].scores.size()
+            << " bundled scores from index" << endl;
+}
+
+void
+ScoreFinder::writeIndex()
+{
+    if (!m_indexChanged) {
+        return;
+    }
+    
+    QSettings settings;
+    settings.beginGroup("ScoreFinderIndex");
+    settings.remove("");
+
+    settings.beginWriteArray("roots", 2);
+    for (int i = 0; i < 2; ++i) {
+        settings.setArrayIndex(i);
+        settings.setValue("path", QString::fromStdString(m_roots[i].path));
+        settings.setValue("modified", qlonglong(m_roots[i].modified));
+    }
+    settings.endArray();
+
+    settings.beginWriteArray("scores");
+    int index = 0;
+    for (int i = 0; i < 2; ++i) {
+        for (const auto &s : m_roots[i].scores) {
+            const auto &score = s.second;
+            QStringList extensions;
+            for (const auto &ext : score.info.extensions) {
+                extensions << QString::fromStdString(ext);
             }
+            settings.setArrayIndex(index++);
+            settings.setValue("root", i);
+            settings.setValue("name", QString::fromStdString(score.info.name));
+            settings.setValue("modified", qlonglong(score.modified));
+            settings.setValue("extensions", extensions);
+            settings.setValue("meiHash",
+                              QString::fromStdString(score.info.meiHash));
+            settings.setValue("meiSize", qlonglong(score.info.meiSize));
+            settings.setValue("meiModified",
+                              qlonglong(score.info.meiModified));
+        }
+    }
+    settings.endArray();
+    settings.endGroup();
+
+    m_indexChanged = false;
+}
+
+vector<string>
+ScoreFinder::getScoreNames()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_indexLoaded) {
+        readIndex();
+    }
+    
+    vector<string> names;
+    
+    for (int i = 0; i < 2; ++i) {
+        refreshRoot(i);
+        for (const auto &s : m_roots[i].scores) {
+            names.push_back(s.first);
+        }
+    }
+
+    writeIndex();
+    return names;
+}
+
+bool
+ScoreFinder::getScoreInfo(string scoreName, ScoreInfo &info)
+{
+    QMutexLocker locker(&m_mutex);
+
+    IndexedScore *score = findScore(scoreName);
+    if (score) {
+        refreshMeiHash(score->info);
+        info = score->info;
+    } else {
+        SVDEBUG << "ScoreFinder::getScoreInfo: Score \""
+                << scoreName << "\" not found" << endl;
+    }
+
+    writeIndex();
+    return score != nullptr;
+}
+
+string
+ScoreFinder::getScoreFile(string scoreName, string extension)
+{
+    QMutexLocker locker(&m_mutex);
+
+    string filePath;
+    
+    IndexedScore *score = findScore(scoreName);
+    if (!score) {
+        SVDEBUG << "ScoreFinder::getScoreFile: Score \""
+                << scoreName << "\" not found" << endl;
+    } else {
+        filePath = score->info.directory + "/" + scoreName + "." + extension;
+        const auto &extensions = score->info.extensions;
+        if (extensions.find(extension) == extensions.end()) {
+            SVDEBUG << "ScoreFinder::getScoreFile: Score file \""
+                    << filePath << "\" does not exist" << endl;
+            filePath = "";
         }
     }
 
-    SVDEBUG << "ScoreFinder::getScoreFile: Score \""
-            << scoreName << "\" not found" << endl;
-    return {};
+    writeIndex();
+    return filePath;
 }
 
 void
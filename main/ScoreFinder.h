@@ -13,7 +13,12 @@
 #ifndef SV_SCORE_FINDER_H
 #define SV_SCORE_FINDER_H
 
+#include <QMutex>
+
+#include <cstdint>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 class ScoreFinder
@@ -34,13 +39,36 @@ public:
      */
     static std::string getBundledScoreDirectory();
 
-    /** Scan the score directories (getUserScoreDirectory() and
-     *  getBundledScoreDirectory()) and return the names of all scores
-     *  found there. The names are returned in no particular order and
-     *  may include duplicates if a score appears in both user and
-     *  bundled locations.
+    /** Return the names of all scores found in the score directories
+     *  (getUserScoreDirectory() and getBundledScoreDirectory()). The
+     *  names are returned in no particular order and may include
+     *  duplicates if a score appears in both user and bundled
+     *  locations.
+     *
+     *  The score directories are not scanned on every call. They are
+     *  kept in an index, saved in the settings between runs, which is
+     *  brought up to date by looking again at a directory only when
+     *  its modification time has changed.
      */
     static std::vector<std::string> getScoreNames();
+
+    /** Information about a score, as kept in the score index.
+     */
+    struct ScoreInfo {
+        std::string name;
+        std::string directory; // full path of the score's directory
+        bool bundled = false;  // true if found in the bundled directory
+        std::set<std::string> extensions; // of files named for the score
+        std::string meiHash;   // SHA-1 of the .mei file in hex, or empty
+        int64_t meiSize = 0;
+        int64_t meiModified = 0; // ms since the epoch
+    };
+
+    /** Look in the score directories for a score of the given name,
+     *  and if it is found, fill in the given info and return true.
+     *  As for getScoreFile(), the user directory takes priority.
+     */
+    static bool getScoreInfo(std::string scoreName, ScoreInfo &info);
     
     /** Look in the score directories (getUserScoreDirectory() and
      *  getBundledScoreDirectory()) for a score of the given name, and
@@ -59,6 +87,9 @@ public:
      *
      *  Note that if a score of a given name appears in both user and
      *  bundled directories, the user directory takes priority.
+     *
+     *  This uses the same index as getScoreNames(), so takes the same
+     *  time however many scores are installed.
      */
     static std::string getScoreFile(std::string scoreName, std::string extension);
 
@@ -89,6 +120,30 @@ public:
      *  copies. Do not overwrite any existing files.
      */
     static void populateUserDirectoriesFromBundled();
+
+private:
+    struct IndexedScore {
+        ScoreInfo info;
+        int64_t modified = 0; // of directory when scanned, or 0 to rescan
+    };
+    struct IndexedRoot {
+        std::string path;
+        int64_t modified = 0; // of directory when scanned, or 0 to rescan
+        std::unordered_map<std::string, IndexedScore> scores;
+    };
+
+    static QMutex m_mutex;
+    static bool m_indexLoaded;
+    static bool m_indexChanged;
+    static IndexedRoot m_roots[2]; // user, then bundled
+
+    // These must be called with m_mutex held
+    static void refreshRoot(int root);
+    static bool refreshScore(IndexedScore &);
+    static void refreshMeiHash(ScoreInfo &);
+    static IndexedScore *findScore(std::string scoreName);
+    static void readIndex();
+    static void writeIndex();
 };
 
 
@@ -0,0 +1,175 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "ScoreGlyphAtlas.h"
+
+#include <QPainter>
+#include <QPainterPath>
+#include <QPaintDevice>
+#include <QTransform>
+
+#include "base/Debug.h"
+
+#include <cmath>
+
+//#define DEBUG_GLYPH_ATLAS 1
+
+ScoreGlyphAtlas::ScoreGlyphAtlas() :
+    m_shelfX(0),
+    m_shelfY(0),
+    m_shelfHeight(0)
+{
+}
+
+ScoreGlyphAtlas::~ScoreGlyphAtlas()
+{
+}
+
+void
+ScoreGlyphAtlas::clear()
+{
+    m_entries.clear();
+    m_sheets.clear();
+    m_shelfX = 0;
+    m_shelfY = 0;
+    m_shelfHeight = 0;
+}
+
+size_t
+ScoreGlyphAtlas::getMemoryUsage() const
+{
+    size_t bytes = 0;
+    for (const auto &sheet : m_sheets) {
+        bytes += sheet.sizeInBytes();
+    }
+    return bytes;
+}
+
+bool
+ScoreGlyphAtlas::allocate(QSize size, int &sheet, QPoint &position)
+{
+    // Simple shelf packing: glyphs are placed left to right along a
+    // shelf as tall as the tallest glyph on it so far
+
+    if (size.width() > sheetSize || size.height() > sheetSize) {
+        return false;
+    }
+
+    if (!m_sheets.empty() && m_shelfX + size.width() > sheetSize) {
+        m_shelfX = 0;
+        m_shelfY += m_shelfHeight;
+        m_shelfHeight = 0;
+    }
+
+    if (m_sheets.empty() || m_shelfY + size.height() > sheetSize) {
+        if (int(m_sheets.size()) >= maxSheets) {
+#ifdef DEBUG_GLYPH_ATLAS
+            SVDEBUG << "ScoreGlyphAtlas::allocate: Atlas full, clearing"
+                    << endl;
+#endif
+            clear();
+        }
+        QImage image(sheetSize, sheetSize,
+                     QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::transparent);
+        m_sheets.push_back(image);
+        m_shelfX = 0;
+        m_shelfY = 0;
+        m_shelfHeight = 0;
+    }
+
+    sheet = int(m_sheets.size()) - 1;
+    position = QPoint(m_shelfX, m_shelfY);
+    m_shelfX += size.width();
+    m_shelfHeight = std::max(m_shelfHeight, size.height());
+    return true;
+}
+
+ScoreGlyphAtlas::Entry
+ScoreGlyphAtlas::rasterise(const QPainterPath &outline, double pixels)
+{
+    Entry entry { -1, {}, {} };
+
+    QRectF bounds = outline.boundingRect();
+    if (bounds.isEmpty()) {
+        return entry;
+    }
+
+    // One pixel of padding on each side for antialiasing
+    int x0 = int(floor(bounds.left() * pixels)) - 1;
+    int y0 = int(floor(bounds.top() * pixels)) - 1;
+    int x1 = int(ceil(bounds.right() * pixels)) + 1;
+    int y1 = int(ceil(bounds.bottom() * pixels)) + 1;
+
+    int sheet = -1;
+    QPoint position;
+    if (!allocate(QSize(x1 - x0, y1 - y0), sheet, position)) {
+        return entry;
+    }
+
+    QPainter paint(&m_sheets[sheet]);
+    paint.setRenderHint(QPainter::Antialiasing, true);
+    paint.setPen(Qt::NoPen);
+    paint.translate(position.x() - x0, position.y() - y0);
+    paint.scale(pixels, pixels);
+    paint.fillPath(outline, Qt::black);
+    paint.end();
+
+    entry.sheet = sheet;
+    entry.rect = QRect(position, QSize(x1 - x0, y1 - y0));
+    entry.offset = QPoint(x0, y0);
+    return entry;
+}
+
+bool
+ScoreGlyphAtlas::draw(QPainter &paint, char32_t code,
+                      const QPainterPath &outline,
+                      double pixelSize, QPointF devicePos)
+{
+    // Rasterise at the resolution of the underlying device, so as to
+    // remain sharp on high-DPI displays
+    double dpr = 1.0;
+    if (paint.device()) {
+        dpr = paint.device()->devicePixelRatioF();
+    }
+
+    Key key { code,
+              int(round(pixelSize * dpr * 4.0)),
+              int(round(dpr * 100.0)) };
+
+    auto itr = m_entries.find(key);
+    if (itr == m_entries.end()) {
+        // NB this may clear the atlas, if it is full, before adding
+        Entry entry = rasterise(outline, key.quarterPixels / 4.0);
+        itr = m_entries.insert({ key, entry }).first;
+#ifdef DEBUG_GLYPH_ATLAS
+        SVDEBUG << "ScoreGlyphAtlas::draw: Rasterised glyph " << int(code)
+                << " at " << key.quarterPixels / 4.0 << "px into sheet "
+                << entry.sheet << endl;
+#endif
+    }
+
+    const Entry &entry = itr->second;
+    if (entry.sheet < 0) {
+        return false;
+    }
+
+    QPointF physical(round(devicePos.x() * dpr) + entry.offset.x(),
+                     round(devicePos.y() * dpr) + entry.offset.y());
+
+    QTransform transform = paint.transform();
+    paint.setTransform(QTransform());
+    paint.drawImage(QRectF(physical / dpr, QSizeF(entry.rect.size()) / dpr),
+                    m_sheets[entry.sheet], entry.rect);
+    paint.setTransform(transform);
+    return true;
+}
@@ -0,0 +1,98 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_SCORE_GLYPH_ATLAS_H
+#define SV_SCORE_GLYPH_ATLAS_H
+
+#include <QImage>
+#include <QRect>
+#include <QPointF>
+
+#include <map>
+#include <vector>
+
+class QPainter;
+class QPainterPath;
+
+/**
+ * A cache of rasterised music glyphs. Each distinct glyph is drawn
+ * once per pixel size into a shared atlas image, and thereafter
+ * painted by copying from the atlas, which is much cheaper than
+ * filling its outline again. The same few glyphs (noteheads, flags,
+ * accidentals, rests) account for most of the drawing on a page of
+ * score.
+ *
+ * Glyphs are snapped to whole device pixels when drawn, and sizes
+ * are quantised to a quarter of a pixel.
+ */
+class ScoreGlyphAtlas
+{
+public:
+    ScoreGlyphAtlas();
+    ~ScoreGlyphAtlas();
+
+    /**
+     * Draw the given glyph outline (for a glyph of size 1.0, origin
+     * on the baseline) at the given device pixel size, with its
+     * origin at the given position in the painter's device
+     * coordinates. The painter's transform is not used. Glyphs are
+     * drawn in black. Return false if the glyph could not be drawn
+     * from the atlas (for example because it is too large), in which
+     * case the caller should fill the outline itself.
+     */
+    bool draw(QPainter &paint, char32_t code, const QPainterPath &outline,
+              double pixelSize, QPointF devicePos);
+
+    /**
+     * Discard all rasterised glyphs.
+     */
+    void clear();
+
+    /**
+     * Return the number of bytes used by the atlas images.
+     */
+    size_t getMemoryUsage() const;
+
+private:
+    struct Key {
+        char32_t code;
+        int quarterPixels;
+        int dprPercent;
+        bool operator<(const Key &k) const {
+            if (code != k.code) return code < k.code;
+            if (quarterPixels != k.quarterPixels) {
+                return quarterPixels < k.quarterPixels;
+            }
+            return dprPercent < k.dprPercent;
+        }
+    };
+
+    struct Entry {
+        int sheet;      // index into m_sheets, or -1 if nothing to draw
+        QRect rect;     // in sheet pixels
+        QPoint offset;  // of the rect's top-left from the glyph origin
+    };
+
+    std::map<Key, Entry> m_entries;
+    std::vector<QImage> m_sheets;
+    int m_shelfX;
+    int m_shelfY;
+    int m_shelfHeight;
+
+    Entry rasterise(const QPainterPath &outline, double pixels);
+    bool allocate(QSize size, int &sheet, QPoint &position);
+
+    static const int sheetSize = 1024;
+    static const int maxSheets = 8;
+};
+
+#endif
@@ -0,0 +1,240 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "ScorePage.h"
+#include "ScoreGlyphAtlas.h"
+
+#include <QPainter>
+
+ScorePage::ScorePage()
+{
+}
+
+ScorePage::~ScorePage()
+{
+}
+
+static size_t
+stringHeapSize(const QString &s)
+{
+    // QArrayData header and UTF-16 data with terminator
+    return s.isNull() ? 0 : 16 + size_t(s.capacity() + 1) * sizeof(QChar);
+}
+
+static size_t
+pathHeapSize(const QPainterPath &p)
+{
+    return size_t(p.elementCount()) * sizeof(QPainterPath::Element);
+}
+
+template <typename T>
+static size_t
+vectorHeapSize(const std::vector<T> &v)
+{
+    return v.capacity() * sizeof(T);
+}
+
+template <typename K, typename V>
+static size_t
+hashHeapSize(const QHash<K, V> &h)
+{
+    // Keys are shared with the element and note tables
+    return size_t(h.capacity()) * (1 + sizeof(K) + sizeof(V));
+}
+
+size_t
+ScorePage::getMemoryUsage() const
+{
+    size_t bytes = sizeof(*this);
+
+    bytes += vectorHeapSize(m_items);
+    bytes += vectorHeapSize(m_pens);
+    bytes += vectorHeapSize(m_brushes);
+    bytes += vectorHeapSize(m_paths);
+    for (const auto &p : m_paths) {
+        bytes += pathHeapSize(p);
+    }
+    bytes += vectorHeapSize(m_glyphs);
+    for (const auto &g : m_glyphs) {
+        bytes += pathHeapSize(g.outline);
+    }
+    bytes += vectorHeapSize(m_texts);
+    for (const auto &t : m_texts) {
+        bytes += stringHeapSize(t.text);
+    }
+    bytes += vectorHeapSize(m_elements);
+    for (const auto &e : m_elements) {
+        bytes += stringHeapSize(e.id) + stringHeapSize(e.type);
+    }
+    bytes += hashHeapSize(m_elementIndex);
+    bytes += vectorHeapSize(m_systems);
+    for (const auto &s : m_systems) {
+        bytes += stringHeapSize(s.id);
+    }
+    bytes += vectorHeapSize(m_notes);
+    bytes += hashHeapSize(m_noteIndex);
+
+    return bytes;
+}
+
+bool
+ScorePage::hasElement(QString id) const
+{
+    return m_elementIndex.contains(id);
+}
+
+QRectF
+ScorePage::getElementBounds(QString id) const
+{
+    auto itr = m_elementIndex.find(id);
+    if (itr == m_elementIndex.end()) {
+        return {};
+    }
+    return m_elements[*itr].bounds;
+}
+
+void
+ScorePage::paint(QPainter &paint, ScoreGlyphAtlas *atlas) const
+{
+    paintItems(paint, atlas, 0, int(m_items.size()), -2);
+}
+
+void
+ScorePage::paintSystem(QPainter &paint, int system,
+                       ScoreGlyphAtlas *atlas) const
+{
+    if (system < 0) {
+        paintItems(paint, atlas, 0, int(m_items.size()), -1);
+    } else if (system < int(m_systems.size()) &&
+               m_systems[system].firstItem >= 0) {
+        paintItems(paint, atlas,
+                   m_systems[system].firstItem,
+                   m_systems[system].endItem,
+                   system);
+    }
+}
+
+void
+ScorePage::paintItems(QPainter &paint, ScoreGlyphAtlas *atlas,
+                      int from, int to, int system) const
+{
+    // A system of -2 means everything, -1 means only items outside
+    // any system
+    
+    paint.save();
+    paint.setRenderHint(QPainter::Antialiasing, true);
+
+    QTransform base = paint.transform();
+
+    if (atlas) {
+        if (base.type() > QTransform::TxScale || base.m11() != base.m22()) {
+            atlas = nullptr;
+        }
+    }
+
+    int currentPen = -2, currentBrush = -2;
+
+    auto usePen = [&](int pen) {
+        if (pen == currentPen) return;
+        if (pen < 0) paint.setPen(Qt::NoPen);
+        else paint.setPen(m_pens[pen]);
+        currentPen = pen;
+    };
+
+    auto useBrush = [&](int brush) {
+        if (brush == currentBrush) return;
+        if (brush < 0) paint.setBrush(Qt::NoBrush);
+        else paint.setBrush(m_brushes[brush]);
+        currentBrush = brush;
+    };
+
+    for (int i = from; i < to; ++i) {
+
+        const auto &item = m_items[i];
+
+        if (system > -2) {
+            int itemSystem =
+                (item.element >= 0 ? m_elements[item.element].system : -1);
+            if (itemSystem != system) {
+                continue;
+            }
+        }
+        
+        switch (item.type) {
+
+        case ItemType::Line:
+            usePen(item.pen);
+            paint.drawLine(QLineF(item.a, item.b));
+            break;
+
+        case ItemType::Polyline:
+            usePen(item.pen);
+            useBrush(-1);
+            paint.drawPath(m_paths[item.index]);
+            break;
+
+        case ItemType::Path:
+            usePen(item.pen);
+            useBrush(item.brush);
+            paint.drawPath(m_paths[item.index]);
+            break;
+
+        case ItemType::Rect:
+            usePen(item.pen);
+            useBrush(item.brush);
+            paint.drawRect(QRectF(item.a, QSizeF(item.b.x(), item.b.y())));
+            break;
+
+        case ItemType::Ellipse:
+            usePen(item.pen);
+            useBrush(item.brush);
+            paint.drawEllipse(QRectF(item.a, QSizeF(item.b.x(), item.b.y())));
+            break;
+
+        case ItemType::Glyph:
+        {
+            double size = item.b.x();
+            if (atlas &&
+                m_brushes[item.brush].color() == Qt::black &&
+                atlas->draw(paint, m_glyphs[item.index].code,
+                            m_glyphs[item.index].outline,
+                            size * base.m11(), base.map(item.a))) {
+                break;
+            }
+            paint.setTransform(QTransform(size, 0, 0, size,
+                                          item.a.x(), item.a.y()) * base);
+            paint.fillPath(m_glyphs[item.index].outline,
+                           m_brushes[item.brush]);
+            paint.setTransform(base);
+            break;
+        }
+
+        case ItemType::Text:
+        {
+            const Text &text = m_texts[item.index];
+            usePen(item.pen);
+            paint.setFont(text.font);
+            if (text.angle != 0.0) {
+                paint.translate(item.a);
+                paint.rotate(text.angle);
+                paint.drawText(QPointF(0, 0), text.text);
+                paint.setTransform(base);
+            } else {
+                paint.drawText(item.a, text.text);
+            }
+            break;
+        }
+        }
+    }
+
+    paint.restore();
+}
@@ -0,0 +1,196 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_SCORE_PAGE_H
+#define SV_SCORE_PAGE_H
+
+#include <QString>
+#include <QHash>
+#include <QRectF>
+#include <QPen>
+#include <QBrush>
+#include <QFont>
+#include <QPainterPath>
+
+#include <vector>
+
+class QPainter;
+class ScoreGlyphAtlas;
+
+/**
+ * A single rendered page of score, recorded as a compact display
+ * list by QtDeviceContext and replayed directly onto a QPainter.
+ *
+ * All coordinates are in the logical units used by Verovio's
+ * layout, with the page margin already applied, so the page occupies
+ * the rectangle from (0,0) to getSize().
+ *
+ * Alongside the drawing itself the page records every element that
+ * Verovio started a graphic for (notes, staffs, systems and so on)
+ * with its ID, type, enclosing element, and the bounds of everything
+ * drawn within it. Notes and the vertical extents of the systems
+ * containing them are also gathered into flat tables as the page is
+ * recorded, so that no further pass over the page is needed to map
+ * musical events onto it.
+ */
+class ScorePage
+{
+public:
+    ScorePage();
+    ~ScorePage();
+
+    /**
+     * Return the size of the page in logical units.
+     */
+    QSizeF getSize() const { return m_size; }
+
+    /**
+     * Paint the page. The painter's transform should map logical
+     * page coordinates to the paint device. If an atlas is provided
+     * and the transform is a simple scale and translation, glyphs
+     * are copied from the atlas rather than filled as outlines.
+     */
+    void paint(QPainter &paint, ScoreGlyphAtlas *atlas = nullptr) const;
+
+    /**
+     * Paint only the items drawn within the given system (an index
+     * into getSystems()), or with a system of -1, only the items
+     * drawn outside any system. Otherwise as paint().
+     */
+    void paintSystem(QPainter &paint, int system,
+                     ScoreGlyphAtlas *atlas = nullptr) const;
+
+    struct Element {
+        QString id;
+        QString type;   // lower-case Verovio class name, e.g. "note"
+        int parent;     // index of the enclosing element, or -1
+        QRectF bounds;  // union of everything drawn within the element
+        int system;     // index into getSystems(), or -1
+    };
+
+    /**
+     * Return true if an element with the given ID appears on this
+     * page.
+     */
+    bool hasElement(QString id) const;
+
+    /**
+     * Return the bounds of the element with the given ID, or an
+     * empty rect if it does not appear on this page.
+     */
+    QRectF getElementBounds(QString id) const;
+
+    /**
+     * Return all elements, in the order in which they were started.
+     * An element's parent always precedes it.
+     */
+    const std::vector<Element> &getElements() const { return m_elements; }
+
+    struct System {
+        QString id;
+        double y;       // top of system, or of its only staff
+        double height;  // or 0 if no extent was found
+        QRectF bounds;  // union of everything drawn within the system
+        int firstItem;  // index of first item drawn within it, or -1
+        int endItem;    // one past the last such item
+    };
+
+    struct Note {
+        QString id;
+        QRectF bounds;
+        int system;     // index into getSystems(), or -1
+    };
+
+    /**
+     * Return all systems, in drawing order. A staff that is not
+     * within any system is counted as a system of its own.
+     */
+    const std::vector<System> &getSystems() const { return m_systems; }
+
+    /**
+     * Return all notes that have IDs, in drawing order.
+     */
+    const std::vector<Note> &getNotes() const { return m_notes; }
+
+    /**
+     * Return the index within getNotes() of the note with the given
+     * ID, or -1 if it does not appear on this page.
+     */
+    int findNote(QString id) const {
+        return m_noteIndex.value(id, -1);
+    }
+
+    enum class ItemType {
+        Line,      // from a to b
+        Polyline,  // m_paths[index], stroked only
+        Path,      // m_paths[index], stroked and filled
+        Rect,      // at a, of size b
+        Ellipse,   // within rect at a, of size b
+        Glyph,     // m_glyphs[index] at origin a, scaled to size b.x()
+        Text       // m_texts[index] with baseline origin at a
+    };
+
+    struct Item {
+        ItemType type;
+        int element;  // innermost enclosing element, or -1
+        int pen;      // index into the pen table, or -1 for none
+        int brush;    // index into the brush table, or -1 for none
+        int index;    // index into the path, glyph or text table
+        QPointF a;
+        QPointF b;
+    };
+
+    /**
+     * Return all drawing items, in drawing order.
+     */
+    const std::vector<Item> &getItems() const { return m_items; }
+
+    struct Glyph {
+        char32_t code;
+        QPainterPath outline; // for a glyph of size 1.0, origin on baseline
+    };
+
+    struct Text {
+        QString text;
+        QFont font;
+        double angle; // clockwise, in degrees
+    };
+
+    const std::vector<Glyph> &getGlyphs() const { return m_glyphs; }
+
+    /**
+     * Return an estimate of the number of bytes used by the display
+     * list and the element, system and note tables.
+     */
+    size_t getMemoryUsage() const;
+
+private:
+    friend class QtDeviceContext;
+
+    void paintItems(QPainter &paint, ScoreGlyphAtlas *atlas,
+                    int from, int to, int system) const;
+
+    QSizeF m_size;
+    std::vector<Item> m_items;
+    std::vector<QPen> m_pens;
+    std::vector<QBrush> m_brushes;
+    std::vector<QPainterPath> m_paths;
+    std::vector<Glyph> m_glyphs;
+    std::vector<Text> m_texts;
+    std::vector<Element> m_elements;
+    QHash<QString, int> m_elementIndex;
+    std::vector<System> m_systems;
+    std::vector<Note> m_notes;
+    QHash<QString, int> m_noteIndex;
+};
+
+#endif
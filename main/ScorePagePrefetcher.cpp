@@ -0,0 +1,167 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "ScorePagePrefetcher.h"
+#include "ScorePage.h"
+
+#include <QPainter>
+
+#include "base/Debug.h"
+
+#include <cmath>
+#include <cstdlib>
+
+//#define DEBUG_PAGE_PREFETCHER 1
+
+ScorePagePrefetcher::ScorePagePrefetcher(QObject *parent) :
+    QObject(parent),
+    m_worker(new QObject),
+    m_clearCount(0)
+{
+    m_thread.setObjectName("ScorePagePrefetcher");
+    m_worker->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
+    m_thread.start(QThread::LowPriority);
+}
+
+ScorePagePrefetcher::~ScorePagePrefetcher()
+{
+    m_thread.quit();
+    m_thread.wait();
+}
+
+int
+ScorePagePrefetcher::find(int pageNo, QSize size, double dpr,
+                          int generation) const
+{
+    for (int i = 0; i < int(m_entries.size()); ++i) {
+        const auto &e = m_entries[i];
+        if (e.pageNo == pageNo && e.size == size &&
+            fabs(e.dpr - dpr) < 1e-6 && e.generation == generation) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool
+ScorePagePrefetcher::isPrefetched(int pageNo, QSize size, double dpr,
+                                  int generation) const
+{
+    return find(pageNo, size, dpr, generation) >= 0;
+}
+
+QImage
+ScorePagePrefetcher::getImage(int pageNo, QSize size, double dpr,
+                              int generation) const
+{
+    int i = find(pageNo, size, dpr, generation);
+    if (i < 0) {
+        return {};
+    }
+    return m_entries[i].image;
+}
+
+void
+ScorePagePrefetcher::clear()
+{
+    m_entries.clear();
+    ++m_clearCount;
+}
+
+size_t
+ScorePagePrefetcher::getMemoryUsage() const
+{
+    size_t bytes = 0;
+    for (const auto &e : m_entries) {
+        bytes += e.image.sizeInBytes();
+    }
+    return bytes;
+}
+
+void
+ScorePagePrefetcher::prefetch(int pageNo, std::shared_ptr<const ScorePage> page,
+                              QSize size, double dpr, QTransform pageToImage,
+                              int generation)
+{
+    if (!page || size.isEmpty() || isPrefetched(pageNo, size, dpr, generation)) {
+        return;
+    }
+
+    // Make room, evicting the entry for the page furthest from this
+    // one
+    while (int(m_entries.size()) >= maxEntries) {
+        int furthest = 0;
+        for (int i = 1; i < int(m_entries.size()); ++i) {
+            if (std::abs(m_entries[i].pageNo - pageNo) >
+                std::abs(m_entries[furthest].pageNo - pageNo)) {
+                furthest = i;
+            }
+        }
+        m_entries.erase(m_entries.begin() + furthest);
+    }
+
+    m_entries.push_back({ pageNo, size, dpr, generation, {} });
+
+#ifdef DEBUG_PAGE_PREFETCHER
+    SVDEBUG << "ScorePagePrefetcher::prefetch: page " << pageNo
+            << " at " << size.width() << "x" << size.height()
+            << " (dpr " << dpr << ")" << endl;
+#endif
+
+    int clearCount = m_clearCount;
+
+    QMetaObject::invokeMethod(m_worker, [=]() {
+
+        // On the worker thread. The page is not modified once it has
+        // been recorded, so painting it here is safe. The glyph
+        // atlas belongs to the GUI thread and is not used
+
+        QImage image(int(ceil(size.width() * dpr)),
+                     int(ceil(size.height() * dpr)),
+                     QImage::Format_ARGB32_Premultiplied);
+        image.setDevicePixelRatio(dpr);
+        image.fill(Qt::transparent);
+
+        QPainter paint(&image);
+        paint.setTransform(pageToImage);
+        page->paint(paint);
+        paint.end();
+
+        QMetaObject::invokeMethod(this, [=]() {
+            received(pageNo, size, dpr, generation, clearCount, image);
+        }, Qt::QueuedConnection);
+
+    }, Qt::QueuedConnection);
+}
+
+void
+ScorePagePrefetcher::received(int pageNo, QSize size, double dpr,
+                              int generation, int clearCount, QImage image)
+{
+    if (clearCount != m_clearCount) {
+        return;
+    }
+
+    int i = find(pageNo, size, dpr, generation);
+    if (i < 0) {
+        // Evicted while we were working on it
+        return;
+    }
+
+#ifdef DEBUG_PAGE_PREFETCHER
+    SVDEBUG << "ScorePagePrefetcher::received: page " << pageNo << endl;
+#endif
+
+    m_entries[i].image = image;
+    emit pagePrefetched(pageNo);
+}
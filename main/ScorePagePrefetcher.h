@@ -0,0 +1,109 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_SCORE_PAGE_PREFETCHER_H
+#define SV_SCORE_PAGE_PREFETCHER_H
+
+#include <QObject>
+#include <QThread>
+#include <QImage>
+#include <QTransform>
+
+#include <memory>
+#include <vector>
+
+class ScorePage;
+
+/**
+ * Rasterises score pages into images on a background thread, so
+ * that a page can be shown by copying a single image rather than by
+ * replaying its display list. Used to have the next page ready
+ * before playback reaches it.
+ *
+ * Images are cached for a small number of pages. Each is identified
+ * by page number, pixel size, device pixel ratio, and a layout
+ * generation number supplied by the caller, and any difference in
+ * these means the image will not be returned.
+ *
+ * All methods must be called from the thread that owns the
+ * prefetcher (normally the GUI thread).
+ */
+class ScorePagePrefetcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    ScorePagePrefetcher(QObject *parent = nullptr);
+    virtual ~ScorePagePrefetcher();
+
+    /**
+     * Request that the given page be rasterised into an image of
+     * the given logical size and device pixel ratio, using the
+     * given transform from page to image (logical) coordinates. Do
+     * nothing if a matching image is already cached or pending.
+     */
+    void prefetch(int pageNo, std::shared_ptr<const ScorePage> page,
+                  QSize size, double dpr, QTransform pageToImage,
+                  int generation);
+
+    /**
+     * Return true if a matching image is cached or is being made.
+     */
+    bool isPrefetched(int pageNo, QSize size, double dpr,
+                      int generation) const;
+
+    /**
+     * Return the cached image for the given page, or a null image if
+     * there is no matching one.
+     */
+    QImage getImage(int pageNo, QSize size, double dpr,
+                    int generation) const;
+
+    /**
+     * Discard all cached images. Any rasterising already under way
+     * will be discarded when it completes.
+     */
+    void clear();
+
+    /**
+     * Return the number of bytes used by cached images.
+     */
+    size_t getMemoryUsage() const;
+
+signals:
+    /**
+     * Emitted when an image has been made for the given page.
+     */
+    void pagePrefetched(int pageNo);
+
+private:
+    struct Entry {
+        int pageNo;
+        QSize size;
+        double dpr;
+        int generation;
+        QImage image; // null while pending
+    };
+
+    QThread m_thread;
+    QObject *m_worker; // lives in m_thread, used as invocation context
+    std::vector<Entry> m_entries;
+    int m_clearCount;
+
+    int find(int pageNo, QSize size, double dpr, int generation) const;
+    void received(int pageNo, QSize size, double dpr, int generation,
+                  int clearCount, QImage image);
+
+    static const int maxEntries = 3;
+};
+
+#endif
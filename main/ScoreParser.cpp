@@ -11,6 +11,7 @@
 */
 
 #include "ScoreParser.h"
+#include "Tracing.h"
 
 #include "verovio-replace/include/vrv/timemap.h"
 #include "verovio-replace/include/vrv/toolkit.h"
@@ -46,8 +47,30 @@ removeGeneratedFiles(const vector<string> files)
 }
 
 vector<string>
-ScoreParser::generateScoreFiles(string dir, string scoreName, string meiFile)
+ScoreParser::generateScoreFiles(string dir, string scoreName, string meiFile,
+                                StageCallback stage)
 {
+    TraceScope trace("ScoreParser::generateScoreFiles", "score");
+    
+    if (!stage) {
+        stage = [](string, bool) { };
+    }
+
+    // Each stage is also recorded as a trace event, if tracing is on
+
+    int64_t stageStart = 0;
+    auto mark = [&](const char *name, bool starting) {
+        if (Tracing::isEnabled()) {
+            if (starting) {
+                stageStart = Tracing::now();
+            } else {
+                Tracing::complete(name, "score", stageStart,
+                                  Tracing::now() - stageStart);
+            }
+        }
+        stage(name, starting);
+    };
+    
     vector<string> generatedFiles;
     
     vrv::Toolkit toolkit(false);
@@ -57,8 +80,11 @@ ScoreParser::generateScoreFiles(string dir, string scoreName, string meiFile)
         SVDEBUG << "ScoreParser::generateScoreFiles: Failed to set Verovio resource path" << endl;
         return {};
     }
+    mark("LoadFile", true);
     toolkit.LoadFile(meiFile);
+    mark("LoadFile", false);
 
+    mark("RenderToTimemap", true);
     jsonxx::Array timemap;
     string option = "{\"includeMeasures\" : true,}";
     string timemapFilePath = dir + "/" + scoreName + ".json";
@@ -68,6 +94,7 @@ ScoreParser::generateScoreFiles(string dir, string scoreName, string meiFile)
     }
     generatedFiles.push_back(timemapFilePath);
     timemap.parse(toolkit.RenderToTimemap(option));
+    mark("RenderToTimemap", false);
 
     std::vector<string> meters; // could start from measure 1 or 0 (pickup)
     for (int i = 0; i < int(timemap.size()); i++) {
@@ -100,6 +127,8 @@ ScoreParser::generateScoreFiles(string dir, string scoreName, string meiFile)
         return {};
     }
 
+    mark("noteLoop", true);
+    
     // Calculating cumulative fraction for the beginning of each measure
     vector<vrv::Fraction> cumulativeMeasureFraction; // note that this is updated later if there is a pickup measure
     if (meters.size() > 0)  cumulativeMeasureFraction.push_back(vrv::Fraction(0, 1));
@@ -206,7 +235,10 @@ ScoreParser::generateScoreFiles(string dir, string scoreName, string meiFile)
         }
     }
 
+    mark("noteLoop", false);
+
     // Writing to the .solo file
+    mark("writeSolo", true);
     string content;
     for (const auto &line : lines) {
         content += std::to_string(line.measureIndex) + "+" + std::to_string(line.beat.numerator) + "/" + std::to_string(line.beat.denominator) + "\t";
@@ -219,6 +251,8 @@ ScoreParser::generateScoreFiles(string dir, string scoreName, string meiFile)
     outfile = dir + "/" + scoreName + ".solo";
     std::ofstream file(outfile);
     file << content;
+    file.close();
+    mark("writeSolo", false);
     generatedFiles.push_back(outfile);
     if (file.good()) {
         SVDEBUG << "Wrote solo data to " << outfile << endl;
@@ -13,6 +13,7 @@
 #ifndef SV_SCORE_PARSER_H
 #define SV_SCORE_PARSER_H
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -24,10 +25,19 @@ public:
      *  included in that list; it's safe to delete all of them
      *  later. If generation failed, return an empty vector (deleting
      *  any partial generated files).
+     *
+     *  If a stage callback is given, it is called with true as each
+     *  stage of the generation begins ("LoadFile", "RenderToTimemap",
+     *  "noteLoop", "writeSolo") and with false as it ends. This is
+     *  for benchmarking.
      */
+    typedef std::function<void(std::string stage, bool starting)>
+    StageCallback;
+    
     static std::vector<std::string> generateScoreFiles(std::string scoreDir,
                                                        std::string scoreName,
-                                                       std::string meiFile);
+                                                       std::string meiFile,
+                                                       StageCallback = {});
 
     /** Obtain the resource path to pass to Verovio. Resources are
      *  unpacked from the binary bundle the first time this is called,
@@ -13,12 +13,16 @@
 #include "ScoreWidget.h"
 #include "ScoreFinder.h"
 #include "ScoreParser.h"
+#include "ScorePage.h"
+#include "QtDeviceContext.h"
+#include "Tracing.h"
+#include "LatencyMonitor.h"
+#include "MemoryReport.h"
 
 #include <QPainter>
 #include <QMouseEvent>
-#include <QSvgRenderer>
-#include <QDomDocument>
-#include <QDomElement>
+#include <QWheelEvent>
+#include <QFile>
 #include <QToolButton>
 #include <QGridLayout>
 #include <QSettings>
@@ -27,12 +31,11 @@
 #include "widgets/IconLoader.h"
 
 #include <vector>
+#include <algorithm>
 
 #include "verovio/include/vrv/toolkit.h"
 #include "verovio/include/vrv/vrv.h"
 
-#include "vrvtrim.h"
-
 //#define DEBUG_SCORE_WIDGET 1
 //#define DEBUG_EVENT_FINDING 1
 
@@ -40,6 +43,10 @@ static QColor navigateHighlightColour("#59c4df");
 static QColor editHighlightColour("#ffbd00");
 static QColor selectHighlightColour(150, 150, 255);
 
+// Space left around each system in the scrolling view modes, in
+// logical page units
+static const double systemGap = 600.0;
+
 using std::vector;
 using std::pair;
 using std::string;
@@ -50,8 +57,17 @@ ScoreWidget::ScoreWidget(bool withZoomControls, QWidget *parent) :
     QFrame(parent),
     m_page(-1),
     m_scale(100),
+    m_musicalEvents(getEmptyMusicalEvents()),
     m_mode(InteractionMode::None),
     m_mouseActive(false),
+    m_viewMode(ViewMode::Paged),
+    m_placementsValid(false),
+    m_scrollExtent(0.0),
+    m_crossExtent(0.0),
+    m_scrollPos(0.0),
+    m_scrollTarget(0.0),
+    m_useGlyphAtlas(true),
+    m_layoutGeneration(0),
     m_aspectRatioAtLoad(1.0),
     m_switchLayoutAtThisAspectRatio(1.2),
     m_widestAllowableAspectRatio(10.0)
@@ -61,6 +77,18 @@ ScoreWidget::ScoreWidget(bool withZoomControls, QWidget *parent) :
     setMouseTracking(true);
     m_verovioResourcePath = ScoreParser::getResourcePath();
 
+    {
+        QSettings settings;
+        settings.beginGroup("ScoreWidget");
+        m_useGlyphAtlas = settings.value("glyphAtlas", m_useGlyphAtlas).toBool();
+        int mode = settings.value("viewMode", int(m_viewMode)).toInt();
+        if (mode >= int(ViewMode::Paged) &&
+            mode <= int(ViewMode::ScrollHorizontal)) {
+            m_viewMode = ViewMode(mode);
+        }
+        settings.endGroup();
+    }
+
     if (withZoomControls) {
         sv::IconLoader il;
         auto zoomOut = new QToolButton;
@@ -92,6 +120,14 @@ ScoreWidget::ScoreWidget(bool withZoomControls, QWidget *parent) :
     m_resizedTimer.setSingleShot(true);
     connect(&m_resizedTimer, &QTimer::timeout,
             this, &ScoreWidget::resizedTimerElapsed);
+
+    m_renderTimer.setSingleShot(true);
+    connect(&m_renderTimer, &QTimer::timeout,
+            this, &ScoreWidget::renderNeighbouringPages);
+
+    m_scrollTimer.setInterval(16);
+    connect(&m_scrollTimer, &QTimer::timeout,
+            this, &ScoreWidget::scrollTimerElapsed);
 }
 
 ScoreWidget::~ScoreWidget()
@@ -114,7 +150,7 @@ ScoreWidget::getCurrentPage() const
 int
 ScoreWidget::getPageCount() const
 {
-    return m_svgPages.size();
+    return m_pages.size();
 }
 
 void
@@ -126,8 +162,8 @@ ScoreWidget::setScale(int scale)
     m_scale = scale;
 
     QString errorString;
-    if (!reloadScoreFile(errorString)) {
-        SVCERR << "ScoreWidget::setScale: Failed to reload score: "
+    if (!relayout(errorString)) {
+        SVCERR << "ScoreWidget::setScale: Failed to lay out score again: "
                << errorString << endl;
         return;
     }
@@ -146,9 +182,93 @@ ScoreWidget::getScale() const
     return m_scale;
 }
 
+void
+ScoreWidget::reportMemoryUsage(MemoryReport &report) const
+{
+    const QString owner = "ScoreWidget";
+    
+    size_t rendered = 0, pageBytes =
+        m_pages.capacity() * sizeof(std::shared_ptr<ScorePage>);
+    for (const auto &page : m_pages) {
+        if (page) {
+            ++rendered;
+            pageBytes += page->getMemoryUsage();
+        }
+    }
+    report.add(owner, "pages (rendered)", rendered, pageBytes);
+
+    report.add(owner, "m_noteIds", m_noteIds.size(),
+               MemoryReport::sizeOf(m_noteIds, [](const EventId &id) {
+                   return MemoryReport::heapSize(id);
+               }));
+
+    report.add(owner, "m_noteEvents", m_noteEvents.size(),
+               MemoryReport::sizeOfFlat(m_noteEvents));
+
+    report.add(owner, "m_eventLabels", m_eventLabels.size(),
+               MemoryReport::sizeOf(m_eventLabels, [](const EventLabel &l) {
+                   return MemoryReport::heapSize(l);
+               }));
+
+    report.add(owner, "m_eventFirstNotes", m_eventFirstNotes.size(),
+               MemoryReport::sizeOfFlat(m_eventFirstNotes));
+    
+    report.add(owner, "m_noteIndex", m_noteIndex.size(),
+               sizeof(m_noteIndex) + m_noteIndex.getMemoryUsage());
+    
+    report.add(owner, "m_labelIndex", m_labelIndex.size(),
+               sizeof(m_labelIndex) + m_labelIndex.getMemoryUsage());
+
+    report.add(owner, "m_noteData", m_noteData.size(),
+               MemoryReport::sizeOfFlat(m_noteData));
+
+    report.add(owner, "m_pageNotes", m_pageNotes.size(),
+               MemoryReport::sizeOf(m_pageNotes, [](const vector<int> &v) {
+                   return MemoryReport::heapSize(v);
+               }));
+
+    report.addShared(owner, "m_musicalEvents", m_musicalEvents.get(),
+                     m_musicalEvents->size(),
+                     MemoryReport::sizeOf(*m_musicalEvents));
+
+    report.add(owner, "m_selectionRects", m_selectionRects.size(),
+               MemoryReport::sizeOf
+               (m_selectionRects, [](const SelectionRects &r) {
+                   return MemoryReport::heapSize(r.rects);
+               }));
+
+    report.add(owner, "m_placements", m_placements.size(),
+               MemoryReport::sizeOfFlat(m_placements));
+
+    report.add(owner, "glyph atlas", 0, m_glyphAtlas.getMemoryUsage());
+    report.add(owner, "prefetched page images", 0,
+               m_prefetcher.getMemoryUsage());
+
+    // The Verovio toolkit, which holds the parsed document and its
+    // layout, is opaque to us and is not included
+    
+    for (const auto &d : m_noteData) {
+        if (!d.isNull() && d.page >= int(m_pages.size())) {
+            report.warn(owner, QString("Event data for %1 refers to page %2, "
+                                       "but there are only %3 pages")
+                        .arg(getIdOf(d)).arg(d.page).arg(m_pages.size()));
+            break;
+        }
+    }
+    for (int p = 0; p < int(m_pageNotes.size()); ++p) {
+        if (!m_pageNotes[p].empty() &&
+            (p >= int(m_pages.size()) || !m_pages[p])) {
+            report.warn(owner, QString("Events are mapped on page %1, which "
+                                       "is not rendered").arg(p));
+        }
+    }
+}
+
 bool
 ScoreWidget::loadScoreFile(QString scoreName, QString scoreFile, QString &errorString)
 {
+    TraceScope trace("ScoreWidget::loadScoreFile", "score");
+
     clearSelection();
 
     if (m_verovioResourcePath == "") {
@@ -157,8 +277,26 @@ ScoreWidget::loadScoreFile(QString scoreName, QString scoreFile, QString &errorS
         return false;
     }
 
-    m_svgPages.clear();
-    m_noteSystemExtentMap.clear();
+    m_renderTimer.stop();
+    m_pages.clear();
+    m_glyphAtlas.clear();
+    m_prefetcher.clear();
+    ++m_layoutGeneration;
+    m_toolkit.reset();
+
+    m_placements.clear();
+    m_placementsValid = false;
+    m_scrollTimer.stop();
+    m_scrollPos = 0.0;
+    m_scrollTarget = 0.0;
+
+    m_noteIds.clear();
+    m_noteEvents.clear();
+    m_eventLabels.clear();
+    m_eventFirstNotes.clear();
+    m_noteIndex.clear();
+    m_labelIndex.clear();
+    clearEventLayout();
 
     m_highlightEventLabel = {};
     m_eventToHighlight = {};
@@ -170,18 +308,145 @@ ScoreWidget::loadScoreFile(QString scoreName, QString scoreFile, QString &errorS
     SVDEBUG << "ScoreWidget::loadScoreFile: Asked to load MEI file \""
             << scoreFile << "\" for score \"" << scoreName << "\"" << endl;
 
-    vrv::Toolkit toolkit(false);
+    // The toolkit, and the Verovio document within it, are kept for
+    // as long as the score is shown, so that a change of size or
+    // scale only needs a new layout rather than a reload
+    
+    auto toolkit = std::make_unique<vrv::Toolkit>(false);
+    m_aspectRatioAtLoad = double(width()) / double(height());
+    if (!setupToolkit(*toolkit, scoreFile, m_aspectRatioAtLoad, errorString)) {
+        return false;
+    }
+
+    m_toolkit = std::move(toolkit);
+    
+    int pp = m_toolkit->GetPageCount();
+
+    SVDEBUG << "ScoreWidget::loadScoreFile: Have " << pp << " pages" << endl;
+
+    m_pages = vector<shared_ptr<ScorePage>>(pp);
+    m_pageNotes = vector<vector<int>>(pp);
+    
+    if (!renderPage(0)) {
+        errorString = "Failed to render score page";
+        m_pages.clear();
+        m_toolkit.reset();
+        return false;
+    }
+    
+    m_scoreName = scoreName;
+    m_scoreFilename = scoreFile;
+
+    SVDEBUG << "ScoreWidget::loadScoreFile: Load successful, showing first page"
+            << endl;
+    showPage(0);
+    return true;
+}
+
+bool
+ScoreWidget::renderPage(int p)
+{
+    if (!m_toolkit || p < 0 || p >= int(m_pages.size())) {
+        return false;
+    }
+    if (m_pages[p]) {
+        return true;
+    }
+
+    TraceScope trace("ScoreWidget::renderPage", "score");
+
+    // Pages are recorded directly into display lists, without going
+    // through SVG: see exportPageToSvg for the SVG route
+    
+    QtDeviceContext dc;
+    dc.SetResources(&m_toolkit->GetResources());
+
+    if (!m_toolkit->RenderToDeviceContext(p + 1, &dc)) { // (verovio is 1-based)
+        SVDEBUG << "ScoreWidget::renderPage: Failed to render page "
+                << p << endl;
+        return false;
+    }
+
+    m_pages[p] = dc.takePage();
+    m_placementsValid = false;
+
+    SVDEBUG << "ScoreWidget::renderPage: recorded page " << p
+            << " with " << m_pages[p]->getItems().size() << " items and "
+            << m_pages[p]->getElements().size() << " elements" << endl;
+
+    mapEventsOnPage(p);
+    return true;
+}
+
+void
+ScoreWidget::renderNeighbouringPages()
+{
+    // Record the pages either side of the one shown, one per timer
+    // tick, so that turning to either of them is quick. As this
+    // starts when a page is shown, the next page is normally recorded
+    // long before playback reaches the end of the current one. Other
+    // pages are recorded only when something needs them
+
+    if (m_viewMode != ViewMode::Paged) {
+        return;
+    }
+    
+    for (int p : { m_page + 1, m_page - 1 }) {
+        if (p < 0 || p >= int(m_pages.size()) || m_pages[p]) {
+            continue;
+        }
+        if (!renderPage(p)) {
+            return;
+        }
+        if (p == m_page + 1) {
+            // in case playback has already reached the last system
+            prefetchNextPage(m_eventToHighlight);
+        }
+        m_renderTimer.start(0);
+        return;
+    }
+}
+
+bool
+ScoreWidget::haveAllPages() const
+{
+    for (const auto &page : m_pages) {
+        if (!page) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+ScoreWidget::setupToolkit(vrv::Toolkit &toolkit, QString scoreFile,
+                          double myAspectRatio, QString &errorString)
+{
     if (!toolkit.SetResourcePath(m_verovioResourcePath)) {
-        SVDEBUG << "ScoreWidget::loadScoreFile: Failed to set Verovio resource path" << endl;
+        SVDEBUG << "ScoreWidget::setupToolkit: Failed to set Verovio resource path" << endl;
+        errorString = "Failed to set Verovio resource path";
         return false;
     }
 
 //    std::cout << toolkit.GetOptionUsageString() << std::endl;
 //    std::cout << toolkit.GetAvailableOptions() << std::endl;
 
-    double myAspectRatio = double(width()) / double(height());
-    m_aspectRatioAtLoad = myAspectRatio;
-    bool singleSystem = (myAspectRatio > m_switchLayoutAtThisAspectRatio);
+    applyLayoutOptions(toolkit, myAspectRatio);
+    
+    if (!toolkit.LoadFile(scoreFile.toStdString())) {
+        SVDEBUG << "ScoreWidget::setupToolkit: Load failed in Verovio toolkit" << endl;
+        errorString = "Failed to load score file";
+        return false;
+    }
+
+    return true;
+}
+
+void
+ScoreWidget::applyLayoutOptions(vrv::Toolkit &toolkit, double myAspectRatio)
+{
+    bool singleSystem = (m_viewMode == ViewMode::Paged &&
+                         myAspectRatio > m_switchLayoutAtThisAspectRatio);
     int pageHeight = 2970; // A4
     int pageWidth = 2100; // A4
 
@@ -215,319 +480,336 @@ ScoreWidget::loadScoreFile(QString scoreName, QString scoreFile, QString &errorS
     options = options.replace('\'', '"');
     
     toolkit.SetOptions(options.toStdString());
-    
-    if (m_scale != 100) {
-        if (!toolkit.SetScale(m_scale)) {
-            SVDEBUG << "ScoreWidget::loadScoreFile: Failed to set rendering scale" << endl;
-        } else {
-            SVDEBUG << "ScoreWidget::loadScoreFile: Set scale to " << m_scale << endl;
-        }
+
+    // Always set the scale, even when it is the default, as the
+    // toolkit may previously have been laid out at another one
+    if (!toolkit.SetScale(m_scale)) {
+        SVDEBUG << "ScoreWidget::applyLayoutOptions: Failed to set rendering scale" << endl;
+    } else {
+        SVDEBUG << "ScoreWidget::applyLayoutOptions: Set scale to " << m_scale << endl;
     }
     
     SVDEBUG << "options: " << toolkit.GetOptions() << endl;
-    
-    if (!toolkit.LoadFile(scoreFile.toStdString())) {
-        SVDEBUG << "ScoreWidget::loadScoreFile: Load failed in Verovio toolkit" << endl;
+}
+
+bool
+ScoreWidget::exportPageToSvg(int page, QString filename, QString &errorString)
+{
+    if (!m_toolkit || page < 0 || page >= getPageCount()) {
+        errorString = "No score page to export";
         return false;
     }
 
-    int pp = toolkit.GetPageCount();
-
-    SVDEBUG << "ScoreWidget::loadScoreFile: Have " << pp << " pages" << endl;
-    
-    for (int p = 0; p < pp; ++p) {
-
-        std::string svgText = toolkit.RenderToSVG(p + 1); // (verovio is 1-based)
-
-        // Verovio generates SVG 1.1, this transforms its output to
-        // SVG 1.2 Tiny required by Qt
-        svgText = VrvTrim::transformSvgToTiny(svgText);
-
-        QByteArray svgData = QByteArray::fromStdString(svgText);
-        
-        shared_ptr<QSvgRenderer> renderer = make_shared<QSvgRenderer>(svgData);
-        renderer->setAspectRatioMode(Qt::KeepAspectRatio);
-
-        SVDEBUG << "ScoreWidget::loadScoreFile: created renderer from "
-                << svgData.size() << "-byte SVG data" << endl;
-
-        m_svgPages.push_back(renderer);
+    // The resident toolkit has the same layout as is shown, so the
+    // page breaks match
+    std::string svgText = m_toolkit->RenderToSVG(page + 1, true);
+    if (svgText == "") {
+        errorString = "Failed to render score page as SVG";
+        return false;
+    }
 
-        findSystemExtents(svgData, renderer);
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        errorString = QString("Failed to open file \"%1\" for writing")
+            .arg(filename);
+        return false;
     }
-    
-    m_scoreName = scoreName;
-    m_scoreFilename = scoreFile;
 
-    SVDEBUG << "ScoreWidget::loadScoreFile: Load successful, showing first page"
-            << endl;
-    showPage(0);
+    file.write(QByteArray::fromStdString(svgText));
     return true;
 }
 
 bool
-ScoreWidget::reloadScoreFile(QString &errorString)
+ScoreWidget::relayout(QString &errorString)
 {
-    auto scoreName = m_scoreName;
-    auto scoreFilename = m_scoreFilename;
-    auto musicalEvents = m_musicalEvents;
+    TraceScope trace("ScoreWidget::relayout", "score");
 
-    auto highlightEventLabel = m_highlightEventLabel;
+    if (!m_toolkit) {
+        errorString = "No score loaded";
+        return false;
+    }
 
-    auto selectStartLabel = m_selectStart.label;
-    auto selectEndLabel = m_selectEnd.label;
-        
-    QString firstEventOnPageId;
-    if (m_page > 0 && !m_pageEventsMap[m_page].empty()) {
-        firstEventOnPageId = m_pageEventsMap[m_page][0];
+    // Find something to keep in view: the highlighted event if there
+    // is one, otherwise the first event on the current page
+    
+    int anchorNote = m_eventToHighlight.note;
+    if (anchorNote < 0 && m_page > 0 && m_page < int(m_pageNotes.size()) &&
+        !m_pageNotes[m_page].empty()) {
+        anchorNote = m_pageNotes[m_page][0];
     }
 
-    SVDEBUG << "ScoreWidget::reloadScoreFile: saved highlightEventLabel as \""
-            << highlightEventLabel << "\" and firstEventOnPageId as \""
-            << firstEventOnPageId << "\"" << endl;
+    int selectStartNote = m_selectStart.note;
+    int selectEndNote = m_selectEnd.note;
+    int highlightNote = m_eventToHighlight.note;
+    
+    SVDEBUG << "ScoreWidget::relayout: anchoring at \""
+            << (anchorNote < 0 ? EventId() : m_noteIds[anchorNote])
+            << "\"" << endl;
+
+    m_renderTimer.stop();
+    
+    m_aspectRatioAtLoad = double(width()) / double(height());
+    applyLayoutOptions(*m_toolkit, m_aspectRatioAtLoad);
+    m_toolkit->RedoLayout();
+
+    // All pages are now out of date, but only the one we are going
+    // to show is rendered straight away
     
-    if (!loadScoreFile(scoreName, scoreFilename, errorString)) {
+    m_pages = vector<shared_ptr<ScorePage>>(m_toolkit->GetPageCount());
+    clearEventLayout();
+    m_glyphAtlas.clear();
+    m_prefetcher.clear();
+    ++m_layoutGeneration;
+
+    m_placements.clear();
+    m_placementsValid = false;
+    m_scrollTimer.stop();
+    m_scrollPos = 0.0;
+    m_scrollTarget = 0.0;
+
+    int page = 0;
+    if (anchorNote >= 0) {
+        page = std::max(0, findPageWithNote(anchorNote));
+    }
+
+    if (!renderPage(page)) {
+        errorString = "Failed to render score page";
         return false;
     }
 
-    SVDEBUG << "ScoreWidget::reloadScoreFile: reloaded, resetting musical events to recreate page maps" << endl;
+    m_selectStart = resolveEvent(selectStartNote);
+    m_selectEnd = resolveEvent(selectEndNote);
+    m_eventToHighlight = resolveEvent(highlightNote);
     
-    setMusicalEvents(musicalEvents);
+    m_page = -1;
+    showPage(page);
+    return true;
+}
 
-    if (selectStartLabel != "") {
-        m_selectStart = getEventWithLabel(selectStartLabel);
+int
+ScoreWidget::findPageWithNote(int note) const
+{
+    if (note < 0) {
+        return -1;
     }
-    if (selectEndLabel != "") {
-        m_selectEnd = getEventWithLabel(selectEndLabel);
+    if (!m_noteData[note].isNull()) {
+        return m_noteData[note].page;
     }
+    if (!m_toolkit) {
+        return -1;
+    }
+    return m_toolkit->GetPageWithElement(m_noteIds[note].toStdString()) - 1;
+}
 
-    if (highlightEventLabel != "") {
-        SVDEBUG << "ScoreWidget::reloadScoreFile: resetting to highlighted event" << endl;
-        setHighlightEventByLabel(highlightEventLabel);
-    } else if (firstEventOnPageId != "") {
-        SVDEBUG << "ScoreWidget::reloadScoreFile: resetting to first event on page" << endl;
-        auto firstEventOnPage = getEventWithId(firstEventOnPageId);
-        if (!firstEventOnPage.isNull()) {
-            showPage(firstEventOnPage.page);
-        }
+ScoreWidget::EventData
+ScoreWidget::resolveEvent(int note)
+{
+    if (note < 0) {
+        return {};
     }
+    if (m_noteData[note].isNull() && !haveAllPages()) {
+        renderPage(findPageWithNote(note));
+    }
+    return m_noteData[note];
+}
 
-    return true;
+int
+ScoreWidget::findNote(const EventId &id) const
+{
+    return m_noteIndex.find(id, [this](int n) -> const EventId & {
+        return m_noteIds[n];
+    });
 }
 
-void
-ScoreWidget::findSystemExtents(QByteArray svgData, shared_ptr<QSvgRenderer> renderer)
+int
+ScoreWidget::findNoteWithLabel(const EventLabel &label) const
 {
-    // Study the system dimensions in order to calculate proper
-    // highlight positions, and add them to m_noteSystemExtentMap.
+    return m_labelIndex.find(label, [this](int n) -> const EventLabel & {
+        return m_eventLabels[m_noteEvents[n]];
+    });
+}
 
-    // We are now parsing the SVG XML in three different ways! But I
-    // still don't think it's a significant overhead
-    
-    QDomDocument doc;
-    doc.setContent(svgData);
+const ScoreWidget::EventId &
+ScoreWidget::getIdOf(const EventData &data) const
+{
+    static const EventId none;
+    return data.isNull() ? none : m_noteIds[data.note];
+}
 
-    Extent currentExtent;
-    vector<double> staffLines;
+const ScoreWidget::EventLabel &
+ScoreWidget::getLabelOf(const EventData &data) const
+{
+    static const EventLabel none;
+    return data.isNull() ? none : m_eventLabels[data.indexInEvents];
+}
 
-    auto extractExtent = [&](QDomElement path,
-                             QString systemId,
-                             QString staffId) -> Extent {
-        
-        // We're looking for a path of the form Mx0 y0 Lx1 y1
-        
-        QStringList dd = path.attribute("d").split(" ", Qt::SkipEmptyParts);
-        if (dd.size() != 4) return {};
+void
+ScoreWidget::clearEventLayout()
+{
+    m_noteData = vector<EventData>(m_noteIds.size());
+    m_pageNotes = vector<vector<int>>(m_pages.size());
+    m_selectionRects.clear();
+}
 
-        if (dd[0].startsWith("M", Qt::CaseInsensitive)) {
-            dd[0] = dd[0].right(dd[0].length()-1);
-        } else return {};
+void
+ScoreWidget::setMusicalEvents(SharedMusicalEvents events)
+{
+    TraceScope trace("ScoreWidget::setMusicalEvents", "score");
 
-        if (dd[2].startsWith("L", Qt::CaseInsensitive)) {
-            dd[2] = dd[2].right(dd[2].length()-1);
-        } else return {};
-        
-        bool ok = false;
-        double x0 = dd[0].toDouble(&ok); if (!ok) return {};
-        double y0 = dd[1].toDouble(&ok); if (!ok) return {};
-        double x1 = dd[2].toDouble(&ok); if (!ok) return {};
-        double y1 = dd[3].toDouble(&ok); if (!ok) return {};
-        
-        if (systemId != "" && y1 > y0 && x1 == x0) {
-#ifdef DEBUG_SCORE_WIDGET
-            SVDEBUG << "Found possible extent for system with id \""
-                    << systemId << "\": from "
-                    << y0 << " -> " << y1 << endl;
-#endif
-            QRectF mapped = renderer->transformForElement(systemId)
-                .mapRect(QRectF(0, y0, 1, y1 - y0));
-            return Extent(mapped.y(), mapped.height());
-        }
+    m_musicalEvents = (events ? events : getEmptyMusicalEvents());
 
-        if (staffId != "" && x1 > x0 && y1 == y0 &&
-            staffLines.size() < 5) {
-#ifdef DEBUG_SCORE_WIDGET
-            SVDEBUG << "Found possible staff line for staff with id \""
-                    << staffId << "\": from "
-                    << x0 << " to " << x1 << " at y = " << y0 << endl;
-#endif
-            staffLines.push_back(y0);
-            if (staffLines.size() == 5) {
-                y0 = staffLines[0];
-                y1 = staffLines[4];
 #ifdef DEBUG_SCORE_WIDGET
-                SVDEBUG << "Deducing extent from staff lines as "
-                        << y0 << " -> " << y1 << endl;
+    SVDEBUG << "ScoreWidget::setMusicalEvents: " << m_musicalEvents->size()
+            << " events" << endl;
 #endif
-                QRectF mapped = renderer->transformForElement(staffId)
-                    .mapRect(QRectF(0, y0, 1, y1 - y0));
-                return Extent(mapped.y(), mapped.height());
-            }
-        }                
-        
-        return {};
-    };
-    
-    std::function<void(QDomNode, QString, QString)> descend =
-        [&](QDomNode node, QString systemId, QString staffId) {
-
-        if (!node.isElement()) {
-            return;
-        }
 
-        QDomElement elt = node.toElement();
-        QString tag = elt.tagName();
-
-        if (systemId != "" || staffId != "") {
-            if (currentExtent.isNull() && tag == "path") {
-                // Haven't yet seen system dimensions, defined using
-                // either the vertical path that joins the systems, or
-                // if there is only one staff, locations of the first
-                // and fifth staff lines. This might be one of the
-                // bits of evidence we need
-                currentExtent = extractExtent(elt, systemId, staffId);
-            }
-        }
-        
-        if (tag == "g") {
-            // The remaining elements we're interested in (system,
-            // staff, note) are all defined using group tags in SVG
+    // Intern the notes and index them by ID and label, which does
+    // not depend on the layout. The events are then associated with
+    // pages as each page is rendered
 
-            QStringList classes =
-                elt.attribute("class").split(" ", Qt::SkipEmptyParts);
+    int n = int(m_musicalEvents->size());
+    
+    m_noteIds.clear();
+    m_noteEvents.clear();
+    m_eventLabels.clear();
+    m_eventLabels.reserve(n);
+    m_eventFirstNotes = vector<int>(n, -1);
+    m_noteIndex.clear();
+    m_noteIndex.reserve(n);
+    m_labelIndex.clear();
+    m_labelIndex.reserve(n);
+
+    auto noteIdOf = [this](int note) -> const EventId & {
+        return m_noteIds[note];
+    };
+    auto labelOf = [this](int note) -> const EventLabel & {
+        return m_eventLabels[m_noteEvents[note]];
+    };
 
-            if (systemId == "" && classes.contains("system")) {
-                systemId = elt.attribute("id");
-                currentExtent = {};
+    for (int ix = 0; ix < n; ++ix) {
+        const auto &ev = (*m_musicalEvents)[ix];
+        m_eventLabels.push_back(ev.measureInfo.toLabel());
+        for (const auto &nt : ev.notes) {
+            if (!nt.isNewNote) {
+                continue;
             }
-
-            if (staffId == "" && classes.contains("staff")) {
-                staffId = elt.attribute("id");
-                staffLines.clear();
-                if (systemId == "") { // a staff outside a system
-                    currentExtent = {};
-                }
+            EventId id = QString::fromStdString(nt.noteId);
+            if (id == "") {
+                SVDEBUG << "ScoreWidget::setMusicalEvents: NOTE: found note with no id" << endl;
+                continue;
             }
-            
-            if (!currentExtent.isNull() && classes.contains("note")) {
-                QString noteId = elt.attribute("id");
-                if (noteId != "") {
-#ifdef DEBUG_EVENT_FINDING
-                    SVDEBUG << "Assigning system extent ("
-                            << currentExtent.y << ","
-                            << currentExtent.height
-                            << ") to note with id \"" << noteId << "\"" << endl;
-#endif
-                    m_noteSystemExtentMap[noteId] = currentExtent;
-                }
+            int note = m_noteIndex.find(id, noteIdOf);
+            if (note < 0) {
+                note = int(m_noteIds.size());
+                m_noteIds.push_back(id);
+                m_noteEvents.push_back(ix);
+                m_noteIndex.insert(id, note, noteIdOf);
+            } else {
+                m_noteEvents[note] = ix;
             }
+            m_labelIndex.insert(m_eventLabels[ix], note, labelOf);
         }
-            
-        auto children = node.childNodes();
-        for (int i = 0; i < children.size(); ++i) {
-            descend(children.at(i), systemId, staffId);
-        }
-    };
+    }
 
-    descend(doc.documentElement(), "", "");
-}                       
+    // An event is located by its first note, which might not be one
+    // that starts there (in which case it has no location of its own)
+    
+    for (int ix = 0; ix < n; ++ix) {
+        const auto &ev = (*m_musicalEvents)[ix];
+        if (!ev.notes.empty()) {
+            m_eventFirstNotes[ix] =
+                findNote(QString::fromStdString(ev.notes.begin()->noteId));
+        }
+    }
+    
+    clearEventLayout();
 
-void
-ScoreWidget::setMusicalEvents(const Score::MusicalEventList &events)
-{
-    m_musicalEvents = events;
+    if (m_pages.empty()) {
+        SVDEBUG << "ScoreWidget::setMusicalEvents: WARNING: No pages, score should have been set before this" << endl;
+        return;
+    }
 
+    for (int p = 0; p < int(m_pages.size()); ++p) {
+        mapEventsOnPage(p);
+    }
+    
 #ifdef DEBUG_SCORE_WIDGET
-    SVDEBUG << "ScoreWidget::setMusicalEvents: " << events.size()
-            << " events" << endl;
+    SVDEBUG << "ScoreWidget::setMusicalEvents: Done" << endl;
 #endif
+}
 
-    m_idDataMap.clear();
-    m_labelIdMap.clear();
-    m_pageEventsMap.clear();
+void
+ScoreWidget::mapEventsOnPage(int p)
+{
+    if (p < int(m_selectionRects.size())) {
+        m_selectionRects[p] = {};
+    }
     
-    if (m_svgPages.empty()) {
-        SVDEBUG << "ScoreWidget::setMusicalEvents: WARNING: No SVG pages, score should have been set before this" << endl;
+    if (!m_pages[p] || m_noteIds.empty()) {
         return;
     }
+
+    const auto &notes = m_pages[p]->getNotes();
+    const auto &systems = m_pages[p]->getSystems();
+
+    auto &pageNotes = m_pageNotes[p];
+    pageNotes.clear();
     
-    int p = 0;
-    int npages = m_svgPages.size();
-    int ix = 0;
-    
-    for (const auto &ev : m_musicalEvents) {
-        for (const auto &n : ev.notes) {
-            if (!n.isNewNote) {
-                continue;
-            }
-            EventId id = QString::fromStdString(n.noteId);
-            if (id == "") {
-                SVDEBUG << "ScoreWidget::setMusicalEvents: NOTE: found note with no id" << endl;
-                continue;
-            }
-            if (p + 1 < npages &&
-                !m_svgPages[p]->elementExists(id) &&
-                m_svgPages[p + 1]->elementExists(id)) {
-                ++p;
-            }
+    for (const auto &note : notes) {
 
-            if (m_svgPages[p]->elementExists(id)) {
+        int n = findNote(note.id);
+        if (n < 0) {
+            continue;
+        }
 
-                QRectF rect = m_svgPages[p]->boundsOnElement(id); 
-                rect = m_svgPages[p]->transformForElement(id).mapRect(rect);
+        int ix = m_noteEvents[n];
+        const auto &ev = (*m_musicalEvents)[ix];
+        
+        // The highlight spans the whole height of the system
+        // containing the note, where we know it
+                
+        QRectF rect = note.bounds;
+        QRectF highlight = rect;
+        if (note.system >= 0) {
+            const auto &system = systems[note.system];
+            if (system.height > 0.0) {
+                highlight = QRectF(rect.x(), system.y,
+                                   rect.width(), system.height);
+            }
+        }
 
 #ifdef DEBUG_EVENT_FINDING
-                SVDEBUG << "found note id " << id << " for event at "
-                        << ev.measureInfo.toLabel()
-                        << " -> page " << p << ", rect "
-                        << rect.x() << "," << rect.y() << " " << rect.width()
-                        << "x" << rect.height() << endl;
+        SVDEBUG << "found note id " << note.id << " for event at "
+                << m_eventLabels[ix]
+                << " -> page " << p << ", rect "
+                << rect.x() << "," << rect.y() << " " << rect.width()
+                << "x" << rect.height() << endl;
 #endif
 
-                EventData data;
-                data.id = id;
-                data.page = p;
-                data.boxOnPage = rect;
-                data.location = ev.measureInfo.measureFraction;
-                data.label = ev.measureInfo.toLabel();
-                data.indexInEvents = ix;
-                m_idDataMap[id] = data;
-                m_pageEventsMap[p].push_back(id);
-                m_labelIdMap[data.label] = id;
-            }
-        }
-        ++ix;
+        EventData &data = m_noteData[n];
+        data.note = n;
+        data.page = p;
+        data.boxOnPage = rect;
+        data.highlightOnPage = highlight;
+        data.system = note.system;
+        data.location = ev.measureInfo.measureFraction;
+        data.indexInEvents = ix;
+
+        pageNotes.push_back(n);
     }
 
-#ifdef DEBUG_SCORE_WIDGET
-    SVDEBUG << "ScoreWidget::setMusicalEvents: Done" << endl;
-#endif
+    // Notes on a page are kept in score order, which is the order in
+    // which they were interned, not drawing order
+    
+    std::sort(pageNotes.begin(), pageNotes.end());
 }
 
 void
 ScoreWidget::resizeEvent(QResizeEvent *)
 {
-    if (m_page >= 0) {
+    if (m_viewMode != ViewMode::Paged) {
+        scrollTo(m_scrollTarget, false);
+    } else if (m_page >= 0) {
         showPage(m_page);
     }
 
@@ -537,6 +819,11 @@ ScoreWidget::resizeEvent(QResizeEvent *)
 void
 ScoreWidget::resizedTimerElapsed()
 {
+    if (m_viewMode != ViewMode::Paged) {
+        // The scrolling layout does not depend on the widget shape
+        return;
+    }
+    
     double aspect = double(width()) / double(height());
 
     if (aspect <= m_switchLayoutAtThisAspectRatio &&
@@ -549,7 +836,7 @@ ScoreWidget::resizedTimerElapsed()
     }
     
     QString error;
-    if (!reloadScoreFile(error)) {
+    if (!relayout(error)) {
         SVDEBUG << error << endl;
     }
 }
@@ -576,21 +863,26 @@ ScoreWidget::mouseMoveEvent(QMouseEvent *e)
 {
     if (!m_mouseActive) return;
 
+    auto &latency =
+        LatencyMonitor::getProbe(LatencyMonitor::Metric::ScoreHover);
+    latency.inputReceived();
+    
     m_eventUnderMouse = getEventAtPoint(e->pos());
 
 #ifdef DEBUG_SCORE_WIDGET
     SVDEBUG << "ScoreWidget::mouseMoveEvent: id under mouse = "
-            << m_eventUnderMouse.id << endl;
+            << getIdOf(m_eventUnderMouse) << endl;
 #endif
     
     update();
+    latency.repaintRequested();
 
     if (!m_eventUnderMouse.isNull()) {
 #ifdef DEBUG_SCORE_WIDGET
         SVDEBUG << "ScoreWidget::mouseMoveEvent: Emitting scorePositionHighlighted at " << m_eventUnderMouse.location << endl;
 #endif
         emit scoreLocationHighlighted(m_eventUnderMouse.location,
-                                      m_eventUnderMouse.label,
+                                      getLabelOf(m_eventUnderMouse),
                                       m_mode);
     }
 }
@@ -604,7 +896,7 @@ ScoreWidget::mousePressEvent(QMouseEvent *e)
     
     mouseMoveEvent(e);
 
-    if (!m_musicalEvents.empty() && !m_eventUnderMouse.isNull() &&
+    if (!m_musicalEvents->empty() && !m_eventUnderMouse.isNull() &&
         (m_mode == InteractionMode::SelectStart ||
          m_mode == InteractionMode::SelectEnd)) {
 
@@ -632,10 +924,10 @@ ScoreWidget::mousePressEvent(QMouseEvent *e)
         if (end.isNull()) end = getScoreEndEvent();
         emit selectionChanged(start.location,
                               isSelectedFromStart(),
-                              start.label,
+                              getLabelOf(start),
                               end.location,
                               isSelectedToEnd(),
-                              end.label);
+                              getLabelOf(end));
         update();
     }
 
@@ -644,7 +936,7 @@ ScoreWidget::mousePressEvent(QMouseEvent *e)
         SVDEBUG << "ScoreWidget::mousePressEvent: Emitting scorePositionActivated at " << m_eventUnderMouse.location << endl;
 #endif
         emit scoreLocationActivated(m_eventUnderMouse.location,
-                                    m_eventUnderMouse.label,
+                                    getLabelOf(m_eventUnderMouse),
                                     m_mode);
         update();
     }
@@ -666,10 +958,10 @@ ScoreWidget::clearSelection()
 
     emit selectionChanged(m_selectStart.location,
                           true,
-                          getScoreStartEvent().label,
+                          getLabelOf(getScoreStartEvent()),
                           m_selectEnd.location,
                           true,
-                          getScoreEndEvent().label);
+                          getLabelOf(getScoreEndEvent()));
 
     update();
 }
@@ -699,14 +991,14 @@ ScoreWidget::zoomReset()
 ScoreWidget::EventData
 ScoreWidget::getScoreStartEvent() const
 {
-    if (m_musicalEvents.empty()) return {};
-    return getEventForMusicalEvent(*m_musicalEvents.begin());
+    if (m_musicalEvents->empty()) return {};
+    return getEventForMusicalEvent(0);
 }
 
 bool
 ScoreWidget::isSelectedFromStart() const
 {
-    return (m_musicalEvents.empty() ||
+    return (m_musicalEvents->empty() ||
             m_selectStart.isNull() ||
             m_selectStart.indexInEvents == 0);
 }
@@ -714,46 +1006,33 @@ ScoreWidget::isSelectedFromStart() const
 ScoreWidget::EventData
 ScoreWidget::getScoreEndEvent() const
 {
-    if (m_musicalEvents.empty()) return {};
-    return getEventForMusicalEvent(*m_musicalEvents.rbegin());
+    if (m_musicalEvents->empty()) return {};
+    return getEventForMusicalEvent(int(m_musicalEvents->size()) - 1);
 }
 
-ScoreWidget::EventData
-ScoreWidget::getEventForMusicalEvent(const Score::MusicalEvent &mev) const
+const ScoreWidget::EventData &
+ScoreWidget::getEventForNote(int note) const
 {
-    if (mev.notes.empty()) return {};
-    return getEventWithId(mev.notes.begin()->noteId);
+    static const EventData none;
+    if (note < 0) return none;
+    return m_noteData[note];
 }
 
-ScoreWidget::EventData
-ScoreWidget::getEventWithId(EventId id) const
+const ScoreWidget::EventData &
+ScoreWidget::getEventForMusicalEvent(int indexInEvents) const
 {
-    auto itr = m_idDataMap.find(id);
-    if (itr == m_idDataMap.end()) {
-        return {};
+    if (indexInEvents < 0 || indexInEvents >= int(m_eventFirstNotes.size())) {
+        return getEventForNote(-1);
     }
-    return itr->second;
-}
-
-ScoreWidget::EventData
-ScoreWidget::getEventWithId(const std::string &id) const
-{
-    return getEventWithId(QString::fromStdString(id));
-}
-
-ScoreWidget::EventData
-ScoreWidget::getEventWithLabel(EventLabel label) const
-{
-    if (m_labelIdMap.find(label) == m_labelIdMap.end()) return {};
-    return getEventWithId(m_labelIdMap.at(label));
+    return getEventForNote(m_eventFirstNotes[indexInEvents]);
 }
 
 bool
 ScoreWidget::isSelectedToEnd() const
 {
-    return (m_musicalEvents.empty() ||
+    return (m_musicalEvents->empty() ||
             m_selectEnd.isNull() ||
-            m_selectEnd.indexInEvents + 1 >= int(m_musicalEvents.size()));
+            m_selectEnd.indexInEvents + 1 >= int(m_musicalEvents->size()));
 }
 
 bool
@@ -767,9 +1046,9 @@ ScoreWidget::getSelection(Fraction &start, EventLabel &startLabel,
                           Fraction &end, EventLabel &endLabel) const
 {
     start = m_selectStart.location;
-    startLabel = m_selectStart.label;
+    startLabel = getLabelOf(m_selectStart);
     end = m_selectEnd.location;
-    endLabel = m_selectEnd.label;
+    endLabel = getLabelOf(m_selectEnd);
 }
 
 void
@@ -793,10 +1072,36 @@ ScoreWidget::mouseDoubleClickEvent(QMouseEvent *e)
 ScoreWidget::EventData
 ScoreWidget::getEventAtPoint(QPoint point)
 {
-    const auto &events = m_pageEventsMap[m_page];
+    // Find the page, and in the scrolling modes the system, under
+    // the point, and work in page coordinates from there
+    
+    int page = m_page;
+    int system = -1;
+    QPointF pagePoint;
+
+    if (m_viewMode == ViewMode::Paged) {
+        pagePoint = m_widgetToPage.map(QPointF(point));
+    } else {
+        updatePlacements();
+        QPointF scrollPoint = getScrollToWidget().inverted().map(QPointF(point));
+        int i = getPlacementAt(m_viewMode == ViewMode::ScrollVertical ?
+                               scrollPoint.y() : scrollPoint.x());
+        if (i < 0) {
+            return {};
+        }
+        page = m_placements[i].page;
+        system = m_placements[i].system;
+        pagePoint = scrollPoint - m_placements[i].offset;
+    }
+    
+    if (page < 0 || page >= int(m_pageNotes.size())) {
+        return {};
+    }
+    
+    const auto &pageNotes = m_pageNotes[page];
     
-    double px = point.x();
-    double py = point.y();
+    double px = pagePoint.x();
+    double py = pagePoint.y();
 
     EventData found;
     double foundX = 0.0;
@@ -805,17 +1110,17 @@ ScoreWidget::getEventAtPoint(QPoint point)
     SVDEBUG << "ScoreWidget::getEventAtPoint: point " << px << "," << py << endl;
 #endif
     
-    for (auto itr = events.begin(); itr != events.end(); ++itr) {
+    for (int n : pageNotes) {
 
-        EventId id = *itr;
-        EventData edata = getEventWithId(id);
+        const EventData &edata = m_noteData[n];
         if (edata.isNull()) continue;
+        if (system >= 0 && edata.system != system) continue;
         
-        QRectF r = getHighlightRectFor(edata);
+        QRectF r = edata.highlightOnPage;
         if (r == QRectF()) continue;
 
 #ifdef DEBUG_EVENT_FINDING
-        SVDEBUG << "ScoreWidget::getEventAtPoint: id " << *itr
+        SVDEBUG << "ScoreWidget::getEventAtPoint: id " << m_noteIds[n]
                 << " has rect " << r.x() << "," << r.y() << " "
                 << r.width() << "x" << r.height() << " (seeking " << px
                 << "," << py << ")" << endl;
@@ -834,7 +1139,7 @@ ScoreWidget::getEventAtPoint(QPoint point)
 
 #ifdef DEBUG_EVENT_FINDING
     SVDEBUG << "ScoreWidget::idAtPoint: point " << point.x()
-            << "," << point.y() << " -> element id " << found.id
+            << "," << point.y() << " -> element id " << getIdOf(found)
             << " with x = " << foundX << endl;
 #endif
     
@@ -844,19 +1149,33 @@ ScoreWidget::getEventAtPoint(QPoint point)
 QRectF
 ScoreWidget::getHighlightRectFor(const EventData &event)
 {
-    QRectF rect = event.boxOnPage;
+    QTransform transform;
+    if (!getPageToWidget(event.page, event.system, transform)) {
+        return {};
+    }
+    return transform.mapRect(event.highlightOnPage);
+}
 
-    if (m_noteSystemExtentMap.find(event.id) != m_noteSystemExtentMap.end()) {
-        Extent extent = m_noteSystemExtentMap.at(event.id);
-        rect = QRectF(rect.x(), extent.y, rect.width(), extent.height);
+bool
+ScoreWidget::getPageToWidget(int page, int system, QTransform &transform) const
+{
+    if (m_viewMode == ViewMode::Paged) {
+        transform = m_pageToWidget;
+        return true;
     }
-                      
-    return m_pageToWidget.mapRect(rect);
+    int i = findPlacement(page, system);
+    if (i < 0) {
+        return false;
+    }
+    transform = getPlacementTransform(i);
+    return true;
 }
 
 void
 ScoreWidget::paintEvent(QPaintEvent *e)
 {
+    TraceScope trace("ScoreWidget::paintEvent", "score");
+
     QFrame::paintEvent(e);
 
     if (m_initialSize == QSize()) {
@@ -865,20 +1184,38 @@ ScoreWidget::paintEvent(QPaintEvent *e)
     
     if (m_page < 0 || m_page >= getPageCount()) {
         SVDEBUG << "ScoreWidget::paintEvent: No page or page out of range, painting nothing" << endl;
-        return;
+    } else if (m_viewMode != ViewMode::Paged) {
+        paintScrolling();
+    } else {
+        paintPaged();
+    }
+
+    if (LatencyMonitor::isEnabled()) {
+        QPainter paint(this);
+        LatencyMonitor::paintOverlay
+            (paint, rect(), { LatencyMonitor::Metric::ScoreHover });
     }
+    
+    LatencyMonitor::getProbe(LatencyMonitor::Metric::ScoreHover).painted();
+}
 
+void
+ScoreWidget::paintPaged()
+{
     QPainter paint(this);
 
-    auto renderer = m_svgPages[m_page];
+    auto page = m_pages[m_page];
+    if (!page) {
+        SVDEBUG << "ScoreWidget::paintPaged: Page has not been rendered, painting nothing" << endl;
+        return;
+    }
 
-    // When we actually paint the SVG, we just tell Qt to stick it on
-    // the paint device scaled while preserving aspect. But we still
-    // need to do the same calculations ourselves to construct the
-    // transforms needed for mapping to e.g. mouse interaction space
+    // The page is scaled to fit the widget while preserving aspect,
+    // and the same transform is used for mapping to e.g. mouse
+    // interaction space
     
     QSizeF widgetSize = size();
-    QSizeF pageSize = renderer->viewBoxF().size();
+    QSizeF pageSize = page->getSize();
 
     double ww = widgetSize.width(), wh = widgetSize.height();
     double pw = pageSize.width(), ph = pageSize.height();
@@ -893,18 +1230,137 @@ ScoreWidget::paintEvent(QPaintEvent *e)
         return;
     }
     
+    m_pageToWidget = getPageFitTransform(pageSize);
+    m_widgetToPage = m_pageToWidget.inverted();
+    
+    paintHighlight(paint);
+    paintSelection(paint, m_page);
+
+    // If the page was prefetched (see prefetchNextPage) then it can
+    // be shown by drawing a single image
+    
+    QImage image = m_prefetcher.getImage(m_page, size(), devicePixelRatioF(),
+                                         m_layoutGeneration);
+    if (!image.isNull()) {
+        paint.resetTransform();
+        paint.drawImage(QPointF(0, 0), image);
+        return;
+    }
+    
+    paint.setTransform(m_pageToWidget);
+    page->paint(paint, m_useGlyphAtlas ? &m_glyphAtlas : nullptr);
+}
+
+QTransform
+ScoreWidget::getPageFitTransform(QSizeF pageSize) const
+{
+    double ww = width(), wh = height();
+    double pw = pageSize.width(), ph = pageSize.height();
+    
     double scale = std::min(ww / pw, wh / ph);
     double xorigin = (ww - (pw * scale)) / 2.0;
     double yorigin = (wh - (ph * scale)) / 2.0;
 
-    m_pageToWidget = QTransform();
-    m_pageToWidget.translate(xorigin, yorigin);
-    m_pageToWidget.scale(scale, scale);
+    QTransform transform;
+    transform.translate(xorigin, yorigin);
+    transform.scale(scale, scale);
+    return transform;
+}
+
+void
+ScoreWidget::prefetchNextPage(const EventData &event)
+{
+    // Called as the highlight moves during playback. Once it reaches
+    // the last system on the current page, have an image of the next
+    // page made in the background, so that turning to it costs only
+    // a single image copy.
+    //
+    // Recording the next page is the expensive part, and is not done
+    // here, as that would stall playback just before the turn. It is
+    // recorded in idle time as soon as the current page is shown (see
+    // renderNeighbouringPages), which calls back here when it is done
+    
+    if (m_viewMode != ViewMode::Paged || event.isNull() ||
+        event.page != m_page) {
+        return;
+    }
+
+    int next = m_page + 1;
+    if (next >= getPageCount() || !m_pages[m_page]) {
+        return;
+    }
+
+    int systems = int(m_pages[m_page]->getSystems().size());
+    if (event.system < systems - 1) {
+        return;
+    }
+
+    QSize widgetSize = size();
+    double dpr = devicePixelRatioF();
+    if (m_prefetcher.isPrefetched(next, widgetSize, dpr, m_layoutGeneration)) {
+        return;
+    }
+
+    if (!m_pages[next]) {
+        if (!m_renderTimer.isActive()) {
+            m_renderTimer.start(0);
+        }
+        return;
+    }
+
+#ifdef DEBUG_SCORE_WIDGET
+    SVDEBUG << "ScoreWidget::prefetchNextPage: prefetching page " << next
+            << endl;
+#endif
+    
+    m_prefetcher.prefetch(next, m_pages[next], widgetSize, dpr,
+                          getPageFitTransform(m_pages[next]->getSize()),
+                          m_layoutGeneration);
+}
+
+void
+ScoreWidget::paintScrolling()
+{
+    vector<int> visible = getVisiblePlacements();
+    if (visible.empty()) {
+        return;
+    }
+
+    QPainter paint(this);
+
+    paintHighlight(paint);
+
+    int prevPage = -1;
+    for (int i : visible) {
+        int page = m_placements[i].page;
+        if (page != prevPage) {
+            paintSelection(paint, page);
+            prevPage = page;
+        }
+    }
 
-    m_widgetToPage = QTransform();
-    m_widgetToPage.scale(1.0 / scale, 1.0 / scale);
-    m_widgetToPage.translate(-xorigin, -yorigin);
+    ScoreGlyphAtlas *atlas = (m_useGlyphAtlas ? &m_glyphAtlas : nullptr);
     
+    for (int i : visible) {
+        const auto &placement = m_placements[i];
+        const auto &page = m_pages[placement.page];
+        paint.setTransform(getPlacementTransform(i));
+        if (placement.system < 0) {
+            page->paint(paint, atlas);
+            continue;
+        }
+        page->paintSystem(paint, placement.system, atlas);
+        if (i == 0 && m_viewMode == ViewMode::ScrollVertical) {
+            // The first placement also has the title and anything
+            // else drawn outside the systems on the first page
+            page->paintSystem(paint, -1, atlas);
+        }
+    }
+}
+
+void
+ScoreWidget::paintHighlight(QPainter &paint)
+{
     // Show a highlight bar if the interaction mode is anything other
     // than None - the colour and location depend on the mode
     
@@ -916,13 +1372,13 @@ ScoreWidget::paintEvent(QPaintEvent *e)
             event = m_eventUnderMouse;
 #ifdef DEBUG_SCORE_WIDGET
             SVDEBUG << "ScoreWidget::paint: under mouse = "
-                    << event.label << endl;
+                    << getLabelOf(event) << endl;
 #endif
         } else {
             event = m_eventToHighlight;
 #ifdef DEBUG_SCORE_WIDGET
             SVDEBUG << "ScoreWidget::paint: to highlight = "
-                    << event.label << endl;
+                    << getLabelOf(event) << endl;
 #endif
         }
 
@@ -963,9 +1419,13 @@ ScoreWidget::paintEvent(QPaintEvent *e)
             }
         }
     }
+}
 
+void
+ScoreWidget::paintSelection(QPainter &paint, int page)
+{
     // Highlight the current selection if there is one
-    if (!m_musicalEvents.empty() &&
+    if (!m_musicalEvents->empty() && m_pages[page] &&
         (!isSelectedAll() ||
          (m_mode == InteractionMode::SelectStart ||
           m_mode == InteractionMode::SelectEnd))) {
@@ -975,112 +1435,142 @@ ScoreWidget::paintEvent(QPaintEvent *e)
         paint.setPen(Qt::NoPen);
         paint.setBrush(fillColour);
 
-        auto exclusiveComparator =
-            [](const Score::MusicalEvent &e, const Fraction &f) {
-                return e.measureInfo.measureFraction < f;
-        };
-        auto inclusiveComparator =
-            [](const Score::MusicalEvent &e, const Fraction &f) {
-                return !(f < e.measureInfo.measureFraction);
-        };
-        
-        Score::MusicalEventList::iterator i0 = m_musicalEvents.begin();
-        if (!m_selectStart.isNull()) {
-            i0 = lower_bound(m_musicalEvents.begin(), m_musicalEvents.end(),
-                             m_selectStart.location, exclusiveComparator);
-        }
-        Score::MusicalEventList::iterator i1 = m_musicalEvents.end();
-        if (!m_selectEnd.isNull()) {
-            i1 = lower_bound(m_musicalEvents.begin(), m_musicalEvents.end(),
-                             m_selectEnd.location, inclusiveComparator);
+        for (const auto &sr : getSelectionRects(page)) {
+            QTransform transform;
+            if (getPageToWidget(page, sr.system, transform)) {
+                paint.drawRect(transform.mapRect(sr.rect));
+            }
         }
+    }
+}
+
+const vector<ScoreWidget::SelectionRect> &
+ScoreWidget::getSelectionRects(int page)
+{
+    if (int(m_selectionRects.size()) <= page) {
+        m_selectionRects.resize(m_pages.size());
+    }
+    
+    auto &cache = m_selectionRects[page];
+    if (cache.valid &&
+        cache.start == m_selectStart.note &&
+        cache.end == m_selectEnd.note) {
+        return cache.rects;
+    }
+
+    TraceScope trace("ScoreWidget::getSelectionRects", "score");
+    
+    cache.rects.clear();
+    cache.start = m_selectStart.note;
+    cache.end = m_selectEnd.note;
+    cache.valid = true;
+    
+    auto exclusiveComparator =
+        [](const Score::MusicalEvent &e, const Fraction &f) {
+            return e.measureInfo.measureFraction < f;
+    };
+    auto inclusiveComparator =
+        [](const Score::MusicalEvent &e, const Fraction &f) {
+            return !(f < e.measureInfo.measureFraction);
+    };
+        
+    // The selection is the range of musical events [i0, i1),
+    // walked by index through the flat per-event tables
+        
+    const auto &events = *m_musicalEvents;
+    int n = int(events.size());
+        
+    int i0 = 0;
+    if (!m_selectStart.isNull()) {
+        i0 = int(lower_bound(events.begin(), events.end(),
+                             m_selectStart.location,
+                             exclusiveComparator) - events.begin());
+    }
+    int i1 = n;
+    if (!m_selectEnd.isNull()) {
+        i1 = int(lower_bound(events.begin(), events.end(),
+                             m_selectEnd.location,
+                             inclusiveComparator) - events.begin());
+    }
 
 #ifdef DEBUG_SCORE_WIDGET
-        SVDEBUG << "ScoreWidget::paint: selection spans from "
-                << m_selectStart.location << " to " << m_selectEnd.location
-                << " giving us iterators at "
-                << (i0 == m_musicalEvents.end() ? "(end)" :
-                    i0->notes.empty() ? "(location without note)" :
-                    i0->notes[0].noteId)
-                << " to " 
-                << (i1 == m_musicalEvents.end() ? "(end)" :
-                    i1->notes.empty() ? "(location without note)" :
-                    i1->notes[0].noteId)
-                << endl;
+    SVDEBUG << "ScoreWidget::getSelectionRects: selection spans from "
+            << m_selectStart.location << " to " << m_selectEnd.location
+            << " giving us events " << i0 << " to " << i1 << " of "
+            << n << endl;
 #endif
 
-        double lineOrigin = m_pageToWidget.map(QPointF(0, 0)).x();
-        double lineWidth = m_pageToWidget.map(QPointF(pageSize.width(), 0)).x();
+    // The rects are in page coordinates, and are mapped to the widget
+    // only when they are drawn. Each runs from its event to the next
+    // one on the same line, or to the end of the line
         
-        double prevY = -1.0;
-        double furthestX = 0.0;
+    double lineOrigin = 0.0;
+    double lineWidth = m_pages[page]->getSize().width();
+        
+    double prevY = -1.0;
+    double furthestX = 0.0;
 
-        for (auto i = i0; i != i1 && i != m_musicalEvents.end(); ++i) {
-            EventData data = getEventForMusicalEvent(*i);
-            if (data.page < m_page) {
-                continue;
-            }
-            if (data.page > m_page) {
-                break;
-            }
-            QRectF rect = getHighlightRectFor(data);
+    for (int i = i0; i < i1 && i < n; ++i) {
+        const EventData &data = getEventForMusicalEvent(i);
+        if (data.page < page) {
+            continue;
+        }
+        if (data.page > page) {
+            break;
+        }
+        QRectF rect = data.highlightOnPage;
 #ifdef DEBUG_EVENT_FINDING                    
-            SVDEBUG << "I'm at " << rect.x() << "," << rect.y() << " with width "
-                    << rect.width() << " (furthest X so far = " << furthestX
-                    << ")" << endl;
+        SVDEBUG << "I'm at " << rect.x() << "," << rect.y() << " with width "
+                << rect.width() << " (furthest X so far = " << furthestX
+                << ")" << endl;
 #endif
-            if (rect == QRectF()) {
-                continue;
-            }
-            if (i == i0) {
-                prevY = rect.y();
-            }
-            if (rect.y() > prevY) {
+        if (rect == QRectF()) {
+            continue;
+        }
+        if (i == i0) {
+            prevY = rect.y();
+        }
+        if (rect.y() > prevY) {
 #ifdef DEBUG_EVENT_FINDING
-                SVDEBUG << "New line, resetting x and furthestX to " << lineOrigin << endl;
+            SVDEBUG << "New line, resetting x and furthestX to " << lineOrigin << endl;
 #endif
-                rect.setX(lineOrigin);
-                furthestX = lineOrigin;
-            } else if (rect.x() < furthestX - 0.001) {
-                continue;
-            }
-            auto j = i;
-            ++j;
-            if (j != i1) {
-                rect.setWidth(lineWidth - rect.x());
-            }
-            while (j != m_musicalEvents.end()) {
-                EventData nextData = getEventForMusicalEvent(*j);
-                QRectF nextRect = getHighlightRectFor(nextData);
-                if (nextData.page == m_page &&
-                    nextRect.y() <= rect.y() &&
-                    nextRect.x() >= rect.x() &&
-                    nextRect.width() > 0) {
+            rect.setX(lineOrigin);
+            furthestX = lineOrigin;
+        } else if (rect.x() < furthestX - 0.001) {
+            continue;
+        }
+        int j = i + 1;
+        if (j != i1) {
+            rect.setWidth(lineWidth - rect.x());
+        }
+        while (j < n) {
+            const EventData &nextData = getEventForMusicalEvent(j);
+            const QRectF &nextRect = nextData.highlightOnPage;
+            if (nextData.page == page &&
+                nextRect.y() <= rect.y() &&
+                nextRect.x() >= rect.x() &&
+                nextRect.width() > 0) {
 #ifdef DEBUG_EVENT_FINDING                    
-                    SVDEBUG << "next event is at " << nextRect.x()
-                            << " with width " << nextRect.width() << endl;
+                SVDEBUG << "next event is at " << nextRect.x()
+                        << " with width " << nextRect.width() << endl;
 #endif
-                    if (nextRect.x() - rect.x() < rect.width()) {
-                        rect.setWidth(nextRect.x() - rect.x());
-                    }
-                    break;
+                if (nextRect.x() - rect.x() < rect.width()) {
+                    rect.setWidth(nextRect.x() - rect.x());
                 }
-                if (nextData.page > m_page ||
-                    nextRect.y() > rect.y()) {
-                    break;
-                }
-                ++j;
+                break;
             }
-            paint.drawRect(rect);
-            prevY = rect.y();
-            furthestX = rect.x() + rect.width();
+            if (nextData.page > page ||
+                nextRect.y() > rect.y()) {
+                break;
+            }
+            ++j;
         }
+        cache.rects.push_back({ data.system, rect });
+        prevY = rect.y();
+        furthestX = rect.x() + rect.width();
     }
 
-    paint.setPen(Qt::black);
-    paint.setBrush(Qt::black);
-
-    renderer->render(&paint, QRectF(0, 0, ww, wh));
+    return cache.rects;
 }
 
 void
@@ -1091,10 +1581,440 @@ ScoreWidget::showPage(int page)
                 << " out of range; have " << getPageCount() << " pages" << endl;
         return;
     }
+
+    if (!renderPage(page)) {
+        return;
+    }
+
+    if (m_viewMode != ViewMode::Paged) {
+        updatePlacements();
+        int i = findPlacement(page, -1);
+        if (i >= 0) {
+            scrollTo(getPlacementStart(i), false);
+        }
+    }
     
     m_page = page;
     emit pageChanged(m_page);
     update();
+
+    if (m_viewMode == ViewMode::Paged) {
+        m_renderTimer.start(0);
+    }
+}
+
+void
+ScoreWidget::setViewMode(ViewMode mode)
+{
+    if (mode == m_viewMode) {
+        return;
+    }
+
+    m_viewMode = mode;
+    m_placements.clear();
+    m_placementsValid = false;
+    m_scrollTimer.stop();
+    m_scrollPos = 0.0;
+    m_scrollTarget = 0.0;
+    
+    QSettings settings;
+    settings.beginGroup("ScoreWidget");
+    settings.setValue("viewMode", int(m_viewMode));
+    settings.endGroup();
+
+    // The single-system layout is only used in paged mode, so we
+    // may need a new layout
+    if (m_toolkit) {
+        QString error;
+        if (!relayout(error)) {
+            SVDEBUG << "ScoreWidget::setViewMode: " << error << endl;
+        }
+    }
+
+    update();
+}
+
+void
+ScoreWidget::updatePlacements()
+{
+    if (m_placementsValid) {
+        return;
+    }
+    m_placementsValid = true;
+    
+    // Note which system is at the start of the viewport, so that we
+    // can keep it there if anything placed before it changes size
+    
+    int anchorPage = -1, anchorSystem = -1;
+    double anchorDelta = 0.0;
+    int anchor = getPlacementAt(m_scrollPos);
+    if (anchor >= 0) {
+        anchorPage = m_placements[anchor].page;
+        anchorSystem = m_placements[anchor].system;
+        anchorDelta = m_scrollPos - getPlacementStart(anchor);
+    }
+    
+    m_placements.clear();
+    m_scrollExtent = 0.0;
+    m_crossExtent = 0.0;
+
+    QSizeF pageSize;
+    for (const auto &page : m_pages) {
+        if (page) {
+            pageSize = page->getSize();
+            break;
+        }
+    }
+    if (pageSize.isEmpty()) {
+        return;
+    }
+
+    bool vertical = (m_viewMode == ViewMode::ScrollVertical);
+    double pos = 0.0;
+    double systemCross = 0.0, pageCross = 0.0;
+    
+    for (int p = 0; p < int(m_pages.size()); ++p) {
+
+        const auto &page = m_pages[p];
+        bool placed = false;
+        
+        if (page) {
+            const auto &systems = page->getSystems();
+            for (int s = 0; s < int(systems.size()); ++s) {
+                QRectF b = systems[s].bounds;
+                if (b.isEmpty()) {
+                    continue;
+                }
+                if (vertical && p == 0 && !placed) {
+                    // Leave room for the title above the first system
+                    b.setTop(0.0);
+                }
+                Placement placement;
+                placement.page = p;
+                placement.system = s;
+                if (vertical) {
+                    placement.rect = QRectF(0.0, pos, pageSize.width(),
+                                            b.height() + systemGap);
+                    placement.offset = QPointF
+                        (0.0, pos + systemGap / 2.0 - b.top());
+                    pos += placement.rect.height();
+                    systemCross = std::max(systemCross, pageSize.width());
+                } else {
+                    placement.rect = QRectF(pos, 0.0,
+                                            b.width() + systemGap,
+                                            b.height() + systemGap);
+                    placement.offset = QPointF
+                        (pos + systemGap / 2.0 - b.left(),
+                         systemGap / 2.0 - b.top());
+                    pos += placement.rect.width();
+                    systemCross = std::max(systemCross,
+                                           placement.rect.height());
+                }
+                m_placements.push_back(placement);
+                placed = true;
+            }
+        }
+
+        if (!placed) {
+            // Not rendered yet, or nothing on it that we recognise as
+            // a system: place the page whole
+            Placement placement;
+            placement.page = p;
+            placement.system = -1;
+            if (vertical) {
+                placement.rect = QRectF(QPointF(0.0, pos), pageSize);
+                placement.offset = QPointF(0.0, pos);
+                pos += pageSize.height();
+                pageCross = std::max(pageCross, pageSize.width());
+            } else {
+                placement.rect = QRectF(QPointF(pos, 0.0), pageSize);
+                placement.offset = QPointF(pos, 0.0);
+                pos += pageSize.width();
+                pageCross = std::max(pageCross, pageSize.height());
+            }
+            m_placements.push_back(placement);
+        }
+    }
+
+    m_scrollExtent = pos;
+    m_crossExtent = (systemCross > 0.0 ? systemCross : pageCross);
+
+    if (anchorPage >= 0) {
+        int i = findPlacement(anchorPage, anchorSystem);
+        if (i >= 0) {
+            double from = m_scrollPos;
+            m_scrollPos = getPlacementStart(i) +
+                std::min(anchorDelta, getPlacementLength(i));
+            m_scrollTarget += m_scrollPos - from;
+        }
+    }
+
+#ifdef DEBUG_SCORE_WIDGET
+    SVDEBUG << "ScoreWidget::updatePlacements: " << m_placements.size()
+            << " placements, extent " << m_scrollExtent << " by "
+            << m_crossExtent << ", scroll position " << m_scrollPos << endl;
+#endif
+}
+
+vector<int>
+ScoreWidget::getVisiblePlacements()
+{
+    // Systems within the viewport are painted. Pages with systems
+    // within half a viewport either side of it are rendered, if they
+    // have not been already. Rendering a page changes the placements
+    // (a placeholder is replaced by the real systems) so we go round
+    // again after each one
+    
+    for (int attempt = 0; attempt <= int(m_pages.size()); ++attempt) {
+
+        updatePlacements();
+
+        double viewport = getViewportLength();
+        double from = m_scrollPos - viewport / 2.0;
+        double to = m_scrollPos + viewport * 1.5;
+
+        vector<int> visible;
+        int pending = -1;
+
+        for (int i = std::max(0, getPlacementAt(from));
+             i < int(m_placements.size()); ++i) {
+            double start = getPlacementStart(i);
+            double end = start + getPlacementLength(i);
+            if (start > to) {
+                break;
+            }
+            if (end < from) {
+                continue;
+            }
+            int page = m_placements[i].page;
+            if (!m_pages[page]) {
+                pending = page;
+                break;
+            }
+            if (start < m_scrollPos + viewport && end > m_scrollPos) {
+                visible.push_back(i);
+            }
+        }
+
+        if (pending < 0 || !renderPage(pending)) {
+            return visible;
+        }
+    }
+
+    return {};
+}
+
+int
+ScoreWidget::getPlacementAt(double scrollPos) const
+{
+    // Index of the last placement starting at or before scrollPos
+    
+    int lo = 0, hi = int(m_placements.size());
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (getPlacementStart(mid) <= scrollPos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return (m_placements.empty() ? -1 : 0);
+    }
+    return lo - 1;
+}
+
+int
+ScoreWidget::findPlacement(int page, int system) const
+{
+    // Placement for the given system, or if there is none, the first
+    // placement on the page
+    
+    auto less = [](const Placement &placement, const pair<int, int> &ps) {
+        return placement.page < ps.first ||
+            (placement.page == ps.first && placement.system < ps.second);
+    };
+
+    auto itr = std::lower_bound(m_placements.begin(), m_placements.end(),
+                                pair<int, int>(page, system), less);
+    if (itr != m_placements.end() &&
+        itr->page == page && itr->system == system) {
+        return int(itr - m_placements.begin());
+    }
+
+    itr = std::lower_bound(m_placements.begin(), m_placements.end(),
+                           pair<int, int>(page, -1), less);
+    if (itr != m_placements.end() && itr->page == page) {
+        return int(itr - m_placements.begin());
+    }
+
+    return -1;
+}
+
+double
+ScoreWidget::getPlacementStart(int i) const
+{
+    const QRectF &r = m_placements[i].rect;
+    return (m_viewMode == ViewMode::ScrollVertical ? r.top() : r.left());
+}
+
+double
+ScoreWidget::getPlacementLength(int i) const
+{
+    const QRectF &r = m_placements[i].rect;
+    return (m_viewMode == ViewMode::ScrollVertical ? r.height() : r.width());
+}
+
+double
+ScoreWidget::getScrollScale() const
+{
+    // The strip is scaled so that its breadth fills the widget
+    
+    if (m_crossExtent <= 0.0) {
+        return 1.0;
+    }
+    double breadth =
+        (m_viewMode == ViewMode::ScrollVertical ? width() : height());
+    if (breadth <= 0.0) {
+        return 1.0;
+    }
+    return breadth / m_crossExtent;
+}
+
+double
+ScoreWidget::getViewportLength() const
+{
+    double scale = getScrollScale();
+    if (m_viewMode == ViewMode::ScrollVertical) {
+        return height() / scale;
+    } else {
+        return width() / scale;
+    }
+}
+
+QTransform
+ScoreWidget::getScrollToWidget() const
+{
+    double scale = getScrollScale();
+    QTransform transform;
+    transform.scale(scale, scale);
+    if (m_viewMode == ViewMode::ScrollVertical) {
+        transform.translate(0.0, -m_scrollPos);
+    } else {
+        transform.translate(-m_scrollPos, 0.0);
+    }
+    return transform;
+}
+
+QTransform
+ScoreWidget::getPlacementTransform(int i) const
+{
+    const QPointF &offset = m_placements[i].offset;
+    return QTransform::fromTranslate(offset.x(), offset.y()) *
+        getScrollToWidget();
+}
+
+void
+ScoreWidget::scrollTo(double scrollPos, bool animate)
+{
+    updatePlacements();
+
+    double limit = std::max(0.0, m_scrollExtent - getViewportLength());
+    m_scrollTarget = std::max(0.0, std::min(scrollPos, limit));
+
+    if (!animate) {
+        m_scrollTimer.stop();
+        m_scrollPos = m_scrollTarget;
+        scrollPositionChanged();
+    } else if (!m_scrollTimer.isActive()) {
+        m_scrollTimer.start();
+    }
+}
+
+void
+ScoreWidget::scrollTimerElapsed()
+{
+    // Ease towards the target, finishing when within a pixel
+    
+    double diff = m_scrollTarget - m_scrollPos;
+    if (fabs(diff * getScrollScale()) < 1.0) {
+        m_scrollPos = m_scrollTarget;
+        m_scrollTimer.stop();
+    } else {
+        m_scrollPos += diff * 0.25;
+    }
+    scrollPositionChanged();
+}
+
+void
+ScoreWidget::scrollToShowEvent(const EventData &event)
+{
+    if (event.isNull()) {
+        return;
+    }
+    
+    updatePlacements();
+    int i = findPlacement(event.page, event.system);
+    if (i < 0) {
+        return;
+    }
+
+    double viewport = getViewportLength();
+    double start = getPlacementStart(i);
+    double length = getPlacementLength(i);
+
+    // Show the whole system if it fits, otherwise the event itself
+    // with some context before it
+    
+    if (length > viewport) {
+        QRectF r = event.highlightOnPage.translated(m_placements[i].offset);
+        double eventStart =
+            (m_viewMode == ViewMode::ScrollVertical ? r.top() : r.left());
+        double eventLength =
+            (m_viewMode == ViewMode::ScrollVertical ? r.height() : r.width());
+        if (eventStart >= m_scrollTarget &&
+            eventStart + eventLength <= m_scrollTarget + viewport) {
+            return;
+        }
+        scrollTo(eventStart - viewport / 4.0, true);
+        return;
+    }
+
+    if (start >= m_scrollTarget && start + length <= m_scrollTarget + viewport) {
+        return;
+    }
+
+    scrollTo(start, true);
+}
+
+void
+ScoreWidget::scrollPositionChanged()
+{
+    int i = getPlacementAt(m_scrollPos);
+    if (i >= 0 && m_placements[i].page != m_page) {
+        m_page = m_placements[i].page;
+        emit pageChanged(m_page);
+    }
+    update();
+}
+
+void
+ScoreWidget::wheelEvent(QWheelEvent *e)
+{
+    if (m_viewMode == ViewMode::Paged || m_pages.empty()) {
+        QFrame::wheelEvent(e);
+        return;
+    }
+
+    QPoint delta = e->angleDelta();
+    int d = (std::abs(delta.y()) >= std::abs(delta.x()) ?
+             delta.y() : delta.x());
+
+    // One notch of a typical mouse wheel is 120 units, and we scroll
+    // an eighth of the viewport for it
+    double step = getViewportLength() / 8.0;
+    scrollTo(m_scrollTarget - (d / 120.0) * step, false);
+    e->accept();
 }
 
 void
@@ -1112,7 +2032,8 @@ ScoreWidget::activateEventByLabel(EventLabel label)
 void
 ScoreWidget::setHighlightEventByLabel(EventLabel label, bool activate)
 {
-    m_eventToHighlight = getEventWithLabel(label);
+    // May be on a page that has not been rendered yet
+    m_eventToHighlight = resolveEvent(findNoteWithLabel(label));
     if (m_eventToHighlight.isNull()) {
         SVDEBUG << "ScoreWidget::setHighlightEventByLabel: Label \"" << label
                 << "\" not found" << endl;
@@ -1128,7 +2049,9 @@ ScoreWidget::setHighlightEventByLabel(EventLabel label, bool activate)
 #endif
     
     int page = m_eventToHighlight.page;
-    if (page != m_page) {
+    if (m_viewMode != ViewMode::Paged) {
+        scrollToShowEvent(m_eventToHighlight);
+    } else if (page != m_page) {
 #ifdef DEBUG_SCORE_WIDGET
         SVDEBUG << "ScoreWidget::setHighlightEventByLabel: Flipping to page "
                 << page << endl;
@@ -1136,9 +2059,11 @@ ScoreWidget::setHighlightEventByLabel(EventLabel label, bool activate)
         showPage(page);
     }
 
+    prefetchNextPage(m_eventToHighlight);
+
     if (activate) {
         emit scoreLocationActivated(m_eventToHighlight.location,
-                                    m_eventToHighlight.label,
+                                    getLabelOf(m_eventToHighlight),
                                     m_mode);
     }
     
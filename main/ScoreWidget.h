@@ -17,12 +17,22 @@
 #include <QFrame>
 #include <QTimer>
 
-#include <map>
+#include <vector>
+#include <memory>
 
 #include "piano-aligner/Score.h"
 
-class QSvgRenderer;
-class QDomElement;
+#include "SharedMusicalEvents.h"
+#include "OpenHashIndex.h"
+#include "ScoreGlyphAtlas.h"
+#include "ScorePagePrefetcher.h"
+
+class ScorePage;
+class MemoryReport;
+
+namespace vrv {
+class Toolkit;
+}
 
 class ScoreWidget : public QFrame
 {
@@ -50,9 +60,10 @@ public:
     /** 
      * Set the musical event list for the current score, containing
      * (among other things) an ordered-by-metrical-time correspondence
-     * between metrical time and score element ID.
+     * between metrical time and score element ID. The list is shared,
+     * not copied.
      */
-    void setMusicalEvents(const Score::MusicalEventList &musicalEvents);
+    void setMusicalEvents(SharedMusicalEvents musicalEvents);
     
     /** 
      * Return the current score name, or an empty string if none
@@ -60,6 +71,15 @@ public:
      */
     QString getCurrentScore() const;
 
+    /**
+     * Render the given page (0-based) of the current score as SVG,
+     * laid out as currently shown, and write it to the given
+     * file. SVG is used only for export: the score is shown using a
+     * display list recorded directly from Verovio. If export fails,
+     * return false and set the error string accordingly.
+     */
+    bool exportPageToSvg(int page, QString filename, QString &error);
+    
     /**
      * Return the current page number (0-based).
      */
@@ -73,7 +93,7 @@ public:
     /**
      * Set the scale factor for score rendering. The default is
      * 100. Changing this will cause the whole score to be re-flowed,
-     * which may take a significant amount of time.
+     * although only the page being shown is rendered straight away.
      */
     void setScale(int);
 
@@ -107,6 +127,37 @@ public:
     InteractionMode getInteractionMode() const {
         return m_mode;
     }
+
+    /**
+     * How the score is presented: a page at a time, or as one
+     * continuous strip of systems scrolled vertically or
+     * horizontally. In the scrolling modes the score is never
+     * re-flowed to suit the shape of the widget.
+     */
+    enum class ViewMode {
+        Paged,
+        ScrollVertical,
+        ScrollHorizontal
+    };
+
+    /**
+     * Select a view mode. This is remembered in the settings.
+     */
+    void setViewMode(ViewMode mode);
+
+    /**
+     * Return the current view mode.
+     */
+    ViewMode getViewMode() const {
+        return m_viewMode;
+    }
+
+    /**
+     * Add the sizes of the loaded pages, the event maps, the musical
+     * events and the glyph and page image caches to the given memory
+     * report.
+     */
+    void reportMemoryUsage(MemoryReport &report) const;
                                                  
 public slots:
     /**
@@ -145,6 +196,8 @@ public slots:
 
 private slots:
     void resizedTimerElapsed();
+    void renderNeighbouringPages();
+    void scrollTimerElapsed();
     
 signals:
     void loadFailed(QString scoreNameOrFile, QString errorMessage);
@@ -178,6 +231,7 @@ protected:
     void mousePressEvent(QMouseEvent *) override;
     void mouseDoubleClickEvent(QMouseEvent *) override;
     void paintEvent(QPaintEvent *) override;
+    void wheelEvent(QWheelEvent *) override;
     
 private:
     /**
@@ -190,41 +244,57 @@ private:
     QString m_scoreName;
     QString m_scoreFilename;
     std::string m_verovioResourcePath;
-    std::vector<std::shared_ptr<QSvgRenderer>> m_svgPages;
+
+    // The toolkit holds the loaded Verovio document and its current
+    // layout, from which pages are rendered as they are needed. A
+    // page that has not yet been rendered is null in m_pages
+    std::unique_ptr<vrv::Toolkit> m_toolkit;
+    std::vector<std::shared_ptr<ScorePage>> m_pages;
     int m_page;
     int m_scale;
 
-    Score::MusicalEventList m_musicalEvents;
-    
+    SharedMusicalEvents m_musicalEvents;
+
+    // A note found on a rendered page, identified by its interned
+    // note number (see below). Small and free of strings, so cheap
+    // to copy; the note's ID and its event's label are looked up
+    // with getIdOf and getLabelOf
     struct EventData {
-        EventId id;
-        int page;
+        int note = -1;          // index into m_noteIds, or -1 if null
+        int page = -1;
         QRectF boxOnPage;
+        QRectF highlightOnPage; // box extended to height of system
+        int system = -1;        // index of system on page, or -1
         Fraction location;
-        EventLabel label;
-        int indexInEvents;
-
-        bool isNull() const { return id == ""; }
-    };
-
-    // MEI id-to-extent relations: these are generated from the SVG
-    // XML when the score is loaded
-    struct Extent {
-        double y;
-        double height;
+        int indexInEvents = -1;
 
-        Extent() : y(0.0), height(0.0) { }
-        Extent(double y_, double height_) : y(y_), height(height_) { }
-        bool isNull() const { return y == 0.0 && height == 0.0; }
+        bool isNull() const { return note < 0; }
     };
-    std::map<EventId, Extent> m_noteSystemExtentMap;
 
     // Relations between MEI IDs and musical events: these are
     // generated when the musical event data is set, after the score
-    // has been loaded
-    std::map<EventId, EventData> m_idDataMap;
-    std::map<EventLabel, EventId> m_labelIdMap;
-    std::map<int, std::vector<EventId>> m_pageEventsMap;
+    // has been loaded. Each note that starts a musical event is
+    // interned, in score order, as an index into m_noteIds; the
+    // other tables are flat arrays indexed by note, musical event or
+    // page number
+    std::vector<EventId> m_noteIds;
+    std::vector<int> m_noteEvents;        // note -> index in events
+    std::vector<EventLabel> m_eventLabels;
+    std::vector<int> m_eventFirstNotes;   // event -> its first note, or -1
+    OpenHashIndex<EventId> m_noteIndex;   // ID -> note
+    OpenHashIndex<EventLabel> m_labelIndex; // label -> note
+
+    // Layout-dependent: the event data for each note, null until the
+    // page containing it has been rendered; and the notes on each
+    // page, in score order
+    std::vector<EventData> m_noteData;
+    std::vector<std::vector<int>> m_pageNotes;
+
+    int findNote(const EventId &id) const;
+    int findNoteWithLabel(const EventLabel &label) const;
+    const EventId &getIdOf(const EventData &) const;
+    const EventLabel &getLabelOf(const EventData &) const;
+    void clearEventLayout();
 
     InteractionMode m_mode;
     EventData m_eventUnderMouse;
@@ -236,10 +306,8 @@ private:
 
     EventData getEventAtPoint(QPoint);
 
-    EventData getEventWithId(EventId id) const;
-    EventData getEventWithId(const std::string &id) const;
-    EventData getEventWithLabel(EventLabel label) const;
-    EventData getEventForMusicalEvent(const Score::MusicalEvent &) const;
+    const EventData &getEventForNote(int note) const;
+    const EventData &getEventForMusicalEvent(int indexInEvents) const;
     
     EventData getScoreStartEvent() const;
     EventData getScoreEndEvent() const;
@@ -249,16 +317,96 @@ private:
     bool isSelectedAll() const;
 
     QRectF getHighlightRectFor(const EventData &);
+    void paintHighlight(QPainter &);
+    void paintSelection(QPainter &, int page);
+
+    // The selection highlight on a page, as rects in page coordinates
+    // with the system each is in. These are worked out when a page is
+    // first painted with a given selection, and kept until the
+    // selection, the page's layout or the musical events change
+    struct SelectionRect {
+        int system;
+        QRectF rect;
+    };
+    struct SelectionRects {
+        bool valid = false;
+        int start = -1;     // m_selectStart.note when worked out
+        int end = -1;       // m_selectEnd.note when worked out
+        std::vector<SelectionRect> rects;
+    };
+    std::vector<SelectionRects> m_selectionRects; // index is page
+    const std::vector<SelectionRect> &getSelectionRects(int page);
+    void paintPaged();
+    void paintScrolling();
     void setHighlightEventByLabel(EventLabel label, bool activate);
     
-    void findSystemExtents(QByteArray, std::shared_ptr<QSvgRenderer>);
-
-    bool reloadScoreFile(QString &error);
+    bool setupToolkit(vrv::Toolkit &toolkit, QString scoreFile,
+                      double aspectRatio, QString &error);
+    void applyLayoutOptions(vrv::Toolkit &toolkit, double aspectRatio);
+    bool relayout(QString &error);
+
+    bool renderPage(int page);
+    bool haveAllPages() const;
+    void mapEventsOnPage(int page);
+    int findPageWithNote(int note) const;
+    EventData resolveEvent(int note);
     
     QTransform m_widgetToPage;
     QTransform m_pageToWidget;
 
+    QTransform getPageFitTransform(QSizeF pageSize) const;
+    bool getPageToWidget(int page, int system, QTransform &) const;
+
+    // In the scrolling view modes, each system is placed separately
+    // along a strip. Placements are in "scroll coordinates", the
+    // logical units of the page layout but with the systems laid end
+    // to end, and are ordered by page and system. A page that has not
+    // yet been rendered is placed whole, as a single placeholder with
+    // system -1, until it is rendered and its systems are known
+    struct Placement {
+        int page;
+        int system;     // index into the page's systems, or -1
+        QRectF rect;    // extent in scroll coordinates
+        QPointF offset; // from page coordinates to scroll coordinates
+    };
+
+    ViewMode m_viewMode;
+    std::vector<Placement> m_placements;
+    bool m_placementsValid;
+    double m_scrollExtent;  // length of strip, in scroll coordinates
+    double m_crossExtent;   // breadth of strip, in scroll coordinates
+    double m_scrollPos;     // start of viewport, in scroll coordinates
+    double m_scrollTarget;  // where an animated scroll is heading
+    QTimer m_scrollTimer;
+
+    void updatePlacements();
+    std::vector<int> getVisiblePlacements();
+    int getPlacementAt(double scrollPos) const;
+    int findPlacement(int page, int system) const;
+    double getPlacementStart(int placement) const;
+    double getPlacementLength(int placement) const;
+    double getScrollScale() const;
+    double getViewportLength() const;
+    QTransform getScrollToWidget() const;
+    QTransform getPlacementTransform(int placement) const;
+    void scrollTo(double scrollPos, bool animate);
+    void scrollToShowEvent(const EventData &);
+    void scrollPositionChanged();
+
+    // Rasterised glyphs shared across pages, used when painting
+    // unless disabled in the settings
+    ScoreGlyphAtlas m_glyphAtlas;
+    bool m_useGlyphAtlas;
+
+    // Whole-page images made in the background in paged mode, so
+    // that the next page is ready to show when playback reaches
+    // it. The generation changes whenever the layout does
+    ScorePagePrefetcher m_prefetcher;
+    int m_layoutGeneration;
+    void prefetchNextPage(const EventData &);
+
     QTimer m_resizedTimer;
+    QTimer m_renderTimer;
     QSize m_initialSize;
     double m_aspectRatioAtLoad;
     const double m_switchLayoutAtThisAspectRatio;
@@ -13,9 +13,14 @@
 #include "Session.h"
 
 #include "ScoreAlignmentTransform.h"
+#include "AlignerProcess.h"
+#include "Tracing.h"
+#include "LatencyMonitor.h"
+#include "MemoryReport.h"
 
 #include "transform/TransformFactory.h"
 #include "transform/ModelTransformer.h"
+#include "layer/LayerFactory.h"
 #include "layer/ColourDatabase.h"
 #include "layer/ColourMapper.h"
 
@@ -23,28 +28,50 @@
 #include "data/fileio/CSVFileReader.h"
 #include "data/fileio/CSVFileWriter.h"
 
+#include "data/model/EventCommands.h"
+#include "data/model/DenseTimeValueModel.h"
+#include "data/model/SparseOneDimensionalModel.h"
+#include "widgets/CommandHistory.h"
+
 #include "base/TempWriteFile.h"
 #include "base/StringBits.h"
 
 #include <QMessageBox>
 #include <QFileInfo>
+#include <QSet>
+#include <QThread>
+#include <QSettings>
+
+#include <algorithm>
 
 using namespace std;
 using namespace sv;
 
+//#define DEBUG_SESSION 1
+
 const TransformId
 Session::smartCopyTransformId = "*smartcopy*";
 
 Session::Session() :
     m_pendingOnsetsPane(nullptr),
-    m_pendingOnsetsLayer(nullptr)
+    m_pendingOnsetsLayer(nullptr),
+    m_musicalEvents(getEmptyMusicalEvents()),
+    m_alignerPool(make_shared<AlignerPool>()),
+    m_alignerThreadsAbandoned(false)
 {
     SVDEBUG << "Session::Session" << endl;
+
+    m_alignerPoolTimer.setInterval(30000);
+    connect(&m_alignerPoolTimer, &QTimer::timeout,
+            this, &Session::alignerPoolTimerElapsed);
+    
     setDocument(nullptr, nullptr, nullptr, nullptr, nullptr);
 }
 
 Session::~Session()
 {
+    abandonAlignerThreads();
+    
     for (auto f : m_featureData) {
         ModelById::release(f.second.tempoModel);
     }
@@ -63,6 +90,10 @@ Session::setDocument(Document *doc,
         emit alignmentRejected();
     }
 
+    // Any pooled alignment in progress refers to models belonging
+    // to the old document
+    abandonAlignerThreads();
+
     // Don't reset the score id or musical events - they can outlast
     // the document, and indeed are usually present before the
     // document is first set
@@ -86,6 +117,9 @@ Session::setDocument(Document *doc,
     m_pendingOnsetsLayer = nullptr;
     m_audioModelForPendingOnsets = {};
 
+    for (auto f : m_featureData) {
+        ModelById::release(f.second.tempoModel);
+    }
     m_featureData.clear();
     m_inEditMode = false;
 
@@ -181,6 +215,8 @@ Session::setMainModel(ModelId modelId)
         {},                 // lastExportedTo
         false               // alignmentModified
     };
+
+    warmAlignerPool();
 }
 
 void
@@ -229,6 +265,12 @@ Session::paneRemoved(Pane *pane)
     if (m_tempoCurveWidget) {
         m_tempoCurveWidget->unsetCurveForAudio(modelToBeDeleted);
     }
+
+    auto fitr = m_featureData.find(modelToBeDeleted);
+    if (fitr != m_featureData.end()) {
+        ModelById::release(fitr->second.tempoModel);
+        m_featureData.erase(fitr);
+    }
     
     if (newMainModel == modelToBeDeleted) {
         newMainModel = {};
@@ -542,6 +584,8 @@ Session::setAlignmentTransformId(TransformId alignmentTransformId)
     SVDEBUG << "Session::setAlignmentTransformId: Setting to \""
             << alignmentTransformId << "\"" << endl;
     m_alignmentTransformId = alignmentTransformId;
+
+    warmAlignerPool();
 }
 
 void
@@ -558,6 +602,8 @@ Session::beginPartialAlignment(int scorePositionStartNumerator,
                                sv_frame_t audioFrameStart,
                                sv_frame_t audioFrameEnd)
 {
+    TraceScope trace("Session::beginPartialAlignment", "alignment");
+    
     if (m_mainModel.isNone()) {
         SVDEBUG << "Session::beginPartialAlignment: ERROR: No main model; one should have been set first" << endl;
         return;
@@ -655,21 +701,36 @@ Session::beginPartialAlignment(int scorePositionStartNumerator,
     //!!! What should we do if the user requests an alignment when we
     //!!! are already waiting for one to complete?
     
+    QSettings settings;
+    settings.beginGroup("Preferences");
+    bool useHelper =
+        settings.value("run-aligners-in-helper-process", false).toBool();
+    settings.endGroup();
+    
     for (auto defn : layerDefinitions) {
 
         auto transformId = defn.first;
         auto pane = defn.second.first;
         auto layerPtr = defn.second.second;
         
-        Transform t = TransformFactory::getInstance()->
-            getDefaultTransformFor(transformId);
-
-        SVDEBUG << "Session::beginPartialAlignment: Setting plugin's program to \"" << m_scoreId << "\"" << endl;
-            
-        t.setProgram(m_scoreId);
+        Transform t = makeAlignmentTransform(transformId);
         t.setParameters(params);
 
-        Layer *layer = m_document->createDerivedLayer(t, input);
+        // Run in the helper process if so configured, or else use a
+        // warm aligner instance if there is one; otherwise derive the
+        // layer from the transform in the usual way
+
+        Layer *layer = nullptr;
+        if (useHelper) {
+            layer = beginHelperAlignment(t, input);
+        }
+        if (!layer) {
+            layer = beginPooledAlignment(t, input);
+        }
+        bool reportsReady = (layer != nullptr);
+        if (!reportsReady) {
+            layer = m_document->createDerivedLayer(t, input);
+        }
         if (!layer) {
             SVDEBUG << "Session::beginPartialAlignment: Transform failed to initialise" << endl;
             emit alignmentFailedToRun(QString("Unable to initialise score alignment plugin \"%1\"").arg(transformId));
@@ -696,13 +757,22 @@ Session::beginPartialAlignment(int scorePositionStartNumerator,
         
         m_document->addLayerToView(pane, layer);
 
-        ModelId modelId = layer->getModel();
-        auto model = ModelById::get(modelId);
-        if (model->isReady(nullptr)) {
-            modelReady(modelId);
-        } else {
-            connect(model.get(), SIGNAL(ready(ModelId)),
-                    this, SLOT(modelReady(ModelId)));
+        // Ended in modelReady or rejectAlignment
+        Tracing::asyncBegin("Score alignment", "alignment",
+                            tl->getModel().untyped);
+
+        // A pooled or helper run calls modelReady itself when it
+        // completes
+
+        if (!reportsReady) {
+            ModelId modelId = layer->getModel();
+            auto model = ModelById::get(modelId);
+            if (model->isReady(nullptr)) {
+                modelReady(modelId);
+            } else {
+                connect(model.get(), SIGNAL(ready(ModelId)),
+                        this, SLOT(modelReady(ModelId)));
+            }
         }
     }
         
@@ -713,6 +783,247 @@ Session::beginPartialAlignment(int scorePositionStartNumerator,
     
     m_pendingOnsetsPane = activeAudioPane;
     m_audioModelForPendingOnsets = activeModelId;
+
+    // Have an instance ready for the next partial alignment, as any
+    // pooled one has been used up by this one
+
+    if (!useHelper) {
+        warmAlignerPool();
+    }
+}
+
+Transform
+Session::makeAlignmentTransform(TransformId transformId) const
+{
+    Transform t = TransformFactory::getInstance()->
+        getDefaultTransformFor(transformId);
+
+    SVDEBUG << "Session::makeAlignmentTransform: Setting plugin's program to \"" << m_scoreId << "\"" << endl;
+            
+    t.setProgram(m_scoreId);
+    return t;
+}
+
+Layer *
+Session::beginPooledAlignment(const Transform &t,
+                              const ModelTransformer::Input &input)
+{
+    auto audioModel = ModelById::getAs<DenseTimeValueModel>(input.getModel());
+    if (!audioModel) {
+        return nullptr;
+    }
+    sv_samplerate_t sampleRate = audioModel->getSampleRate();
+
+    auto instance = m_alignerPool->tryAcquire(t, sampleRate);
+    if (!instance) {
+        return nullptr;
+    }
+
+    SVDEBUG << "Session::beginPooledAlignment: Using warm aligner instance"
+            << endl;
+
+    ModelId onsetsModelId;
+    Layer *layer = createAlignmentOutputLayer
+        (t, input, instance->stepSize, onsetsModelId);
+
+    auto pool = m_alignerPool;
+    ModelId audioModelId = input.getModel();
+
+    // Initialising the instance is when an aligner takes its score
+    // and audio range, so that happens in the thread as well
+
+    QThread *thread = QThread::create([=]() {
+        if (!AlignerPool::initialise(instance, t)) {
+            pool->discard(instance);
+            QMetaObject::invokeMethod(this, [=]() {
+                alignmentProcessFailed
+                    (onsetsModelId, tr("Failed to initialise the aligner"));
+            }, Qt::QueuedConnection);
+            return;
+        }
+        bool complete = AlignerPool::run(instance, audioModelId, onsetsModelId,
+                                         m_alignerThreadsAbandoned);
+        pool->discard(instance);
+        if (complete) {
+            QMetaObject::invokeMethod(this, [=]() {
+                modelReady(onsetsModelId);
+            }, Qt::QueuedConnection);
+        }
+    });
+    thread->setObjectName("Session pooled aligner");
+    startAlignerThread(thread, QThread::InheritPriority);
+
+    return layer;
+}
+
+Layer *
+Session::beginHelperAlignment(const Transform &t,
+                              const ModelTransformer::Input &input)
+{
+    if (!AlignerProcess::isAvailable()) {
+        SVDEBUG << "Session::beginHelperAlignment: Aligner helper not found, running in-process instead" << endl;
+        return nullptr;
+    }
+
+    int resolution = t.getStepSize();
+    if (resolution <= 0) resolution = 1;
+    
+    ModelId onsetsModelId;
+    Layer *layer = createAlignmentOutputLayer
+        (t, input, resolution, onsetsModelId);
+
+    // The process object deletes itself once it has reported either
+    // way. Each alignment has its own helper process, so these can
+    // run in parallel
+    
+    AlignerProcess *process = new AlignerProcess(this);
+
+    connect(process, &AlignerProcess::finished,
+            this, [=](ModelId modelId) {
+                modelReady(modelId);
+                process->deleteLater();
+            });
+    connect(process, &AlignerProcess::failed,
+            this, [=](ModelId modelId, QString message) {
+                alignmentProcessFailed(modelId, message);
+                process->deleteLater();
+            });
+
+    if (!process->start(t, input.getModel(), onsetsModelId)) {
+        delete process;
+        m_document->deleteLayer(layer, true);
+        return nullptr;
+    }
+
+    return layer;
+}
+
+void
+Session::alignmentProcessFailed(ModelId onsetsModelId, QString message)
+{
+    if (!m_pendingOnsetsLayer ||
+        m_pendingOnsetsLayer->getModel() != onsetsModelId) {
+        // Not the alignment we are waiting for any more
+        return;
+    }
+
+    Tracing::instant("Score alignment failed", "alignment");
+    emit alignmentFailedToRun(message);
+    rejectAlignment();
+}
+
+Layer *
+Session::createAlignmentOutputLayer(const Transform &t,
+                                    const ModelTransformer::Input &input,
+                                    int resolution,
+                                    ModelId &onsetsModelId)
+{
+    auto audioModel = ModelById::get(input.getModel());
+    sv_samplerate_t sampleRate = audioModel->getSampleRate();
+    
+    auto onsetsModel = make_shared<SparseOneDimensionalModel>
+        (sampleRate, resolution, false);
+    onsetsModel->setCompletion(0);
+    onsetsModelId = ModelById::add(onsetsModel);
+
+    // Record the transform as the model's provenance, just as
+    // createDerivedLayer would, so that it is saved with the session
+    
+    m_document->addAlreadyDerivedModel(t, input, onsetsModelId);
+
+    Layer *layer = m_document->createLayer(LayerFactory::TimeInstants);
+    m_document->setModel(layer, onsetsModelId);
+    return layer;
+}
+
+void
+Session::warmAlignerPool()
+{
+    if (m_mainModel.isNone() || m_scoreId == "") {
+        return;
+    }
+    
+    TransformId transformId = m_alignmentTransformId;
+    if (transformId == "") {
+        transformId = ScoreAlignmentTransform::getDefaultAlignmentTransform();
+    }
+    if (transformId == "" || transformId == smartCopyTransformId) {
+        return;
+    }
+
+    auto model = ModelById::get(m_mainModel);
+    if (!model) {
+        return;
+    }
+    sv_samplerate_t sampleRate = model->getSampleRate();
+
+    // Loading the plugin and its score is what we want to avoid
+    // waiting for, so do it in the background
+    
+    Transform t = makeAlignmentTransform(transformId);
+    auto pool = m_alignerPool;
+
+    QThread *thread = QThread::create([=]() {
+        pool->warm(t, sampleRate);
+    });
+    thread->setObjectName("Session aligner warming");
+    startAlignerThread(thread, QThread::LowPriority);
+
+    if (!m_alignerPoolTimer.isActive()) {
+        m_alignerPoolTimer.start();
+    }
+}
+
+void
+Session::alignerPoolTimerElapsed()
+{
+    if (m_alignerPool->evictIdle() == 0) {
+        m_alignerPoolTimer.stop();
+    }
+}
+
+void
+Session::startAlignerThread(QThread *thread, QThread::Priority priority)
+{
+    m_alignerThreads.push_back(thread);
+
+    // Queued to this thread, and not delivered at all if I have gone
+    // away. If the thread has already been abandoned it has been
+    // deleted, and is no longer in the list (unless a new thread has
+    // since been made at the same address, which will be running)
+    
+    connect(thread, &QThread::finished, this, [=]() {
+        auto itr = find(m_alignerThreads.begin(), m_alignerThreads.end(),
+                        thread);
+        if (itr != m_alignerThreads.end() && thread->isFinished()) {
+            m_alignerThreads.erase(itr);
+            thread->deleteLater();
+        }
+    }, Qt::QueuedConnection);
+    
+    thread->start(priority);
+}
+
+void
+Session::abandonAlignerThreads()
+{
+    if (m_alignerThreads.empty()) {
+        return;
+    }
+
+    SVDEBUG << "Session::abandonAlignerThreads: Waiting for "
+            << m_alignerThreads.size() << " thread(s)" << endl;
+
+    // A pooled run checks this between blocks. Warming can't be
+    // interrupted, but is only loading a plugin
+    
+    m_alignerThreadsAbandoned = true;
+    for (auto thread : m_alignerThreads) {
+        thread->wait();
+        delete thread;
+    }
+    m_alignerThreads.clear();
+    m_alignerThreadsAbandoned = false;
 }
 
 void
@@ -764,6 +1075,7 @@ Session::modelReady(ModelId id)
     SVDEBUG << "Session::modelReady: model is " << id << endl;
 
     if (m_pendingOnsetsLayer && id == m_pendingOnsetsLayer->getModel()) {
+        Tracing::asyncEnd("Score alignment", "alignment", id.untyped);
         alignmentComplete();
     }
 }
@@ -773,6 +1085,12 @@ Session::modelChanged(ModelId id)
 {
     SVDEBUG << "Session::modelChanged: model is " << id << endl;
 
+    // An edit to an onset arrives here, and is shown once the tempo
+    // curve widget has repainted with the recalculated curve
+    auto &latency = LatencyMonitor::getProbe
+        (LatencyMonitor::Metric::AlignmentEditToTempo);
+    latency.inputReceived();
+    
     for (auto &p : m_audioPanes) {
 
         auto onsetsLayer =
@@ -782,6 +1100,7 @@ Session::modelChanged(ModelId id)
 
         if (onsetsLayer && !audioModelId.isNone()) {
             recalculateTempoCurveFor(audioModelId);
+            latency.repaintRequested();
             emit alignmentModified();
         }
     }
@@ -798,6 +1117,8 @@ Session::alignmentComplete()
 {
     SVDEBUG << "Session::alignmentComplete" << endl;
 
+    TraceScope trace("Session::alignmentComplete", "alignment");
+
     recalculateTempoCurveFor(m_audioModelForPendingOnsets);
     updateOnsetColours();
     
@@ -910,6 +1231,14 @@ Session::rejectAlignment()
         return;
     }        
 
+    // An alignment rejected before it completed has not yet ended
+    // its trace event
+    auto pendingModel = ModelById::get(m_pendingOnsetsLayer->getModel());
+    if (pendingModel && !pendingModel->isReady(nullptr)) {
+        Tracing::asyncEnd("Score alignment", "alignment",
+                          pendingModel->getId().untyped);
+    }
+    
     m_document->deleteLayer(m_pendingOnsetsLayer, true);
 
     if (!m_audioModelForPendingOnsets.isNone()) {
@@ -946,8 +1275,24 @@ Session::acceptAlignment()
         (pane, OnsetsLayerSelection::ExcludePendingOnsets);
     
     if (previousOnsets && m_partialAlignmentAudioEnd >= 0) {
+
+        // A partial alignment is merged into the existing onsets
+        // layer as a single undoable command, and the pending layer,
+        // which holds nothing the merged layer does not, goes away
+        
         mergeLayers(previousOnsets, m_pendingOnsetsLayer,
                     m_partialAlignmentAudioStart, m_partialAlignmentAudioEnd);
+
+        m_document->deleteLayer(m_pendingOnsetsLayer, true);
+        previousOnsets->showLayer(pane, true);
+        
+        m_pendingOnsetsLayer = nullptr;
+
+        recalculateTempoCurveFor(m_audioModelForPendingOnsets);
+        updateOnsetColours();
+
+        emit alignmentAccepted();
+        return;
     }
     
     if (previousOnsets) {
@@ -983,25 +1328,111 @@ Session::signifyNavigateMode()
 }
 
 void
-Session::mergeLayers(TimeInstantLayer *from, TimeInstantLayer *to,
+Session::mergeLayers(TimeInstantLayer *into, TimeInstantLayer *from,
                      sv_frame_t overlapStart, sv_frame_t overlapEnd)
 {
-    // Currently the way we are handling this is by having "to"
-    // contain *only* the new events, within overlapStart to
-    // overlapEnd.  So the merge just copies all events outside that
-    // range from "from" to "to". There are surely cleverer ways
-
-    //!!! We should also use a command
+    TraceScope trace("Session::mergeLayers", "alignment");
+
+    // "from" contains *only* the new events, within overlapStart to
+    // overlapEnd. We replace with them those events in "into" that
+    // lie within that range, and also those outside it that are
+    // inconsistent with the new events, i.e. that share a label with
+    // a new event or are out of score order with respect to them. An
+    // old event before the overlap must precede every new event in
+    // the score, and an old event after it must follow every new
+    // event. This is a single linear pass over each sequence.
+    //
+    // All of the changes go into one command on the model of "into",
+    // so that undoing it restores the previous alignment exactly.
     
+    auto intoModel = ModelById::getAs<SparseOneDimensionalModel>(into->getModel());
     auto fromModel = ModelById::getAs<SparseOneDimensionalModel>(from->getModel());
-    auto toModel = ModelById::getAs<SparseOneDimensionalModel>(to->getModel());
+    if (!intoModel || !fromModel) {
+        SVDEBUG << "Session::mergeLayers: Missing model(s)" << endl;
+        return;
+    }
+
+    EventVector oldEvents = intoModel->getAllEvents();
+    EventVector newEvents = fromModel->getAllEvents();
+
+    auto scoreIndexOf = [this](const Event &e) {
+        auto itr = m_eventIndexForLabel.constFind(e.getLabel());
+        if (itr == m_eventIndexForLabel.constEnd()) return -1;
+        return itr.value();
+    };
+    
+    int firstNewIndex = -1, lastNewIndex = -1;
+    QSet<QString> newLabels;
+    newLabels.reserve(int(newEvents.size()));
+    for (const auto &e : newEvents) {
+        newLabels.insert(e.getLabel());
+        int index = scoreIndexOf(e);
+        if (index < 0) continue;
+        if (firstNewIndex < 0 || index < firstNewIndex) firstNewIndex = index;
+        if (index > lastNewIndex) lastNewIndex = index;
+    }
+
+    // The command applies each change as it is added, and we don't
+    // want a tempo recalculation for every one of them - the caller
+    // recalculates once afterwards
+
+    disconnect(intoModel.get(), &Model::modelChanged, this, nullptr);
+    disconnect(intoModel.get(), &Model::modelChangedWithin, this, nullptr);
+    
+    ChangeEventsCommand *command = new ChangeEventsCommand
+        (into->getModel().untyped, tr("Merge Alignment"));
+
+    int replaced = 0, discarded = 0;
+
+    for (const auto &e : oldEvents) {
+
+        sv_frame_t frame = e.getFrame();
+        if (frame >= overlapStart && frame < overlapEnd) {
+            command->remove(e);
+            ++replaced;
+            continue;
+        }
+
+        bool consistent = !newLabels.contains(e.getLabel());
 
-    EventVector beforeOverlap = fromModel->getEventsWithin(0, overlapStart);
-    EventVector afterOverlap = fromModel->getEventsWithin
-        (overlapEnd, fromModel->getEndFrame() - overlapEnd);
+        if (consistent && firstNewIndex >= 0) {
+            int index = scoreIndexOf(e);
+            if (index >= 0) {
+                if (frame < overlapStart) {
+                    consistent = (index < firstNewIndex);
+                } else {
+                    consistent = (index > lastNewIndex);
+                }
+            }
+        }
+        
+        if (!consistent) {
+            command->remove(e);
+            ++discarded;
+        }
+    }
 
-    for (auto e : beforeOverlap) toModel->add(e);
-    for (auto e : afterOverlap) toModel->add(e);
+    for (const auto &e : newEvents) {
+        command->add(e);
+    }
+
+    SVDEBUG << "Session::mergeLayers: replaced " << replaced << " of "
+            << oldEvents.size() << " previous onsets with " << newEvents.size()
+            << " new ones, discarding a further " << discarded
+            << " that conflicted with the new alignment" << endl;
+
+    // The changes were made as the command was built, so we don't
+    // want it to be executed again here
+    Command *c = command->finish();
+    if (c) {
+        CommandHistory::getInstance()->addCommand(c, false);
+    }
+
+    connect(intoModel.get(),
+            &Model::modelChanged, this, &Session::modelChanged);
+
+    connect(intoModel.get(),
+            &Model::modelChangedWithin, this, &Session::modelChangedWithin);
 }
 
 bool
@@ -1011,7 +1442,7 @@ Session::canExportAlignment() const
 //        SVDEBUG << "Session::canExportAlignment: No, no score ID set" << endl;
         return false;
     }
-    if (m_musicalEvents.empty()) {
+    if (m_musicalEvents->empty()) {
 //        SVDEBUG << "Session::canExportAlignment: No, no musical events set" << endl;
         return false;
     }
@@ -1125,6 +1556,84 @@ Session::exportAlignmentEntries(ModelId modelId, QString path)
     return true;
 }
 
+void
+Session::calculateTempoStatisticsFor(ModelId audioModelId,
+                                     TempoStatistics::Output &stats) const
+{
+    TempoStatistics::Input input;
+
+    auto audioModel = ModelById::get(audioModelId);
+    auto itr = m_featureData.find(audioModelId);
+    
+    if (audioModel && itr != m_featureData.end()) {
+
+        const auto &alignmentEntries = itr->second.alignmentEntries;
+        int n = int(min(alignmentEntries.size(), m_musicalEvents->size()));
+
+        input.sampleRate = audioModel->getSampleRate();
+        input.frames.resize(n);
+        input.durations.resize(n);
+    
+        for (int i = 0; i < n; ++i) {
+            input.frames[i] = alignmentEntries[i].frame;
+            Fraction dur = (*m_musicalEvents)[i].duration;
+            input.durations[i] = (dur.denominator > 0 ?
+                                  4.0 * dur.numerator / dur.denominator :
+                                  0.0); // in quarter notes
+        }
+    }
+
+    TempoStatistics::calculate(input, TempoStatistics::defaultWindow, stats);
+}
+
+bool
+Session::exportTempoStatisticsTo(QString path)
+{
+    auto modelId = getActiveAudioModel();
+    
+    if (modelId.isNone() || m_featureData.find(modelId) == m_featureData.end()) {
+        return false;
+    }
+
+    TempoStatistics::Output stats;
+    calculateTempoStatisticsFor(modelId, stats);
+
+    TempWriteFile temp(path);
+    QFile file(temp.getTemporaryFilename());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        SVCERR << "Session::exportTempoStatisticsTo: Failed to open file "
+               << temp.getTemporaryFilename() << " for writing" << endl;
+        return false;
+    }
+    
+    QTextStream out(&file);
+
+    out << "LABEL,TIME,IOI,TEMPO,ROLLING_TEMPO,DEVIATION\n";
+
+    auto number = [](double value) {
+        return (value == value ? QString("%1").arg(value) : QString("N"));
+    };
+    
+    const auto &alignmentEntries = m_featureData.at(modelId).alignmentEntries;
+    int n = int(stats.times.size());
+    
+    for (int i = 0; i < n; ++i) {
+        QVector<QString> columns;
+        columns << QString::fromStdString(alignmentEntries[i].label)
+                << number(stats.times[i])
+                << number(stats.ioi[i])
+                << number(stats.tempo[i])
+                << number(stats.rollingTempo[i])
+                << number(stats.deviation[i]);
+        out << StringBits::joinDelimited(columns, ",") << '\n';
+    }
+
+    file.close();
+    temp.moveToTarget();
+
+    return true;
+}
+
 bool
 Session::importAlignmentFrom(QString path)
 {
@@ -1257,20 +1766,121 @@ Session::importAlignmentFrom(QString path)
 }
 
 void
-Session::setMusicalEvents(QString scoreId,
-                          const Score::MusicalEventList &musicalEvents)
+Session::setMusicalEvents(QString scoreId, SharedMusicalEvents musicalEvents)
 {
+    TraceScope trace("Session::setMusicalEvents", "score");
+    
     m_scoreId = scoreId;
-    m_musicalEvents = musicalEvents;
+    m_musicalEvents = (musicalEvents ? musicalEvents : getEmptyMusicalEvents());
 
-    for (auto fd : m_featureData) {
+    // Work out the label of each musical event, and which event(s)
+    // an onset with a given label belongs to, once for the score
+    // rather than every time the alignment entries are refreshed
+    
+    int n = int(m_musicalEvents->size());
+    
+    m_eventLabels.clear();
+    m_eventLabels.reserve(n);
+    m_eventIndexForLabel.clear();
+    m_eventIndexForLabel.reserve(n);
+    m_nextEventWithSameLabel = vector<int>(n, -1);
+    
+    for (int i = 0; i < n; ++i) {
+        QString label = QString::fromStdString
+            ((*m_musicalEvents)[i].measureInfo.toLabel());
+        m_eventLabels.push_back(label);
+        auto itr = m_eventIndexForLabel.find(label);
+        if (itr == m_eventIndexForLabel.end()) {
+            m_eventIndexForLabel.insert(label, i);
+        } else {
+            // Not expected, but if two events share a label, chain
+            // them so that an onset with that label aligns both
+            int j = itr.value();
+            while (m_nextEventWithSameLabel[j] >= 0) {
+                j = m_nextEventWithSameLabel[j];
+            }
+            m_nextEventWithSameLabel[j] = i;
+        }
+    }
+
+    for (auto &fd : m_featureData) {
         fd.second.alignmentEntries.clear();
     }
+
+    warmAlignerPool();
+}
+
+void
+Session::reportMemoryUsage(MemoryReport &report) const
+{
+    const QString owner = "Session";
+
+    report.addShared(owner, "m_musicalEvents", m_musicalEvents.get(),
+                     m_musicalEvents->size(),
+                     MemoryReport::sizeOf(*m_musicalEvents));
+
+    report.add(owner, "m_eventLabels", m_eventLabels.size(),
+               MemoryReport::sizeOf(m_eventLabels, [](const QString &s) {
+                   return MemoryReport::heapSize(s);
+               }));
+
+    // Keys are shared with m_eventLabels
+    report.add(owner, "m_eventIndexForLabel", m_eventIndexForLabel.size(),
+               MemoryReport::sizeOf(m_eventIndexForLabel,
+                                    [](const QString &, int) {
+                                        return size_t(0);
+                                    }));
+
+    report.add(owner, "m_nextEventWithSameLabel",
+               m_nextEventWithSameLabel.size(),
+               MemoryReport::sizeOfFlat(m_nextEventWithSameLabel));
+
+    size_t entryCount = 0, entryBytes = 0;
+    size_t tempoEventCount = 0, tempoBytes = 0;
+    
+    for (const auto &fd : m_featureData) {
+        
+        const auto &entries = fd.second.alignmentEntries;
+        entryCount += entries.size();
+        entryBytes += MemoryReport::sizeOf(entries, [](const AlignmentEntry &e) {
+            return MemoryReport::heapSize(e.label);
+        });
+
+        if (!ModelById::get(fd.first)) {
+            report.warn(owner, QString("Feature data retained for audio "
+                                       "model %1, which no longer exists")
+                        .arg(fd.first.untyped));
+        }
+        
+        if (fd.second.tempoModel.isNone()) {
+            continue;
+        }
+        
+        auto tempoModel = ModelById::getAs<SparseTimeValueModel>
+            (fd.second.tempoModel);
+        if (!tempoModel) {
+            report.warn(owner, QString("Tempo model %1 for audio model %2 "
+                                       "has been released elsewhere")
+                        .arg(fd.second.tempoModel.untyped)
+                        .arg(fd.first.untyped));
+            continue;
+        }
+        
+        EventVector events = tempoModel->getAllEvents();
+        tempoEventCount += events.size();
+        tempoBytes += sizeof(SparseTimeValueModel) +
+            MemoryReport::sizeOf(events) - sizeof(events);
+    }
+
+    report.add(owner, "alignment entries", entryCount, entryBytes);
+    report.add(owner, "tempo models", tempoEventCount, tempoBytes);
 }
 
 bool
 Session::updateAlignmentEntriesFor(ModelId audioModelId)
 {
+    TraceScope trace("Session::updateAlignmentEntriesFor", "alignment");
+
     if (m_featureData.find(audioModelId) == m_featureData.end()) {
         SVDEBUG << "Session::updateAlignmentEntriesFor: No feature data record found" << endl;
         return false;
@@ -1283,7 +1893,26 @@ Session::updateAlignmentEntriesFor(ModelId audioModelId)
         return false;
     }
 
-    std::map<std::string, sv_frame_t> labelFrameMap;
+    // The alignment entries are a dense vector indexed by musical
+    // event number. They are only reconstructed (with labels) when
+    // the score changes: otherwise we just reset and refill the
+    // frames
+
+    auto &alignmentEntries = m_featureData.at(audioModelId).alignmentEntries;
+    int n = int(m_musicalEvents->size());
+    
+    if (int(alignmentEntries.size()) != n) {
+        alignmentEntries.clear();
+        alignmentEntries.reserve(n);
+        for (const auto &event : *m_musicalEvents) {
+            alignmentEntries.push_back
+                (AlignmentEntry(event.measureInfo.toLabel(), -1));
+        }
+    } else {
+        for (auto &entry : alignmentEntries) {
+            entry.frame = -1;
+        }
+    }
     
     auto onsetsLayer = getOnsetsLayerFromPane
         (pane, OnsetsLayerSelection::ExcludePendingOnsets);
@@ -1293,8 +1922,17 @@ Session::updateAlignmentEntriesFor(ModelId audioModelId)
             ModelById::getAs<SparseOneDimensionalModel>(onsetsLayer->getModel());
         if (onsetsModel) {
             auto onsets = onsetsModel->getAllEvents();
-            for (auto onset : onsets) {
-                labelFrameMap[onset.getLabel().toStdString()] = onset.getFrame();
+            for (const auto &onset : onsets) {
+                // Events are in frame order, so where several onsets
+                // share a label, the last one wins
+                auto itr = m_eventIndexForLabel.constFind(onset.getLabel());
+                if (itr == m_eventIndexForLabel.constEnd()) {
+                    continue;
+                }
+                for (int i = itr.value(); i >= 0;
+                     i = m_nextEventWithSameLabel[i]) {
+                    alignmentEntries[i].frame = int(onset.getFrame());
+                }
             }
         } else {
             SVDEBUG << "Session::updateAlignmentEntriesFor: WARNING: Onsets layer for model " << audioModelId << " lacks onsets model itself" << endl;
@@ -1305,28 +1943,14 @@ Session::updateAlignmentEntriesFor(ModelId audioModelId)
         // effectively empty (full of -1s)
     }
 
-    auto &alignmentEntries = m_featureData.at(audioModelId).alignmentEntries;
-    alignmentEntries.clear();
-    
-    for (auto &event : m_musicalEvents) {
-        Score::MeasureInfo info = event.measureInfo;
-        std::string label = info.toLabel();
-        auto itr = labelFrameMap.find(label);
-        if (itr == labelFrameMap.end()) {
-            // No onset has this musical event's label
-            alignmentEntries.push_back(AlignmentEntry(label, -1));
-        } else {
-            // An onset has this label
-            alignmentEntries.push_back(AlignmentEntry(label, itr->second));
-        }
-    }        
-
     return true;
 }
 
 void
 Session::recalculateTempoCurveFor(ModelId audioModel)
 {
+    TraceScope trace("Session::recalculateTempoCurveFor", "tempo");
+
     if (audioModel.isNone()) return;
 
     if (m_featureData.find(audioModel) == m_featureData.end()) {
@@ -1337,22 +1961,31 @@ Session::recalculateTempoCurveFor(ModelId audioModel)
             {},                 // lastExportedTo
             false               // alignmentModified
         };
-    } else {
-        ModelById::release(m_featureData[audioModel].tempoModel);
     }
     
     m_featureData.at(audioModel).alignmentModified = true;
 
-    sv_samplerate_t sampleRate = ModelById::get(audioModel)->getSampleRate();
-    auto tempoModel = make_shared<SparseTimeValueModel>(sampleRate, 1);
-    ModelId tempoModelId = ModelById::add(tempoModel);
-    m_featureData[audioModel].tempoModel = tempoModelId;
-    tempoModel->setSourceModel(audioModel);
+    // We keep the same tempo model for the lifetime of the audio
+    // model, and update its contents in place, rather than replacing
+    // it each time an onset is edited
+
+    ModelId tempoModelId = m_featureData.at(audioModel).tempoModel;
+    auto tempoModel = ModelById::getAs<SparseTimeValueModel>(tempoModelId);
+    
+    if (!tempoModel) {
+        sv_samplerate_t sampleRate =
+            ModelById::get(audioModel)->getSampleRate();
+        tempoModel = make_shared<SparseTimeValueModel>(sampleRate, 1);
+        tempoModelId = ModelById::add(tempoModel);
+        m_featureData.at(audioModel).tempoModel = tempoModelId;
+        tempoModel->setSourceModel(audioModel);
+    }
     
     auto audioPane = getAudioPaneForAudioModel(audioModel);
     if (!audioPane) {
         SVDEBUG << "Session::recalculateTempoCurve: No audio pane for model "
                 << audioModel << endl;
+        updateTempoModel(tempoModel, {});
         return;
     }
     
@@ -1361,60 +1994,53 @@ Session::recalculateTempoCurveFor(ModelId audioModel)
     if (!onsetsLayer) {
         SVDEBUG << "Session::recalculateTempoCurve: No onsets layer in pane for audio model "
                 << audioModel << endl;
+        updateTempoModel(tempoModel, {});
         return;
     }
 
     if (!updateAlignmentEntriesFor(audioModel)) {
         SVDEBUG << "Session::recalculateTempoCurve: Failed to update alignment entries" << endl;
+        updateTempoModel(tempoModel, {});
         return;
     }
         
     const auto &alignmentEntries = m_featureData.at(audioModel).alignmentEntries;
     int n = alignmentEntries.size();
 
-    int start = -1, end = -2;
-    bool stop = false;
+    TempoStatistics::Output stats;
+    calculateTempoStatisticsFor(audioModel, stats);
+
+    // A tempo point is added for every pair of consecutive aligned
+    // events that are not at the same time. Where there is a gap in
+    // the alignment, zero-valued points are added just after the
+    // penultimate event before the gap and just before the first
+    // tempo point after it, so that the curve drops to zero across
+    // the gap
+    
+    EventVector tempoEvents;
     sv_frame_t prev = -1;
-    while (!stop && end <= n - 4) {
-        start = end + 2;
-        while (alignmentEntries[start].frame < 0) {
-            start++;
-            if (start >= int(alignmentEntries.size()) - 1) {
-                stop = true; // no more aligned sections
-                break;
-            }
+    for (int i = 0; i + 1 < n; ++i) {
+        auto thisFrame = alignmentEntries[i].frame;
+        if (thisFrame < 0 || alignmentEntries[i+1].frame < 0) {
+            continue;
         }
-        end = start;
-        while (!stop && alignmentEntries[end+1].frame >= 0) {
-            end++;
-            if (end >= int(alignmentEntries.size()) - 1) {
-                stop = true; // reached the last event
-                break;
+        double tempo = stats.tempo[i];
+        if (tempo == tempo) { // not NaN
+            if (prev > 0) {
+                tempoEvents.push_back({ prev + 1, 0.0, QString() });
+                tempoEvents.push_back({ thisFrame - 1, 0.0, QString() });
+                prev = -1;
             }
+            Event tempoEvent(thisFrame, float(tempo), m_eventLabels[i]);
+            tempoEvents.push_back(tempoEvent);
         }
-        for (int i = start; i < end; ++i) {
-            auto thisFrame = alignmentEntries[i].frame;
-            auto nextFrame = alignmentEntries[i+1].frame;
-            auto thisSec = RealTime::frame2RealTime(thisFrame, sampleRate).toDouble();
-            auto nextSec = RealTime::frame2RealTime(nextFrame, sampleRate).toDouble();
-            Fraction dur = m_musicalEvents[i].duration;
-            if (abs(nextSec - thisSec) > 0) {
-                if (prev > 0) {
-                    tempoModel->add({ prev + 1, 0.0, QString() });
-                    tempoModel->add({ thisFrame - 1, 0.0, QString() });
-                    prev = -1;
-                }
-                double tempo = (4. * dur.numerator / dur.denominator) * 60. / (nextSec - thisSec); // num of quarter notes per minutes
-                Event tempoEvent(thisFrame, float(tempo),
-                                 QString::fromStdString(alignmentEntries[i].label));
-                tempoModel->add(tempoEvent);
-            }
-            if (i + 1 == end) {
-                prev = thisFrame;
-            }
+        if (i + 2 >= n || alignmentEntries[i+2].frame < 0) {
+            prev = thisFrame;
         }
     }
 
+    updateTempoModel(tempoModel, tempoEvents);
+
     // We must do this after adding all the events, otherwise we get
     // mired in a series of very slow updates from each time an event
     // is added
@@ -1423,6 +2049,40 @@ Session::recalculateTempoCurveFor(ModelId audioModel)
     }
 }
 
+void
+Session::updateTempoModel(shared_ptr<SparseTimeValueModel> tempoModel,
+                          EventVector events)
+{
+    // Change only those events that differ between the model and the
+    // new set, so that an edit to a single onset results in only a
+    // handful of removals and additions
+    
+    EventVector existing = tempoModel->getAllEvents();
+    sort(existing.begin(), existing.end());
+    sort(events.begin(), events.end());
+    
+    EventVector toRemove, toAdd;
+    set_difference(existing.begin(), existing.end(),
+                   events.begin(), events.end(),
+                   back_inserter(toRemove));
+    set_difference(events.begin(), events.end(),
+                   existing.begin(), existing.end(),
+                   back_inserter(toAdd));
+
+#ifdef DEBUG_SESSION
+    SVDEBUG << "Session::updateTempoModel: " << existing.size()
+            << " existing events, " << events.size() << " new, removing "
+            << toRemove.size() << " and adding " << toAdd.size() << endl;
+#endif
+    
+    for (const auto &e : toRemove) {
+        tempoModel->remove(e);
+    }
+    for (const auto &e : toAdd) {
+        tempoModel->add(e);
+    }
+}
+
 void
 Session::updateOnsetColours()
 {
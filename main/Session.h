@@ -24,10 +24,22 @@
 #include "view/Pane.h"
 
 #include "data/model/Model.h"
+#include "data/model/SparseTimeValueModel.h"
 
 #include "piano-aligner/Score.h"
 
 #include "TempoCurveWidget.h"
+#include "SharedMusicalEvents.h"
+#include "TempoStatistics.h"
+#include "AlignerPool.h"
+
+#include <QHash>
+#include <QThread>
+#include <QTimer>
+
+#include <atomic>
+
+class MemoryReport;
 
 class Session : public QObject
 {
@@ -65,8 +77,25 @@ public:
     
     bool importAlignmentFrom(QString filename);
 
-    void setMusicalEvents(QString scoreId,
-                          const Score::MusicalEventList &musicalEvents);
+    /**
+     * Export tempo and inter-onset statistics for the alignment of
+     * the active audio model, as CSV.
+     */
+    bool exportTempoStatisticsTo(QString filename);
+
+    /**
+     * Set the score and its musical event list. The list is shared,
+     * not copied.
+     */
+    void setMusicalEvents(QString scoreId, SharedMusicalEvents musicalEvents);
+
+    /**
+     * Add the sizes of the musical events, label indexes, alignment
+     * entries and tempo models to the given memory report, with a
+     * warning for any tempo model or feature data that has outlived
+     * its audio model.
+     */
+    void reportMemoryUsage(MemoryReport &report) const;
 
     static const sv::TransformId smartCopyTransformId;
                                                                        
@@ -128,6 +157,8 @@ protected slots:
     void frameIlluminated(sv::sv_frame_t);
     
 private:
+    friend class SessionFixture; // main/test/SessionFixture.h
+    
     // I don't own any of these. The SV main window owns the document
     // and panes; the document owns the layers and models
     sv::Document *m_document;
@@ -148,7 +179,15 @@ private:
     sv::TimeInstantLayer *m_pendingOnsetsLayer;
     sv::ModelId m_audioModelForPendingOnsets;
 
-    Score::MusicalEventList m_musicalEvents;
+    SharedMusicalEvents m_musicalEvents;
+
+    // Label of each musical event, by index; the index of the first
+    // musical event with each label; and the index of the next event
+    // with the same label as each event, or -1 if there is none (it
+    // is normally expected that every label will be unique)
+    std::vector<QString> m_eventLabels;
+    QHash<QString, int> m_eventIndexForLabel;
+    std::vector<int> m_nextEventWithSameLabel;
 
     struct FeatureData {
         std::vector<AlignmentEntry> alignmentEntries;
@@ -163,6 +202,15 @@ private:
 
     bool m_inEditMode;
 
+    // Warm aligner instances, shared with the threads that run them
+    std::shared_ptr<AlignerPool> m_alignerPool;
+    QTimer m_alignerPoolTimer;
+
+    // Threads warming or running pooled aligners. I own these, and
+    // abandon and wait for them when the document goes away
+    std::vector<QThread *> m_alignerThreads;
+    std::atomic<bool> m_alignerThreadsAbandoned;
+
     sv::ModelId getAudioModelFromPane(sv::Pane *) const;
     sv::Pane *getAudioPaneForAudioModel(sv::ModelId) const;
 
@@ -174,15 +222,33 @@ private:
     (sv::Pane *, OnsetsLayerSelection) const;
     
     void setOnsetsLayerProperties(sv::TimeInstantLayer *);
+    sv::Transform makeAlignmentTransform(sv::TransformId transformId) const;
+    sv::Layer *beginPooledAlignment(const sv::Transform &,
+                                    const sv::ModelTransformer::Input &);
+    sv::Layer *beginHelperAlignment(const sv::Transform &,
+                                    const sv::ModelTransformer::Input &);
+    sv::Layer *createAlignmentOutputLayer(const sv::Transform &,
+                                          const sv::ModelTransformer::Input &,
+                                          int resolution,
+                                          sv::ModelId &onsetsModelId);
+    void alignmentProcessFailed(sv::ModelId onsetsModelId, QString message);
+    void warmAlignerPool();
+    void alignerPoolTimerElapsed();
+    void startAlignerThread(QThread *, QThread::Priority);
+    void abandonAlignerThreads();
     void alignmentComplete();
-    void mergeLayers(sv::TimeInstantLayer *from, sv::TimeInstantLayer *to,
+    void mergeLayers(sv::TimeInstantLayer *into, sv::TimeInstantLayer *from,
                      sv::sv_frame_t overlapStart, sv::sv_frame_t overlapEnd);
     void recalculateTempoCurveFor(sv::ModelId audioModel);
+    void updateTempoModel(std::shared_ptr<sv::SparseTimeValueModel> tempoModel,
+                          sv::EventVector events);
     void updateOnsetColours();
 
     void updateTempoCurveExtentsFromActivePane();
 
     bool updateAlignmentEntriesFor(sv::ModelId audioModel);
+    void calculateTempoStatisticsFor(sv::ModelId audioModel,
+                                     TempoStatistics::Output &stats) const;
     bool exportAlignmentEntries(sv::ModelId fromAudioModel, QString toFilePath);
 };
 
@@ -0,0 +1,50 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_SHARED_MUSICAL_EVENTS_H
+#define SV_SHARED_MUSICAL_EVENTS_H
+
+#include "piano-aligner/Score.h"
+
+#include <memory>
+
+/**
+ * An immutable musical event list for a score, shared between the
+ * session and the score and tempo-curve widgets rather than copied
+ * into each of them. The list is made once when the score is loaded
+ * and is never changed afterwards; a new score gets a new list, and
+ * the old one goes away when the last component lets go of it.
+ */
+typedef std::shared_ptr<const Score::MusicalEventList> SharedMusicalEvents;
+
+/**
+ * Make a shared list from the given one. Pass a temporary, or use
+ * std::move, to avoid copying the events.
+ */
+inline SharedMusicalEvents
+makeSharedMusicalEvents(Score::MusicalEventList events)
+{
+    return std::make_shared<const Score::MusicalEventList>(std::move(events));
+}
+
+/**
+ * Return a shared empty list, for components that have no score.
+ */
+inline SharedMusicalEvents
+getEmptyMusicalEvents()
+{
+    static SharedMusicalEvents empty =
+        std::make_shared<const Score::MusicalEventList>();
+    return empty;
+}
+
+#endif
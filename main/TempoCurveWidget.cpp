@@ -11,6 +11,9 @@
 */
 
 #include "TempoCurveWidget.h"
+#include "Tracing.h"
+#include "LatencyMonitor.h"
+#include "MemoryReport.h"
 
 #include "svgui/layer/ColourDatabase.h"
 #include "svgui/layer/LinearNumericalScale.h"
@@ -60,6 +63,7 @@ TempoCurveWidget::TempoCurveWidget(QWidget *parent) :
     m_defaultBarCount(8),
     m_barDisplayStart(0),
     m_barDisplayEnd(m_defaultBarCount),
+    m_musicalEvents(getEmptyMusicalEvents()),
     m_firstBar(1),
     m_lastBar(1),
     m_resolution(TempoResolution::perNote),
@@ -171,20 +175,21 @@ TempoCurveWidget::updateHeadsUpDisplay()
 }
 
 void
-TempoCurveWidget::setMusicalEvents(const Score::MusicalEventList &musicalEvents)
+TempoCurveWidget::setMusicalEvents(SharedMusicalEvents musicalEvents)
 {
+    m_musicalEvents = (musicalEvents ? musicalEvents : getEmptyMusicalEvents());
+
 #ifdef DEBUG_TEMPO_CURVE_WIDGET
-    SVDEBUG << "TempoCurveWidget::setMusicalEvents: " << musicalEvents.size() << " events" << endl;
+    SVDEBUG << "TempoCurveWidget::setMusicalEvents: " << m_musicalEvents->size() << " events" << endl;
 #endif
-    
-    m_musicalEvents = musicalEvents;
+
     m_timeSignatures.clear();
     pair<int, int> prev(4, 4);
     // We aim for m_timeSignatures[bar] to record the time sig for
     // that bar number. Bar numbers usually start at 1 (in which case
     // the first entry in the vector is unused) but start at 0 if
     // there is a pick-up bar.
-    for (const auto &e : m_musicalEvents) {
+    for (const auto &e : *m_musicalEvents) {
         int bar = e.measureInfo.measureNumber;
         if (m_timeSignatures.empty()) {
             m_firstBar = bar;
@@ -206,7 +211,7 @@ TempoCurveWidget::setMusicalEvents(const Score::MusicalEventList &musicalEvents)
 #endif
 
     m_tempoModels.clear();
-    m_curves.clear();
+    m_pyramids.clear();
     m_colours.clear();
     m_labelToBarCache.clear();
     m_colourCounter = 0;
@@ -224,7 +229,7 @@ TempoCurveWidget::setCurveForAudio(sv::ModelId audioModel,
 #endif
     
     m_tempoModels[audioModel] = tempoModel;
-    m_curves[audioModel] = extractCurve(tempoModel);
+    extractCurves(tempoModel, m_pyramids[audioModel]);
     
     if (m_colours.find(audioModel) == m_colours.end()) {
     
@@ -251,11 +256,64 @@ TempoCurveWidget::unsetCurveForAudio(sv::ModelId audioModel)
 #endif
 
     m_tempoModels.erase(audioModel);
-    m_curves.erase(audioModel);
+    m_pyramids.erase(audioModel);
 
     update();
 }
 
+void
+TempoCurveWidget::reportMemoryUsage(MemoryReport &report) const
+{
+    const QString owner = "TempoCurveWidget";
+
+    report.addShared(owner, "m_musicalEvents", m_musicalEvents.get(),
+                     m_musicalEvents->size(),
+                     MemoryReport::sizeOf(*m_musicalEvents));
+
+    report.add(owner, "m_timeSignatures", m_timeSignatures.size(),
+               MemoryReport::sizeOfFlat(m_timeSignatures));
+
+    report.add(owner, "m_pyramids", m_pyramids.size(),
+               MemoryReport::sizeOf
+               (m_pyramids, [](const auto &e) {
+                   const TempoPyramid &p = e.second;
+                   return MemoryReport::sizeOf(p.perNote) +
+                       MemoryReport::sizeOf(p.perBeat) +
+                       MemoryReport::sizeOf(p.perBar) +
+                       MemoryReport::heapSize(p.checkpoints) -
+                       3 * sizeof(EventVector);
+               }));
+
+    report.add(owner, "m_labelToBarCache", m_labelToBarCache.size(),
+               MemoryReport::sizeOf(m_labelToBarCache,
+                                    [](const QString &label, double) {
+                                        return MemoryReport::heapSize(label);
+                                    }));
+
+    report.add(owner, "m_tempoModels", m_tempoModels.size(),
+               MemoryReport::sizeOf(m_tempoModels, [](const auto &) {
+                   return size_t(0);
+               }));
+
+    report.add(owner, "m_colours", m_colours.size(),
+               MemoryReport::sizeOf(m_colours, [](const auto &) {
+                   return size_t(0);
+               }));
+
+    for (const auto &t : m_tempoModels) {
+        if (!ModelById::get(t.first)) {
+            report.warn(owner, QString("Curve retained for audio model %1, "
+                                       "which no longer exists")
+                        .arg(t.first.untyped));
+        }
+        if (!ModelById::get(t.second)) {
+            report.warn(owner, QString("Curve retained for tempo model %1, "
+                                       "which has been released")
+                        .arg(t.second.untyped));
+        }
+    }
+}
+
 pair<int, int>
 TempoCurveWidget::getTimeSignature(int bar) const
 {
@@ -357,8 +415,29 @@ TempoCurveWidget::ensureBarVisible(double bar)
 void
 TempoCurveWidget::paintEvent(QPaintEvent *e)
 {
+    TraceScope trace("TempoCurveWidget::paintEvent", "tempo");
+
     QFrame::paintEvent(e);
 
+    paintContents();
+
+    if (LatencyMonitor::isEnabled()) {
+        QPainter paint(this);
+        setPaintFont(paint);
+        LatencyMonitor::paintOverlay
+            (paint, rect(), { LatencyMonitor::Metric::TempoCurveHover,
+                              LatencyMonitor::Metric::AlignmentEditToTempo });
+    }
+
+    LatencyMonitor::getProbe
+        (LatencyMonitor::Metric::TempoCurveHover).painted();
+    LatencyMonitor::getProbe
+        (LatencyMonitor::Metric::AlignmentEditToTempo).painted();
+}
+
+void
+TempoCurveWidget::paintContents()
+{
     LinearNumericalScale scale;
     
     {
@@ -369,14 +448,14 @@ TempoCurveWidget::paintEvent(QPaintEvent *e)
     }
 
 #ifdef DEBUG_TEMPO_CURVE_WIDGET
-    SVDEBUG << "TempoCurveWidget::paintEvent: m_barDisplayStart = " << m_barDisplayStart << ", m_barDisplayEnd = " << m_barDisplayEnd << ", m_firstBar = " << m_firstBar << ", m_lastBar = " << m_lastBar << endl;
+    SVDEBUG << "TempoCurveWidget::paintContents: m_barDisplayStart = " << m_barDisplayStart << ", m_barDisplayEnd = " << m_barDisplayEnd << ", m_firstBar = " << m_firstBar << ", m_lastBar = " << m_lastBar << endl;
 #endif
 
     double barStart = m_barDisplayStart;
     double barEnd = m_barDisplayEnd;
     if (barEnd < m_firstBar) {
 #ifdef DEBUG_TEMPO_CURVE_WIDGET
-        SVDEBUG << "TempoCurveWidget::paintEvent: barEnd = " << barEnd << ", returning early" << endl;
+        SVDEBUG << "TempoCurveWidget::paintContents: barEnd = " << barEnd << ", returning early" << endl;
 #endif
         return;
     }
@@ -538,38 +617,132 @@ TempoCurveWidget::xToBarWith(double x, double barStart, double barEnd) const
     return barStart + ((x - m_margin) / w) * (barEnd - barStart);
 }
 
-EventVector
-TempoCurveWidget::extractCurve(ModelId tempoCurveModelId) const
+const EventVector &
+TempoCurveWidget::getCurve(const TempoPyramid &pyramid) const
+{
+    switch (m_resolution) {
+    case TempoResolution::perBeat: return pyramid.perBeat;
+    case TempoResolution::perBar: return pyramid.perBar;
+    case TempoResolution::perNote: default: return pyramid.perNote;
+    }
+}
+
+void
+TempoCurveWidget::extractCurves(ModelId tempoCurveModelId,
+                                TempoPyramid &pyramid) const
 {
     auto model = ModelById::getAs<SparseTimeValueModel>(tempoCurveModelId);
     if (!model) {
-        return {};
+        pyramid = {};
+        return;
     }
 
     EventVector original = model->getAllEvents();
+
+    // The per-beat and per-bar curves are both produced in a single
+    // pass over the original events. If we already have curves for
+    // an earlier version of this model, we only need to re-run from
+    // the first event that differs, and we can stop as soon as we
+    // reach an event that is unchanged and whose accumulator states
+    // match those recorded for it last time.
+
+    const EventVector &previous = pyramid.perNote;
+    
+    int n = int(original.size());
+    int pn = int(previous.size());
     
-    if (m_resolution == TempoResolution::perNote) {
-        return original;
+    bool haveCheckpoints = (int(pyramid.checkpoints.size()) == pn + 1);
+    
+    int prefix = 0;
+    if (haveCheckpoints) {
+        while (prefix < n && prefix < pn &&
+               original[prefix] == previous[prefix]) {
+            ++prefix;
+        }
     }
 
-    EventVector synthetic;
-    sv_frame_t syntheticFrame = 0;
-    
-    int bar = 0;
-    int beat = 0;
-    int num = 1;
-    int denom = 1;
+    int suffix = 0;
+    if (haveCheckpoints) {
+        while (suffix < n - prefix && suffix < pn - prefix &&
+               original[n - suffix - 1] == previous[pn - suffix - 1]) {
+            ++suffix;
+        }
+    }
+
+    if (prefix == n && n == pn) {
+#ifdef DEBUG_TEMPO_CURVE_WIDGET
+        SVDEBUG << "TempoCurveWidget::extractCurves: no change" << endl;
+#endif
+        return;
+    }
+
+#ifdef DEBUG_TEMPO_CURVE_WIDGET
+    SVDEBUG << "TempoCurveWidget::extractCurves: " << n << " events ("
+            << pn << " previously), common prefix " << prefix
+            << ", common suffix " << suffix << endl;
+#endif
+
+    TempoPyramid old;
+    std::swap(old, pyramid);
+
+    pyramid.perNote = original;
     
-    double prevPos = 0.0;
-    double prevValue = 0.0;
-    double firstNotePos = 0.0;
+    Checkpoint cp;
+    cp.beatCount = 0;
+    cp.barCount = 0;
 
-    double eps = 1.0e-6;
+    if (prefix > 0) {
+        cp = old.checkpoints[prefix];
+        pyramid.checkpoints = vector<Checkpoint>(old.checkpoints.begin(),
+                                                 old.checkpoints.begin() + prefix);
+        pyramid.perBeat = EventVector(old.perBeat.begin(),
+                                      old.perBeat.begin() + cp.beatCount);
+        pyramid.perBar = EventVector(old.perBar.begin(),
+                                     old.perBar.begin() + cp.barCount);
+    }
 
-    double acc = 0.0;
+    pyramid.checkpoints.reserve(n + 1);
+    
+    CurveState beatState = cp.beatState;
+    CurveState barState = cp.barState;
+
+    for (int i = prefix; i < n; ++i) {
 
-    for (const auto &ev : original) {
+        if (i >= n - suffix) {
+            const Checkpoint &oldcp = old.checkpoints[i - n + pn];
+            if (oldcp.beatState == beatState && oldcp.barState == barState) {
+#ifdef DEBUG_TEMPO_CURVE_WIDGET
+                SVDEBUG << "TempoCurveWidget::extractCurves: state at event "
+                        << i << " matches previous extraction, reusing the "
+                        << "remaining " << (n - i) << " events" << endl;
+#endif
+                int beatShift = int(pyramid.perBeat.size()) - oldcp.beatCount;
+                int barShift = int(pyramid.perBar.size()) - oldcp.barCount;
+                for (int j = i - n + pn; j <= pn; ++j) {
+                    Checkpoint c = old.checkpoints[j];
+                    c.beatCount += beatShift;
+                    c.barCount += barShift;
+                    pyramid.checkpoints.push_back(c);
+                }
+                for (int j = oldcp.beatCount; j < int(old.perBeat.size()); ++j) {
+                    pyramid.perBeat.push_back
+                        (old.perBeat[j].withFrame(sv_frame_t(pyramid.perBeat.size())));
+                }
+                for (int j = oldcp.barCount; j < int(old.perBar.size()); ++j) {
+                    pyramid.perBar.push_back
+                        (old.perBar[j].withFrame(sv_frame_t(pyramid.perBar.size())));
+                }
+                return;
+            }
+        }
 
+        cp.beatState = beatState;
+        cp.barState = barState;
+        cp.beatCount = int(pyramid.perBeat.size());
+        cp.barCount = int(pyramid.perBar.size());
+        pyramid.checkpoints.push_back(cp);
+        
+        const auto &ev = original[i];
         double value = ev.getValue();
         QString label = ev.getLabel();
         bool ok = false;
@@ -577,147 +750,163 @@ TempoCurveWidget::extractCurve(ModelId tempoCurveModelId) const
         if (!ok) continue;
 
 #ifdef DEBUG_TEMPO_CURVE_WIDGET
-        SVDEBUG << "TempoCurveWidget::extractCurve: label " << label
+        SVDEBUG << "TempoCurveWidget::extractCurves: label " << label
                 << ", pos " << pos << ", value " << value << endl;
 #endif
 
         if (value <= 0.0) {
 #ifdef DEBUG_TEMPO_CURVE_WIDGET
-            SVDEBUG << "TempoCurveWidget::extractCurve: disregarding event with value " << value << endl;
+            SVDEBUG << "TempoCurveWidget::extractCurves: disregarding event with value " << value << endl;
 #endif
             continue;
         }
 
-        bool isFirstNote = (prevValue == 0.0);
+        accumulateCurve(beatState, true, pos, value, pyramid.perBeat);
+        accumulateCurve(barState, false, pos, value, pyramid.perBar);
+    }
+
+    cp.beatState = beatState;
+    cp.barState = barState;
+    cp.beatCount = int(pyramid.perBeat.size());
+    cp.barCount = int(pyramid.perBar.size());
+    pyramid.checkpoints.push_back(cp);
+}
+
+void
+TempoCurveWidget::accumulateCurve(CurveState &s, bool perBeat,
+                                  double pos, double value,
+                                  EventVector &synthetic) const
+{
+    double eps = 1.0e-6;
+
+    bool isFirstNote = (s.prevValue == 0.0);
             
-        while (true) {
-
-            // A note may continue for several beats: tally up each
-            // beat until we run out of note, then break from the loop
-            // so as to go on to the next note 
-
-            if (beat == 0 && m_resolution == TempoResolution::perBeat) {
-                // First beat of bar: get the time signature. (In
-                // perBar mode the logic is identical but we have
-                // effectively 1/1 signature)
-                auto sig = getTimeSignature(bar);
-                num = sig.first;
-                denom = sig.second;
-            }
+    while (true) {
+
+        // A note may continue for several beats: tally up each
+        // beat until we run out of note, then break from the loop
+        // so as to go on to the next note 
+
+        if (s.beat == 0 && perBeat) {
+            // First beat of bar: get the time signature. (In
+            // perBar mode the logic is identical but we have
+            // effectively 1/1 signature)
+            auto sig = getTimeSignature(s.bar);
+            s.num = sig.first;
+            s.denom = sig.second;
+        }
 
-            // Our position value is bar + beat / numerator (of time
-            // sig), not denominator.  e.g. in 3/4 time the beats land
-            // at 1.0, 1.333, 1.666 etc.
+        // Our position value is bar + beat / numerator (of time
+        // sig), not denominator.  e.g. in 3/4 time the beats land
+        // at 1.0, 1.333, 1.666 etc.
             
-            double nextBeatPos = double(bar) + double(beat + 1) / double(num);
+        double nextBeatPos = double(s.bar) + double(s.beat + 1) / double(s.num);
 
-            if (isFirstNote) {
-                firstNotePos = pos;
+        if (isFirstNote) {
+            s.firstNotePos = pos;
 #ifdef DEBUG_TEMPO_CURVE_WIDGET
-                SVDEBUG << "TempoCurveWidget::extractCurve: This is the first note, setting firstNotePos to " << pos << endl;
+            SVDEBUG << "TempoCurveWidget::accumulateCurve: This is the first note, setting firstNotePos to " << pos << endl;
 #endif
-            }
+        }
         
-            if (pos + eps < nextBeatPos) { // prev note ends before next beat
-                if (!isFirstNote) {
-                    acc += (pos - prevPos) * (1.0 / prevValue);
+        if (pos + eps < nextBeatPos) { // prev note ends before next beat
+            if (!isFirstNote) {
+                s.acc += (pos - s.prevPos) * (1.0 / s.prevValue);
 #ifdef DEBUG_TEMPO_CURVE_WIDGET
-                    SVDEBUG << "TempoCurveWidget::extractCurve: added "
-                            << (pos - prevPos) << " * " << (1.0 / prevValue)
-                            << " to acc, is now " << acc << endl;
+                SVDEBUG << "TempoCurveWidget::accumulateCurve: added "
+                        << (pos - s.prevPos) << " * " << (1.0 / s.prevValue)
+                        << " to acc, is now " << s.acc << endl;
 #endif
-                }
-                break;
             }
+            break;
+        }
 
 #ifdef DEBUG_TEMPO_CURVE_WIDGET
-            SVDEBUG << "TempoCurveWidget::extractCurve: surpassed next beat "
-                    << beat+1 << " of bar " << bar << " (per bar = " << num
-                    << ") at label = " << label << ", pos = " << pos << endl;
+        SVDEBUG << "TempoCurveWidget::accumulateCurve: surpassed next beat "
+                << s.beat+1 << " of bar " << s.bar << " (per bar = " << s.num
+                << ") at pos = " << pos << endl;
 #endif
 
-            if (isFirstNote && firstNotePos < prevPos) {
-                // This is the first note but a previous beat has
-                // already been surpassed during it so we need an
-                // event for that beat
+        if (isFirstNote && s.firstNotePos < s.prevPos) {
+            // This is the first note but a previous beat has
+            // already been surpassed during it so we need an
+            // event for that beat
 #ifdef DEBUG_TEMPO_CURVE_WIDGET
-                SVDEBUG << "TempoCurveWidget::extractCurve: The first note spans a beat, permitting an event for prev beat" << endl;
+            SVDEBUG << "TempoCurveWidget::accumulateCurve: The first note spans a beat, permitting an event for prev beat" << endl;
 #endif
-                prevValue = value;
-            }
+            s.prevValue = value;
+        }
 
-            if (prevValue == 0.0) {
-                // NB we test prevValue here, not isFirstNote, because
-                // the above check may have changed our view of it
+        if (s.prevValue == 0.0) {
+            // NB we test prevValue here, not isFirstNote, because
+            // the above check may have changed our view of it
 #ifdef DEBUG_TEMPO_CURVE_WIDGET
-                SVDEBUG << "TempoCurveWidget::extractCurve: This is the first note, not adding an event for prev note" << endl;
+            SVDEBUG << "TempoCurveWidget::accumulateCurve: This is the first note, not adding an event for prev note" << endl;
 #endif
-            } else {
+        } else {
 
-                acc += (nextBeatPos - prevPos) * (1.0 / prevValue);
+            s.acc += (nextBeatPos - s.prevPos) * (1.0 / s.prevValue);
 
-                double beatDuration = 1.0 / double(num); // in bars
+            double beatDuration = 1.0 / double(s.num); // in bars
 
-                if (firstNotePos > nextBeatPos - beatDuration &&
-                    firstNotePos < nextBeatPos) {
+            if (s.firstNotePos > nextBeatPos - beatDuration &&
+                s.firstNotePos < nextBeatPos) {
 #ifdef DEBUG_TEMPO_CURVE_WIDGET
-                    SVDEBUG << "TempoCurveWidget::extractCurve: this is a partial beat with firstNotePos at "
-                            << firstNotePos << ", adjusting beat duration from "
-                            << beatDuration << " to "
-                            << nextBeatPos - firstNotePos << endl;
+                SVDEBUG << "TempoCurveWidget::accumulateCurve: this is a partial beat with firstNotePos at "
+                        << s.firstNotePos << ", adjusting beat duration from "
+                        << beatDuration << " to "
+                        << nextBeatPos - s.firstNotePos << endl;
 #endif
-                    beatDuration = nextBeatPos - firstNotePos;
-                }
+                beatDuration = nextBeatPos - s.firstNotePos;
+            }
 
-                double syntheticValue = beatDuration / acc;
-                Fraction frac(beat, denom); // To reduce to simplest form
-                QString syntheticLabel =
-                    QString("%1+%2/%3")
-                    .arg(bar)
-                    .arg(frac.numerator)
-                    .arg(frac.denominator);
+            double syntheticValue = beatDuration / s.acc;
+            Fraction frac(s.beat, s.denom); // To reduce to simplest form
+            QString syntheticLabel =
+                QString("%1+%2/%3")
+                .arg(s.bar)
+                .arg(frac.numerator)
+                .arg(frac.denominator);
 
+            // The frame of a synthetic event is simply its index
+            sv_frame_t syntheticFrame = sv_frame_t(synthetic.size());
+            
 #ifdef DEBUG_TEMPO_CURVE_WIDGET
-                SVDEBUG << "TempoCurveWidget::extractCurve: finalised acc with "
-                        << (nextBeatPos - prevPos) << " * " << (1.0 / prevValue)
-                        << " -> now " << acc << ", beat duration = "
-                        << beatDuration << ", beat/acc = "
-                        << syntheticValue << " for label "
-                        << syntheticLabel << " at index " << syntheticFrame
-                        << endl;
+            SVDEBUG << "TempoCurveWidget::accumulateCurve: finalised acc with "
+                    << (nextBeatPos - s.prevPos) << " * " << (1.0 / s.prevValue)
+                    << " -> now " << s.acc << ", beat duration = "
+                    << beatDuration << ", beat/acc = "
+                    << syntheticValue << " for label "
+                    << syntheticLabel << " at index " << syntheticFrame
+                    << endl;
 #endif
 
-                Event s(syntheticFrame, syntheticValue, syntheticLabel);
-                synthetic.push_back(s);
-
-                ++syntheticFrame;
+            synthetic.push_back(Event(syntheticFrame, syntheticValue,
+                                      syntheticLabel));
             
-                prevPos = nextBeatPos;
-                prevValue = value;
+            s.prevPos = nextBeatPos;
+            s.prevValue = value;
 
-                acc = 0.0;
-            }
+            s.acc = 0.0;
+        }
             
-            if (++beat >= num) {
-                ++bar;
-                beat = 0;
-            }
+        if (++s.beat >= s.num) {
+            ++s.bar;
+            s.beat = 0;
+        }
 
 #ifdef DEBUG_TEMPO_CURVE_WIDGET
-            SVDEBUG << "TempoCurveWidget::extractCurve: bar and beat now "
-                    << bar << " and " << beat << endl;
+        SVDEBUG << "TempoCurveWidget::accumulateCurve: bar and beat now "
+                << s.bar << " and " << s.beat << endl;
 #endif
-        }
-
-        if (prevPos < pos) { // (It may have been advanced to an
-                             // interim beat if the note was long)
-            prevPos = pos;
-        }
-        
-        prevValue = value;
     }
 
-    return synthetic;
+    if (s.prevPos < pos) { // (It may have been advanced to an
+                           // interim beat if the note was long)
+        s.prevPos = pos;
+    }
+        
+    s.prevValue = value;
 }
 
 void
@@ -756,7 +945,7 @@ TempoCurveWidget::paintCurve(ModelId audioModelId, QColor colour,
                              double barStart, double barEnd,
                              bool isCloseTempoModel)
 {
-    if (m_curves.find(audioModelId) == m_curves.end()) {
+    if (m_pyramids.find(audioModelId) == m_pyramids.end()) {
         return;
     }
     
@@ -772,7 +961,7 @@ TempoCurveWidget::paintCurve(ModelId audioModelId, QColor colour,
         return;
     }
     
-    const EventVector &points = m_curves.at(audioModelId);
+    const EventVector &points = getCurve(m_pyramids.at(audioModelId));
 
     double maxValue = model->getValueMaximum();
     double minValue = model->getValueMinimum();
@@ -977,6 +1166,10 @@ TempoCurveWidget::mouseMoveEvent(QMouseEvent *e)
         return;
     }
 
+    auto &latency =
+        LatencyMonitor::getProbe(LatencyMonitor::Metric::TempoCurveHover);
+    latency.inputReceived();
+    
     QPoint pos = e->pos();
 
     if (!m_clickedInRange) {
@@ -986,6 +1179,7 @@ TempoCurveWidget::mouseMoveEvent(QMouseEvent *e)
 #endif
             emit highlightLabel(m_closeLabel);
             update();
+            latency.repaintRequested();
         }
         return;
     }
@@ -1040,6 +1234,7 @@ TempoCurveWidget::mouseMoveEvent(QMouseEvent *e)
     }
         
     update();
+    latency.repaintRequested();
 }
 
 void
@@ -1072,9 +1267,8 @@ TempoCurveWidget::changeTempoResolution(TempoResolution resolution)
             << int(resolution) << endl;
     m_resolution = resolution;
 
-    for (const auto &m : m_tempoModels) {
-        m_curves[m.first] = extractCurve(m.second);
-    }
+    // All resolutions are already present in m_pyramids, so there is
+    // nothing to recalculate here
     
     update();
 }
@@ -1091,14 +1285,14 @@ TempoCurveWidget::identifyClosePoint(QPoint pos)
     double x = pos.x();
     double y = pos.y();
     
-    for (auto c : m_curves) {
+    for (const auto &c : m_pyramids) {
 
         ModelId audioModelId = c.first;
         ModelId tempoModelId = m_tempoModels.at(audioModelId);
         
-        const EventVector &points(c.second);
+        const EventVector &points(getCurve(c.second));
         
-        for (auto p : points) {
+        for (const auto &p : points) {
         
             double py = m_coordinateScale.getCoordForValue(this, p.getValue());
             if (py < 0 || py > height() || fabs(py - y) > threshold) {
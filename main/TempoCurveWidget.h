@@ -29,6 +29,10 @@
 
 #include "piano-aligner/Score.h"
 
+#include "SharedMusicalEvents.h"
+
+class MemoryReport;
+
 namespace sv {
 class Thumbwheel;
 class NotifyingPushButton;
@@ -42,11 +46,21 @@ public:
     TempoCurveWidget(QWidget *parent = 0);
     virtual ~TempoCurveWidget();
     
-    void setMusicalEvents(const Score::MusicalEventList &musicalEvents);
+    /**
+     * Set the musical event list for the current score. The list is
+     * shared, not copied.
+     */
+    void setMusicalEvents(SharedMusicalEvents musicalEvents);
 
     void setCurveForAudio(sv::ModelId audioModel, sv::ModelId tempoModel);
     void unsetCurveForAudio(sv::ModelId audioModel);
 
+    /**
+     * Add the sizes of the musical events, the curves held at each
+     * resolution and the label cache to the given memory report.
+     */
+    void reportMemoryUsage(MemoryReport &report) const;
+
     // LayerDimensionProvider methods
     QRect getPaintRect() const override { return rect(); }
     bool hasLightBackground() const override { return true; }
@@ -89,13 +103,59 @@ protected:
     void wheelHorizontal(int sign, Qt::KeyboardModifiers);
 
 private:
-    // m_tempoModels contains the original models; m_curves contains
-    // synthetic events generated from each model at the currently
-    // active resolution. (If the resolution is perNote, the curves
-    // are the same as the events found in the corresponding models.)
-    // In all cases the map key is the audio model id.
+    // Running state of the per-beat or per-bar accumulation carried
+    // out by extractCurves. A copy is kept for every source event so
+    // that a later extraction can resume part-way through the curve.
+    struct CurveState {
+        int bar;
+        int beat;
+        int num;
+        int denom;
+        double prevPos;
+        double prevValue;
+        double firstNotePos;
+        double acc;
+
+        CurveState() :
+            bar(0), beat(0), num(1), denom(1),
+            prevPos(0.0), prevValue(0.0), firstNotePos(0.0), acc(0.0) { }
+
+        bool operator==(const CurveState &s) const {
+            return bar == s.bar && beat == s.beat &&
+                num == s.num && denom == s.denom &&
+                prevPos == s.prevPos && prevValue == s.prevValue &&
+                firstNotePos == s.firstNotePos && acc == s.acc;
+        }
+        bool operator!=(const CurveState &s) const {
+            return !(*this == s);
+        }
+    };
+
+    struct Checkpoint {
+        CurveState beatState;
+        CurveState barState;
+        int beatCount;
+        int barCount;
+    };
+
+    // All three resolutions of a single tempo curve. perNote is a
+    // copy of the events in the tempo model; perBeat and perBar are
+    // synthetic events derived from it. checkpoints[i] records the
+    // accumulator states and synthetic event counts before perNote[i]
+    // was processed, with one further entry for the final state.
+    struct TempoPyramid {
+        sv::EventVector perNote;
+        sv::EventVector perBeat;
+        sv::EventVector perBar;
+        std::vector<Checkpoint> checkpoints;
+    };
+    
+    // m_tempoModels contains the original models; m_pyramids
+    // contains the curves generated from each model at every
+    // resolution, of which getCurve returns the currently active
+    // one. In both cases the map key is the audio model id.
     std::map<sv::ModelId, sv::ModelId> m_tempoModels;
-    std::map<sv::ModelId, sv::EventVector> m_curves;
+    std::map<sv::ModelId, TempoPyramid> m_pyramids;
     std::map<sv::ModelId, QColor> m_colours;
     mutable QHash<QString, double> m_labelToBarCache;
     QString m_crotchet;
@@ -109,7 +169,7 @@ private:
     int m_defaultBarCount;
     double m_barDisplayStart;
     double m_barDisplayEnd;
-    Score::MusicalEventList m_musicalEvents;
+    SharedMusicalEvents m_musicalEvents;
     int m_firstBar;
     int m_lastBar;
     TempoResolution m_resolution;
@@ -154,7 +214,12 @@ private:
     double xToBar(double x) const;
     double xToBarWith(double x, double barStart, double barEnd) const;
 
-    sv::EventVector extractCurve(sv::ModelId tempoCurveModelId) const;
+    void extractCurves(sv::ModelId tempoCurveModelId,
+                       TempoPyramid &pyramid) const;
+    void accumulateCurve(CurveState &state, bool perBeat,
+                         double pos, double value,
+                         sv::EventVector &synthetic) const;
+    const sv::EventVector &getCurve(const TempoPyramid &pyramid) const;
     
     bool isBarVisible(double bar);
     void ensureBarVisible(double bar);
@@ -163,6 +228,7 @@ private:
                                  sv::ModelId audioModel) const;
     double labelToBarAndFraction(QString label, bool *ok) const;
     double labelToBarAndFractionUncached(QString label, bool *ok) const;
+    void paintContents();
     void paintBarAndBeatLines(double barStart, double barEnd);
     void paintCurve(sv::ModelId audioModelId, QColor colour,
                     double barStart, double barEnd, bool isCloseTempoModel);
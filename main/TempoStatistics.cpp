@@ -0,0 +1,86 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "TempoStatistics.h"
+
+#include <limits>
+#include <algorithm>
+
+using namespace std;
+using namespace sv;
+
+void
+TempoStatistics::calculate(const Input &input, int window, Output &output)
+{
+    const int n = int(min(input.frames.size(), input.durations.size()));
+    const double nan = numeric_limits<double>::quiet_NaN();
+    const double rate = (input.sampleRate > 0 ? 1.0 / input.sampleRate : 0.0);
+
+    output.times.resize(n);
+    output.ioi.resize(n);
+    output.tempo.resize(n);
+    output.rollingTempo.resize(n);
+    output.deviation.resize(n);
+
+    if (n == 0) return;
+
+    const sv_frame_t *frames = input.frames.data();
+    const double *durations = input.durations.data();
+    double *times = output.times.data();
+    double *ioi = output.ioi.data();
+    double *tempo = output.tempo.data();
+    double *rolling = output.rollingTempo.data();
+    double *deviation = output.deviation.data();
+
+    for (int i = 0; i < n; ++i) {
+        times[i] = (frames[i] >= 0 ? double(frames[i]) * rate : nan);
+    }
+
+    // NaN propagates through the subtraction for unaligned events
+    for (int i = 0; i + 1 < n; ++i) {
+        ioi[i] = times[i+1] - times[i];
+    }
+    ioi[n-1] = nan;
+
+    // A zero interval (two events aligned to the same frame) has no
+    // meaningful tempo. Comparisons with NaN are false, so the test
+    // also excludes unaligned events
+    for (int i = 0; i < n; ++i) {
+        bool defined = (ioi[i] < 0.0 || ioi[i] > 0.0);
+        tempo[i] = (defined ? durations[i] * 60.0 / ioi[i] : nan);
+    }
+
+    // Rolling mean over the defined tempo values, via prefix sums of
+    // the values and of the number of them
+
+    if (window < 1) window = 1;
+    int half = window / 2;
+
+    vector<double> sums(n + 1, 0.0);
+    vector<int> counts(n + 1, 0);
+    for (int i = 0; i < n; ++i) {
+        bool defined = (tempo[i] == tempo[i]);
+        sums[i+1] = sums[i] + (defined ? tempo[i] : 0.0);
+        counts[i+1] = counts[i] + (defined ? 1 : 0);
+    }
+
+    for (int i = 0; i < n; ++i) {
+        int lo = max(i - half, 0);
+        int hi = min(i + half + 1, n);
+        int count = counts[hi] - counts[lo];
+        rolling[i] = (count > 0 ? (sums[hi] - sums[lo]) / count : nan);
+    }
+
+    for (int i = 0; i < n; ++i) {
+        deviation[i] = tempo[i] / rolling[i] - 1.0;
+    }
+}
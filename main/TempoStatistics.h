@@ -0,0 +1,91 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_TEMPO_STATISTICS_H
+#define SV_TEMPO_STATISTICS_H
+
+#include "base/BaseTypes.h"
+
+#include <vector>
+
+/**
+ * Tempo and inter-onset statistics for a whole recording, calculated
+ * from the aligned onset frames of a sequence of musical events.
+ *
+ * Inputs and outputs are held as separate flat arrays, one element
+ * per musical event, and each statistic is calculated in its own
+ * branch-free loop so that the compiler is free to vectorise it.
+ * Values that are undefined (for example the tempo of an event whose
+ * successor has not been aligned) are NaN.
+ */
+class TempoStatistics
+{
+public:
+    struct Input {
+        /**
+         * Onset frame of each musical event, or a negative value if
+         * the event has not been aligned.
+         */
+        std::vector<sv::sv_frame_t> frames;
+
+        /**
+         * Score duration of each musical event, from its onset to
+         * the onset of the following event, in quarter notes.
+         */
+        std::vector<double> durations;
+
+        sv::sv_samplerate_t sampleRate;
+
+        Input() : sampleRate(0) { }
+    };
+
+    struct Output {
+        /**
+         * Onset time of each event in seconds.
+         */
+        std::vector<double> times;
+
+        /**
+         * Interval in seconds from each onset to the next.
+         */
+        std::vector<double> ioi;
+
+        /**
+         * Tempo in quarter notes per minute across each interval.
+         */
+        std::vector<double> tempo;
+
+        /**
+         * Mean of the defined tempo values within a window centred
+         * on each event.
+         */
+        std::vector<double> rollingTempo;
+
+        /**
+         * Proportional deviation of each tempo value from the
+         * rolling mean, i.e. tempo / rollingTempo - 1.
+         */
+        std::vector<double> deviation;
+    };
+
+    /**
+     * Calculate all statistics for the given input, using a rolling
+     * window of the given number of events (rounded up to an odd
+     * number). The output vectors are resized to the number of
+     * events; their existing capacity is reused where possible.
+     */
+    static void calculate(const Input &input, int window, Output &output);
+
+    static const int defaultWindow = 9;
+};
+
+#endif
@@ -0,0 +1,321 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "Tracing.h"
+
+#include "base/TempWriteFile.h"
+#include "base/Debug.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QThread>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <vector>
+
+using namespace std;
+using namespace sv;
+
+namespace {
+
+// A few megabytes of records, allocated the first time tracing is
+// enabled
+const uint64_t capacity = 65536;
+const uint64_t capacityMask = capacity - 1;
+
+struct Record
+{
+    // Zero while the record is being written, otherwise one more
+    // than the index of the event it holds, so that a reader can
+    // tell whether it has been overwritten while being read
+    std::atomic<uint64_t> sequence { 0 };
+    const char *name = nullptr;
+    const char *category = nullptr;
+    int64_t start = 0;
+    int64_t duration = 0;
+    uint64_t id = 0;
+    int thread = 0;
+    char phase = 0;
+};
+
+struct Snapshot
+{
+    const char *name;
+    const char *category;
+    int64_t start;
+    int64_t duration;
+    uint64_t id;
+    int thread;
+    char phase;
+};
+
+const auto epoch = chrono::steady_clock::now();
+
+std::atomic<Record *> records(nullptr);
+std::atomic<uint64_t> nextIndex(0);
+std::atomic<uint64_t> firstIndex(0);
+std::atomic<int> nextThread(1);
+
+QMutex mutex; // for allocation and thread names
+map<int, QString> threadNames;
+
+thread_local int currentThread = 0;
+
+int
+getThread()
+{
+    if (currentThread == 0) {
+        currentThread = nextThread++;
+        QString name;
+        QThread *thread = QThread::currentThread();
+        if (thread) {
+            name = thread->objectName();
+            auto app = QCoreApplication::instance();
+            if (name == "" && app && thread == app->thread()) {
+                name = "Main";
+            }
+        }
+        if (name == "") {
+            name = QString("Thread %1").arg(currentThread);
+        }
+        QMutexLocker locker(&mutex);
+        threadNames[currentThread] = name;
+    }
+    return currentThread;
+}
+
+QString
+escaped(QString s)
+{
+    s.replace("\\", "\\\\");
+    s.replace("\"", "\\\"");
+    s.replace("\n", "\\n");
+    return s;
+}
+
+}
+
+std::atomic<bool> Tracing::m_enabled(false);
+
+void
+Tracing::setEnabled(bool enabled)
+{
+    if (enabled && !records.load()) {
+        QMutexLocker locker(&mutex);
+        if (!records.load()) {
+            records.store(new Record[capacity]);
+        }
+    }
+
+    SVDEBUG << "Tracing::setEnabled: " << (enabled ? "on" : "off") << endl;
+
+    m_enabled.store(enabled);
+}
+
+void
+Tracing::clear()
+{
+    firstIndex.store(nextIndex.load());
+}
+
+int64_t
+Tracing::now()
+{
+    return chrono::duration_cast<chrono::microseconds>
+        (chrono::steady_clock::now() - epoch).count();
+}
+
+void
+Tracing::record(char phase, const char *name, const char *category,
+                int64_t start, int64_t duration, uint64_t id)
+{
+    Record *buffer = records.load(std::memory_order_acquire);
+    if (!buffer) {
+        return;
+    }
+
+    int thread = getThread();
+
+    uint64_t index = nextIndex.fetch_add(1, std::memory_order_relaxed);
+    Record &r = buffer[index & capacityMask];
+
+    r.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    r.name = name;
+    r.category = category;
+    r.start = start;
+    r.duration = duration;
+    r.id = id;
+    r.thread = thread;
+    r.phase = phase;
+
+    r.sequence.store(index + 1, std::memory_order_release);
+}
+
+void
+Tracing::complete(const char *name, const char *category,
+                  int64_t start, int64_t duration)
+{
+    record('X', name, category, start, duration, 0);
+}
+
+void
+Tracing::begin(const char *name, const char *category)
+{
+    if (!isEnabled()) return;
+    record('B', name, category, now(), 0, 0);
+}
+
+void
+Tracing::end(const char *name, const char *category)
+{
+    if (!isEnabled()) return;
+    record('E', name, category, now(), 0, 0);
+}
+
+void
+Tracing::asyncBegin(const char *name, const char *category, uint64_t id)
+{
+    if (!isEnabled()) return;
+    record('b', name, category, now(), 0, id);
+}
+
+void
+Tracing::asyncEnd(const char *name, const char *category, uint64_t id)
+{
+    if (!isEnabled()) return;
+    record('e', name, category, now(), 0, id);
+}
+
+void
+Tracing::instant(const char *name, const char *category)
+{
+    if (!isEnabled()) return;
+    record('i', name, category, now(), 0, 0);
+}
+
+int
+Tracing::getEventCount()
+{
+    uint64_t next = nextIndex.load();
+    uint64_t first = firstIndex.load();
+    if (next < first + capacity) {
+        return int(next - first);
+    } else {
+        return int(capacity);
+    }
+}
+
+bool
+Tracing::writeChromeTrace(QString path)
+{
+    // Take a consistent copy of each event still in the buffer,
+    // skipping any that are overwritten while we read them. Events
+    // keep being recorded meanwhile, so this does not block tracing
+
+    vector<Snapshot> events;
+
+    Record *buffer = records.load(std::memory_order_acquire);
+    if (buffer) {
+        uint64_t next = nextIndex.load();
+        uint64_t first = firstIndex.load();
+        if (next > capacity && first < next - capacity) {
+            first = next - capacity;
+        }
+        events.reserve(size_t(next - first));
+        for (uint64_t index = first; index < next; ++index) {
+            const Record &r = buffer[index & capacityMask];
+            uint64_t before = r.sequence.load(std::memory_order_acquire);
+            if (before != index + 1) {
+                continue;
+            }
+            Snapshot s { r.name, r.category, r.start, r.duration,
+                         r.id, r.thread, r.phase };
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (r.sequence.load(std::memory_order_relaxed) != before) {
+                continue;
+            }
+            events.push_back(s);
+        }
+    }
+
+    map<int, QString> names;
+    {
+        QMutexLocker locker(&mutex);
+        names = threadNames;
+    }
+
+    TempWriteFile temp(path);
+    QFile file(temp.getTemporaryFilename());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        SVCERR << "Tracing::writeChromeTrace: Failed to open file "
+               << temp.getTemporaryFilename() << " for writing" << endl;
+        return false;
+    }
+
+    QTextStream out(&file);
+
+    qint64 pid = QCoreApplication::applicationPid();
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    out << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << pid
+        << ",\"tid\":0,\"args\":{\"name\":\""
+        << escaped(QCoreApplication::applicationName()) << "\"}}";
+
+    for (const auto &n : names) {
+        out << ",\n";
+        out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid
+            << ",\"tid\":" << n.first << ",\"args\":{\"name\":\""
+            << escaped(n.second) << "\"}}";
+    }
+
+    for (const auto &e : events) {
+        out << ",\n";
+        out << "{\"ph\":\"" << e.phase
+            << "\",\"name\":\"" << escaped(e.name)
+            << "\",\"cat\":\"" << escaped(e.category)
+            << "\",\"ts\":" << e.start
+            << ",\"pid\":" << pid
+            << ",\"tid\":" << e.thread;
+        switch (e.phase) {
+        case 'X':
+            out << ",\"dur\":" << e.duration;
+            break;
+        case 'b': case 'e':
+            out << ",\"id\":\"0x" << QString::number(e.id, 16) << "\"";
+            break;
+        case 'i':
+            out << ",\"s\":\"t\"";
+            break;
+        default:
+            break;
+        }
+        out << "}";
+    }
+
+    out << "\n]}\n";
+
+    file.close();
+    temp.moveToTarget();
+
+    SVDEBUG << "Tracing::writeChromeTrace: Wrote " << events.size()
+            << " events to " << path << endl;
+
+    return true;
+}
@@ -0,0 +1,142 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_TRACING_H
+#define SV_TRACING_H
+
+#include <QString>
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Lightweight event tracing for the score, alignment and tempo hot
+ * paths. Unlike Profiler, this is compiled into release builds: it
+ * is switched on and off at runtime, and when off each trace point
+ * costs a single relaxed atomic load.
+ *
+ * While enabled, events are written into a fixed-size ring buffer
+ * in memory, overwriting the oldest once full, so tracing can be left
+ * on indefinitely and the buffer saved once a stall has been seen.
+ * The buffer is saved as Chrome trace-event JSON, which can be
+ * loaded into Perfetto (ui.perfetto.dev) or chrome://tracing.
+ *
+ * Event names and categories are not copied, so they must be string
+ * literals or otherwise outlive the trace.
+ *
+ * All functions are thread-safe.
+ */
+class Tracing
+{
+public:
+    static bool isEnabled() {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Switch tracing on or off. Events already recorded are retained
+     * when switching off, and may still be saved.
+     */
+    static void setEnabled(bool enabled);
+
+    /**
+     * Discard all recorded events.
+     */
+    static void clear();
+
+    /**
+     * Return the current time in microseconds on the trace clock.
+     */
+    static int64_t now();
+
+    /**
+     * Record an event with the given start time and duration, both
+     * in microseconds on the trace clock. Normally called by
+     * TraceScope rather than directly.
+     */
+    static void complete(const char *name, const char *category,
+                         int64_t start, int64_t duration);
+
+    /**
+     * Record the start and end of a synchronous region that cannot
+     * conveniently be covered by a TraceScope. Begin and end must be
+     * called on the same thread and must nest.
+     */
+    static void begin(const char *name, const char *category);
+    static void end(const char *name, const char *category);
+
+    /**
+     * Record the start and end of an asynchronous operation, such as
+     * an alignment, that may finish on a different thread or in a
+     * different call from the one that started it. The id links the
+     * start to the end.
+     */
+    static void asyncBegin(const char *name, const char *category,
+                           uint64_t id);
+    static void asyncEnd(const char *name, const char *category,
+                         uint64_t id);
+
+    /**
+     * Record a point event.
+     */
+    static void instant(const char *name, const char *category);
+
+    /**
+     * Return the number of events currently held in the ring buffer.
+     */
+    static int getEventCount();
+
+    /**
+     * Write the recorded events to the given file as Chrome
+     * trace-event JSON. Return false if the file could not be
+     * written.
+     */
+    static bool writeChromeTrace(QString path);
+
+private:
+    static std::atomic<bool> m_enabled;
+
+    static void record(char phase, const char *name, const char *category,
+                       int64_t start, int64_t duration, uint64_t id);
+};
+
+/**
+ * Record the lifetime of this object as a trace event, if tracing is
+ * enabled when it is constructed. Use as
+ *
+ *     TraceScope trace("ScoreWidget::paintEvent", "score");
+ */
+class TraceScope
+{
+public:
+    TraceScope(const char *name, const char *category) :
+        m_name(name),
+        m_category(category),
+        m_start(Tracing::isEnabled() ? Tracing::now() : -1) { }
+
+    ~TraceScope() {
+        if (m_start >= 0) {
+            Tracing::complete(m_name, m_category,
+                              m_start, Tracing::now() - m_start);
+        }
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *m_name;
+    const char *m_category;
+    int64_t m_start;
+};
+
+#endif
@@ -0,0 +1,373 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+/*
+    Benchmark for the stages of loading a score, run over a corpus of
+    generated MEI scores of increasing length (two-stave piano
+    writing, 8 to 512 measures by default) and any further MEI files
+    given on the command line.
+
+    The stages timed are Verovio's LoadFile and RenderToTimemap, the
+    per-note loop and solo file writing in
+    ScoreParser::generateScoreFiles, RenderToSVG and
+    VrvTrim::transformSvgToTiny over every page, recording every page
+    through QtDeviceContext (which is where system extents are now
+    found), and ScoreWidget::loadScoreFile and setMusicalEvents.
+
+    For each score and stage a JSON object is written to standard
+    output on a line of its own, giving the mean and minimum wall
+    time per run, the number of allocations and bytes allocated per
+    run through C++ operator new, and the peak resident set size of
+    the process so far. Allocations made directly with malloc, which
+    include those of Qt containers such as QString, QByteArray and
+    QList, are not counted, and the field names say so. Other
+    progress messages go to standard error.
+
+    Usage: score-pipeline-bench [-n iterations] [-m measures,...] [file.mei...]
+*/
+
+#include "../ScoreParser.h"
+#include "../ScoreWidget.h"
+#include "../QtDeviceContext.h"
+#include "vrvtrim.h"
+#include "../test/SyntheticScore.h"
+
+#include "piano-aligner/Score.h"
+
+#include "verovio/include/vrv/toolkit.h"
+
+#include <QApplication>
+#include <QTemporaryDir>
+#include <QFileInfo>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+static atomic<size_t> allocationCount(0);
+static atomic<size_t> allocationBytes(0);
+
+void *operator new(size_t size)
+{
+    ++allocationCount;
+    allocationBytes += size;
+    if (void *p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+static string jsonEscape(const string &s)
+{
+    string out;
+    out.reserve(s.size());
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += char(c);
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += char(c);
+        }
+    }
+    return out;
+}
+
+static long peakRssKb()
+{
+#ifdef _WIN32
+    return -1;
+#else
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return -1;
+#ifdef __APPLE__
+    return long(ru.ru_maxrss / 1024);
+#else
+    return long(ru.ru_maxrss);
+#endif
+#endif
+}
+
+struct StageResult
+{
+    int runs = 0;
+    double totalSec = 0.0;
+    double minSec = 0.0;
+    size_t allocations = 0;
+    size_t bytes = 0;
+};
+
+class Stages
+{
+public:
+    void start(string stage) {
+        auto &r = m_running[stage];
+        r.allocations = allocationCount;
+        r.bytes = allocationBytes;
+        r.start = chrono::steady_clock::now();
+    }
+
+    void stop(string stage) {
+        auto end = chrono::steady_clock::now();
+        auto itr = m_running.find(stage);
+        if (itr == m_running.end()) return;
+        double sec = chrono::duration<double>(end - itr->second.start).count();
+        if (m_results.find(stage) == m_results.end()) {
+            m_order.push_back(stage);
+        }
+        auto &r = m_results[stage];
+        if (r.runs == 0 || sec < r.minSec) r.minSec = sec;
+        ++r.runs;
+        r.totalSec += sec;
+        r.allocations += allocationCount - itr->second.allocations;
+        r.bytes += allocationBytes - itr->second.bytes;
+        m_running.erase(itr);
+    }
+
+    template <typename F>
+    void time(string stage, F f) {
+        start(stage);
+        f();
+        stop(stage);
+    }
+
+    void report(string score, int measures, int pages, int notes) {
+        for (const auto &stage : m_order) {
+            const auto &r = m_results[stage];
+            cout << "{\"score\": \"" << jsonEscape(score) << "\""
+                 << ", \"measures\": " << measures
+                 << ", \"pages\": " << pages
+                 << ", \"notes\": " << notes
+                 << ", \"stage\": \"" << jsonEscape(stage) << "\""
+                 << ", \"runs\": " << r.runs
+                 << ", \"wall_ms_mean\": " << r.totalSec * 1000.0 / r.runs
+                 << ", \"wall_ms_min\": " << r.minSec * 1000.0
+                 << ", \"new_allocations_per_run\": "
+                 << r.allocations / r.runs
+                 << ", \"new_allocated_bytes_per_run\": "
+                 << r.bytes / r.runs
+                 << ", \"peak_rss_kb\": " << peakRssKb()
+                 << "}" << endl;
+        }
+        m_order.clear();
+        m_results.clear();
+    }
+
+private:
+    struct Running {
+        chrono::steady_clock::time_point start;
+        size_t allocations;
+        size_t bytes;
+    };
+    map<string, Running> m_running;
+    map<string, StageResult> m_results;
+    vector<string> m_order;
+};
+
+static bool benchmarkScore(string name, string meiFile, int measures,
+                           string workDir, int iterations)
+{
+    Stages stages;
+    string resourcePath = ScoreParser::getResourcePath();
+    string timemapOption = "{\"includeMeasures\" : true,}";
+    int pageCount = 0;
+
+    cerr << "Benchmarking " << name << "..." << endl;
+
+    for (int it = 0; it < iterations; ++it) {
+        vrv::Toolkit toolkit(false);
+        if (!toolkit.SetResourcePath(resourcePath)) {
+            cerr << "Failed to set Verovio resource path" << endl;
+            return false;
+        }
+        bool loaded = false;
+        stages.time("Toolkit::LoadFile", [&]() {
+            loaded = toolkit.LoadFile(meiFile);
+        });
+        if (!loaded) {
+            cerr << "Failed to load " << meiFile << " in Verovio" << endl;
+            return false;
+        }
+
+        stages.time("Toolkit::RenderToTimemap", [&]() {
+            (void)toolkit.RenderToTimemap(timemapOption);
+        });
+
+        pageCount = toolkit.GetPageCount();
+
+        vector<string> svgPages;
+        stages.time("Toolkit::RenderToSVG", [&]() {
+            for (int p = 0; p < pageCount; ++p) {
+                svgPages.push_back(toolkit.RenderToSVG(p + 1));
+            }
+        });
+
+        stages.time("VrvTrim::transformSvgToTiny", [&]() {
+            for (const auto &svg : svgPages) {
+                (void)VrvTrim::transformSvgToTiny(svg);
+            }
+        });
+
+        stages.time("QtDeviceContext page recording", [&]() {
+            for (int p = 0; p < pageCount; ++p) {
+                QtDeviceContext dc;
+                dc.SetResources(&toolkit.GetResources());
+                toolkit.RenderToDeviceContext(p + 1, &dc);
+                (void)dc.takePage();
+            }
+        });
+    }
+
+    // generateScoreFiles loads the file and renders the timemap
+    // itself; we report only the stages particular to it, as the
+    // others are timed directly above
+
+    auto callback = [&](string stage, bool starting) {
+        if (stage != "noteLoop" && stage != "writeSolo") return;
+        stage = "ScoreParser::generateScoreFiles " + stage;
+        if (starting) stages.start(stage);
+        else stages.stop(stage);
+    };
+
+    vector<string> generated;
+    for (int it = 0; it < iterations; ++it) {
+        generated = ScoreParser::generateScoreFiles
+            (workDir, name, meiFile, callback);
+        if (generated.empty()) {
+            cerr << "Failed to generate score files for " << meiFile << endl;
+            return false;
+        }
+    }
+
+    Score score;
+    if (!score.initialize(workDir + "/" + name + ".solo") ||
+        !score.readMeter(workDir + "/" + name + ".meter")) {
+        cerr << "Failed to read generated score files for " << name << endl;
+        return false;
+    }
+    auto musicalEvents = makeSharedMusicalEvents(score.getMusicalEvents());
+
+    for (int it = 0; it < iterations; ++it) {
+        ScoreWidget widget(false);
+        widget.resize(800, 1000);
+        QString error;
+        bool loaded = false;
+        stages.time("ScoreWidget::loadScoreFile", [&]() {
+            loaded = widget.loadScoreFile(QString::fromStdString(name),
+                                          QString::fromStdString(meiFile),
+                                          error);
+        });
+        if (!loaded) {
+            cerr << "ScoreWidget failed to load " << meiFile << ": "
+                 << error.toStdString() << endl;
+            return false;
+        }
+        stages.time("ScoreWidget::setMusicalEvents", [&]() {
+            widget.setMusicalEvents(musicalEvents);
+        });
+    }
+
+    stages.report(name, measures, pageCount, int(musicalEvents->size()));
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty()) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QApplication app(argc, argv);
+
+    int iterations = 3;
+    vector<int> corpus { 8, 32, 128, 512 };
+    vector<string> files;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+            corpus.clear();
+            stringstream list(argv[++i]);
+            string m;
+            while (getline(list, m, ',')) {
+                if (atoi(m.c_str()) > 0) corpus.push_back(atoi(m.c_str()));
+            }
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    if (iterations < 1) {
+        cerr << "Usage: " << argv[0]
+             << " [-n iterations] [-m measures,...] [file.mei...]" << endl;
+        return 2;
+    }
+
+    QTemporaryDir tempDir;
+    if (!tempDir.isValid()) {
+        cerr << "Failed to create temporary directory" << endl;
+        return 1;
+    }
+    string workDir = tempDir.path().toStdString();
+
+    for (int measures : corpus) {
+        string name = "generated-" + to_string(measures);
+        string path = workDir + "/" + name + ".mei";
+        ofstream out(path);
+        out << generateSyntheticMei(measures);
+        out.close();
+        if (!out.good()) {
+            cerr << "Failed to write " << path << endl;
+            return 1;
+        }
+        if (!benchmarkScore(name, path, measures, workDir, iterations)) {
+            return 1;
+        }
+    }
+
+    for (const auto &file : files) {
+        string name = QFileInfo(QString::fromStdString(file))
+            .completeBaseName().toStdString();
+        if (!benchmarkScore(name, file, -1, workDir, iterations)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,232 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+/*
+    Microbenchmarks for the interactive alignment paths in Session.
+
+    For each requested size (1k, 10k and 100k onsets by default)
+    this builds a Session against an in-memory Document holding a
+    synthetic audio model, a synthetic score of that many musical
+    events, and an alignment with one onset per event, imported from
+    a generated CSV file. It then times importAlignmentFrom,
+    recalculateTempoCurveFor, updateAlignmentEntriesFor,
+    exportAlignmentEntries, mergeLayers with a partial alignment over
+    the middle half of the recording (including undoing it again),
+    and the ScoreBasedFrameAligner mapping calls.
+
+    Results are written as one JSON object per line per operation.
+    Runs headless: QT_QPA_PLATFORM is set to offscreen unless already
+    set.
+
+    Usage: session-bench [-n iterations] [-e events,...]
+*/
+
+#include "../ScoreBasedFrameAligner.h"
+
+#include "../test/SessionFixture.h"
+
+#include <QApplication>
+#include <QTemporaryDir>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace sv;
+
+// Spacing of the synthetic onsets. Small, so that the audio model
+// stays a manageable size even with 100k onsets
+static const sv_frame_t onsetSpacing = 100;
+
+struct Timing
+{
+    string op;
+    int runs = 0;
+    double totalSec = 0.0;
+    double minSec = 0.0;
+};
+
+template <typename F>
+static void timeRuns(vector<Timing> &timings, string op, int iterations, F f)
+{
+    Timing t;
+    t.op = op;
+    for (int i = 0; i < iterations; ++i) {
+        auto start = chrono::steady_clock::now();
+        f();
+        auto end = chrono::steady_clock::now();
+        double sec = chrono::duration<double>(end - start).count();
+        if (t.runs == 0 || sec < t.minSec) t.minSec = sec;
+        ++t.runs;
+        t.totalSec += sec;
+    }
+    timings.push_back(t);
+}
+
+static bool benchmark(int eventCount, int iterations)
+{
+    cerr << "Benchmarking " << eventCount << " onsets..." << endl;
+
+    QTemporaryDir tempDir;
+    if (!tempDir.isValid()) {
+        cerr << "Failed to create temporary directory" << endl;
+        return false;
+    }
+    string dir = tempDir.path().toStdString();
+
+    Score::MusicalEventList events;
+    if (!writeSyntheticSoloScore(dir, "bench", eventCount, events)) {
+        cerr << "Failed to write synthetic score" << endl;
+        return false;
+    }
+
+    SessionFixture f(events, onsetSpacing, "bench");
+    Session &session = f.session;
+    sv_frame_t frames = f.frames;
+
+    QString alignmentPath = QString::fromStdString(dir + "/alignment.csv");
+    if (!writeSyntheticAlignment(alignmentPath.toStdString(), events,
+                                 onsetSpacing, f.sampleRate)) {
+        cerr << "Failed to write synthetic alignment" << endl;
+        return false;
+    }
+    QString exportPath = QString::fromStdString(dir + "/export.csv");
+
+    vector<Timing> timings;
+
+    timeRuns(timings, "importAlignmentFrom", iterations, [&]() {
+        session.importAlignmentFrom(alignmentPath);
+    });
+
+    if (!f.importAlignment(alignmentPath)) {
+        cerr << "Alignment import failed" << endl;
+        return false;
+    }
+    TimeInstantLayer *onsetsLayer = f.onsets;
+
+    timeRuns(timings, "recalculateTempoCurveFor", iterations, [&]() {
+        f.recalculateTempoCurve();
+    });
+
+    timeRuns(timings, "updateAlignmentEntriesFor", iterations, [&]() {
+        f.updateAlignmentEntries();
+    });
+
+    timeRuns(timings, "exportAlignmentEntries", iterations, [&]() {
+        f.exportAlignmentEntries(exportPath);
+    });
+
+    // A partial alignment over the middle half, slightly displaced
+    // from the existing one, merged as acceptAlignment would
+
+    sv_frame_t overlapStart = frames / 4, overlapEnd = (frames * 3) / 4;
+
+    timeRuns(timings, "mergeLayers", iterations, [&]() {
+        auto pending = f.addPendingLayer();
+        auto pendingModel = ModelById::getAs<SparseOneDimensionalModel>
+            (pending->getModel());
+        for (int i = 0; i < int(events.size()); ++i) {
+            sv_frame_t frame = onsetSpacing * (i + 1) + onsetSpacing / 4;
+            if (frame >= overlapStart && frame < overlapEnd) {
+                pendingModel->add(Event(frame, QString::fromStdString
+                                        (events[i].measureInfo.toLabel())));
+            }
+        }
+        f.mergeLayers(pending, overlapStart, overlapEnd);
+        f.document->deleteLayer(pending, true);
+        // Undo the merge, so that every run starts from the same
+        // onsets
+        CommandHistory::getInstance()->undo();
+        CommandHistory::getInstance()->clear();
+    });
+
+    ScoreBasedFrameAligner aligner(&session);
+    const int mappingCalls = 200;
+
+    vector<QString> labels;
+    timeRuns(timings, "ScoreBasedFrameAligner::mapToScoreLabel x200",
+             iterations, [&]() {
+                 labels.clear();
+                 for (int i = 0; i < mappingCalls; ++i) {
+                     labels.push_back(aligner.mapToScoreLabel
+                                      ((frames * i) / mappingCalls));
+                 }
+             });
+
+    timeRuns(timings,
+             "ScoreBasedFrameAligner::mapFromScoreLabelAndProportion x200",
+             iterations, [&]() {
+                 for (const auto &label : labels) {
+                     sv_frame_t frame = 0;
+                     aligner.mapFromScoreLabelAndProportion
+                         (onsetsLayer, label, 0.5, frame);
+                 }
+             });
+
+    for (const auto &t : timings) {
+        cout << "{\"onsets\": " << eventCount
+             << ", \"operation\": \"" << t.op << "\""
+             << ", \"runs\": " << t.runs
+             << ", \"wall_ms_mean\": " << t.totalSec * 1000.0 / t.runs
+             << ", \"wall_ms_min\": " << t.minSec * 1000.0
+             << "}" << endl;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty()) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QApplication app(argc, argv);
+
+    int iterations = 5;
+    vector<int> sizes { 1000, 10000, 100000 };
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-e") && i + 1 < argc) {
+            sizes.clear();
+            stringstream list(argv[++i]);
+            string n;
+            while (getline(list, n, ',')) {
+                if (atoi(n.c_str()) > 0) sizes.push_back(atoi(n.c_str()));
+            }
+        } else {
+            iterations = 0;
+            break;
+        }
+    }
+
+    if (iterations < 1 || sizes.empty()) {
+        cerr << "Usage: " << argv[0] << " [-n iterations] [-e events,...]"
+             << endl;
+        return 2;
+    }
+
+    for (int n : sizes) {
+        if (!benchmark(n, iterations)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+/*
+    Microbenchmark for TempoStatistics::calculate. Generates a
+    synthetic alignment of the requested number of onsets, with a
+    proportion of them left unaligned, and reports the time per run
+    and the throughput in millions of onsets per second.
+
+    Usage: tempo-statistics-bench [onsets [iterations]]
+*/
+
+#include "../TempoStatistics.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace sv;
+
+int main(int argc, char **argv)
+{
+    int n = 1000000;
+    int iterations = 20;
+
+    if (argc > 1) n = atoi(argv[1]);
+    if (argc > 2) iterations = atoi(argv[2]);
+    if (n < 1 || iterations < 1) {
+        cerr << "Usage: " << argv[0] << " [onsets [iterations]]" << endl;
+        return 2;
+    }
+
+    TempoStatistics::Input input;
+    input.sampleRate = 44100;
+    input.frames.resize(n);
+    input.durations.resize(n);
+
+    mt19937 rng(42);
+    uniform_real_distribution<double> jitter(0.9, 1.1);
+    uniform_int_distribution<int> gap(0, 99);
+    const double quarters[] = { 0.25, 0.5, 1.0, 1.5, 2.0 };
+
+    sv_frame_t frame = 0;
+    for (int i = 0; i < n; ++i) {
+        double dur = quarters[i % 5];
+        input.durations[i] = dur;
+        input.frames[i] = (gap(rng) == 0 ? -1 : frame);
+        frame += sv_frame_t(dur * 0.5 * input.sampleRate * jitter(rng));
+    }
+
+    TempoStatistics::Output output;
+
+    // One untimed run so that the output vectors are already sized
+    TempoStatistics::calculate(input, TempoStatistics::defaultWindow, output);
+
+    double checksum = 0.0;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        TempoStatistics::calculate(input, TempoStatistics::defaultWindow,
+                                   output);
+        double r = output.rollingTempo[(i * 7919) % n];
+        if (r == r) checksum += r;
+    }
+    auto end = chrono::steady_clock::now();
+
+    double sec = chrono::duration<double>(end - start).count();
+    double perRun = sec / iterations;
+
+    cout << "onsets: " << n << endl;
+    cout << "iterations: " << iterations << endl;
+    cout << "ms per run: " << perRun * 1000.0 << endl;
+    cout << "million onsets per second: " << (n / perRun) / 1.0e6 << endl;
+    cout << "checksum: " << checksum << endl;
+
+    return 0;
+}
@@ -1,23 +1,69 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
 
 /*
- * Convert SVG from Verovio (SVG-1.1 full) to profile supported by Qt
- * (SVG-1.2 Tiny). This code was proposed for use with Macaw
- * (https://github.com/exyte/Macaw, MIT license) by Alpha (alpha0010)
- * https://github.com/exyte/Macaw/issues/759#issuecomment-1022216541
- */
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+/*
+    Benchmark comparing the streaming implementation of
+    VrvTrim::transformSvgToTiny with the original DOM implementation,
+    which is kept here for the purpose, over real Verovio output.
+
+    Each argument is either an SVG page previously produced by
+    Verovio, or an MEI file, which is rendered with the Verovio
+    toolkit to obtain every page of SVG. With no arguments, the pages
+    of a corpus of generated MEI scores (as used by
+    score-pipeline-bench) are used instead. Rendering MEI uses the
+    Verovio resource directory given with -r, or else the resources
+    built into the application.
+
+    VrvTrim is no longer used by the application, which renders
+    Verovio pages through QtDeviceContext, so the streaming
+    transformer lives here alongside the DOM one.
+
+    Usage: vrvtrim-bench [-r resourcedir] [-n iterations] [file...]
+*/
 
 #include "vrvtrim.h"
 
+#include "../ScoreParser.h"
+#include "../test/SyntheticScore.h"
+
+#include "verovio/include/vrv/toolkit.h"
 #include "pugixml.hpp"
 
+#include <QCoreApplication>
+
 #include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
 #include <cstring>
+#include <fstream>
+#include <iostream>
 #include <map>
 #include <regex>
 #include <set>
 #include <sstream>
+#include <string>
 #include <vector>
 
+using namespace std;
+
+/*
+ * The original implementation of VrvTrim::transformSvgToTiny, using a
+ * pugixml DOM, kept here for comparison. This code was proposed for
+ * use with Macaw (https://github.com/exyte/Macaw, MIT license) by
+ * Alpha (alpha0010)
+ * https://github.com/exyte/Macaw/issues/759#issuecomment-1022216541
+ */
+
 template <class UnaryPredicate>
 inline static void vrvSvgTrim(std::string &s, UnaryPredicate p)
 {
@@ -187,12 +233,8 @@ static void styleVerseText(const pugi::xml_document &svgXml)
     style.text() = ".text { font-family: LiberationSerif; }";
 }
 
-/**
- * Convert svg symbol defs to path defs, and other manipulations
- * needed to conform to SVG 1.2 Tiny.
- */
-std::string
-VrvTrim::transformSvgToTiny(const std::string &svg)
+static std::string
+transformSvgToTinyDom(const std::string &svg)
 {
     pugi::xml_document svgXml;
     pugi::xml_parse_result parseResult = svgXml.load_string(svg.c_str());
@@ -284,3 +326,139 @@ VrvTrim::transformSvgToTiny(const std::string &svg)
     svgXml.save(result);
     return result.str();
 }
+
+static bool endsWith(const string &s, const string &suffix)
+{
+    return s.size() >= suffix.size() &&
+        s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+template <typename F>
+static double timeRuns(const vector<string> &pages, int iterations,
+                       size_t &outputBytes, F transform)
+{
+    outputBytes = 0;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        for (const auto &page : pages) {
+            outputBytes += transform(page).size();
+        }
+    }
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double>(end - start).count();
+}
+
+static bool renderPages(vrv::Toolkit &toolkit, vector<string> &pages)
+{
+    for (int p = 0; p < toolkit.GetPageCount(); ++p) {
+        pages.push_back(toolkit.RenderToSVG(p + 1));
+    }
+    return toolkit.GetPageCount() > 0;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    
+    string resourcePath;
+    int iterations = 10;
+    vector<string> files;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            resourcePath = argv[++i];
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    if (iterations < 1) {
+        cerr << "Usage: " << argv[0]
+             << " [-r resourcedir] [-n iterations] [file...]" << endl;
+        cerr << "Each file may be a Verovio SVG page or an MEI score"
+             << endl;
+        return 2;
+    }
+
+    if (resourcePath == "") {
+        resourcePath = ScoreParser::getResourcePath();
+    }
+
+    vector<string> pages;
+    size_t inputBytes = 0;
+    
+    for (const auto &file : files) {
+        if (endsWith(file, ".svg")) {
+            ifstream in(file);
+            if (!in) {
+                cerr << "Failed to open " << file << endl;
+                return 1;
+            }
+            stringstream ss;
+            ss << in.rdbuf();
+            pages.push_back(ss.str());
+        } else {
+            vrv::Toolkit toolkit(false);
+            if (!toolkit.SetResourcePath(resourcePath)) {
+                cerr << "Failed to set Verovio resource path" << endl;
+                return 1;
+            }
+            if (!toolkit.LoadFile(file)) {
+                cerr << "Failed to load " << file << " in Verovio" << endl;
+                return 1;
+            }
+            renderPages(toolkit, pages);
+        }
+    }
+
+    if (files.empty()) {
+        for (int measures : { 8, 64, 512 }) {
+            vrv::Toolkit toolkit(false);
+            if (!toolkit.SetResourcePath(resourcePath)) {
+                cerr << "Failed to set Verovio resource path" << endl;
+                return 1;
+            }
+            if (!toolkit.LoadData(generateSyntheticMei(measures)) ||
+                !renderPages(toolkit, pages)) {
+                cerr << "Failed to render generated score of " << measures
+                     << " measures" << endl;
+                return 1;
+            }
+        }
+    }
+
+    for (const auto &page : pages) {
+        inputBytes += page.size();
+    }
+
+    cout << "pages: " << pages.size() << endl;
+    cout << "input bytes per iteration: " << inputBytes << endl;
+    cout << "iterations: " << iterations << endl;
+
+    size_t domBytes = 0, streamBytes = 0;
+    
+    double dom = timeRuns(pages, iterations, domBytes,
+                          [](const string &s) {
+                              return transformSvgToTinyDom(s);
+                          });
+    
+    double stream = timeRuns(pages, iterations, streamBytes,
+                             [](const string &s) {
+                                 return VrvTrim::transformSvgToTiny(s);
+                             });
+
+    double mb = double(inputBytes) * iterations / (1024.0 * 1024.0);
+    
+    cout << "dom: " << dom * 1000.0 / iterations << " ms per iteration, "
+         << mb / dom << " MB/s, output bytes per iteration "
+         << domBytes / iterations << endl;
+    cout << "streaming: " << stream * 1000.0 / iterations
+         << " ms per iteration, " << mb / stream
+         << " MB/s, output bytes per iteration "
+         << streamBytes / iterations << endl;
+    cout << "speedup: " << dom / stream << endl;
+    
+    return 0;
+}
@@ -0,0 +1,860 @@
+
+/*
+ * Convert SVG from Verovio (SVG-1.1 full) to profile supported by Qt
+ * (SVG-1.2 Tiny). This code was proposed for use with Macaw
+ * (https://github.com/exyte/Macaw, MIT license) by Alpha (alpha0010)
+ * https://github.com/exyte/Macaw/issues/759#issuecomment-1022216541
+ */
+
+#include "vrvtrim.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string_view>
+#include <vector>
+
+/*
+ * Streaming implementation. This performs the same transformations
+ * as the original pugixml DOM implementation (which is found in
+ * vrvtrim-bench.cpp, for comparison), but in a single pass over
+ * the input without building a document tree. The only things held
+ * in memory besides the input and output are the symbol definitions
+ * (one per glyph used in the page) and the sizes at which each is
+ * used, the content that precedes the inner svg
+ * element (a description and stylesheet), and the flattened form of
+ * whichever text element is currently being read. All strings taken
+ * from the input are held as views into it rather than copied.
+ */
+
+namespace {
+
+struct XmlAttribute
+{
+    std::string_view name;
+    std::string_view value;
+};
+
+struct XmlToken
+{
+    enum Kind { StartTag, EmptyTag, EndTag, Text, Other };
+
+    Kind kind;
+    std::string_view name;
+    std::vector<XmlAttribute> attributes;
+    std::string_view raw;
+
+    std::string_view attribute(std::string_view attrName) const {
+        for (const auto &a : attributes) {
+            if (a.name == attrName) return a.value;
+        }
+        return {};
+    }
+
+    bool hasAttribute(std::string_view attrName) const {
+        for (const auto &a : attributes) {
+            if (a.name == attrName) return true;
+        }
+        return false;
+    }
+};
+
+/**
+ * Minimal non-validating XML tokenizer, sufficient for the SVG
+ * produced by Verovio. Attribute values and text are returned
+ * exactly as they appear in the input, i.e. still escaped.
+ */
+class XmlTokenizer
+{
+public:
+    XmlTokenizer(std::string_view in) : m_in(in), m_pos(0) { }
+
+    /**
+     * Read the next token. Return false at the end of the input or
+     * on error, in which case getError() returns a non-empty string.
+     */
+    bool next(XmlToken &token) {
+
+        if (m_pos >= m_in.size()) return false;
+
+        size_t start = m_pos;
+        
+        if (m_in[m_pos] != '<') {
+            size_t lt = m_in.find('<', m_pos);
+            if (lt == std::string_view::npos) lt = m_in.size();
+            token.kind = XmlToken::Text;
+            token.name = {};
+            token.attributes.clear();
+            token.raw = m_in.substr(start, lt - start);
+            m_pos = lt;
+            return true;
+        }
+
+        if (startsWith("<!--")) return skipTo(start, "-->", token);
+        if (startsWith("<![CDATA[")) {
+            // Treated as text, and kept in its CDATA wrapper
+            if (!skipTo(start, "]]>", token)) return false;
+            token.kind = XmlToken::Text;
+            return true;
+        }
+        if (startsWith("<?")) return skipTo(start, "?>", token);
+        if (startsWith("<!")) return skipTo(start, ">", token);
+
+        token.attributes.clear();
+        
+        bool end = false;
+        ++m_pos;
+        if (m_pos < m_in.size() && m_in[m_pos] == '/') {
+            end = true;
+            ++m_pos;
+        }
+
+        size_t nameStart = m_pos;
+        while (m_pos < m_in.size() && !isNameEnd(m_in[m_pos])) ++m_pos;
+        token.name = m_in.substr(nameStart, m_pos - nameStart);
+        if (token.name.empty()) return fail("element name expected");
+
+        while (true) {
+            skipSpace();
+            if (m_pos >= m_in.size()) return fail("unterminated tag");
+            char c = m_in[m_pos];
+            if (c == '>') {
+                ++m_pos;
+                token.kind = (end ? XmlToken::EndTag : XmlToken::StartTag);
+                break;
+            }
+            if (c == '/' && !end) {
+                if (m_pos + 1 >= m_in.size() || m_in[m_pos + 1] != '>') {
+                    return fail("'>' expected after '/'");
+                }
+                m_pos += 2;
+                token.kind = XmlToken::EmptyTag;
+                break;
+            }
+            if (end) return fail("unexpected content in end tag");
+            
+            size_t attrStart = m_pos;
+            while (m_pos < m_in.size() && !isNameEnd(m_in[m_pos]) &&
+                   m_in[m_pos] != '=') {
+                ++m_pos;
+            }
+            std::string_view attrName =
+                m_in.substr(attrStart, m_pos - attrStart);
+            if (attrName.empty()) return fail("attribute name expected");
+            skipSpace();
+            if (m_pos >= m_in.size() || m_in[m_pos] != '=') {
+                return fail("'=' expected after attribute name");
+            }
+            ++m_pos;
+            skipSpace();
+            if (m_pos >= m_in.size() ||
+                (m_in[m_pos] != '"' && m_in[m_pos] != '\'')) {
+                return fail("quoted attribute value expected");
+            }
+            char quote = m_in[m_pos++];
+            size_t valueEnd = m_in.find(quote, m_pos);
+            if (valueEnd == std::string_view::npos) {
+                return fail("unterminated attribute value");
+            }
+            token.attributes.push_back
+                ({ attrName, m_in.substr(m_pos, valueEnd - m_pos) });
+            m_pos = valueEnd + 1;
+        }
+
+        token.raw = m_in.substr(start, m_pos - start);
+        return true;
+    }
+
+    const std::string &getError() const { return m_error; }
+    
+private:
+    std::string_view m_in;
+    size_t m_pos;
+    std::string m_error;
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+    
+    static bool isNameEnd(char c) {
+        return isSpace(c) || c == '/' || c == '>';
+    }
+
+    void skipSpace() {
+        while (m_pos < m_in.size() && isSpace(m_in[m_pos])) ++m_pos;
+    }
+    
+    bool startsWith(std::string_view s) const {
+        return m_in.substr(m_pos, s.size()) == s;
+    }
+
+    bool skipTo(size_t start, std::string_view terminator, XmlToken &token) {
+        size_t end = m_in.find(terminator, m_pos);
+        if (end == std::string_view::npos) {
+            return fail("unterminated markup");
+        }
+        m_pos = end + terminator.size();
+        token.kind = XmlToken::Other;
+        token.name = {};
+        token.attributes.clear();
+        token.raw = m_in.substr(start, m_pos - start);
+        return true;
+    }
+    
+    bool fail(const char *message) {
+        m_error = std::string("Error parsing SVG at offset ") +
+            std::to_string(m_pos) + ": " + message;
+        m_pos = m_in.size();
+        return false;
+    }
+};
+
+/**
+ * Return true if the text consists entirely of whitespace, in which
+ * case (like the pugixml parser with default options) we disregard
+ * it within text elements.
+ */
+static bool isWhitespace(std::string_view text)
+{
+    for (char c : text) {
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') return false;
+    }
+    return true;
+}
+
+/**
+ * Parse a sequence of numbers separated by whitespace and/or commas,
+ * starting at the beginning of the given text. Return the number of
+ * values successfully read, up to n.
+ */
+static int parseNumbers(std::string_view text, double *values, int n)
+{
+    // strtod needs a terminated string, and the attribute values
+    // we are interested in are short
+    char buffer[128];
+    size_t len = std::min(text.size(), sizeof(buffer) - 1);
+    std::memcpy(buffer, text.data(), len);
+    buffer[len] = '\0';
+    
+    const char *p = buffer;
+    int count = 0;
+    while (count < n) {
+        while (*p == ' ' || *p == ',' || *p == '\t' ||
+               *p == '\n' || *p == '\r') {
+            ++p;
+        }
+        char *end = nullptr;
+        double value = std::strtod(p, &end);
+        if (end == p) break;
+        values[count++] = value;
+        p = end;
+    }
+    return count;
+}
+
+static std::string_view trimLetters(std::string_view s)
+{
+    while (!s.empty() && std::isalpha((unsigned char)s.front())) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && std::isalpha((unsigned char)s.back())) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+class TinyStreamTransformer
+{
+public:
+    TinyStreamTransformer(const std::string &svg) :
+        m_in(svg),
+        m_tokenizer(m_in),
+        m_out(&m_output),
+        m_haveRoot(false),
+        m_innerSvgDepth(-1),
+        m_haveRootDefs(false),
+        m_rootDefsEndInPrelude(false),
+        m_rootDefsEnd(0),
+        m_symbolDepth(-1),
+        m_symbolHavePath(false),
+        m_textDepth(-1),
+        m_textRawStart(0),
+        m_flatTspanCount(0),
+        m_havePendingTspan(false) {
+        // The output is usually a little smaller than the input, but
+        // may be larger when a symbol is used at many sizes
+        m_output.reserve(svg.size() + svg.size() / 8 + 1024);
+    }
+
+    std::string transform() {
+
+        XmlToken token;
+
+        while (m_tokenizer.next(token)) {
+            if (m_symbolDepth >= 0) {
+                symbolToken(token);
+            } else if (m_textDepth >= 0) {
+                textToken(token);
+            } else {
+                generalToken(token);
+            }
+        }
+
+        if (!m_tokenizer.getError().empty()) {
+            return m_tokenizer.getError();
+        }
+
+        insertPathDefs();
+        return std::move(m_output);
+    }
+
+private:
+    std::string_view m_in;
+    XmlTokenizer m_tokenizer;
+    
+    std::string m_output;
+    std::string m_prelude;
+    std::string *m_out; // either &m_output or &m_prelude
+
+    // The element stack. We only need the names, which are views
+    // into the input
+    std::vector<std::string_view> m_stack;
+
+    bool m_haveRoot;
+    std::string_view m_rootName;
+    std::vector<XmlAttribute> m_rootAttributes;
+    int m_innerSvgDepth;
+
+    // Where the path defs are to go: at the end of the first defs
+    // element within the root, as in the DOM implementation. While
+    // the prelude is being written, the offset is into the prelude
+    bool m_haveRootDefs;
+    bool m_rootDefsEndInPrelude;
+    size_t m_rootDefsEnd;
+
+    struct Symbol {
+        std::string_view id;
+        bool valid;
+        double viewBoxWidth;
+        double viewBoxHeight;
+        double transformX;
+        double transformY;
+        std::string_view coords;
+    };
+    std::vector<Symbol> m_symbols; // in document order
+
+    // The sizes ("width-height") at which each symbol is used, sorted
+    // as in the DOM implementation
+    std::map<std::string_view, std::set<std::string>> m_useConfigs;
+
+    // Scratch buffers for rewriting use elements, reused so as to
+    // avoid allocating for every element
+    std::string m_elemConfig;
+    std::string m_pathId;
+    std::string m_newHref;
+
+    // Symbol currently being read
+    int m_symbolDepth;
+    std::string_view m_symbolId;
+    std::string_view m_symbolViewBox;
+    std::string_view m_symbolTransform;
+    std::string_view m_symbolCoords;
+    bool m_symbolHavePath;
+
+    // The whitelisted text attributes, in the order in which we write
+    // them (which is the order in which the DOM implementation, which
+    // keeps them in a std::map, also writes them)
+    static constexpr int textAttrCount = 7;
+    static const std::string_view textAttrNames[textAttrCount];
+    
+    struct TextAttributes {
+        std::string_view values[textAttrCount];
+        bool present[textAttrCount];
+        
+        TextAttributes() {
+            for (int i = 0; i < textAttrCount; ++i) present[i] = false;
+        }
+        bool operator==(const TextAttributes &other) const {
+            for (int i = 0; i < textAttrCount; ++i) {
+                if (present[i] != other.present[i]) return false;
+                if (present[i] && values[i] != other.values[i]) return false;
+            }
+            return true;
+        }
+    };
+
+    struct TextFrame {
+        TextAttributes attributes;
+        std::string_view name;
+        std::string_view text;
+        bool isTspan;
+        bool hasTspanChild;
+    };
+
+    // Text element currently being read
+    int m_textDepth;
+    XmlToken m_textStart;
+    size_t m_textRawStart;
+    std::vector<TextFrame> m_textStack;
+    std::string m_flatText;
+    int m_flatTspanCount;
+    bool m_havePendingTspan;
+    TextAttributes m_pendingTspanAttributes;
+    std::string m_pendingTspanText;
+
+    size_t offsetOf(std::string_view s) const {
+        return size_t(s.data() - m_in.data());
+    }
+    
+    static void writeAttribute(std::string &out,
+                               std::string_view name,
+                               std::string_view value) {
+        char quote = (value.find('"') == std::string_view::npos ? '"' : '\'');
+        out += ' ';
+        out += name;
+        out += '=';
+        out += quote;
+        out += value;
+        out += quote;
+    }
+
+    void generalToken(const XmlToken &token) {
+
+        switch (token.kind) {
+
+        case XmlToken::Text:
+        case XmlToken::Other:
+            *m_out += token.raw;
+            return;
+
+        case XmlToken::EndTag:
+            if (m_stack.empty()) return;
+            if (m_stack.size() == 2 && m_stack.back() == "defs") {
+                markRootDefsEnd();
+            }
+            m_stack.pop_back();
+            if (int(m_stack.size()) == m_innerSvgDepth) {
+                // Inner svg closed: its content has been promoted
+                // into the root, so the tag itself is dropped
+                m_innerSvgDepth = -2;
+                return;
+            }
+            if (m_stack.empty() && m_haveRoot) {
+                finishRoot();
+                m_output += token.raw;
+                return;
+            }
+            *m_out += token.raw;
+            return;
+
+        case XmlToken::StartTag:
+        case XmlToken::EmptyTag:
+            break;
+        }
+
+        int depth = int(m_stack.size());
+        bool empty = (token.kind == XmlToken::EmptyTag);
+        
+        if (!m_haveRoot) {
+            m_haveRoot = true;
+            m_rootName = token.name;
+            m_rootAttributes = token.attributes;
+            if (empty) {
+                finishRoot();
+                m_output += "</";
+                m_output += m_rootName;
+                m_output += '>';
+                return;
+            }
+            m_stack.push_back(token.name);
+            // Everything up to the inner svg goes into the prelude,
+            // as we can't write the root element's start tag until
+            // we know its viewBox
+            m_out = &m_prelude;
+            return;
+        }
+
+        if (depth == 1 && m_innerSvgDepth == -1 && token.name == "svg") {
+            startInnerSvg(token);
+            if (!empty) {
+                m_innerSvgDepth = depth;
+                m_stack.push_back(token.name);
+            } else {
+                m_innerSvgDepth = -2;
+            }
+            return;
+        }
+
+        if (token.name == "symbol") {
+            m_symbolId = token.attribute("id");
+            m_symbolViewBox = token.attribute("viewBox");
+            m_symbolTransform = {};
+            m_symbolCoords = {};
+            m_symbolHavePath = false;
+            if (empty) {
+                finishSymbol();
+            } else {
+                m_symbolDepth = 0;
+            }
+            return;
+        }
+
+        if (token.name == "text") {
+            m_textStart = token;
+            m_textRawStart = offsetOf(token.raw);
+            m_textStack.clear();
+            m_flatText.clear();
+            m_flatTspanCount = 0;
+            m_havePendingTspan = false;
+            TextFrame frame;
+            frame.name = token.name;
+            frame.isTspan = false;
+            frame.hasTspanChild = false;
+            m_textStack.push_back(frame);
+            if (empty) {
+                finishText(token.raw);
+            } else {
+                m_textDepth = 0;
+            }
+            return;
+        }
+
+        if (token.name == "use") {
+            writeUse(token);
+        } else if (depth == 1 && empty && token.name == "defs" &&
+                   !m_haveRootDefs) {
+            // Expand it, so as to have somewhere to put the path defs
+            *m_out += token.raw.substr(0, token.raw.size() - 2);
+            *m_out += '>';
+            markRootDefsEnd();
+            *m_out += "</defs>";
+        } else {
+            *m_out += token.raw;
+        }
+
+        if (!empty) {
+            m_stack.push_back(token.name);
+        }
+    }
+
+    void startInnerSvg(const XmlToken &inner) {
+        m_output += '<';
+        m_output += m_rootName;
+        for (const auto &a : m_rootAttributes) {
+            if (a.name == "width" || a.name == "height" ||
+                a.name == "viewBox") {
+                continue;
+            }
+            writeAttribute(m_output, a.name, a.value);
+        }
+        writeAttribute(m_output, "viewBox", inner.attribute("viewBox"));
+        m_output += '>';
+        flushPrelude();
+    }
+
+    void flushPrelude() {
+        if (m_rootDefsEndInPrelude) {
+            m_rootDefsEnd += m_output.size();
+            m_rootDefsEndInPrelude = false;
+        }
+        m_output += m_prelude;
+        m_prelude.clear();
+        m_out = &m_output;
+    }
+
+    void markRootDefsEnd() {
+        if (m_haveRootDefs) return;
+        m_haveRootDefs = true;
+        m_rootDefsEnd = m_out->size();
+        m_rootDefsEndInPrelude = (m_out == &m_prelude);
+    }
+
+    void finishRoot() {
+        if (m_out == &m_prelude) {
+            // We never saw an inner svg element
+            m_output += '<';
+            m_output += m_rootName;
+            for (const auto &a : m_rootAttributes) {
+                if (a.name == "width" || a.name == "height") continue;
+                writeAttribute(m_output, a.name, a.value);
+            }
+            m_output += '>';
+            flushPrelude();
+        }
+        m_output += "<style type=\"text/css\">"
+            ".text { font-family: LiberationSerif; }</style>";
+    }
+
+    void symbolToken(const XmlToken &token) {
+        switch (token.kind) {
+        case XmlToken::StartTag:
+        case XmlToken::EmptyTag:
+            if (m_symbolDepth == 0 && !m_symbolHavePath &&
+                token.name == "path") {
+                m_symbolTransform = token.attribute("transform");
+                m_symbolCoords = token.attribute("d");
+                m_symbolHavePath = true;
+            }
+            if (token.kind == XmlToken::StartTag) {
+                ++m_symbolDepth;
+            }
+            break;
+        case XmlToken::EndTag:
+            if (m_symbolDepth == 0) {
+                finishSymbol();
+                m_symbolDepth = -1;
+            } else {
+                --m_symbolDepth;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    void finishSymbol() {
+        
+        Symbol symbol;
+        symbol.id = m_symbolId;
+        symbol.valid = false;
+        symbol.coords = m_symbolCoords;
+
+        // Expecting e.g. transform="scale(1,-1)" and
+        // viewBox="0 0 1000 1000"
+        size_t scale = m_symbolTransform.find("scale(");
+        double t[2], v[4];
+        if (scale != std::string_view::npos &&
+            parseNumbers(m_symbolTransform.substr(scale + 6), t, 2) == 2 &&
+            parseNumbers(m_symbolViewBox, v, 4) == 4) {
+            symbol.transformX = t[0];
+            symbol.transformY = t[1];
+            symbol.viewBoxWidth = v[2];
+            symbol.viewBoxHeight = v[3];
+            symbol.valid = true;
+        }
+
+        m_symbols.push_back(symbol);
+    }
+
+    void writeUse(const XmlToken &token) {
+
+        std::string_view hrefName = "xlink:href";
+        if (!token.hasAttribute(hrefName)) hrefName = "href";
+        std::string_view oldHref = token.attribute(hrefName);
+        std::string_view width = trimLetters(token.attribute("width"));
+        std::string_view height = trimLetters(token.attribute("height"));
+
+        std::string &elemConfig = m_elemConfig;
+        elemConfig.clear();
+        elemConfig += width;
+        elemConfig += '-';
+        elemConfig += height;
+
+        std::string_view symbolId =
+            (oldHref.empty() ? oldHref : oldHref.substr(1));
+
+        m_useConfigs[symbolId].insert(elemConfig);
+
+        *m_out += "<use";
+        for (const auto &a : token.attributes) {
+            if (a.name == "width" || a.name == "height") {
+                continue;
+            }
+            if (a.name == hrefName) {
+                m_newHref.clear();
+                m_newHref += oldHref;
+                m_newHref += '-';
+                m_newHref += elemConfig;
+                writeAttribute(*m_out, a.name, m_newHref);
+            } else {
+                writeAttribute(*m_out, a.name, a.value);
+            }
+        }
+        *m_out += (token.kind == XmlToken::EmptyTag ? "/>" : ">");
+    }
+
+    void insertPathDefs() {
+
+        // Create a path def for each symbol and each size at which it
+        // is used, and put them all into the root defs element. If
+        // there is none, the DOM implementation has nowhere to put
+        // them either
+
+        if (!m_haveRootDefs) return;
+
+        std::string paths;
+        
+        for (const auto &symbol : m_symbols) {
+            if (!symbol.valid) continue;
+            auto itr = m_useConfigs.find(symbol.id);
+            if (itr == m_useConfigs.end()) continue;
+            for (const auto &elemConfig : itr->second) {
+                size_t dash = elemConfig.find('-');
+                double w = std::strtod(elemConfig.c_str(), nullptr);
+                double h = std::strtod(elemConfig.c_str() + dash + 1, nullptr);
+                m_pathId.clear();
+                m_pathId += symbol.id;
+                m_pathId += '-';
+                m_pathId += elemConfig;
+                paths += "<path";
+                writeAttribute(paths, "id", m_pathId);
+                std::string transformAttr("scale(");
+                transformAttr += std::to_string
+                    (symbol.transformX * w / symbol.viewBoxWidth);
+                transformAttr += ',';
+                transformAttr += std::to_string
+                    (symbol.transformY * h / symbol.viewBoxHeight);
+                transformAttr += ')';
+                writeAttribute(paths, "transform", transformAttr);
+                writeAttribute(paths, "d", symbol.coords);
+                paths += "/>";
+            }
+        }
+
+        m_output.insert(m_rootDefsEnd, paths);
+    }
+
+    void textToken(const XmlToken &token) {
+        
+        switch (token.kind) {
+
+        case XmlToken::Text:
+            if (!isWhitespace(token.raw) && m_textStack.back().text.empty()) {
+                // As in the DOM implementation, only the first text
+                // child of an element counts
+                m_textStack.back().text = token.raw;
+            }
+            break;
+
+        case XmlToken::StartTag:
+        case XmlToken::EmptyTag:
+        {
+            TextFrame &parent = m_textStack.back();
+            TextFrame frame;
+            frame.name = token.name;
+            frame.isTspan = (token.name == "tspan" && parent.isTspan) ||
+                (token.name == "tspan" && m_textStack.size() == 1);
+            frame.hasTspanChild = false;
+            if (frame.isTspan) {
+                parent.hasTspanChild = true;
+                for (int i = 0; i < textAttrCount; ++i) {
+                    if (token.hasAttribute(textAttrNames[i])) {
+                        frame.attributes.values[i] =
+                            token.attribute(textAttrNames[i]);
+                        frame.attributes.present[i] = true;
+                    } else if (m_textStack.size() > 1) {
+                        frame.attributes.values[i] =
+                            parent.attributes.values[i];
+                        frame.attributes.present[i] =
+                            parent.attributes.present[i];
+                    }
+                }
+            }
+            m_textStack.push_back(frame);
+            ++m_textDepth;
+            if (token.kind == XmlToken::EmptyTag) {
+                endTextElement();
+            }
+            break;
+        }
+
+        case XmlToken::EndTag:
+            if (m_textDepth == 0) {
+                endTextElement();
+                finishText(token.raw);
+                m_textDepth = -1;
+            } else {
+                endTextElement();
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    void endTextElement() {
+        TextFrame frame = m_textStack.back();
+        m_textStack.pop_back();
+        if (m_textDepth > 0) --m_textDepth;
+        bool isLeaf = frame.isTspan || m_textStack.empty();
+        if (isLeaf && !frame.hasTspanChild && !frame.text.empty()) {
+            appendFlatTspan(frame.attributes, frame.text);
+        }
+    }
+
+    void appendFlatTspan(const TextAttributes &attributes,
+                         std::string_view text) {
+        if (m_havePendingTspan && attributes == m_pendingTspanAttributes) {
+            // Same attributes as the previous tspan: merge into it
+            m_pendingTspanText += text;
+            return;
+        }
+        flushPendingTspan();
+        m_havePendingTspan = true;
+        m_pendingTspanAttributes = attributes;
+        m_pendingTspanText = text;
+        ++m_flatTspanCount;
+    }
+
+    void flushPendingTspan() {
+        if (!m_havePendingTspan) return;
+        m_flatText += "<tspan";
+        for (int i = 0; i < textAttrCount; ++i) {
+            if (m_pendingTspanAttributes.present[i]) {
+                writeAttribute(m_flatText, textAttrNames[i],
+                               m_pendingTspanAttributes.values[i]);
+            }
+        }
+        m_flatText += '>';
+        m_flatText += m_pendingTspanText;
+        m_flatText += "</tspan>";
+        m_havePendingTspan = false;
+    }
+    
+    void finishText(std::string_view endRaw) {
+
+        flushPendingTspan();
+
+        if (m_flatTspanCount == 0) {
+            // Nothing to flatten: write the original element as it was
+            size_t end = offsetOf(endRaw) + endRaw.size();
+            *m_out += m_in.substr(m_textRawStart, end - m_textRawStart);
+            return;
+        }
+
+        *m_out += '<';
+        *m_out += m_textStart.name;
+        for (const auto &a : m_textStart.attributes) {
+            writeAttribute(*m_out, a.name, a.value);
+        }
+        *m_out += '>';
+        *m_out += m_flatText;
+        *m_out += "</";
+        *m_out += m_textStart.name;
+        *m_out += '>';
+    }
+};
+
+const std::string_view
+TinyStreamTransformer::textAttrNames[TinyStreamTransformer::textAttrCount] = {
+    "class",
+    "font-family",
+    "font-size",
+    "font-style",
+    "text-anchor",
+    "x",
+    "y"
+};
+
+}
+
+std::string
+VrvTrim::transformSvgToTiny(const std::string &svg)
+{
+    TinyStreamTransformer transformer(svg);
+    return transformer.transform();
+}
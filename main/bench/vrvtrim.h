@@ -15,7 +15,10 @@ class VrvTrim
 public:
     /**
      * Convert svg symbol defs to path defs, and other manipulations
-     * needed to conform to SVG 1.2 Tiny.
+     * needed to conform to SVG 1.2 Tiny. This works in a single
+     * streaming pass over the input, without building a document
+     * tree. If the input cannot be parsed, the returned string
+     * contains an error description.
      */
     static std::string transformSvgToTiny(const std::string &svg);
 };
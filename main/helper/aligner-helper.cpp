@@ -0,0 +1,183 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+/*
+    Helper process that runs a score aligner Vamp plugin over audio
+    handed to it in shared memory by AlignerProcess, so that the
+    aligner runs isolated from the application and in parallel with
+    any other alignments.
+
+    Usage: performance-precision-aligner sharedmemorykey pluginkey
+               output program stepsize blocksize [parameter=value ...]
+
+    The plugin key is a Vamp plugin key (library:plugin). See
+    AlignerSharedAudio.h for the shared-memory layout and the
+    messages written to standard output.
+*/
+
+#include "../AlignerSharedAudio.h"
+
+#include <vamp-hostsdk/PluginLoader.h>
+
+#include <QSharedMemory>
+#include <QString>
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+using Vamp::Plugin;
+using Vamp::RealTime;
+using Vamp::HostExt::PluginLoader;
+
+static int fail(string message)
+{
+    cerr << "error: " << message << endl;
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 7) {
+        cerr << "Usage: " << argv[0] << " sharedmemorykey pluginkey output "
+             << "program stepsize blocksize [parameter=value ...]" << endl;
+        return 2;
+    }
+
+    QString sharedKey = QString::fromUtf8(argv[1]);
+    string pluginKey = argv[2];
+    string outputId = argv[3];
+    string program = argv[4];
+    int stepSize = atoi(argv[5]);
+    int blockSize = atoi(argv[6]);
+
+    QSharedMemory shared(sharedKey);
+    if (!shared.attach(QSharedMemory::ReadOnly)) {
+        return fail("failed to attach to shared memory \"" +
+                    sharedKey.toStdString() + "\": " +
+                    shared.errorString().toStdString());
+    }
+
+    const auto *header =
+        static_cast<const AlignerSharedAudioHeader *>(shared.constData());
+    if (size_t(shared.size()) < sizeof(AlignerSharedAudioHeader) ||
+        header->magic != AlignerSharedAudioHeader::expectedMagic ||
+        header->version != AlignerSharedAudioHeader::expectedVersion ||
+        size_t(shared.size()) < sizeof(AlignerSharedAudioHeader) +
+        size_t(header->frameCount) * sizeof(float)) {
+        return fail("shared memory does not contain the expected audio");
+    }
+
+    const float *audio = reinterpret_cast<const float *>(header + 1);
+    int64_t frameCount = header->frameCount;
+    float sampleRate = float(header->sampleRate);
+    unsigned int intRate = (unsigned int)lrint(header->sampleRate);
+
+    unique_ptr<Plugin> plugin(PluginLoader::getInstance()->loadPlugin
+                              (pluginKey, sampleRate,
+                               PluginLoader::ADAPT_ALL_SAFE));
+    if (!plugin) {
+        return fail("failed to load plugin \"" + pluginKey + "\"");
+    }
+
+    auto outputs = plugin->getOutputDescriptors();
+    int outputIndex = -1;
+    for (int i = 0; i < int(outputs.size()); ++i) {
+        if (outputId == "" || outputs[i].identifier == outputId) {
+            outputIndex = i;
+            break;
+        }
+    }
+    if (outputIndex < 0) {
+        return fail("plugin has no output \"" + outputId + "\"");
+    }
+
+    if (program != "") {
+        plugin->selectProgram(program);
+    }
+
+    for (int i = 7; i < argc; ++i) {
+        string arg = argv[i];
+        auto eq = arg.find('=');
+        if (eq == string::npos) {
+            return fail("malformed parameter argument \"" + arg + "\"");
+        }
+        plugin->setParameter(arg.substr(0, eq), float(atof(arg.c_str() + eq + 1)));
+    }
+
+    if (blockSize <= 0) {
+        blockSize = int(plugin->getPreferredBlockSize());
+        if (blockSize <= 0) blockSize = 1024;
+    }
+    if (stepSize <= 0) {
+        stepSize = int(plugin->getPreferredStepSize());
+        if (stepSize <= 0) stepSize = blockSize;
+    }
+
+    if (!plugin->initialise(1, stepSize, blockSize)) {
+        return fail("plugin failed to initialise");
+    }
+
+    auto report = [&](const Plugin::FeatureSet &features, int64_t frame) {
+        auto itr = features.find(outputIndex);
+        if (itr == features.end()) return;
+        for (const auto &f : itr->second) {
+            int64_t featureFrame = frame;
+            if (f.hasTimestamp) {
+                featureFrame = RealTime::realTime2Frame(f.timestamp, intRate);
+            }
+            cout << "feature " << featureFrame << " " << f.label << "\n";
+        }
+        cout.flush();
+    };
+
+    vector<float> block(blockSize, 0.f);
+    int completion = 0;
+
+    for (int64_t frame = 0; frame < frameCount; frame += stepSize) {
+
+        // Read directly from the shared segment except for the final,
+        // partial block, which must be zero-padded
+
+        const float *buffers[1];
+        if (frame + blockSize <= frameCount) {
+            buffers[0] = audio + frame;
+        } else {
+            fill(block.begin(), block.end(), 0.f);
+            copy(audio + frame, audio + frameCount, block.begin());
+            buffers[0] = block.data();
+        }
+
+        report(plugin->process(buffers,
+                               RealTime::frame2RealTime(long(frame), intRate)),
+               frame);
+
+        int c = int((100 * frame) / frameCount);
+        if (c > completion && c < 100) {
+            completion = c;
+            cout << "progress " << completion << endl;
+        }
+    }
+
+    report(plugin->getRemainingFeatures(), frameCount);
+
+    cout << "done" << endl;
+
+    plugin.reset();
+    shared.detach();
+    return 0;
+}
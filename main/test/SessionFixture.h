@@ -0,0 +1,231 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_SESSION_FIXTURE_H
+#define SV_SESSION_FIXTURE_H
+
+#include "../Session.h"
+#include "../TempoCurveWidget.h"
+
+#include "piano-aligner/Score.h"
+
+#include "framework/Document.h"
+#include "view/Pane.h"
+#include "view/ViewManager.h"
+#include "layer/LayerFactory.h"
+#include "layer/TimeInstantLayer.h"
+#include "data/model/SparseOneDimensionalModel.h"
+#include "data/model/test/MockWaveModel.h"
+#include "widgets/CommandHistory.h"
+
+#include <fstream>
+#include <memory>
+#include <numeric>
+#include <string>
+
+inline std::string
+syntheticFraction(int num, int den)
+{
+    int g = std::gcd(num, den);
+    if (g == 0) g = 1;
+    return std::to_string(num / g) + "/" + std::to_string(den / g);
+}
+
+/**
+ * Write a score of the given number of musical events into the given
+ * directory, as a single line of quarter notes in 4/4 in the .solo
+ * and .meter formats written by ScoreParser::generateScoreFiles, and
+ * read back its musical events. Return false on failure.
+ */
+inline bool
+writeSyntheticSoloScore(std::string dir, std::string name, int events,
+                        Score::MusicalEventList &musicalEvents)
+{
+    std::ofstream meter(dir + "/" + name + ".meter");
+    meter << "1\t4/4\n";
+    meter.close();
+
+    std::ofstream solo(dir + "/" + name + ".solo");
+    for (int i = 0; i <= events; ++i) {
+        std::string position = std::to_string(i / 4 + 1) + "+" +
+            syntheticFraction(i % 4, 4) + "\t" + syntheticFraction(i, 4);
+        if (i > 0) {
+            // note-off for the previous event
+            solo << position << "\t90\t" << 60 + ((i - 1) * 5) % 24
+                 << "\t0\tn" << (i - 1) << "\n";
+        }
+        if (i < events) {
+            solo << position << "\t90\t" << 60 + (i * 5) % 24
+                 << "\t80\tn" << i << "\n";
+        }
+    }
+    solo.close();
+
+    if (!meter.good() || !solo.good()) {
+        return false;
+    }
+
+    Score score;
+    if (!score.initialize(dir + "/" + name + ".solo") ||
+        !score.readMeter(dir + "/" + name + ".meter")) {
+        return false;
+    }
+    musicalEvents = score.getMusicalEvents();
+    return !musicalEvents.empty();
+}
+
+/**
+ * Write an alignment CSV file, in the format read by
+ * Session::importAlignmentFrom, with one onset per musical event at
+ * the given spacing, starting one spacing in. Return false on
+ * failure.
+ */
+inline bool
+writeSyntheticAlignment(std::string path,
+                        const Score::MusicalEventList &musicalEvents,
+                        sv::sv_frame_t spacing,
+                        sv::sv_samplerate_t sampleRate)
+{
+    std::ofstream csv(path);
+    csv << "LABEL,TIME,FRAME\n";
+    for (int i = 0; i < int(musicalEvents.size()); ++i) {
+        sv::sv_frame_t frame = spacing * (i + 1);
+        csv << musicalEvents[i].measureInfo.toLabel() << ","
+            << double(frame) / sampleRate << "," << frame << "\n";
+    }
+    csv.close();
+    return csv.good();
+}
+
+/**
+ * A Session against an in-memory Document holding a synthetic audio
+ * model long enough for one onset per musical event at the given
+ * spacing, with a margin of one spacing at either end. Also provides
+ * the tests and benchmarks with access to the Session's internals.
+ */
+class SessionFixture
+{
+public:
+    SessionFixture(const Score::MusicalEventList &musicalEvents,
+                   sv::sv_frame_t spacing, QString scoreId) :
+        frames(spacing * (int(musicalEvents.size()) + 2)),
+        document(new sv::Document),
+        pane(new sv::Pane),
+        tempoCurveWidget(new TempoCurveWidget),
+        onsets(nullptr) {
+
+        auto audio = std::make_shared<sv::MockWaveModel>
+            (std::vector<sv::Sort> { sv::Sine }, int(frames), 0);
+        sampleRate = audio->getSampleRate();
+        audioId = sv::ModelById::add(audio);
+
+        pane->setViewManager(&viewManager);
+        document->setMainModel(audioId);
+
+        auto sharedEvents = makeSharedMusicalEvents(musicalEvents);
+        session.setDocument(document, pane, tempoCurveWidget,
+                            nullptr, nullptr);
+        session.setMusicalEvents(scoreId, sharedEvents);
+        tempoCurveWidget->setMusicalEvents(sharedEvents);
+        session.setMainModel(audioId);
+    }
+
+    ~SessionFixture() {
+        session.unsetDocument();
+        delete document;
+        delete pane;
+        delete tempoCurveWidget;
+        sv::ModelById::release(audioId);
+        sv::CommandHistory::getInstance()->clear();
+    }
+
+    SessionFixture(const SessionFixture &) = delete;
+    SessionFixture &operator=(const SessionFixture &) = delete;
+
+    /**
+     * Import the given alignment file and find the onsets layer and
+     * model it ends up in. Return false on failure.
+     */
+    bool importAlignment(QString path) {
+        if (!session.importAlignmentFrom(path)) {
+            return false;
+        }
+        sv::CommandHistory::getInstance()->clear();
+        onsets = session.getOnsetsLayer();
+        if (!onsets) {
+            return false;
+        }
+        model = sv::ModelById::getAs<sv::SparseOneDimensionalModel>
+            (onsets->getModel());
+        return bool(model);
+    }
+
+    /**
+     * Create an empty time-instants layer, in the audio pane, for a
+     * pending alignment.
+     */
+    sv::TimeInstantLayer *addPendingLayer() {
+        auto pending = qobject_cast<sv::TimeInstantLayer *>
+            (document->createEmptyLayer(sv::LayerFactory::TimeInstants));
+        if (pending) {
+            document->addLayerToView(pane, pending);
+        }
+        return pending;
+    }
+
+    /**
+     * Set up the given layer as a pending partial alignment, as
+     * alignmentComplete would leave it, and accept it.
+     */
+    void acceptPartialAlignment(sv::TimeInstantLayer *pending,
+                                sv::sv_frame_t overlapStart,
+                                sv::sv_frame_t overlapEnd) {
+        onsets->showLayer(pane, false);
+        session.m_pendingOnsetsPane = pane;
+        session.m_pendingOnsetsLayer = pending;
+        session.m_audioModelForPendingOnsets = audioId;
+        session.m_partialAlignmentAudioStart = overlapStart;
+        session.m_partialAlignmentAudioEnd = overlapEnd;
+        session.acceptAlignment();
+    }
+
+    void recalculateTempoCurve() {
+        session.recalculateTempoCurveFor(audioId);
+    }
+
+    bool updateAlignmentEntries() {
+        return session.updateAlignmentEntriesFor(audioId);
+    }
+
+    bool exportAlignmentEntries(QString path) {
+        return session.exportAlignmentEntries(audioId, path);
+    }
+
+    void mergeLayers(sv::TimeInstantLayer *from,
+                     sv::sv_frame_t overlapStart,
+                     sv::sv_frame_t overlapEnd) {
+        session.mergeLayers(onsets, from, overlapStart, overlapEnd);
+    }
+
+    sv::sv_frame_t frames;
+    sv::sv_samplerate_t sampleRate;
+    sv::ModelId audioId;
+    sv::ViewManager viewManager;
+    sv::Document *document;
+    sv::Pane *pane;
+    TempoCurveWidget *tempoCurveWidget;
+    Session session;
+    sv::TimeInstantLayer *onsets;
+    std::shared_ptr<sv::SparseOneDimensionalModel> model;
+};
+
+#endif
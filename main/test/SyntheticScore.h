@@ -0,0 +1,106 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_SYNTHETIC_SCORE_H
+#define SV_SYNTHETIC_SCORE_H
+
+#include "../ScoreParser.h"
+
+#include "piano-aligner/Score.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+/**
+ * Return the text of a generated MEI score of the given number of
+ * measures of 4/4. There are two staves: a running line of eighth
+ * notes over half-note chords, with pitches varying from measure to
+ * measure so that the layout is not entirely regular.
+ */
+inline std::string
+generateSyntheticMei(int measures)
+{
+    static const char *pnames[] = { "c", "d", "e", "f", "g", "a", "b" };
+
+    std::stringstream s;
+    s << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      << "<mei xmlns=\"http://www.music-encoding.org/ns/mei\" meiversion=\"5.0\">\n"
+      << "<meiHead><fileDesc><titleStmt><title>Synthetic "
+      << measures << "</title></titleStmt><pubStmt/></fileDesc></meiHead>\n"
+      << "<music><body><mdiv><score>\n"
+      << "<scoreDef meter.count=\"4\" meter.unit=\"4\" keysig=\"0\">\n"
+      << "<staffGrp symbol=\"brace\" bar.thru=\"true\">\n"
+      << "<staffDef n=\"1\" lines=\"5\" clef.shape=\"G\" clef.line=\"2\"/>\n"
+      << "<staffDef n=\"2\" lines=\"5\" clef.shape=\"F\" clef.line=\"4\"/>\n"
+      << "</staffGrp>\n</scoreDef>\n<section>\n";
+
+    for (int m = 1; m <= measures; ++m) {
+        s << "<measure n=\"" << m << "\" xml:id=\"m" << m << "\">\n"
+          << "<staff n=\"1\"><layer n=\"1\">";
+        for (int i = 0; i < 8; ++i) {
+            int step = (m * 3 + i * 2) % 12;
+            s << "<note xml:id=\"n" << m << "_" << i << "\" pname=\""
+              << pnames[step % 7] << "\" oct=\"" << (4 + step / 7)
+              << "\" dur=\"8\"/>";
+        }
+        s << "</layer></staff>\n<staff n=\"2\"><layer n=\"1\">";
+        for (int c = 0; c < 2; ++c) {
+            int root = (m + c * 4) % 7;
+            s << "<chord xml:id=\"c" << m << "_" << c << "\" dur=\"2\">";
+            for (int k = 0; k < 3; ++k) {
+                s << "<note xml:id=\"b" << m << "_" << c << "_" << k
+                  << "\" pname=\"" << pnames[(root + k * 2) % 7]
+                  << "\" oct=\"" << (2 + (root + k * 2) / 7) << "\"/>";
+            }
+            s << "</chord>";
+        }
+        s << "</layer></staff>\n</measure>\n";
+    }
+
+    s << "</section>\n</score></mdiv></body></music>\n</mei>\n";
+    return s.str();
+}
+
+/**
+ * Write a generated MEI score of the given number of measures into
+ * the given directory, generate the score files for it as the
+ * application would when opening it, and read back its musical
+ * events. Return the path of the MEI file, or an empty string on
+ * failure.
+ */
+inline std::string
+writeSyntheticScore(std::string dir, std::string name, int measures,
+                    Score::MusicalEventList &musicalEvents)
+{
+    std::string meiPath = dir + "/" + name + ".mei";
+    std::ofstream out(meiPath);
+    out << generateSyntheticMei(measures);
+    out.close();
+    if (!out.good()) {
+        return {};
+    }
+
+    if (ScoreParser::generateScoreFiles(dir, name, meiPath).empty()) {
+        return {};
+    }
+
+    Score score;
+    if (!score.initialize(dir + "/" + name + ".solo") ||
+        !score.readMeter(dir + "/" + name + ".meter")) {
+        return {};
+    }
+    musicalEvents = score.getMusicalEvents();
+    return meiPath;
+}
+
+#endif
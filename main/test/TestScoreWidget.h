@@ -0,0 +1,250 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_SCORE_WIDGET_H
+#define TEST_SCORE_WIDGET_H
+
+#include "../ScoreWidget.h"
+#include "../ScoreParser.h"
+#include "../MemoryReport.h"
+
+#include "SyntheticScore.h"
+#include "WidgetTestSupport.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QSettings>
+
+#include <memory>
+
+using namespace WidgetTestSupport;
+
+class TestScoreWidget : public QObject
+{
+    Q_OBJECT
+
+    QTemporaryDir m_dir;
+    QString m_meiFile;
+    Score::MusicalEventList m_events;
+    SharedMusicalEvents m_sharedEvents;
+
+    std::unique_ptr<ScoreWidget> makeWidget(bool useGlyphAtlas = true) {
+        QSettings settings;
+        settings.beginGroup("ScoreWidget");
+        settings.setValue("glyphAtlas", useGlyphAtlas);
+        settings.setValue("viewMode", int(ScoreWidget::ViewMode::Paged));
+        settings.endGroup();
+        auto widget = std::make_unique<ScoreWidget>(false);
+        widget->resize(800, 1000);
+        widget->show();
+        if (!QTest::qWaitForWindowExposed(widget.get())) {
+            return {};
+        }
+        QString error;
+        if (!widget->loadScoreFile("synthetic", m_meiFile, error)) {
+            qWarning() << "Failed to load synthetic score:" << error;
+            return {};
+        }
+        widget->setMusicalEvents(m_sharedEvents);
+        widget->setInteractionMode(ScoreWidget::InteractionMode::Navigate);
+        return widget;
+    }
+
+    std::string labelOf(int i) const {
+        return m_events[i].measureInfo.toLabel();
+    }
+
+private slots:
+    void initTestCase() {
+        if (ScoreParser::getResourcePath() == "") {
+            QSKIP("Verovio resources not found");
+        }
+        QVERIFY(m_dir.isValid());
+        m_meiFile = QString::fromStdString
+            (writeSyntheticScore(m_dir.path().toStdString(), "synthetic",
+                                 48, m_events));
+        QVERIFY(m_meiFile != "");
+        QVERIFY(!m_events.empty());
+        m_sharedEvents = makeSharedMusicalEvents(m_events);
+    }
+
+    void loadRendersPage() {
+        auto widget = makeWidget();
+        QVERIFY(widget);
+        QVERIFY(widget->getPageCount() > 1);
+        QCOMPARE(widget->getCurrentPage(), 0);
+        QImage image = grab(*widget);
+        QVERIFY(countDarkPixels(image) > 1000);
+    }
+
+    void repaintIsStable() {
+        auto widget = makeWidget();
+        QVERIFY(widget);
+        QImage a = grab(*widget);
+        QImage b = grab(*widget);
+        QCOMPARE(countDifferingPixels(a, b), 0);
+    }
+
+    void glyphAtlasMatchesDirectDrawing() {
+        auto direct = makeWidget(false);
+        QVERIFY(direct);
+        auto atlas = makeWidget(true);
+        QVERIFY(atlas);
+        QImage a = grab(*direct);
+        QImage b = grab(*atlas);
+        QCOMPARE(a.size(), b.size());
+        // Glyphs drawn from the atlas are pixel-aligned, so may
+        // differ slightly in antialiasing at their edges. Allow that,
+        // and a handful of edge pixels beyond it, but nothing like a
+        // missing or misplaced glyph
+        int differing = countDifferingPixels(a, b, 48);
+        int dark = countDarkPixels(a);
+        QVERIFY(dark > 0);
+        QVERIFY2(differing <= dark / 50,
+                 qPrintable(QString("%1 of %2 dark pixels differ")
+                            .arg(differing).arg(dark)));
+    }
+
+    void highlightIsPainted() {
+        auto widget = makeWidget();
+        QVERIFY(widget);
+        QImage before = grab(*widget);
+        widget->setHighlightEventByLabel(labelOf(0));
+        QImage after = grab(*widget);
+        QVERIFY(countColouredPixels(after) > countColouredPixels(before));
+        QCOMPARE(widget->getCurrentPage(), 0);
+    }
+
+    void pageFlipRoundTrip() {
+        auto widget = makeWidget();
+        QVERIFY(widget);
+        QImage first = grab(*widget);
+        widget->showPage(1);
+        QCOMPARE(widget->getCurrentPage(), 1);
+        QImage second = grab(*widget);
+        QVERIFY(countDifferingPixels(first, second) > 0);
+        widget->showPage(0);
+        QImage again = grab(*widget);
+        QCOMPARE(countDifferingPixels(first, again), 0);
+    }
+
+    void followFlipsPages() {
+        // Highlighting the last event, as playback-follow would at
+        // the end of a performance, shows the last page
+        auto widget = makeWidget();
+        QVERIFY(widget);
+        widget->setHighlightEventByLabel(labelOf(int(m_events.size()) - 1));
+        QCOMPARE(widget->getCurrentPage(), widget->getPageCount() - 1);
+        QVERIFY(countColouredPixels(grab(*widget)) > 0);
+    }
+
+    void hoverHighlightsUnderMouse() {
+        auto widget = makeWidget();
+        QVERIFY(widget);
+        QImage before = grab(*widget);
+        QPointF pos(widget->width() / 3, widget->height() / 6);
+        sendEnter(*widget, pos);
+        bool changed = false;
+        for (int i = 0; i < 20 && !changed; ++i) {
+            sendMouseMove(*widget, pos + QPointF(i * 10, 0));
+            changed = (countColouredPixels(grab(*widget)) >
+                       countColouredPixels(before));
+        }
+        QVERIFY(changed);
+    }
+
+    void selectionIsPainted() {
+        auto widget = makeWidget();
+        QVERIFY(widget);
+        QImage before = grab(*widget);
+        widget->setInteractionMode(ScoreWidget::InteractionMode::SelectStart);
+        QPointF pos(widget->width() / 3, widget->height() / 6);
+        sendEnter(*widget, pos);
+        Fraction start, end;
+        ScoreWidget::EventLabel startLabel, endLabel;
+        for (int i = 0; i < 20 && startLabel == ""; ++i) {
+            sendMousePress(*widget, pos + QPointF(i * 10, 0));
+            widget->getSelection(start, startLabel, end, endLabel);
+        }
+        QVERIFY(startLabel != "");
+        // Move the mouse away so only the selection is highlighted
+        sendMouseMove(*widget, QPointF(1, 1));
+        QImage selected = grab(*widget);
+        QVERIFY(countColouredPixels(selected) > countColouredPixels(before));
+        // The second paint uses the rects worked out by the first
+        QCOMPARE(countDifferingPixels(selected, grab(*widget)), 0);
+        widget->clearSelection();
+        QVERIFY(countColouredPixels(grab(*widget)) <
+                countColouredPixels(selected));
+    }
+
+    void memoryReportCoversScore() {
+        auto widget = makeWidget();
+        QVERIFY(widget);
+        MemoryReport report;
+        widget->reportMemoryUsage(report);
+        size_t pageBytes = 0, eventCount = 0;
+        for (const auto &e : report.getEntries()) {
+            if (e.item == "pages (rendered)") pageBytes = e.bytes;
+            if (e.item == "m_musicalEvents") eventCount = e.count;
+        }
+        QVERIFY(pageBytes > 0);
+        QCOMPARE(eventCount, m_events.size());
+        QVERIFY(report.getTotalFor("ScoreWidget") > pageBytes);
+        QVERIFY(report.getWarnings().empty());
+    }
+
+    void benchmarkPaint() {
+        auto widget = makeWidget();
+        QVERIFY(widget);
+        QBENCHMARK {
+            widget->repaint();
+        }
+    }
+
+    void benchmarkHover() {
+        auto widget = makeWidget();
+        QVERIFY(widget);
+        sendEnter(*widget, QPointF(10, 10));
+        int x = 0;
+        QBENCHMARK {
+            x = (x + 7) % widget->width();
+            sendMouseMove(*widget, QPointF(x, widget->height() / 4));
+            widget->repaint();
+        }
+    }
+
+    void benchmarkFollow() {
+        auto widget = makeWidget();
+        QVERIFY(widget);
+        int i = 0;
+        QBENCHMARK {
+            widget->setHighlightEventByLabel(labelOf(i));
+            widget->repaint();
+            i = (i + 1) % int(m_events.size());
+        }
+    }
+
+    void benchmarkPageFlip() {
+        auto widget = makeWidget();
+        QVERIFY(widget);
+        int p = 0;
+        QBENCHMARK {
+            p = (p + 1) % widget->getPageCount();
+            widget->showPage(p);
+            widget->repaint();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,181 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_SESSION_H
+#define TEST_SESSION_H
+
+#include "SessionFixture.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QTemporaryDir>
+
+using namespace sv;
+
+class TestSession : public QObject
+{
+    Q_OBJECT
+
+    QTemporaryDir m_dir;
+    Score::MusicalEventList m_events;
+    QString m_alignmentFile;
+
+    // Spacing of the onsets in the imported alignment
+    static constexpr sv_frame_t spacing = 1000;
+
+    QString labelOf(int i) const {
+        return QString::fromStdString(m_events[i].measureInfo.toLabel());
+    }
+
+    static int countOffGrid(const EventVector &events) {
+        int n = 0;
+        for (const auto &e : events) {
+            if (e.getFrame() % spacing != 0) ++n;
+        }
+        return n;
+    }
+    
+    static EventVector eventsLabelled(const EventVector &events,
+                                      QString label) {
+        EventVector found;
+        for (const auto &e : events) {
+            if (e.getLabel() == label) found.push_back(e);
+        }
+        return found;
+    }
+    
+private slots:
+    void initTestCase() {
+        QVERIFY(m_dir.isValid());
+        std::string dir = m_dir.path().toStdString();
+        QVERIFY(writeSyntheticSoloScore(dir, "test", 32, m_events));
+        m_alignmentFile = m_dir.path() + "/alignment.csv";
+        QVERIFY(writeSyntheticAlignment(m_alignmentFile.toStdString(),
+                                        m_events, spacing, 44100));
+    }
+
+    void acceptPartialAlignmentIsUndoable() {
+        SessionFixture f(m_events, spacing, "test");
+        QVERIFY(f.importAlignment(m_alignmentFile));
+        EventVector previous = f.model->getAllEvents();
+        QCOMPARE(int(previous.size()), int(m_events.size()));
+        QCOMPARE(countOffGrid(previous), 0);
+
+        // A pending partial alignment over the middle half of the
+        // recording, displaced from the existing one
+
+        sv_frame_t overlapStart = f.frames / 4;
+        sv_frame_t overlapEnd = (f.frames * 3) / 4;
+        auto pending = f.addPendingLayer();
+        QVERIFY(pending);
+        auto pendingModel = ModelById::getAs<SparseOneDimensionalModel>
+            (pending->getModel());
+        int realigned = 0;
+        for (int i = 0; i < int(m_events.size()); ++i) {
+            sv_frame_t frame = spacing * (i + 1) + spacing / 4;
+            if (frame >= overlapStart && frame < overlapEnd) {
+                pendingModel->add(Event(frame, labelOf(i)));
+                ++realigned;
+            }
+        }
+        QVERIFY(realigned > 0);
+
+        f.acceptPartialAlignment(pending, overlapStart, overlapEnd);
+
+        // The merge goes into the existing layer
+        QCOMPARE(f.session.getOnsetsLayer(), f.onsets);
+        EventVector merged = f.model->getAllEvents();
+        QCOMPARE(int(merged.size()), int(m_events.size()));
+        QCOMPARE(countOffGrid(merged), realigned);
+
+        // Undoing it restores the previous onsets exactly
+        CommandHistory::getInstance()->undo();
+        QCOMPARE(f.session.getOnsetsLayer(), f.onsets);
+        QVERIFY(f.model->getAllEvents() == previous);
+
+        CommandHistory::getInstance()->redo();
+        QVERIFY(f.model->getAllEvents() == merged);
+    }
+
+    void acceptPartialAlignmentDiscardsConflicts() {
+        SessionFixture f(m_events, spacing, "test");
+        QVERIFY(f.importAlignment(m_alignmentFile));
+        int n = int(m_events.size());
+
+        sv_frame_t overlapStart = f.frames / 4;
+        sv_frame_t overlapEnd = (f.frames * 3) / 4;
+
+        // An old onset before the overlap that is out of score order
+        // with respect to the new ones: it carries the label of the
+        // last event, which the new alignment does not touch
+
+        Event outOfOrder(spacing / 2, labelOf(n - 1));
+        f.model->add(outOfOrder);
+        EventVector previous = f.model->getAllEvents();
+
+        // The new alignment re-places the events within the overlap
+        // and also the first event after it, whose old onset lies
+        // outside the overlap and so conflicts with it by label
+
+        int first = -1, conflicting = -1;
+        for (int i = 0; i < n; ++i) {
+            sv_frame_t frame = spacing * (i + 1);
+            if (first < 0 && frame >= overlapStart) first = i;
+            if (frame >= overlapEnd) {
+                conflicting = i;
+                break;
+            }
+        }
+        QVERIFY(first >= 0);
+        QVERIFY(conflicting > first);
+        QVERIFY(conflicting + 1 < n - 1);
+
+        auto pending = f.addPendingLayer();
+        QVERIFY(pending);
+        auto pendingModel = ModelById::getAs<SparseOneDimensionalModel>
+            (pending->getModel());
+        for (int i = first; i < conflicting; ++i) {
+            pendingModel->add(Event(spacing * (i + 1), labelOf(i)));
+        }
+        Event replacement(overlapEnd - 1, labelOf(conflicting));
+        pendingModel->add(replacement);
+
+        f.acceptPartialAlignment(pending, overlapStart, overlapEnd);
+
+        EventVector merged = f.model->getAllEvents();
+
+        // The conflicting old onset is replaced by the new one
+        EventVector found = eventsLabelled(merged, labelOf(conflicting));
+        QCOMPARE(int(found.size()), 1);
+        QCOMPARE(found[0].getFrame(), replacement.getFrame());
+
+        // The out-of-order one is discarded, but the last event's
+        // own onset, which is in order, is kept
+        found = eventsLabelled(merged, labelOf(n - 1));
+        QCOMPARE(int(found.size()), 1);
+        QCOMPARE(found[0].getFrame(), spacing * n);
+
+        // Consistent onsets either side of the overlap are kept
+        QCOMPARE(int(eventsLabelled(merged, labelOf(0)).size()), 1);
+        found = eventsLabelled(merged, labelOf(conflicting + 1));
+        QCOMPARE(int(found.size()), 1);
+        QCOMPARE(found[0].getFrame(), spacing * (conflicting + 2));
+
+        QCOMPARE(int(merged.size()), n);
+
+        // And undoing restores all of them, conflicts included
+        CommandHistory::getInstance()->undo();
+        QVERIFY(f.model->getAllEvents() == previous);
+    }
+};
+
+#endif
@@ -0,0 +1,203 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_TEMPO_CURVE_WIDGET_H
+#define TEST_TEMPO_CURVE_WIDGET_H
+
+#include "../TempoCurveWidget.h"
+#include "../ScoreParser.h"
+
+#include "SyntheticScore.h"
+#include "WidgetTestSupport.h"
+
+#include "data/model/SparseTimeValueModel.h"
+#include "data/model/test/MockWaveModel.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include <cmath>
+#include <memory>
+
+using namespace sv;
+using namespace WidgetTestSupport;
+
+class TestTempoCurveWidget : public QObject
+{
+    Q_OBJECT
+
+    QTemporaryDir m_dir;
+    Score::MusicalEventList m_events;
+    SharedMusicalEvents m_sharedEvents;
+    ModelId m_audioModel;
+    sv_samplerate_t m_sampleRate = 0;
+
+    std::unique_ptr<TempoCurveWidget> makeWidget() {
+        auto widget = std::make_unique<TempoCurveWidget>();
+        widget->resize(1000, 300);
+        widget->show();
+        if (!QTest::qWaitForWindowExposed(widget.get())) {
+            return {};
+        }
+        widget->setMusicalEvents(m_sharedEvents);
+        widget->setCurrentAudioModel(m_audioModel);
+        return widget;
+    }
+
+    // One tempo point per musical event, at a tempo that wanders
+    // between 60 and 120 bpm
+    ModelId makeTempoModel() {
+        auto model = std::make_shared<SparseTimeValueModel>(m_sampleRate, 1);
+        for (int i = 0; i + 1 < int(m_events.size()); ++i) {
+            float tempo = float(90.0 + 30.0 * sin(double(i) / 5.0));
+            model->add(Event(sv_frame_t(i) * 22050, tempo,
+                             QString::fromStdString
+                             (m_events[i].measureInfo.toLabel())));
+        }
+        return ModelById::add(model);
+    }
+
+    void changeTempoAt(ModelId tempoModelId, int index, float tempo) {
+        auto model = ModelById::getAs<SparseTimeValueModel>(tempoModelId);
+        auto events = model->getAllEvents();
+        model->remove(events[index]);
+        model->add(events[index].withValue(tempo));
+    }
+
+private slots:
+    void initTestCase() {
+        if (ScoreParser::getResourcePath() == "") {
+            QSKIP("Verovio resources not found");
+        }
+        QVERIFY(m_dir.isValid());
+        QVERIFY(writeSyntheticScore(m_dir.path().toStdString(), "synthetic",
+                                    48, m_events) != "");
+        QVERIFY(m_events.size() > 10);
+        m_sharedEvents = makeSharedMusicalEvents(m_events);
+        auto audio = std::make_shared<MockWaveModel>
+            (std::vector<Sort> { Sine }, 22050 * int(m_events.size()), 0);
+        m_sampleRate = audio->getSampleRate();
+        m_audioModel = ModelById::add(audio);
+    }
+
+    void cleanupTestCase() {
+        ModelById::release(m_audioModel);
+    }
+
+    void curveIsPainted() {
+        auto widget = makeWidget();
+        QVERIFY(widget);
+        int empty = countColouredPixels(grab(*widget));
+        ModelId tempo = makeTempoModel();
+        widget->setCurveForAudio(m_audioModel, tempo);
+        QVERIFY(countColouredPixels(grab(*widget)) > empty);
+        widget->unsetCurveForAudio(m_audioModel);
+        ModelById::release(tempo);
+    }
+
+    void repaintIsStable() {
+        auto widget = makeWidget();
+        QVERIFY(widget);
+        ModelId tempo = makeTempoModel();
+        widget->setCurveForAudio(m_audioModel, tempo);
+        QImage a = grab(*widget);
+        QImage b = grab(*widget);
+        QCOMPARE(countDifferingPixels(a, b), 0);
+        widget->unsetCurveForAudio(m_audioModel);
+        ModelById::release(tempo);
+    }
+
+    void highlightIsPainted() {
+        auto widget = makeWidget();
+        QVERIFY(widget);
+        ModelId tempo = makeTempoModel();
+        widget->setCurveForAudio(m_audioModel, tempo);
+        QImage before = grab(*widget);
+        widget->setHighlightedPosition
+            (QString::fromStdString(m_events[4].measureInfo.toLabel()));
+        QImage after = grab(*widget);
+        QVERIFY(countDifferingPixels(before, after) > 0);
+        widget->unsetCurveForAudio(m_audioModel);
+        ModelById::release(tempo);
+    }
+
+    void incrementalUpdateMatchesFresh() {
+        // A widget that had the curve before an edit, and so only
+        // re-extracts the part that changed, must paint the same as
+        // one that sees the edited curve for the first time
+        ModelId tempo = makeTempoModel();
+        auto updated = makeWidget();
+        QVERIFY(updated);
+        updated->setCurveForAudio(m_audioModel, tempo);
+        (void)grab(*updated);
+        changeTempoAt(tempo, int(m_events.size()) / 2, 150.f);
+        updated->setCurveForAudio(m_audioModel, tempo);
+        QImage a = grab(*updated);
+        updated->unsetCurveForAudio(m_audioModel);
+
+        auto fresh = makeWidget();
+        QVERIFY(fresh);
+        fresh->setCurveForAudio(m_audioModel, tempo);
+        QImage b = grab(*fresh);
+        fresh->unsetCurveForAudio(m_audioModel);
+
+        QCOMPARE(countDifferingPixels(a, b), 0);
+        ModelById::release(tempo);
+    }
+
+    void benchmarkPaint() {
+        auto widget = makeWidget();
+        QVERIFY(widget);
+        ModelId tempo = makeTempoModel();
+        widget->setCurveForAudio(m_audioModel, tempo);
+        QBENCHMARK {
+            widget->repaint();
+        }
+        widget->unsetCurveForAudio(m_audioModel);
+        ModelById::release(tempo);
+    }
+
+    void benchmarkHover() {
+        auto widget = makeWidget();
+        QVERIFY(widget);
+        ModelId tempo = makeTempoModel();
+        widget->setCurveForAudio(m_audioModel, tempo);
+        sendEnter(*widget, QPointF(10, 10));
+        int x = 0;
+        QBENCHMARK {
+            x = (x + 7) % widget->width();
+            sendMouseMove(*widget, QPointF(x, widget->height() / 2));
+            widget->repaint();
+        }
+        widget->unsetCurveForAudio(m_audioModel);
+        ModelById::release(tempo);
+    }
+
+    void benchmarkCurveEdit() {
+        auto widget = makeWidget();
+        QVERIFY(widget);
+        ModelId tempo = makeTempoModel();
+        widget->setCurveForAudio(m_audioModel, tempo);
+        int i = 0;
+        QBENCHMARK {
+            i = (i + 1) % (int(m_events.size()) - 1);
+            changeTempoAt(tempo, i, float(60 + (i * 13) % 60));
+            widget->setCurveForAudio(m_audioModel, tempo);
+            widget->repaint();
+        }
+        widget->unsetCurveForAudio(m_audioModel);
+        ModelById::release(tempo);
+    }
+};
+
+#endif
@@ -0,0 +1,128 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_WIDGET_TEST_SUPPORT_H
+#define SV_WIDGET_TEST_SUPPORT_H
+
+#include <QApplication>
+#include <QWidget>
+#include <QImage>
+#include <QMouseEvent>
+#include <QEnterEvent>
+
+#include <algorithm>
+#include <cstdlib>
+
+/**
+ * Helpers for driving widgets offscreen and inspecting what they
+ * paint.
+ */
+namespace WidgetTestSupport {
+
+/**
+ * Render the widget, at its current size, into an image.
+ */
+inline QImage
+grab(QWidget &widget)
+{
+    return widget.grab().toImage()
+        .convertToFormat(QImage::Format_ARGB32_Premultiplied);
+}
+
+/**
+ * Return the number of pixels in the image that are dark, i.e. ink
+ * on a light background.
+ */
+inline int
+countDarkPixels(const QImage &image)
+{
+    int count = 0;
+    for (int y = 0; y < image.height(); ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            if (qGray(line[x]) < 128) ++count;
+        }
+    }
+    return count;
+}
+
+/**
+ * Return the number of pixels that are not grey, i.e. have been
+ * painted in some colour.
+ */
+inline int
+countColouredPixels(const QImage &image)
+{
+    int count = 0;
+    for (int y = 0; y < image.height(); ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            int r = qRed(line[x]), g = qGreen(line[x]), b = qBlue(line[x]);
+            if (std::max({ r, g, b }) - std::min({ r, g, b }) > 32) ++count;
+        }
+    }
+    return count;
+}
+
+/**
+ * Return the number of pixels that differ between two images of the
+ * same size, or -1 if the sizes differ. A pixel differs if any of its
+ * channels differs by more than the given tolerance.
+ */
+inline int
+countDifferingPixels(const QImage &a, const QImage &b, int tolerance = 0)
+{
+    if (a.size() != b.size()) return -1;
+    int count = 0;
+    for (int y = 0; y < a.height(); ++y) {
+        const QRgb *la = reinterpret_cast<const QRgb *>(a.constScanLine(y));
+        const QRgb *lb = reinterpret_cast<const QRgb *>(b.constScanLine(y));
+        for (int x = 0; x < a.width(); ++x) {
+            if (la[x] == lb[x]) continue;
+            if (std::abs(qRed(la[x]) - qRed(lb[x])) > tolerance ||
+                std::abs(qGreen(la[x]) - qGreen(lb[x])) > tolerance ||
+                std::abs(qBlue(la[x]) - qBlue(lb[x])) > tolerance ||
+                std::abs(qAlpha(la[x]) - qAlpha(lb[x])) > tolerance) {
+                ++count;
+            }
+        }
+    }
+    return count;
+}
+
+inline void
+sendEnter(QWidget &widget, QPointF pos)
+{
+    QEnterEvent e(pos, pos, widget.mapToGlobal(pos));
+    QApplication::sendEvent(&widget, &e);
+}
+
+inline void
+sendMouseMove(QWidget &widget, QPointF pos,
+              Qt::MouseButtons buttons = Qt::NoButton)
+{
+    QMouseEvent e(QEvent::MouseMove, pos, widget.mapToGlobal(pos),
+                  Qt::NoButton, buttons, Qt::NoModifier);
+    QApplication::sendEvent(&widget, &e);
+}
+
+inline void
+sendMousePress(QWidget &widget, QPointF pos)
+{
+    QMouseEvent e(QEvent::MouseButtonPress, pos, widget.mapToGlobal(pos),
+                  Qt::LeftButton, Qt::LeftButton, Qt::NoModifier);
+    QApplication::sendEvent(&widget, &e);
+}
+
+}
+
+#endif
@@ -0,0 +1,62 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Performance Precision
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+/*
+    Render-regression and performance tests for the score and tempo
+    curve widgets. These show the widgets offscreen, drive them with
+    synthetic scores, tempo curves and mouse input, and check what
+    they paint. The benchmark* tests report time per frame through
+    QBENCHMARK; pass e.g. -tickcounter or -iterations to QTest as
+    usual.
+
+    Runs headless: QT_QPA_PLATFORM is set to offscreen unless already
+    set.
+*/
+
+#include "TestScoreWidget.h"
+#include "TestTempoCurveWidget.h"
+
+#include "base/Debug.h"
+
+#include <QApplication>
+
+int main(int argc, char *argv[])
+{
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty()) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    int good = 0, bad = 0;
+
+    QApplication app(argc, argv);
+    app.setOrganizationName("sonic-visualiser");
+    app.setApplicationName("test-score-widgets");
+
+    {
+        TestScoreWidget t;
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
+    {
+        TestTempoCurveWidget t;
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
+
+    if (bad > 0) {
+        SVCERR << "\n********* " << bad << " test suite(s) failed!\n" << endl;
+        return 1;
+    } else {
+        SVCERR << "All tests passed" << endl;
+        return 0;
+    }
+}
@@ -797,6 +797,14 @@ public:
      */
     Options *GetOptionsObj() { return m_options; }
 
+    /**
+     * Return the Resources object of the document, for use with a
+     * device context passed to RenderToDeviceContext.
+     *
+     * @ingroup nodoc
+     */
+    const Resources &GetResources() const { return m_doc.GetResources(); }
+
     /**
      * Copy the data to the cstring internal buffer.
      *